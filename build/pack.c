@@ -744,6 +744,9 @@ pgpDig dig = _dig;
 	}
 	strcpy(buf, rpmio_flags);
 	buf[s - rpmio_flags] = '\0';
+	/* XXX the no. of compression threads doesn't belong in the header. */
+	if ((s = strchr(buf, 'T')) != NULL)
+	    *s = '\0';
 
 	he->tag = RPMTAG_PAYLOADFLAGS;
 	he->t = RPM_STRING_TYPE;
@@ -62,6 +62,96 @@ static int uintcmp(const void * a, const void * b)
     return rc;
 }
 
+/**
+ * Normalize a name for the changed names set (directories lose the '/').
+ * @param N		dependency name or file path
+ * @param t		buffer (at least strlen(N)+1 bytes)
+ * @return		normalized name
+ */
+static const char * depChangedKey(const char * N, /*@returned@*/ char * t)
+	/*@modifies t @*/
+{
+    size_t nb = strlen(N);
+    (void) strcpy(t, N);
+    /* XXX don't truncate if parent is / */
+    if (nb > 1 && t[nb-1] == '/')
+	t[nb-1] = '\0';
+    return t;
+}
+
+/**
+ * Remember a name whose providers have changed since the last check.
+ * @param ts		transaction set
+ * @param N		dependency name or file path
+ */
+static void depChangedAdd(rpmts ts, /*@null@*/ const char * N)
+	/*@modifies ts @*/
+{
+    const char * key;
+
+    if (N == NULL || *N == '\0')
+	return;
+    key = depChangedKey(N, alloca(strlen(N) + 1));
+    if (ts->depchanged == NULL)
+	ts->depchanged = htCreate(1023, 0, 0, NULL, NULL);
+    if (htHasEntry(ts->depchanged, key))
+	return;
+    (void) argvAdd(&ts->depchangedkeys, key);
+    htAddEntry(ts->depchanged, ts->depchangedkeys[ts->ndepchangedkeys++], NULL);
+}
+
+/**
+ * Have the providers of a name changed since the last check?
+ * @param ts		transaction set
+ * @param N		dependency name or file path
+ * @return		1 if changed, 0 otherwise
+ */
+static int depChangedHas(rpmts ts, /*@null@*/ const char * N)
+	/*@*/
+{
+    if (ts->depchanged == NULL || N == NULL || *N == '\0')
+	return 0;
+    return htHasEntry(ts->depchanged,
+		depChangedKey(N, alloca(strlen(N) + 1)));
+}
+
+/**
+ * Remember the provides and files of an added (or erased) element.
+ *
+ * An erased element also withdraws its installed requires and conflicts,
+ * which changes the results of elements that provide those names.
+ * @param ts		transaction set
+ * @param p		transaction element
+ */
+static void depChangedElement(rpmts ts, rpmte p)
+	/*@modifies ts, p @*/
+{
+    rpmds provides = rpmdsInit(rpmteDS(p, RPMTAG_PROVIDENAME));
+    rpmfi fi = rpmfiInit(rpmteFI(p, RPMTAG_BASENAMES), 0);
+    rpmds ds;
+
+    if (provides != NULL)
+    while (rpmdsNext(provides) >= 0)
+	depChangedAdd(ts, rpmdsN(provides));
+    if (fi != NULL)
+    while (rpmfiNext(fi) >= 0)
+	depChangedAdd(ts, rpmfiFN(fi));
+
+    if (rpmteType(p) != TR_REMOVED)
+	return;
+
+    /* Erasing: added elements may no longer conflict with it. */
+    ds = rpmdsInit(rpmteDS(p, RPMTAG_CONFLICTNAME));
+    if (ds != NULL)
+    while (rpmdsNext(ds) >= 0)
+	depChangedAdd(ts, rpmdsN(ds));
+    /* Erasing: erased elements may no longer be required by it. */
+    ds = rpmdsInit(rpmteDS(p, RPMTAG_REQUIRENAME));
+    if (ds != NULL)
+    while (rpmdsNext(ds) >= 0)
+	depChangedAdd(ts, rpmdsN(ds));
+}
+
 /**
  * Add removed package instance to ordered transaction set.
  * @param ts		transaction set
@@ -93,6 +183,8 @@ static int removePackage(rpmts ts, Header h, uint32_t hdrNum,
 	}
     }
 
+    rpmtsCleanDepCache(ts);
+
     if (ts->rbf == NULL) {
 	static size_t n = 10000;	/* XXX population estimate */
 	static double e = 1.0e-4;
@@ -126,7 +218,13 @@ assert(xx == 0);
 
     p = rpmteNew(ts, h, TR_REMOVED, NULL, NULL, hdrNum, depends);
     ts->order[ts->orderCount] = p;
+    ts->nwaves = 0;		/* XXX the schedule needs rpmtsOrder() again. */
     ts->numErasedFiles += rpmfiFC(rpmteFI(p, RPMTAG_BASENAMES));
+
+    /* Erasures change what is installed, and may resolve prior problems. */
+    depChangedElement(ts, p);
+    ts->depretry = 1;
+
     if (indexp != NULL)
 	*indexp = ts->orderCount;
     ts->orderCount++;
@@ -726,6 +824,8 @@ assert(he->p.str != NULL);
 	goto exit;
 
 addheader:
+    rpmtsCleanDepCache(ts);
+
     if (oc >= ts->orderAlloced) {
 	ts->orderAlloced += (oc - ts->orderAlloced) + ts->delta;
 /*@-type +voidabstract @*/
@@ -744,11 +844,14 @@ assert(p != NULL);
     }
 
     ts->order[oc] = p;
+    ts->nwaves = 0;		/* XXX the schedule needs rpmtsOrder() again. */
     ts->numAddedFiles += rpmfiFC(rpmteFI(p, RPMTAG_BASENAMES));
     if (!duplicate) {
 	ts->orderCount++;
 	rpmcliPackagesTotal++;
-    }
+	depChangedElement(ts, p);
+    } else
+	ts->depcheckall = 1;	/* XXX replaced provides are withdrawn. */
     
     pkgKey = rpmalAdd(&ts->addedPackages, pkgKey, rpmteKey(p),
 			rpmteDS(p, RPMTAG_PROVIDENAME),
@@ -857,6 +960,104 @@ void rpmnsClean(void)
     sysinfo_path = _free(sysinfo_path);
 }
 
+/**
+ * Serialize access to shared transaction set state (added packages,
+ * dependency cache, solver) while threaded dependency checks are running.
+ */
+#define	DLOCK(_ts)	\
+    do { if ((_ts)->dlock != NULL) yarnPossess((_ts)->dlock); } while (0)
+#define	DUNLOCK(_ts)	\
+    do { if ((_ts)->dlock != NULL) yarnRelease((_ts)->dlock); } while (0)
+
+/**
+ * Namespaces that are probed, rather than looked up in packages.
+ */
+#define	_DEPENDS_PROBES	\
+    (RPMNS_TYPE_FUNCTION | RPMNS_TYPE_USER | RPMNS_TYPE_GROUP | \
+     RPMNS_TYPE_ACCESS | RPMNS_TYPE_MOUNTED | RPMNS_TYPE_DISKSPACE | \
+     RPMNS_TYPE_DIGEST | RPMNS_TYPE_SIGNATURE | RPMNS_TYPE_VERIFY | \
+     RPMNS_TYPE_GNUPG | RPMNS_TYPE_MACRO | RPMNS_TYPE_ENVVAR | \
+     RPMNS_TYPE_RUNNING | RPMNS_TYPE_SANITY | RPMNS_TYPE_VCHECK | \
+     RPMNS_TYPE_RPMLIB | RPMNS_TYPE_CPUINFO | RPMNS_TYPE_GETCONF | \
+     RPMNS_TYPE_UNAME | RPMNS_TYPE_SONAME)
+
+/**
+ * Probes share (lazily loaded) global state, threaded checks probe serially.
+ */
+#if defined(WITH_PTHREADS)
+/*@unchecked@*/
+static pthread_mutex_t _probes_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+#if defined(CACHE_DEPENDENCY_RESULT)
+/**
+ * Probe namespaces whose answers are not cached (system state, not packages).
+ */
+#define	_DEPCACHE_NOCACHE	\
+    (_DEPENDS_PROBES & ~(RPMNS_TYPE_RPMLIB | RPMNS_TYPE_CPUINFO | \
+     RPMNS_TYPE_GETCONF | RPMNS_TYPE_UNAME | RPMNS_TYPE_SONAME))
+
+void rpmtsCleanDepCache(rpmts ts)
+{
+    if (ts == NULL)
+	return;
+    ts->depcache = (ts->depcache ? htFree(ts->depcache) : NULL);
+    ts->depcachekeys = argvFree(ts->depcachekeys);
+    ts->ndepcachekeys = 0;
+}
+
+/**
+ * Retrieve a previously resolved dependency result.
+ * @param ts		transaction set
+ * @param key		dependency context, flags and DNEVR
+ * @return		cached result, -1 if not cached
+ */
+static int depCacheGet(rpmts ts, const char * key)
+	/*@modifies ts @*/
+{
+    void ** data = NULL;
+    int rc = -1;
+
+    DLOCK(ts);
+    if (ts->depcache != NULL
+     && !htGetEntry(ts->depcache, key, &data, NULL, NULL))
+    {
+	ts->depcachehits++;
+	rc = *(int *)data[0];
+    } else
+	ts->depcachemisses++;
+    DUNLOCK(ts);
+    return rc;
+}
+
+/**
+ * Save a resolved dependency result.
+ * @param ts		transaction set
+ * @param key		dependency context, flags and DNEVR
+ * @param rc		result (before negation)
+ */
+static void depCachePut(rpmts ts, const char * key, int rc)
+	/*@modifies ts @*/
+{
+    int * val;
+
+    DLOCK(ts);
+    if (ts->depcache == NULL)
+	ts->depcache = htCreate(1023, 0, 1, NULL, NULL);
+    if (!htHasEntry(ts->depcache, key)) {
+	(void) argvAdd(&ts->depcachekeys, key);
+	val = xmalloc(sizeof(*val));
+	*val = rc;
+	htAddEntry(ts->depcache, ts->depcachekeys[ts->ndepcachekeys++], val);
+    }
+    DUNLOCK(ts);
+}
+#else
+void rpmtsCleanDepCache(/*@unused@*/ rpmts ts)
+{
+}
+#endif
+
 /**
  * Check dep for an unsatisfied dependency.
  * @param ts		transaction set
@@ -864,14 +1065,12 @@ void rpmnsClean(void)
  * @param adding	dependency is from added package set?
  * @return		0 if satisfied, 1 if not satisfied, 2 if error
  */
-static int unsatisfiedDepend(rpmts ts, rpmds dep, int adding)
+static int _unsatisfiedDepend(rpmts ts, rpmds dep, int adding)
 	/*@globals _cacheDependsRC, rpmGlobalMacroContext, h_errno,
 		sysinfo_path, fileSystem, internalState @*/
-	/*@modifies ts, dep, _cacheDependsRC, rpmGlobalMacroContext,
+	/*@modifies ts, dep, rpmGlobalMacroContext,
 		sysinfo_path, fileSystem, internalState @*/
 {
-    DBT * key = alloca(sizeof(*key));
-    DBT * data = alloca(sizeof(*data));
     rpmmi mi;
     nsType NSType;
     const char * Name;
@@ -879,6 +1078,7 @@ static int unsatisfiedDepend(rpmts ts, rpmds dep, int adding)
     Header h;
 #if defined(CACHE_DEPENDENCY_RESULT)
     int _cacheThisRC = 1;
+    char * key = NULL;
 #endif
     int rc;
     int xx;
@@ -891,44 +1091,17 @@ static int unsatisfiedDepend(rpmts ts, rpmds dep, int adding)
 
 #if defined(CACHE_DEPENDENCY_RESULT)
     /*
-     * Check if dbiOpen/dbiPut failed (e.g. permissions), we can't cache.
+     * Check for a result resolved earlier in this transaction. Answers
+     * can differ for added and erased package contexts, and with flags
+     * (e.g. MISSINGOK) that the DNEVR omits, so key on all of them.
      */
-    if (_cacheDependsRC) {
-	dbiIndex dbi;
-	dbi = dbiOpen(rpmtsGetRdb(ts), RPMDBI_DEPCACHE, 0);
-	if (dbi == NULL)
-	    _cacheDependsRC = 0;
-	else {
-	    const char * DNEVR;
-
-	    rc = -1;
-	    if ((DNEVR = rpmdsDNEVR(dep)) != NULL) {
-		DBC * dbcursor = NULL;
-		void * datap = NULL;
-		size_t datalen = 0;
-		size_t DNEVRlen = strlen(DNEVR);
-
-		xx = dbiCopen(dbi, dbiTxnid(dbi), &dbcursor, 0);
-
-		memset(key, 0, sizeof(*key));
-/*@i@*/		key->data = (void *) DNEVR;
-		key->size = DNEVRlen;
-		memset(data, 0, sizeof(*data));
-		data->data = datap;
-		data->size = datalen;
-/*@-nullstate@*/ /* FIX: data->data may be NULL */
-		xx = dbiGet(dbi, dbcursor, key, data, DB_SET);
-/*@=nullstate@*/
-		DNEVR = key->data;
-		DNEVRlen = key->size;
-		datap = data->data;
-		datalen = data->size;
-
-		if (xx == 0 && datap && datalen == 4)
-		    memcpy(&rc, datap, datalen);
-		xx = dbiCclose(dbi, dbcursor, 0);
-	    }
-
+    if (_cacheDependsRC && !(NSType & _DEPCACHE_NOCACHE)) {
+	const char * DNEVR = rpmdsDNEVR(dep);
+	if (DNEVR != NULL) {
+	    key = alloca(strlen(DNEVR) + sizeof("0 00000000 "));
+	    (void) sprintf(key, "%c %08x %s", (char)('0' + adding),
+			(unsigned) Flags, DNEVR);
+	    rc = depCacheGet(ts, key);
 	    if (rc >= 0) {
 		rpmdsNotify(dep, _("(cached)"), rc);
 		return rpmdsNegateRC(dep, rc);
@@ -1424,7 +1597,10 @@ retry:
     }
 
     /* Search added packages for the dependency. */
-    if (rpmalSatisfiesDepend(ts->addedPackages, dep, NULL) != NULL) {
+    DLOCK(ts);
+    xx = (rpmalSatisfiesDepend(ts->addedPackages, dep, NULL) != NULL);
+    DUNLOCK(ts);
+    if (xx) {
 #if defined(CACHE_DEPENDENCY_RESULT)
 	/*
 	 * XXX Ick, context sensitive answers from dependency cache.
@@ -1473,12 +1649,19 @@ retry:
      */
     if (adding == 1 && retries > 0 && !(rpmtsDFlags(ts) & RPMDEPS_FLAG_NOSUGGEST)) {
 	if (ts->solve != NULL) {
+#if defined(CACHE_DEPENDENCY_RESULT)
+	    /* XXX Solutions are side effects, always ask the solver. */
+	    _cacheThisRC = 0;
+#endif
+	    DLOCK(ts);
 	    xx = (*ts->solve) (ts, dep, ts->solveData);
+	    if (xx == -1)
+		rpmalMakeIndex(ts->addedPackages);
+	    DUNLOCK(ts);
 	    if (xx == 0)
 		goto exit;
 	    if (xx == -1) {
 		retries--;
-		rpmalMakeIndex(ts->addedPackages);
 		goto retry;
 	    }
 	}
@@ -1497,48 +1680,46 @@ unsatisfied:
     }
 
 exit:
-    /*
-     * If dbiOpen/dbiPut fails (e.g. permissions), we can't cache.
-     */
 #if defined(CACHE_DEPENDENCY_RESULT)
-    if (_cacheDependsRC && _cacheThisRC) {
-	dbiIndex dbi;
-	dbi = dbiOpen(rpmtsGetRdb(ts), RPMDBI_DEPCACHE, 0);
-	if (dbi == NULL) {
-	    _cacheDependsRC = 0;
-	} else {
-	    const char * DNEVR;
-	    xx = 0;
-	    if ((DNEVR = rpmdsDNEVR(dep)) != NULL) {
-		DBC * dbcursor = NULL;
-		size_t DNEVRlen = strlen(DNEVR);
-
-		xx = dbiCopen(dbi, dbiTxnid(dbi), &dbcursor, DB_WRITECURSOR);
-
-		memset(key, 0, sizeof(*key));
-/*@i@*/		key->data = (void *) DNEVR;
-		key->size = DNEVRlen;
-		memset(data, 0, sizeof(*data));
-		data->data = &rc;
-		data->size = sizeof(rc);
-
-		/*@-compmempass@*/
-		xx = dbiPut(dbi, dbcursor, key, data, 0);
-		/*@=compmempass@*/
-		xx = dbiCclose(dbi, dbcursor, DB_WRITECURSOR);
-	    }
-	    if (xx)
-		_cacheDependsRC = 0;
-	}
-    }
+    if (key != NULL && _cacheThisRC)
+	depCachePut(ts, key, rc);
 #endif
 
     return rpmdsNegateRC(dep, rc);
 }
 
+/**
+ * Check dep for an unsatisfied dependency, probing serially if threaded.
+ * @param ts		transaction set
+ * @param dep		dependency
+ * @param adding	dependency is from added package set?
+ * @return		0 if satisfied, 1 if not satisfied, 2 if error
+ */
+static int unsatisfiedDepend(rpmts ts, rpmds dep, int adding)
+	/*@globals rpmGlobalMacroContext, h_errno,
+		fileSystem, internalState @*/
+	/*@modifies ts, dep, rpmGlobalMacroContext,
+		fileSystem, internalState @*/
+{
+    int rc;
+
+    if (ts->dlock != NULL && (rpmdsNSType(dep) & _DEPENDS_PROBES)) {
+#if defined(WITH_PTHREADS)
+	(void) pthread_mutex_lock(&_probes_mutex);
+#endif
+	rc = _unsatisfiedDepend(ts, dep, adding);
+#if defined(WITH_PTHREADS)
+	(void) pthread_mutex_unlock(&_probes_mutex);
+#endif
+    } else
+	rc = _unsatisfiedDepend(ts, dep, adding);
+    return rc;
+}
+
 /**
  * Check added requires/conflicts against against installed+added packages.
  * @param ts		transaction set
+ * @param ps		problem set
  * @param pkgNEVRA	package name-version-release.arch
  * @param requires	Requires: dependencies (or NULL)
  * @param conflicts	Conflicts: dependencies (or NULL)
@@ -1549,7 +1730,7 @@ exit:
  * @param adding	dependency is from added package set?
  * @return		0 = deps ok, 1 = dep problems, 2 = error
  */
-static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
+static int checkPackageDeps(rpmts ts, rpmps ps, const char * pkgNEVRA,
 		/*@null@*/ rpmds requires,
 		/*@null@*/ rpmds conflicts,
 		/*@null@*/ rpmds dirnames,
@@ -1558,10 +1739,9 @@ static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
 		rpmuint32_t tscolor, int adding)
 	/*@globals rpmGlobalMacroContext, h_errno,
 		fileSystem, internalState @*/
-	/*@modifies ts, requires, conflicts, dirnames, linktos,
+	/*@modifies ts, ps, requires, conflicts, dirnames, linktos,
 		rpmGlobalMacroContext, fileSystem, internalState */
 {
-    rpmps ps = rpmtsProblems(ts);
     rpmuint32_t dscolor;
     const char * Name;
     int terminate = 2;		/* XXX terminate if rc >= terminate */
@@ -1597,8 +1777,10 @@ static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
 	{   fnpyKey * suggestedKeys = NULL;
 
 	    if (ts->availablePackages != NULL) {
+		DLOCK(ts);
 		suggestedKeys = rpmalAllSatisfiesDepend(ts->availablePackages,
 				requires, NULL);
+		DUNLOCK(ts);
 	    }
 
 	    rpmdsProblem(ps, pkgNEVRA, requires, suggestedKeys, adding);
@@ -1675,8 +1857,10 @@ static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
 	{   fnpyKey * suggestedKeys = NULL;
 
 	    if (ts->availablePackages != NULL) {
+		DLOCK(ts);
 		suggestedKeys = rpmalAllSatisfiesDepend(ts->availablePackages,
 				dirnames, NULL);
+		DUNLOCK(ts);
 	    }
 
 	    rpmdsProblem(ps, pkgNEVRA, dirnames, suggestedKeys, adding);
@@ -1723,8 +1907,10 @@ static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
 	{   fnpyKey * suggestedKeys = NULL;
 
 	    if (ts->availablePackages != NULL) {
+		DLOCK(ts);
 		suggestedKeys = rpmalAllSatisfiesDepend(ts->availablePackages,
 				linktos, NULL);
+		DUNLOCK(ts);
 	    }
 
 	    rpmdsProblem(ps, pkgNEVRA, linktos, suggestedKeys, adding);
@@ -1742,7 +1928,6 @@ static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
     }
 #endif    
 
-    ps = rpmpsFree(ps);
     return ourrc;
 }
 
@@ -1751,15 +1936,16 @@ static int checkPackageDeps(rpmts ts, const char * pkgNEVRA,
  * Adding: check name/provides dep against each conflict match,
  * Erasing: check name/provides/filename dep against each requiredby match.
  * @param ts		transaction set
+ * @param ps		problem set
  * @param depName	dependency name
  * @param mi		rpm database iterator
  * @param adding	dependency is from added package set?
  * @return		0 no problems found
  */
-static int checkPackageSet(rpmts ts, const char * depName,
+static int checkPackageSet(rpmts ts, rpmps ps, const char * depName,
 		/*@only@*/ /*@null@*/ rpmmi mi, int adding)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
-	/*@modifies ts, mi, rpmGlobalMacroContext, fileSystem, internalState @*/
+	/*@modifies ts, ps, mi, rpmGlobalMacroContext, fileSystem, internalState @*/
 {
     HE_t he = memset(alloca(sizeof(*he)), 0, sizeof(*he));
     rpmdepFlags depFlags = rpmtsDFlags(ts);
@@ -1801,7 +1987,7 @@ static int checkPackageSet(rpmts ts, const char * depName,
 	(void) rpmdsSetNoPromote(dirnames, _rpmds_nopromote);
 	(void) rpmdsSetNoPromote(linktos, _rpmds_nopromote);
 
-	rc = checkPackageDeps(ts, he->p.str,
+	rc = checkPackageDeps(ts, ps, he->p.str,
 		requires, conflicts, dirnames, linktos,
 		depName, tscolor, adding);
 
@@ -1826,12 +2012,13 @@ static int checkPackageSet(rpmts ts, const char * depName,
 /**
  * Check to-be-erased dependencies against installed requires.
  * @param ts		transaction set
+ * @param ps		problem set
  * @param depName	requires name
  * @return		0 no problems found
  */
-static int checkDependentPackages(rpmts ts, const char * depName)
+static int checkDependentPackages(rpmts ts, rpmps ps, const char * depName)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
-	/*@modifies ts, rpmGlobalMacroContext, fileSystem, internalState @*/
+	/*@modifies ts, ps, rpmGlobalMacroContext, fileSystem, internalState @*/
 {
     int rc = 0;
 
@@ -1839,7 +2026,7 @@ static int checkDependentPackages(rpmts ts, const char * depName)
     if (rpmtsGetRdb(ts) != NULL) {
 	rpmmi mi;
 	mi = rpmtsInitIterator(ts, RPMTAG_REQUIRENAME, depName, 0);
-	rc = checkPackageSet(ts, depName, mi, 0);
+	rc = checkPackageSet(ts, ps, depName, mi, 0);
     }
     return rc;
 }
@@ -1847,12 +2034,13 @@ static int checkDependentPackages(rpmts ts, const char * depName)
 /**
  * Check to-be-added dependencies against installed conflicts.
  * @param ts		transaction set
+ * @param ps		problem set
  * @param depName	conflicts name
  * @return		0 no problems found
  */
-static int checkDependentConflicts(rpmts ts, const char * depName)
+static int checkDependentConflicts(rpmts ts, rpmps ps, const char * depName)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
-	/*@modifies ts, rpmGlobalMacroContext, fileSystem, internalState @*/
+	/*@modifies ts, ps, rpmGlobalMacroContext, fileSystem, internalState @*/
 {
     int rc = 0;
 
@@ -1860,159 +2048,492 @@ static int checkDependentConflicts(rpmts ts, const char * depName)
     if (rpmtsGetRdb(ts) != NULL) {
 	rpmmi mi;
 	mi = rpmtsInitIterator(ts, RPMTAG_CONFLICTNAME, depName, 0);
-	rc = checkPackageSet(ts, depName, mi, 1);
+	rc = checkPackageSet(ts, ps, depName, mi, 1);
     }
 
     return rc;
 }
 
-int _rpmtsCheck(rpmts ts)
+/**
+ * Check an added element's dependencies, and installed conflicts against it.
+ * @param ts		transaction set
+ * @param ps		problem set
+ * @param p		added transaction element
+ * @return		0 no problems found
+ */
+static int checkAddedElement(rpmts ts, rpmps ps, rpmte p)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, ps, p, rpmGlobalMacroContext, fileSystem, internalState @*/
 {
-    const char * depName = NULL;
     rpmdepFlags depFlags = rpmtsDFlags(ts);
     rpmuint32_t tscolor = rpmtsColor(ts);
-    rpmmi mi = NULL;
-    rpmtsi pi = NULL; rpmte p;
-    int closeatexit = 0;
-    int xx;
+    rpmds provides, requires, conflicts, dirnames, linktos;
+    const char * depName = NULL;
+    ARGV_t av = NULL;
+    rpmfi fi;
     int terminate = 2;		/* XXX terminate if rc >= terminate */
+    int rc;
+    int i;
+
+/*@-nullpass@*/	/* FIX: rpmts{A,O} can return null. */
+    rpmlog(RPMLOG_DEBUG, "========== +++ %s %s/%s 0x%x\n",
+	rpmteNEVR(p), rpmteA(p), rpmteO(p), rpmteColor(p));
+/*@=nullpass@*/
+    requires = (!(depFlags & RPMDEPS_FLAG_NOREQUIRES)
+	? rpmteDS(p, RPMTAG_REQUIRENAME) : NULL);
+    conflicts = (!(depFlags & RPMDEPS_FLAG_NOCONFLICTS)
+	? rpmteDS(p, RPMTAG_CONFLICTNAME) : NULL);
+    /* XXX srpm's don't have directory paths. */
+    if (p->isSource) {
+	dirnames = NULL;
+	linktos = NULL;
+    } else {
+	dirnames = (!(depFlags & RPMDEPS_FLAG_NOPARENTDIRS)
+	    ? rpmteDS(p, RPMTAG_DIRNAMES) : NULL);
+	linktos = (!(depFlags & RPMDEPS_FLAG_NOLINKTOS)
+	    ? rpmteDS(p, RPMTAG_FILELINKTOS) : NULL);
+    }
+
+    rc = checkPackageDeps(ts, ps, rpmteNEVRA(p),
+			requires, conflicts, dirnames, linktos,
+			NULL, tscolor, 1);
+    if (rc >= terminate)
+	return rc;
+
+    /* XXX The provides are also indexed in ts->addedPackages, copy names. */
+    DLOCK(ts);
+    provides = rpmteDS(p, RPMTAG_PROVIDENAME);
+    provides = rpmdsInit(provides);
+    if (provides != NULL)
+    while (rpmdsNext(provides) >= 0)
+	(void) argvAdd(&av, rpmdsN(provides));
+    DUNLOCK(ts);
+
+    if (av != NULL)
+    for (i = 0; av[i] != NULL; i++) {
+	/* Adding: check provides key against conflicts matches. */
+	if (checkDependentConflicts(ts, ps, av[i]))
+	    rc = 1;
+    }
+    av = argvFree(av);
+
+    fi = rpmteFI(p, RPMTAG_BASENAMES);
+    fi = rpmfiInit(fi, 0);
+    while (rpmfiNext(fi) >= 0) {
+	depName = _free(depName);
+	depName = xstrdup(rpmfiFN(fi));
+	/* Adding: check filename against conflicts matches. */
+	if (checkDependentConflicts(ts, ps, depName))
+	    rc = 1;
+    }
+    depName = _free(depName);
+
+    return rc;
+}
+
+/**
+ * Check that installed packages don't need what an erased element provides.
+ * @param ts		transaction set
+ * @param ps		problem set
+ * @param p		erased transaction element
+ * @return		0 no problems found
+ */
+static int checkErasedElement(rpmts ts, rpmps ps, rpmte p)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, ps, p, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    const char * depName = NULL;
+    rpmds provides;
+    rpmfi fi;
     int rc = 0;
-    int ourrc = 0;
 
-if (_rpmts_debug)
-fprintf(stderr, "--> %s(%p) tsFlags 0x%x\n", __FUNCTION__, ts, rpmtsFlags(ts));
+/*@-nullpass@*/	/* FIX: rpmts{A,O} can return null. */
+    rpmlog(RPMLOG_DEBUG, "========== --- %s %s/%s 0x%x\n",
+	rpmteNEVR(p), rpmteA(p), rpmteO(p), rpmteColor(p));
+/*@=nullpass@*/
 
-    (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_CHECK), 0);
+    provides = rpmteDS(p, RPMTAG_PROVIDENAME);
+    provides = rpmdsInit(provides);
+    if (provides != NULL)
+    while (rpmdsNext(provides) >= 0) {
+	depName = _free(depName);
+	depName = xstrdup(rpmdsN(provides));
 
-    /* Do lazy, readonly, open of rpm database. */
-    if (rpmtsGetRdb(ts) == NULL && rpmtsDBMode(ts) != -1) {
-	rc = (rpmtsOpenDB(ts, rpmtsDBMode(ts)) ? 2 : 0);
-	closeatexit = (rc == 0);
+	/* Erasing: check provides against requiredby matches. */
+	if (checkDependentPackages(ts, ps, depName))
+	    rc = 1;
     }
-    if (rc && (ourrc = rc) >= terminate)
-	goto exit;
 
-    ts->probs = rpmpsFree(ts->probs);
+    fi = rpmteFI(p, RPMTAG_BASENAMES);
+    fi = rpmfiInit(fi, 0);
+    while (rpmfiNext(fi) >= 0) {
+	depName = _free(depName);
+	depName = xstrdup(rpmfiFN(fi));
+	/* Erasing: check filename against requiredby matches. */
+	if (checkDependentPackages(ts, ps, depName))
+	    rc = 1;
+    }
+    depName = _free(depName);
 
-    rpmalMakeIndex(ts->addedPackages);
+    return rc;
+}
 
-    /*
-     * Look at all of the added packages and make sure their dependencies
-     * are satisfied.
-     */
-    pi = rpmtsiInit(ts);
-    while (ourrc < terminate && (p = rpmtsiNext(pi, TR_ADDED)) != NULL) {
-	rpmds provides, requires, conflicts, dirnames, linktos;
-	rpmfi fi;
+/**
+ * Append problems from one problem set to another.
+ * @param ps		problem set
+ * @param src		problems to append
+ */
+static void appendProblems(rpmps ps, /*@null@*/ rpmps src)
+	/*@modifies ps @*/
+{
+    rpmpsi psi = rpmpsInitIterator(src);
 
-/*@-nullpass@*/	/* FIX: rpmts{A,O} can return null. */
-	rpmlog(RPMLOG_DEBUG, "========== +++ %s %s/%s 0x%x\n",
-		rpmteNEVR(p), rpmteA(p), rpmteO(p), rpmteColor(p));
-/*@=nullpass@*/
-	requires = (!(depFlags & RPMDEPS_FLAG_NOREQUIRES)
-	    ? rpmteDS(p, RPMTAG_REQUIRENAME) : NULL);
-	conflicts = (!(depFlags & RPMDEPS_FLAG_NOCONFLICTS)
-	    ? rpmteDS(p, RPMTAG_CONFLICTNAME) : NULL);
-	/* XXX srpm's don't have directory paths. */
-	if (p->isSource) {
-	    dirnames = NULL;
-	    linktos = NULL;
-	} else {
-	    dirnames = (!(depFlags & RPMDEPS_FLAG_NOPARENTDIRS)
-		? rpmteDS(p, RPMTAG_DIRNAMES) : NULL);
-	    linktos = (!(depFlags & RPMDEPS_FLAG_NOLINKTOS)
-		? rpmteDS(p, RPMTAG_FILELINKTOS) : NULL);
+    while (rpmpsNextIterator(psi) >= 0) {
+	rpmProblem prob = rpmpsProblem(psi);
+	rpmpsAppend(ps, rpmProblemGetType(prob),
+		rpmProblemGetPkgNEVR(prob), rpmProblemKey(prob),
+		rpmProblemGetStr(prob), NULL,
+		rpmProblemGetAltNEVR(prob),
+		rpmProblemGetDiskNeed(prob));
+    }
+    psi = rpmpsFreeIterator(psi);
+}
+
+/**
+ * Must an element be checked, or are the results from the last check valid?
+ *
+ * Results stay valid unless something the element requires, conflicts with
+ * or provides has been added or erased since the last check.
+ * @param ts		transaction set
+ * @param p		transaction element
+ * @return		1 if the element must be checked, 0 otherwise
+ */
+static int depCheckNeeded(rpmts ts, rpmte p)
+	/*@modifies p @*/
+{
+    static rpmTag tags[] = {
+	RPMTAG_PROVIDENAME, RPMTAG_REQUIRENAME, RPMTAG_CONFLICTNAME,
+	RPMTAG_DIRNAMES, RPMTAG_FILELINKTOS, 0
+    };
+    rpmTag * tagp;
+    rpmds ds;
+    rpmfi fi;
+
+    if (ts->depcheckall || !p->checked)
+	return 1;
+    if (ts->depretry && (p->checkrc || rpmpsNumProblems(p->probs) > 0))
+	return 1;
+    if (ts->depchanged == NULL)
+	return 0;
+
+    for (tagp = tags; *tagp != 0; tagp++) {
+	ds = rpmdsInit(rpmteDS(p, *tagp));
+	if (ds != NULL)
+	while (rpmdsNext(ds) >= 0) {
+	    if (depChangedHas(ts, rpmdsN(ds)))
+		return 1;
 	}
+    }
+    fi = rpmfiInit(rpmteFI(p, RPMTAG_BASENAMES), 0);
+    if (fi != NULL)
+    while (rpmfiNext(fi) >= 0) {
+	if (depChangedHas(ts, rpmfiFN(fi)))
+	    return 1;
+    }
+    return 0;
+}
 
-	rc = checkPackageDeps(ts, rpmteNEVRA(p),
-			requires, conflicts, dirnames, linktos,
-			NULL, tscolor, 1);
-	if (rc && (ourrc = rc) >= terminate)
-	    break;
+/**
+ * Save the results of checking an element for the next check.
+ * @param p		transaction element
+ * @param ps		element problems
+ * @param rc		element result
+ */
+static void depCheckSave(rpmte p, rpmps ps, int rc)
+	/*@modifies p, ps @*/
+{
+    (void) rpmpsFree(p->probs);
+    p->probs = rpmpsLink(ps, "depCheckSave");
+    p->checkrc = rc;
+    p->checked = 1;
+}
+
+/**
+ * Check an element, reusing the results of the last check if still valid.
+ * @param ts		transaction set
+ * @param ps		problem set
+ * @param p		transaction element
+ * @return		0 no problems found
+ */
+static int checkElement(rpmts ts, rpmps ps, rpmte p)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, ps, p, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    rpmps eps;
+    int rc;
 
-	provides = rpmteDS(p, RPMTAG_PROVIDENAME);
-	provides = rpmdsInit(provides);
-	if (provides != NULL)
-	while (ourrc < terminate && rpmdsNext(provides) >= 0) {
-	    depName = _free(depName);
-	    depName = xstrdup(rpmdsN(provides));
+    if (!depCheckNeeded(ts, p)) {
+	appendProblems(ps, p->probs);
+	return p->checkrc;
+    }
 
-#ifdef	NOTYET
-	    if (rpmdsNSType(provides) == RPMNS_TYPE_ENVVAR) {
-		const char * EVR = rpmdsEVR(provides);
-		if (rpmdsNegateRC(provides, 0))
-		    EVR = NULL;
-		if (envPut(depName, EVR));
-		    rc = 2;
-	    } else
-#endif
+    eps = rpmpsCreate();
+    rc = (rpmteType(p) == TR_ADDED
+	? checkAddedElement(ts, eps, p)
+	: checkErasedElement(ts, eps, p));
+    depCheckSave(p, eps, rc);
+    appendProblems(ps, eps);
+    eps = rpmpsFree(eps);
+    return rc;
+}
 
-	    /* Adding: check provides key against conflicts matches. */
-	    if (checkDependentConflicts(ts, depName))
-		rc = 1;
-	}
-	if (rc && (ourrc = rc) >= terminate)
-	    break;
+/**
+ * Check added, then erased, elements.
+ * @param ts		transaction set
+ * @param ps		problem set
+ * @return		0 no problems found
+ */
+static int checkElements(rpmts ts, rpmps ps)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, ps, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    rpmtsi pi;
+    rpmte p;
+    int terminate = 2;		/* XXX terminate if rc >= terminate */
+    int rc = 0;
+    int ourrc = 0;
 
-	fi = rpmteFI(p, RPMTAG_BASENAMES);
-	fi = rpmfiInit(fi, 0);
-	while (ourrc < terminate && rpmfiNext(fi) >= 0) {
-	    depName = _free(depName);
-	    depName = xstrdup(rpmfiFN(fi));
-	    /* Adding: check filename against conflicts matches. */
-	    if (checkDependentConflicts(ts, depName))
-		rc = 1;
-	}
+    /*
+     * Look at all of the added packages and make sure their dependencies
+     * are satisfied.
+     */
+    pi = rpmtsiInit(ts);
+    while (ourrc < terminate && (p = rpmtsiNext(pi, TR_ADDED)) != NULL) {
+	rc = checkElement(ts, ps, p);
 	if (rc && (ourrc = rc) >= terminate)
 	    break;
     }
     pi = rpmtsiFree(pi);
-    if (rc && (ourrc = rc) >= terminate)
-	goto exit;
+    if (ourrc >= terminate)
+	return ourrc;
 
     /*
      * Look at the removed packages and make sure they aren't critical.
      */
     pi = rpmtsiInit(ts);
     while (ourrc < terminate && (p = rpmtsiNext(pi, TR_REMOVED)) != NULL) {
-	rpmds provides;
-	rpmfi fi;
+	rc = checkElement(ts, ps, p);
+	if (rc && (ourrc = rc) >= terminate)
+	    break;
+    }
+    pi = rpmtsiFree(pi);
 
-/*@-nullpass@*/	/* FIX: rpmts{A,O} can return null. */
-	rpmlog(RPMLOG_DEBUG, "========== --- %s %s/%s 0x%x\n",
-		rpmteNEVR(p), rpmteA(p), rpmteO(p), rpmteColor(p));
-/*@=nullpass@*/
+    return ourrc;
+}
 
-	provides = rpmteDS(p, RPMTAG_PROVIDENAME);
-	provides = rpmdsInit(provides);
-	if (provides != NULL)
-	while (ourrc < terminate && rpmdsNext(provides) >= 0) {
-	    depName = _free(depName);
-	    depName = xstrdup(rpmdsN(provides));
+/**
+ * Elements shared by threaded dependency check workers.
+ */
+typedef /*@abstract@*/ struct checkWork_s * checkWork;
+
+struct checkWork_s {
+/*@dependent@*/
+    rpmts ts;			/*!< Transaction set. */
+/*@only@*/
+    rpmte * te;			/*!< Elements, added then erased. */
+/*@only@*/
+    rpmps * ps;			/*!< Per-element problems. */
+/*@only@*/
+    int * rc;			/*!< Per-element results. */
+    int nte;			/*!< No. of elements. */
+    int next;			/*!< Next element to check. */
+    int stop;			/*!< First element with fatal results. */
+};
 
-	    /* Erasing: check provides against requiredby matches. */
-	    if (checkDependentPackages(ts, depName))
-		rc = 1;
-	}
-	if (rc && (ourrc = rc) >= terminate)
+/**
+ * Check elements, in claim order, until none (or a fatal result) remain.
+ * @param _w		check work
+ */
+static void checkWorker(void * _w)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies _w, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    checkWork w = _w;
+    rpmts ts = w->ts;
+    int terminate = 2;		/* XXX terminate if rc >= terminate */
+    int i;
+
+    for (;;) {
+	yarnPossess(ts->dlock);
+	i = (w->next < w->stop ? w->next++ : -1);
+	yarnRelease(ts->dlock);
+	if (i < 0)
 	    break;
 
-	fi = rpmteFI(p, RPMTAG_BASENAMES);
-	fi = rpmfiInit(fi, 0);
-	while (ourrc < terminate && rpmfiNext(fi) >= 0) {
-	    depName = _free(depName);
-	    depName = xstrdup(rpmfiFN(fi));
-	    /* Erasing: check filename against requiredby matches. */
-	    if (checkDependentPackages(ts, depName))
-		rc = 1;
+	/* Elements with still valid results were filled in already. */
+	if (w->ps[i] != NULL)
+	    continue;
+
+	w->ps[i] = rpmpsCreate();
+	w->rc[i] = (rpmteType(w->te[i]) == TR_ADDED
+		? checkAddedElement(ts, w->ps[i], w->te[i])
+		: checkErasedElement(ts, w->ps[i], w->te[i]));
+	depCheckSave(w->te[i], w->ps[i], w->rc[i]);
+
+	if (w->rc[i] >= terminate) {
+	    yarnPossess(ts->dlock);
+	    if (i < w->stop)
+		w->stop = i;
+	    yarnRelease(ts->dlock);
 	}
-	if (rc && (ourrc = rc) >= terminate)
-	    break;
     }
+}
+
+/**
+ * Check added and erased elements with a pool of worker threads.
+ *
+ * Each worker claims the next unchecked element and collects its problems
+ * separately, the problems are then merged in element order so that the
+ * result is identical to a serial check. The rpmdb is shared (Berkeley DB
+ * is opened free-threaded), each rpmdb iterator has its own cursors.
+ * @param ts		transaction set
+ * @param ps		problem set
+ * @param nthreads	no. of worker threads
+ * @return		0 no problems found
+ */
+static int checkElementsThreaded(rpmts ts, rpmps ps, int nthreads)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, ps, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    struct checkWork_s w;
+    yarnThread * threads;
+    rpmtsi pi;
+    rpmte p;
+    int terminate = 2;		/* XXX terminate if rc >= terminate */
+    int nneeded = 0;
+    int ourrc = 0;
+    int i;
+
+    memset(&w, 0, sizeof(w));
+    w.ts = ts;
+    w.te = xcalloc(rpmtsNElements(ts) + 1, sizeof(*w.te));
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, TR_ADDED)) != NULL)
+	w.te[w.nte++] = p;
+    pi = rpmtsiFree(pi);
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, TR_REMOVED)) != NULL)
+	w.te[w.nte++] = p;
     pi = rpmtsiFree(pi);
+    w.ps = xcalloc(w.nte + 1, sizeof(*w.ps));
+    w.rc = xcalloc(w.nte + 1, sizeof(*w.rc));
+    w.stop = w.nte;
+
+    /* Reuse still valid results, stopping where a serial check would. */
+    for (i = 0; i < w.nte; i++) {
+	p = w.te[i];
+	if (depCheckNeeded(ts, p)) {
+	    nneeded++;
+	    continue;
+	}
+	w.ps[i] = rpmpsLink(p->probs, "checkElementsThreaded");
+	w.rc[i] = p->checkrc;
+	if (w.rc[i] >= terminate && i < w.stop)
+	    w.stop = i;
+    }
+
+    /* Open all indices (and packed headers) before sharing the rpmdb. */
+    if (rpmtsGetRdb(ts) != NULL)
+	(void) rpmdbOpenAll(rpmtsGetRdb(ts));
+
+    if (nthreads > nneeded)
+	nthreads = nneeded;
+    threads = xcalloc(nthreads + 1, sizeof(*threads));
+    ts->dlock = yarnNewLock(0);
+    for (i = 0; i < nthreads; i++)
+	threads[i] = yarnLaunch(checkWorker, &w);
+    for (i = 0; i < nthreads; i++)
+	threads[i] = yarnJoin(threads[i]);
+    ts->dlock = yarnFreeLock(ts->dlock);
+    threads = _free(threads);
+
+    /* Merge problems in element order, stopping where a serial check would. */
+    for (i = 0; i < w.nte; i++) {
+	if (ourrc < terminate && w.ps[i] != NULL) {
+	    appendProblems(ps, w.ps[i]);
+	    if (w.rc[i])
+		ourrc = w.rc[i];
+	}
+	w.ps[i] = rpmpsFree(w.ps[i]);
+    }
+
+    w.rc = _free(w.rc);
+    w.ps = _free(w.ps);
+    w.te = _free(w.te);
+    return ourrc;
+}
+
+int _rpmtsCheck(rpmts ts)
+{
+    rpmdepFlags depFlags = rpmtsDFlags(ts);
+    rpmuint32_t tscolor = rpmtsColor(ts);
+    rpmps ps = NULL;
+    int closeatexit = 0;
+    int nthreads;
+    int frozen;
+    int xx;
+    int terminate = 2;		/* XXX terminate if rc >= terminate */
+    int rc = 0;
+    int ourrc = 0;
+
+if (_rpmts_debug)
+fprintf(stderr, "--> %s(%p) tsFlags 0x%x\n", __FUNCTION__, ts, rpmtsFlags(ts));
+
+    (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_CHECK), 0);
+
+    /* Do lazy, readonly, open of rpm database. */
+    if (rpmtsGetRdb(ts) == NULL && rpmtsDBMode(ts) != -1) {
+	rc = (rpmtsOpenDB(ts, rpmtsDBMode(ts)) ? 2 : 0);
+	closeatexit = (rc == 0);
+    }
     if (rc && (ourrc = rc) >= terminate)
 	goto exit;
 
+    ts->probs = rpmpsFree(ts->probs);
+    ps = rpmtsProblems(ts);
+
+    rpmalMakeIndex(ts->addedPackages);
+
+    /*
+     * Unless the solver might add more elements to the transaction while
+     * checking, elements can be checked concurrently, and only elements
+     * affected by changes since the last check need to be re-checked.
+     */
+    frozen = (ts->solve == NULL || (depFlags & RPMDEPS_FLAG_NOSUGGEST)
+	|| (ts->solve == rpmtsSolve && !(depFlags & RPMDEPS_FLAG_ADDINDEPS)));
+    if (!frozen || depFlags != ts->depcheckflags || tscolor != ts->depcheckcolor)
+	ts->depcheckall = 1;
+    /* Unsatisfied dependencies are passed to the solver (again). */
+    if (ts->solve != NULL && !(depFlags & RPMDEPS_FLAG_NOSUGGEST))
+	ts->depretry = 1;
+
+    nthreads = rpmExpandNumeric("%{?_dependency_threads}");
+    if (frozen && nthreads > 1 && rpmtsNElements(ts) > 1)
+	rc = checkElementsThreaded(ts, ps, nthreads);
+    else
+	rc = checkElements(ts, ps);
+    if (rc && (ourrc = rc) >= terminate)
+	goto exit;
+
+    /* All elements have been checked, start tracking changes afresh. */
+    ts->depchanged = (ts->depchanged ? htFree(ts->depchanged) : NULL);
+    ts->depchangedkeys = argvFree(ts->depchangedkeys);
+    ts->ndepchangedkeys = 0;
+    ts->depretry = 0;
+    ts->depcheckall = !frozen;
+    ts->depcheckflags = depFlags;
+    ts->depcheckcolor = tscolor;
+
     /*
      * Make sure transaction dependencies are satisfied.
      */
@@ -2024,24 +2545,18 @@ fprintf(stderr, "--> %s(%p) tsFlags 0x%x\n", __FUNCTION__, ts, rpmtsFlags(ts));
 	const char * dep = NULL;
 	int adding = 2;
 	tscolor = 0;	/* XXX no coloring for transaction dependencies. */
-	rc = checkPackageDeps(ts, tsNEVRA, R, C, D, L, dep, tscolor, adding);
+	rc = checkPackageDeps(ts, ps, tsNEVRA, R, C, D, L, dep, tscolor, adding);
     }
     if (rc && (ourrc = rc) >= terminate)
 	goto exit;
 
 exit:
-    mi = rpmmiFree(mi);
-    pi = rpmtsiFree(pi);
-    depName = _free(depName);
+    ps = rpmpsFree(ps);
 
     (void) rpmswExit(rpmtsOp(ts, RPMTS_OP_CHECK), 0);
 
     if (closeatexit)
 	xx = rpmtsCloseDB(ts);
-#if defined(CACHE_DEPENDENCY_RESULT)
-    else if (_cacheDependsRC)
-	xx = rpmdbCloseDBI(rpmtsGetRdb(ts), RPMDBI_DEPCACHE);
-#endif
 
 #ifdef	NOTYET
      /* On failed dependencies, perform the autorollback goal (if any). */
@@ -17,7 +17,6 @@
 #include <rpmfi.h>
 
 #define	_RPMTE_INTERNAL
-#define	_RPMTS_ORDER_INTERNAL
 #include <rpmte.h>
 #define	_RPMTS_INTERNAL
 #include <rpmts.h>
@@ -28,60 +27,6 @@ typedef	rpmuint32_t rpm_color_t;
 
 /*@access alKey @*/	/* XXX for reordering and RPMAL_NOMATCH assign */
 
-/**
- */
-typedef /*@abstract@*/ struct orderListIndex_s *	orderListIndex;
-/*@access orderListIndex@*/
-
-/**
- */
-struct orderListIndex_s {
-/*@dependent@*/
-    alKey pkgKey;
-    int orIndex;
-};
-
-/*
- * Strongly Connected Components
- * set of packages (indirectly) requiering each other
- */
-struct scc_s {
-    int count;		/* # of external requires this SCC has */
-#if 0
-    int qcnt;		/* # of external requires pointing to this SCC */
-#endif
-    int size;		/* # of members */
-#ifdef	REFERENCE
-    tsortInfo * members;
-#else
-    rpmte * members;
-#endif	/* REFERENCE */
-};
-
-typedef struct scc_s * scc;
-
-#ifdef	REFERENCE
-struct relation_s {
-    tsortInfo   rel_suc;	/* pkg requiring this package */
-    rpmsenseFlags rel_flags;	/* accumulated flags of the requirements */
-    struct relation_s * rel_next;
-};
-
-typedef struct relation_s * relation;
-
-struct tsortInfo_s {
-    rpmte te;
-    int	     tsi_count;		/* #pkgs this pkg requires */
-    int	     tsi_qcnt;		/* #pkgs requiring this package */
-    int	     tsi_reqx;		/* requires Idx/mark as (queued/loop) */
-    struct relation_s * tsi_relations;
-    struct relation_s * tsi_forward_relations;
-    tsortInfo tsi_suc;		/*  used for queuing (addQ) */
-    int      tsi_SccIdx;	/* # of the SCC the node belongs to (1 for trivial SCCs) */
-    int      tsi_SccLowlink;	/* used for SCC detection */
-};
-#endif	/* REFERENCE */
-
 struct badDeps_s {
 /*@observer@*/ /*@owned@*/ /*@null@*/
     const char * pname;
@@ -132,14 +77,9 @@ static int ignoreDep(const rpmts ts, const rpmte p, const rpmte q)
     if (!badDepsInitialized) {
 	char * s = rpmExpand("%{?_dependency_whiteout}", NULL);
 	const char ** av = NULL;
-#ifdef	REFERENCE
-	int msglvl = (rpmtsDFlags(ts) & RPMDEPS_FLAG_DEPLOOPS)
-			? RPMLOG_WARNING : RPMLOG_DEBUG;
-#else
 	int anaconda = rpmtsDFlags(ts) & RPMDEPS_FLAG_ANACONDA;
 	int msglvl = (anaconda || (rpmtsDFlags(ts) & RPMDEPS_FLAG_DEPLOOPS))
 			? RPMLOG_WARNING : RPMLOG_DEBUG;
-#endif
 	int ac = 0;
 	int i;
 
@@ -182,115 +122,6 @@ static int ignoreDep(const rpmts ts, const rpmte p, const rpmte q)
 /*@=compdef@*/
 }
 
-#ifdef	REFERENCE
-static void rpmTSIFree(tsortInfo tsi)
-{
-    relation rel;
-
-    while (tsi->tsi_relations != NULL) {
-	rel = tsi->tsi_relations;
-	tsi->tsi_relations = tsi->tsi_relations->rel_next;
-	rel = _free(rel);
-    }
-    while (tsi->tsi_forward_relations != NULL) {
-	rel = tsi->tsi_forward_relations;
-	tsi->tsi_forward_relations = \
-	    tsi->tsi_forward_relations->rel_next;
-	rel = _free(rel);
-    }
-}
-
-static inline int addSingleRelation(rpmte p,
-				    rpmte q,
-				    rpmsenseFlags dsflags)
-{
-    struct tsortInfo_s *tsi_p, *tsi_q;
-    relation rel;
-    rpmElementType teType = rpmteType(p);
-    rpmsenseFlags flags;
-
-    /* Avoid deps outside this transaction and self dependencies */
-    if (q == NULL || q == p)
-	return 0;
-
-    /* Erasures are reversed installs. */
-    if (teType == TR_REMOVED) {
-	rpmte r = p;
-	p = q;
-	q = r;
-	flags = isErasePreReq(dsflags);
-    } else {
-	flags = isInstallPreReq(dsflags);
-    }
-
-    /* map legacy prereq to pre/preun as needed */
-    if (isLegacyPreReq(dsflags)) {
-	flags |= (teType == TR_ADDED) ?
-	    RPMSENSE_SCRIPT_PRE : RPMSENSE_SCRIPT_PREUN;
-    }
-
-    tsi_p = rpmteTSI(p);
-    tsi_q = rpmteTSI(q);
-
-    /* if relation got already added just update the flags */
-    if (tsi_q->tsi_relations && tsi_q->tsi_relations->rel_suc == tsi_p) {
-	tsi_q->tsi_relations->rel_flags |= flags;
-	tsi_p->tsi_forward_relations->rel_flags |= flags;
-	return 0;
-    }
-
-    /* Record next "q <- p" relation (i.e. "p" requires "q"). */
-    if (p != q) {
-	/* bump p predecessor count */
-	tsi_p->tsi_count++;
-    }
-
-    rel = xcalloc(1, sizeof(*rel));
-    rel->rel_suc = tsi_p;
-    rel->rel_flags = flags;
-
-    rel->rel_next = tsi_q->tsi_relations;
-    tsi_q->tsi_relations = rel;
-    if (p != q) {
-	/* bump q successor count */
-	tsi_q->tsi_qcnt++;
-    }
-
-    rel = xcalloc(1, sizeof(*rel));
-    rel->rel_suc = tsi_q;
-    rel->rel_flags = flags;
-
-    rel->rel_next = tsi_p->tsi_forward_relations;
-    tsi_p->tsi_forward_relations = rel;
-
-    return 0;
-}
-#endif	/* REFERENCE */
-
-/**
- * Recursively mark all nodes with their predecessors.
- * @param tsi		successor chain
- * @param q		predecessor
- */
-static void markLoop(/*@special@*/ tsortInfo tsi, rpmte q)
-	/*@globals internalState @*/
-	/*@uses tsi @*/
-	/*@modifies internalState @*/
-{
-    rpmte p;
-
-    while (tsi != NULL && (p = tsi->tsi_suc) != NULL) {
-	tsi = tsi->tsi_next;
-	if (rpmteTSI(p)->tsi_chain != NULL)
-	    continue;
-	/*@-assignexpose -temptrans@*/
-	rpmteTSI(p)->tsi_chain = q;
-	/*@=assignexpose =temptrans@*/
-	if (rpmteTSI(p)->tsi_next != NULL)
-	    markLoop(rpmteTSI(p)->tsi_next, p);
-    }
-}
-
 /*
  * Return display string a dependency, adding contextual flags marker.
  * @param f		dependency flags
@@ -318,317 +149,286 @@ static inline /*@observer@*/ const char * identifyDepend(rpmuint32_t f)
 }
 
 /**
- * Find (and eliminate co-requisites) "q <- p" relation in dependency loop.
- * Search all successors of q for instance of p. Format the specific relation,
- * (e.g. p contains "Requires: q"). Unlink and free co-requisite (i.e.
- * pure Requires: dependencies) successor node(s).
- * @param q		sucessor (i.e. package required by p)
- * @param p		predecessor (i.e. package that "Requires: q")
- * @param zap		max. no. of co-requisites to remove (-1 is all)?
- * @retval nzaps	address of no. of relations removed
- * @param msglvl	message level at which to spew
- * @return		(possibly NULL) formatted "q <- p" releation (malloc'ed)
- */
-/*@-mustmod@*/ /* FIX: hack modifies, but -type disables */
-static /*@owned@*/ /*@null@*/ const char *
-zapRelation(rpmte q, rpmte p,
-		int zap, /*@in@*/ /*@out@*/ int * nzaps, int msglvl)
-	/*@globals rpmGlobalMacroContext, h_errno, internalState @*/
-	/*@modifies q, p, *nzaps, rpmGlobalMacroContext, internalState @*/
-{
-    rpmds requires;
-    tsortInfo tsi_prev;
-    tsortInfo tsi;
-    const char *dp = NULL;
-
-    for (tsi_prev = rpmteTSI(q), tsi = rpmteTSI(q)->tsi_next;
-	 tsi != NULL;
-	/* XXX Note: the loop traverses "not found", break on "found". */
-	/*@-nullderef@*/
-	 tsi_prev = tsi, tsi = tsi->tsi_next)
-	/*@=nullderef@*/
-    {
-	rpmuint32_t Flags;
-
-	/*@-abstractcompare@*/
-	if (tsi->tsi_suc != p)
-	    continue;
-	/*@=abstractcompare@*/
-
-	requires = rpmteDS((rpmteType(p) == TR_REMOVED ? q : p), tsi->tsi_tagn);
-	if (requires == NULL) continue;		/* XXX can't happen */
-
-	(void) rpmdsSetIx(requires, tsi->tsi_reqx);
-
-	Flags = rpmdsFlags(requires);
-
-	dp = rpmdsNewDNEVR( identifyDepend(Flags), requires);
-
-	/*
-	 * Attempt to unravel a dependency loop by eliminating Requires's.
-	 */
-	if (zap) {
-	    rpmlog(msglvl,
-			_("removing %s \"%s\" from tsort relations.\n"),
-			(rpmteNEVRA(p) ?  rpmteNEVRA(p) : "???"), dp);
-	    rpmteTSI(p)->tsi_count--;
-	    if (tsi_prev) tsi_prev->tsi_next = tsi->tsi_next;
-	    tsi->tsi_next = NULL;
-	    tsi->tsi_suc = NULL;
-	    tsi = _free(tsi);
-	    if (nzaps)
-		(*nzaps)++;
-	    if (zap)
-		zap--;
-	}
-	/* XXX Note: the loop traverses "not found", get out now! */
-	break;
-    }
-    return dp;
-}
-/*@=mustmod@*/
-
-#ifdef	REFERENCE
-/**
- * Record next "q <- p" relation (i.e. "p" requires "q").
+ * Create the erased package index.
  * @param ts		transaction set
- * @param p		predecessor (i.e. package that "Requires: q")
- * @param requires	relation
- * @return		0 always
  */
-static inline int addRelation(rpmts ts,
-			      rpmal al,
-			      rpmte p,
-			      rpmds requires)
+static void orderErasedIndex(rpmts ts)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies ts, fileSystem, internalState @*/
 {
-    rpmte q;
-    ARGV_const_t qcolls;
-    rpmsenseFlags dsflags;
-
-    dsflags = rpmdsFlags(requires);
-
-    /* Avoid dependendencies which are not relevant for ordering */
-    if (dsflags & (RPMSENSE_RPMLIB|RPMSENSE_CONFIG|RPMSENSE_PRETRANS))
-	return 0;
-
-    q = rpmalSatisfiesDepend(al, requires);
-
-    /* Avoid deps outside this transaction and self dependencies */
-    if (q == NULL || q == p)
-	return 0;
-
-    /* Avoid certain dependency relations. */
-    if (ignoreDep(ts, p, q))
-	return 0;
+    rpmuint32_t tscolor = rpmtsColor(ts);
+    rpmtsi pi;
+    rpmte p;
 
-    addSingleRelation(p, q, dsflags);
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, TR_REMOVED)) != NULL) {
+/*@-abstract@*/
+	fnpyKey key = (fnpyKey) p;
+/*@=abstract@*/
+	alKey pkgKey = RPMAL_NOMATCH;
 
-    /* If q is a member of any collections, make sure p requires all packages
-     * that are also in those collections */
-    for (qcolls = rpmteCollections(q); qcolls && *qcolls; qcolls++) {
-	rpmte *te;
-	rpmte *tes = rpmalAllInCollection(al, *qcolls);
-	for (te = tes; te && *te; te++) {
-	    addSingleRelation(p, *te, RPMSENSE_SCRIPT_PRE);
-	}
-	_free(tes);
+	pkgKey = rpmalAdd(&ts->erasedPackages, pkgKey, key,
+			rpmteDS(p, RPMTAG_PROVIDENAME),
+			rpmteFI(p, RPMTAG_BASENAMES), tscolor);
+	/* XXX pretend erasedPackages are just appended to addedPackages. */
+	pkgKey = (alKey)(((long)pkgKey) + ts->numAddedPackages);
+	(void) rpmteSetAddedKey(p, pkgKey);
     }
-
-    return 0;
+    pi = rpmtsiFree(pi);
+    rpmalMakeIndex(ts->erasedPackages);
 }
-#endif	/* REFERENCE */
 
 /**
- * Record next "q <- p" relation (i.e. "p" requires "q").
+ * Partition the (ordered) elements into parallel install schedule waves.
  * @param ts		transaction set
- * @param p		predecessor (i.e. package that "Requires: q")
- * @param requires	relation
- * @return		0 always
  */
-static inline int orgrpmAddRelation(rpmts ts,
-			      rpmal al,
-			      rpmte p,
-			      rpmds requires)
+static void orderWaves(rpmts ts)
+	/*@modifies ts @*/
 {
-    rpmte q;
-    struct tsortInfo_s * tsi_p, * tsi_q;
-    relation rel;
-    const char * N = rpmdsN(requires);
-    rpmElementType teType = rpmteType(p);
-    rpmsenseFlags flags;
-    rpmsenseFlags dsflags;
-
-#ifdef	REFERENCE
-    if (N == NULL)
-	return 0;
-
-    dsflags = rpmdsFlags(requires);
-
-    /* Avoid rpmlib feature and package config dependencies */
-    if (dsflags & (RPMSENSE_RPMLIB|RPMSENSE_CONFIG))
-	return 0;
-
-    q = rpmalSatisfiesDepend(al, requires);
-#else
-    rpmtsi qi;
-    fnpyKey key;
-    alKey pkgKey;
-    int i = 0;
-
-    dsflags = rpmdsFlags(requires);
+    int nwaves = 0;
+    int wave;
+    int i;
 
-    /* Avoid certain NS dependencies. */
-    switch (rpmdsNSType(requires)) {
-    default:
-	break;
-    case RPMNS_TYPE_RPMLIB:
-    case RPMNS_TYPE_CONFIG:
-    case RPMNS_TYPE_CPUINFO:
-    case RPMNS_TYPE_GETCONF:
-    case RPMNS_TYPE_UNAME:
-    case RPMNS_TYPE_SONAME:
-    case RPMNS_TYPE_ACCESS:
-    case RPMNS_TYPE_USER:
-    case RPMNS_TYPE_GROUP:
-    case RPMNS_TYPE_MOUNTED:
-    case RPMNS_TYPE_DISKSPACE:
-    case RPMNS_TYPE_DIGEST:
-    case RPMNS_TYPE_GNUPG:
-    case RPMNS_TYPE_MACRO:
-    case RPMNS_TYPE_ENVVAR:
-    case RPMNS_TYPE_RUNNING:
-    case RPMNS_TYPE_SANITY:
-    case RPMNS_TYPE_VCHECK:
-    case RPMNS_TYPE_SIGNATURE:
-	return 0;
-	/*@notreached@*/ break;
-    }
+    ts->waves = _free(ts->waves);
+    ts->wavex = _free(ts->wavex);
+    ts->nwaves = 0;
 
-#ifndef	NOTYET
-    /* Avoid looking up files/directories that are "owned" by _THIS_ package. */
-    if (*N == '/') {
-	rpmfi fi = rpmteFI(p, RPMTAG_BASENAMES);
-	rpmbf bf = rpmfiFNBF(fi);
-	if (bf != NULL && rpmbfChk(bf, N, strlen(N)) > 0)
-	    return 0;
+    for (i = 0; i < ts->orderCount; i++) {
+	if ((wave = rpmteWave(ts->order[i])) < 0)
+	    return;		/* XXX not scheduled */
+	if (wave >= nwaves)
+	    nwaves = wave + 1;
     }
-#endif
-
-    pkgKey = RPMAL_NOMATCH;
-    key = rpmalSatisfiesDepend(al, requires, &pkgKey);
-
-    /* Ordering depends only on added/erased package relations. */
-    if (pkgKey == RPMAL_NOMATCH)
-	return 0;
+    if (nwaves == 0)
+	return;
 
-/* XXX Set q to the added/removed package that was found. */
-    /* XXX pretend erasedPackages are just appended to addedPackages. */
-    if (teType == TR_REMOVED)
-	pkgKey = (alKey)(((long)pkgKey) + ts->numAddedPackages);
+    /* Counting sort, elements within a wave stay in (linear) order. */
+    ts->wavex = xcalloc(nwaves + 1, sizeof(*ts->wavex));
+    ts->waves = xmalloc((ts->orderCount + 1) * sizeof(*ts->waves));
+    for (i = 0; i < ts->orderCount; i++)
+	ts->wavex[rpmteWave(ts->order[i]) + 1]++;
+    for (wave = 0; wave < nwaves; wave++)
+	ts->wavex[wave + 1] += ts->wavex[wave];
+    for (i = 0; i < ts->orderCount; i++) {
+	wave = rpmteWave(ts->order[i]);
+	ts->waves[ts->wavex[wave]++] = i;
+    }
+    for (wave = nwaves; wave > 0; wave--)
+	ts->wavex[wave] = ts->wavex[wave - 1];
+    ts->wavex[0] = 0;
+    ts->nwaves = nwaves;
+
+    rpmlog(RPMLOG_DEBUG, D_("========== %d elements in %d waves\n"),
+		ts->orderCount, nwaves);
+}
 
-    for (qi = rpmtsiInit(ts), i = 0; (q = rpmtsiNext(qi, 0)) != NULL; i++) {
-	if (pkgKey == rpmteAddedKey(q))
-	    break;
-    }
-    qi = rpmtsiFree(qi);
+/*@unchecked@*/
+#ifdef	NOTYET
+static rpmuint32_t _autobits = _notpre(_ALL_REQUIRES_MASK);
+#else
+static rpmuint32_t _autobits = 0xffffffff;
 #endif
+#define isAuto(_x)	((_x) & _autobits)
 
-    /* Avoid deps outside this transaction and self dependencies */
-    if (q == NULL || q == p)
-	return 0;
-
-    /* Avoid certain dependency relations. */
-    if (ignoreDep(ts, p, q))
-	return 0;
-
-    /* Erasures are reversed installs. */
-    if (teType == TR_REMOVED) {
-        rpmte r = p;
-        p = q;
-        q = r;
-	flags = isErasePreReq(dsflags);
-    } else {
-	flags = isInstallPreReq(dsflags);
-    }
-
-#ifndef	DYING
-#define	isLegacyPreReq(_x)  (((_x) & _ALL_REQUIRES_MASK) == RPMSENSE_PREREQ)
-    /* map legacy prereq to pre/preun as needed */
-    if (isLegacyPreReq(dsflags)) {
-	flags |= (teType == TR_ADDED) ?
-		 RPMSENSE_SCRIPT_PRE : RPMSENSE_SCRIPT_PREUN;
-    }
-#undef	isLegacyPreReq
-#endif
+/*
+ * The ordering engine: relations between element indices are recorded
+ * once, compiled into compressed sparse row (CSR) successor/predecessor
+ * arrays, and sorted with a single pass. When the sort stalls, loops
+ * (strongly connected components) among the remaining elements are found
+ * once, and each stall is broken by releasing a member of a loop that no
+ * other remaining element is waiting on.
+ */
 
-    tsi_p = rpmteTSI(p);
-    tsi_q = rpmteTSI(q);
+/**
+ * A "q <- p" relation (i.e. "p" requires "q") between element indices.
+ */
+struct orderRel_s {
+    int q;			/*!< Predecessor (i.e. package that is required). */
+    int p;			/*!< Successor (i.e. package that "Requires: q"). */
+    int who;			/*!< Element with the dependency. */
+    rpmTag tagN;		/*!< Dependency tag. */
+    int ix;			/*!< Dependency index. */
+};
 
-    /* if relation got already added just update the flags */
-    if (tsi_q->tsi_relations && tsi_q->tsi_relations->rel_suc == p) {
-	tsi_q->tsi_relations->rel_flags |= flags;
-	tsi_p->tsi_forward_relations->rel_flags |= flags;
-	return 0;
-    }
+/**
+ * Transaction element ordering graph.
+ */
+typedef /*@abstract@*/ struct orderGraph_s * orderGraph;
 
-    /* Record next "q <- p" relation (i.e. "p" requires "q"). */
-    if (p != q) {
-	/* bump p predecessor count */
-	rpmteTSI(p)->tsi_count++;
-    }
+struct orderGraph_s {
+/*@dependent@*/
+    rpmts ts;			/*!< Transaction set. */
+/*@only@*/
+    rpmte * te;			/*!< Elements (in presentation order). */
+    int nte;			/*!< No. of elements. */
+/*@only@*/
+    int * keyx;			/*!< Element index of added/erased key. */
+    int nkeys;			/*!< No. of added/erased keys. */
+/*@only@*/
+    int * selected;		/*!< Last element (+1) recording a relation. */
+/*@only@*/
+    struct orderRel_s * rels;	/*!< Relations (in recording order). */
+    int nrels;			/*!< No. of relations. */
+    int allocrels;		/*!< No. of allocated relations. */
+/*@only@*/ /*@null@*/
+    int * succx;		/*!< Successors of q: succ[succx[q]:succx[q+1]]. */
+/*@only@*/ /*@null@*/
+    int * succ;			/*!< Successor relations. */
+/*@only@*/ /*@null@*/
+    int * predx;		/*!< Predecessors of p: pred[predx[p]:predx[p+1]]. */
+/*@only@*/ /*@null@*/
+    int * pred;			/*!< Predecessor relations. */
+/*@only@*/ /*@null@*/
+    unsigned char * zapped;	/*!< Relation removed to break a loop? */
+/*@only@*/
+    int * count;		/*!< No. of remaining predecessors. */
+/*@only@*/
+    int * qcnt;			/*!< No. of successors. */
+/*@only@*/
+    int * queued;		/*!< Generation when queued, 0 if not queued. */
+/*@only@*/
+    int * suc;			/*!< Queue linkage (-1 terminates). */
+/*@only@*/
+    unsigned char * done;	/*!< Has the element been ordered? */
+/*@only@*/ /*@null@*/
+    int * sccx;			/*!< Loop of element (-1 if none). */
+/*@only@*/ /*@null@*/
+    int * sccmx;		/*!< Members of s: sccm[sccmx[s]:sccmx[s+1]]. */
+/*@only@*/ /*@null@*/
+    int * sccm;			/*!< Loop members. */
+/*@only@*/ /*@null@*/
+    int * sccext;		/*!< No. of remaining relations from outside. */
+/*@only@*/ /*@null@*/
+    int * sccleft;		/*!< No. of remaining members. */
+    int nsccs;			/*!< No. of loops. */
+};
 
-    /* Save max. depth in dependency tree */
-    if (rpmteDepth(p) <= rpmteDepth(q))
-	(void) rpmteSetDepth(p, (rpmteDepth(q) + 1));
-    if (rpmteDepth(p) > ts->maxDepth)
-	ts->maxDepth = rpmteDepth(p);
+/**
+ * Added package index ordering key (qsort/bsearch).
+ */
+struct orderPkgid_s {
+/*@observer@*/
+    const char * pkgid;
+    int x;
+};
 
-    rel = xcalloc(1, sizeof(*rel));
-    rel->rel_suc = p;
-    rel->rel_flags = flags;
+/**
+ * Compare added package pkgid's, then indices (qsort/bsearch).
+ * @param one		1st added package
+ * @param two		2nd added package
+ * @return		result of comparison
+ */
+static int orderPkgidCmp(const void * one, const void * two)	/*@*/
+{
+    const struct orderPkgid_s * a = one;
+    const struct orderPkgid_s * b = two;
+    int rc = strcmp(a->pkgid, b->pkgid);
+    if (rc == 0 && a->x >= 0 && b->x >= 0)
+	rc = (a->x - b->x);
+    return rc;
+}
 
-    rel->rel_next = rpmteTSI(q)->tsi_relations;
-    rpmteTSI(q)->tsi_relations = rel;
-    if (p != q) {
-	/* bump q successor count */
-	rpmteTSI(q)->tsi_qcnt++;
-    }
+/**
+ * Destroy an ordering graph.
+ * @param og		ordering graph
+ * @return		NULL always
+ */
+/*@null@*/
+static orderGraph orderGraphFree(/*@only@*/ /*@null@*/ orderGraph og)
+	/*@modifies og @*/
+{
+    if (og == NULL)
+	return NULL;
+    og->sccleft = _free(og->sccleft);
+    og->sccext = _free(og->sccext);
+    og->sccm = _free(og->sccm);
+    og->sccmx = _free(og->sccmx);
+    og->sccx = _free(og->sccx);
+    og->done = _free(og->done);
+    og->suc = _free(og->suc);
+    og->queued = _free(og->queued);
+    og->qcnt = _free(og->qcnt);
+    og->count = _free(og->count);
+    og->zapped = _free(og->zapped);
+    og->pred = _free(og->pred);
+    og->predx = _free(og->predx);
+    og->succ = _free(og->succ);
+    og->succx = _free(og->succx);
+    og->rels = _free(og->rels);
+    og->selected = _free(og->selected);
+    og->keyx = _free(og->keyx);
+    og->te = _free(og->te);
+    og = _free(og);
+    return NULL;
+}
 
-    rel = xcalloc(1, sizeof(*rel));
-    rel->rel_suc = q;
-    rel->rel_flags = flags;
+/**
+ * Create an ordering graph for the elements of a transaction set.
+ * @param ts		transaction set
+ * @return		new ordering graph
+ */
+static orderGraph orderGraphNew(rpmts ts)
+	/*@*/
+{
+    orderGraph og = xcalloc(1, sizeof(*og));
+    rpmtsi pi;
+    rpmte p;
+    long kx;
+    int x;
 
-    rel->rel_next = rpmteTSI(p)->tsi_forward_relations;
-    rpmteTSI(p)->tsi_forward_relations = rel;
+    og->ts = ts;
+    og->te = xcalloc(rpmtsNElements(ts) + 1, sizeof(*og->te));
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, 0)) != NULL)
+	og->te[og->nte++] = p;
+    pi = rpmtsiFree(pi);
 
-    return 0;
+    /* Map added/erased keys to element indices (1st element wins). */
+    for (x = 0; x < og->nte; x++) {
+	kx = (long) rpmteAddedKey(og->te[x]);
+	if (kx >= og->nkeys)
+	    og->nkeys = kx + 1;
+    }
+    og->keyx = xmalloc((og->nkeys + 1) * sizeof(*og->keyx));
+    for (kx = 0; kx < og->nkeys; kx++)
+	og->keyx[kx] = -1;
+    for (x = og->nte - 1; x >= 0; x--) {
+	kx = (long) rpmteAddedKey(og->te[x]);
+	if (kx >= 0)
+	    og->keyx[kx] = x;
+    }
+
+    og->selected = xcalloc(og->nte + 1, sizeof(*og->selected));
+    og->count = xcalloc(og->nte + 1, sizeof(*og->count));
+    og->qcnt = xcalloc(og->nte + 1, sizeof(*og->qcnt));
+    og->queued = xcalloc(og->nte + 1, sizeof(*og->queued));
+    og->suc = xcalloc(og->nte + 1, sizeof(*og->suc));
+    og->done = xcalloc(og->nte + 1, sizeof(*og->done));
+    return og;
 }
 
 /**
  * Record next "q <- p" relation (i.e. "p" requires "q").
- * @param ts		transaction set
+ * @param og		ordering graph
  * @param al		added/erased package index
- * @param p		predecessor (i.e. package that "Requires: q")
- * @param selected	boolean package selected array
+ * @param px		index of package that "Requires: q"
+ * @param who		index of package with the dependency
  * @param requires	relation
- * @return		0 always
  */
-/*@-mustmod@*/
-static inline int addRelation(rpmts ts, rpmal al,
-		/*@dependent@*/ rpmte p,
-		unsigned char * selected,
+static void orderGraphAddRelation(orderGraph og, rpmal al, int px, int who,
 		rpmds requires)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
-	/*@modifies ts, p, *selected, rpmGlobalMacroContext,
-		fileSystem, internalState @*/
+	/*@modifies og, rpmGlobalMacroContext, fileSystem, internalState @*/
 {
-    rpmtsi qi; rpmte q;
-    tsortInfo tsi;
+    rpmts ts = og->ts;
+    rpmte p = og->te[px];
+    rpmte q;
     const char * N = rpmdsN(requires);
-    fnpyKey key;
     int teType = rpmteType(p);
+    struct orderRel_s * rel;
     alKey pkgKey;
-    int i = 0;
+    long kx;
+    int qx;
 
     /* Avoid certain NS dependencies. */
     switch (rpmdsNSType(requires)) {
@@ -653,7 +453,7 @@ static inline int addRelation(rpmts ts, rpmal al,
     case RPMNS_TYPE_SANITY:
     case RPMNS_TYPE_VCHECK:
     case RPMNS_TYPE_SIGNATURE:
-	return 0;
+	return;
 	/*@notreached@*/ break;
     }
 
@@ -662,1422 +462,529 @@ static inline int addRelation(rpmts ts, rpmal al,
 	rpmfi fi = rpmteFI(p, RPMTAG_BASENAMES);
 	rpmbf bf = rpmfiFNBF(fi);
 	if (bf != NULL && rpmbfChk(bf, N, strlen(N)) > 0)
-	    return 0;
+	    return;
     }
 
     pkgKey = RPMAL_NOMATCH;
-    key = rpmalSatisfiesDepend(al, requires, &pkgKey);
+    (void) rpmalSatisfiesDepend(al, requires, &pkgKey);
 
     /* Ordering depends only on added/erased package relations. */
     if (pkgKey == RPMAL_NOMATCH)
-	return 0;
+	return;
 
-/* XXX Set q to the added/removed package that was found. */
     /* XXX pretend erasedPackages are just appended to addedPackages. */
+    kx = (long) pkgKey;
     if (teType == TR_REMOVED)
-	pkgKey = (alKey)(((long)pkgKey) + ts->numAddedPackages);
-
-    for (qi = rpmtsiInit(ts), i = 0; (q = rpmtsiNext(qi, 0)) != NULL; i++) {
-	if (pkgKey == rpmteAddedKey(q))
-	    break;
-    }
-    qi = rpmtsiFree(qi);
-    if (q == NULL || i >= ts->orderCount)
-	return 0;
+	kx += ts->numAddedPackages;
+    if (kx < 0 || kx >= og->nkeys || (qx = og->keyx[kx]) < 0)
+	return;
+    q = og->te[qx];
 
     /* Avoid certain dependency relations. */
     if (ignoreDep(ts, p, q))
-	return 0;
+	return;
 
     /* Avoid redundant relations. */
-    if (selected[i] != 0)
-	return 0;
-    selected[i] = 1;
+    if (og->selected[qx] == px + 1)
+	return;
+    og->selected[qx] = px + 1;
+
+    if (og->nrels == og->allocrels) {
+	og->allocrels = (og->allocrels ? 2 * og->allocrels : 4 * og->nte + 16);
+	og->rels = xrealloc(og->rels, og->allocrels * sizeof(*og->rels));
+    }
+    rel = og->rels + og->nrels++;
+    rel->who = who;
+    rel->tagN = rpmdsTagN(requires);
+    rel->ix = rpmdsIx(requires);
 
     /* Erasures are reversed installs. */
     if (teType == TR_REMOVED) {
 	rpmte r = p;
 	p = q;
 	q = r;
+	rel->q = px;
+	rel->p = qx;
+    } else {
+	rel->q = qx;
+	rel->p = px;
     }
 
-    /* T3. Record next "q <- p" relation (i.e. "p" requires "q"). */
-    rpmteTSI(p)->tsi_count++;			/* bump p predecessor count */
-
     if (rpmteDepth(p) <= rpmteDepth(q))	/* Save max. depth in dependency tree */
 	(void) rpmteSetDepth(p, (rpmteDepth(q) + 1));
     if (rpmteDepth(p) > ts->maxDepth)
 	ts->maxDepth = rpmteDepth(p);
-
-    tsi = xcalloc(1, sizeof(*tsi));
-    tsi->tsi_suc = p;
-
-    tsi->tsi_tagn = rpmdsTagN(requires);
-    tsi->tsi_reqx = rpmdsIx(requires);
-
-    tsi->tsi_next = rpmteTSI(q)->tsi_next;
-    rpmteTSI(q)->tsi_next = tsi;
-    rpmteTSI(q)->tsi_qcnt++;			/* bump q successor count */
-
-    return 0;
-}
-/*@=mustmod@*/
-
-/**
- * Compare ordered list entries by index (qsort/bsearch).
- * @param one		1st ordered list entry
- * @param two		2nd ordered list entry
- * @return		result of comparison
- */
-static int orderListIndexCmp(const void * one, const void * two)	/*@*/
-{
-    /*@-castexpose@*/
-    long a = (long) ((const orderListIndex)one)->pkgKey;
-    long b = (long) ((const orderListIndex)two)->pkgKey;
-    /*@=castexpose@*/
-    return (a - b);
 }
 
-#ifdef	REFERENCE
 /**
- * Add element to list sorting by tsi_qcnt.
- * @param p		new element
- * @retval qp		address of first element
- * @retval rp		address of last element
- * @param prefcolor
+ * Record all relations between transaction elements.
+ * @param og		ordering graph
  */
-static void addQ(tsortInfo p, tsortInfo * qp, tsortInfo * rp,
-		rpm_color_t prefcolor)
+static void orderGraphRelations(orderGraph og)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies og, rpmGlobalMacroContext, fileSystem, internalState @*/
 {
-    tsortInfo q, qprev;
-
-    /* Mark the package as queued. */
-    p->tsi_reqx = 1;
-
-    if ((*rp) == NULL) {	/* 1st element */
-	/* FIX: double indirection */
-	(*rp) = (*qp) = p;
-	return;
-    }
+    rpmts ts = og->ts;
+    struct orderPkgid_s * pkgids;
+    int npkgids = 0;
+    rpmds requires;
+    rpmal al;
+    rpmte p;
+    int px;
 
-    /* Find location in queue using metric tsi_qcnt. */
-    for (qprev = NULL, q = (*qp);
-	 q != NULL;
-	 qprev = q, q = q->tsi_suc)
-    {
-	/* XXX Insure preferred color first. */
-	if (rpmteColor(p->te) != prefcolor && rpmteColor(p->te) != rpmteColor(q->te))
+    /* Index added packages by pkgid for upgrade erasures. */
+    pkgids = xcalloc(og->nte + 1, sizeof(*pkgids));
+    for (px = 0; px < og->nte; px++) {
+	p = og->te[px];
+	if (rpmteType(p) != TR_ADDED || p->pkgid == NULL)
 	    continue;
-
-	if (q->tsi_qcnt <= p->tsi_qcnt)
-	    break;
+	pkgids[npkgids].pkgid = p->pkgid;
+	pkgids[npkgids].x = px;
+	npkgids++;
     }
+    if (npkgids > 1)
+	qsort(pkgids, npkgids, sizeof(*pkgids), orderPkgidCmp);
 
-    if (qprev == NULL) {	/* insert at beginning of list */
-	p->tsi_suc = q;
-	(*qp) = p;		/* new head */
-    } else if (q == NULL) {	/* insert at end of list */
-	qprev->tsi_suc = p;
-	(*rp) = p;		/* new tail */
-    } else {			/* insert between qprev and q */
-	p->tsi_suc = q;
-	qprev->tsi_suc = p;
-    }
-}
-#endif	/* REFERENCE */
+    for (px = 0; px < og->nte; px++) {
+	p = og->te[px];
+	al = (rpmteType(p) == TR_ADDED ? ts->addedPackages : ts->erasedPackages);
 
-/**
- * Add element to list sorting by tsi_qcnt.
- * @param p		new element
+	/* Avoid narcisstic relations. */
+	og->selected[px] = px + 1;
+
+	requires = rpmdsInit(rpmteDS(p, RPMTAG_REQUIRENAME));
+	if (requires != NULL)
+	while (rpmdsNext(requires) >= 0) {
+	    if (!isAuto(rpmdsFlags(requires)))
+		/*@innercontinue@*/ continue;
+	    orderGraphAddRelation(og, al, px, px, requires);
+	}
+
+	/* Ensure that erasures follow installs during upgrades. */
+	if (rpmteType(p) == TR_REMOVED && p->flink.Pkgid && p->flink.Pkgid[0]
+	 && npkgids > 0)
+	{
+	    struct orderPkgid_s key;
+	    struct orderPkgid_s * needle;
+
+	    key.pkgid = p->flink.Pkgid[0];
+	    key.x = -1;
+	    needle = bsearch(&key, pkgids, npkgids, sizeof(key), orderPkgidCmp);
+	    while (needle != NULL && needle > pkgids
+		&& !strcmp(needle[-1].pkgid, key.pkgid))
+		needle--;
+	    for (; needle != NULL && needle < pkgids + npkgids
+		&& !strcmp(needle->pkgid, key.pkgid); needle++)
+	    {
+		rpmte q = og->te[needle->x];
+		requires = rpmdsFromPRCO(q->PRCO, RPMTAG_NAME);
+		if (requires == NULL)
+		    /*@innercontinue@*/ continue;
+		/* XXX disable erased arrow reversal. */
+		p->type = TR_ADDED;
+		orderGraphAddRelation(og, ts->addedPackages, px, needle->x,
+			requires);
+		p->type = TR_REMOVED;
+	    }
+	}
+
+	/* Order by requiring parent directories as prerequisites. */
+	requires = rpmdsInit(rpmteDS(p, RPMTAG_DIRNAMES));
+	if (requires != NULL)
+	while (rpmdsNext(requires) >= 0)
+	    orderGraphAddRelation(og, al, px, px, requires);
+
+	/* Order by requiring no dangling symlinks. */
+	requires = rpmdsInit(rpmteDS(p, RPMTAG_FILELINKTOS));
+	if (requires != NULL)
+	while (rpmdsNext(requires) >= 0)
+	    orderGraphAddRelation(og, al, px, px, requires);
+    }
+
+    pkgids = _free(pkgids);
+}
+
+/**
+ * Compile recorded relations into successor and predecessor arrays.
+ * @param og		ordering graph
+ */
+static void orderGraphCompile(orderGraph og)
+	/*@modifies og @*/
+{
+    int n = og->nte;
+    int * at = xmalloc((n + 1) * sizeof(*at));
+    int r;
+    int x;
+
+    og->succx = xcalloc(n + 1, sizeof(*og->succx));
+    og->predx = xcalloc(n + 1, sizeof(*og->predx));
+    for (r = 0; r < og->nrels; r++) {
+	og->succx[og->rels[r].q + 1]++;
+	og->predx[og->rels[r].p + 1]++;
+    }
+    for (x = 0; x < n; x++) {
+	og->count[x] = og->predx[x + 1];
+	og->qcnt[x] = og->succx[x + 1];
+	og->succx[x + 1] += og->succx[x];
+	og->predx[x + 1] += og->predx[x];
+    }
+
+    og->succ = xmalloc((og->nrels + 1) * sizeof(*og->succ));
+    og->pred = xmalloc((og->nrels + 1) * sizeof(*og->pred));
+    og->zapped = xcalloc(og->nrels + 1, sizeof(*og->zapped));
+
+    /* Successors are visited most recently recorded first (as before). */
+    memcpy(at, og->succx, n * sizeof(*at));
+    for (r = og->nrels - 1; r >= 0; r--)
+	og->succ[at[og->rels[r].q]++] = r;
+    memcpy(at, og->predx, n * sizeof(*at));
+    for (r = 0; r < og->nrels; r++)
+	og->pred[at[og->rels[r].p]++] = r;
+
+    at = _free(at);
+}
+
+/**
+ * Add element to queue sorting by qcnt.
+ * @param og		ordering graph
+ * @param x		new element
  * @retval *qp		first element
  * @retval *rp		last element
  * @param prefcolor	preferred color
  */
-static void addQ(/*@dependent@*/ rpmte p,
-		/*@in@*/ /*@out@*/ rpmte * qp,
-		/*@in@*/ /*@out@*/ rpmte * rp,
+static void orderGraphAddQ(orderGraph og, int x, int * qp, int * rp,
 		rpmuint32_t prefcolor)
-	/*@modifies p, *qp, *rp @*/
+	/*@modifies og, *qp, *rp @*/
 {
-    rpmte q, qprev;
-
-#ifdef	REFERENCE
-    /* Mark the package as queued. */
-    rpmteTSI(p)->tsi_reqx = 1;
-#endif	/* REFERENCE */
+    rpmte p = og->te[x];
+    int qprev;
+    int q;
 
-    if ((*rp) == NULL) {	/* 1st element */
-	(*rp) = (*qp) = p;
+    if ((*rp) < 0) {		/* 1st element */
+	og->suc[x] = -1;
+	(*rp) = (*qp) = x;
 	return;
     }
 
-    /* Find location in queue using metric tsi_qcnt. */
-    for (qprev = NULL, q = (*qp);
-	 q != NULL;
-	 qprev = q, q = rpmteTSI(q)->tsi_suc)
-    {
+    /* Find location in queue using metric qcnt. */
+    for (qprev = -1, q = (*qp); q >= 0; qprev = q, q = og->suc[q]) {
 	/* XXX Insure preferred color first. */
-	if (rpmteColor(p) != prefcolor && rpmteColor(p) != rpmteColor(q))
+	if (rpmteColor(p) != prefcolor && rpmteColor(p) != rpmteColor(og->te[q]))
 	    continue;
 
-#ifdef	REFERENCE
-#else	/* REFERENCE */
 	/* XXX Insure removed after added. */
-	if (rpmteType(p) == TR_REMOVED && rpmteType(p) != rpmteType(q))
+	if (rpmteType(p) == TR_REMOVED && rpmteType(p) != rpmteType(og->te[q]))
 	    continue;
 
 	/* XXX Follow all previous generations in the queue. */
-	if (rpmteTSI(p)->tsi_queued > rpmteTSI(q)->tsi_queued)
+	if (og->queued[x] > og->queued[q])
 	    continue;
-#endif	/* REFERENCE */
 
 	/* XXX Within a generation, queue behind more "important". */
-	if (rpmteTSI(q)->tsi_qcnt <= rpmteTSI(p)->tsi_qcnt)
+	if (og->qcnt[q] <= og->qcnt[x])
 	    break;
     }
 
-    if (qprev == NULL) {	/* insert at beginning of list */
-	rpmteTSI(p)->tsi_suc = q;
-	(*qp) = p;		/* new head */
-    } else if (q == NULL) {	/* insert at end of list */
-	rpmteTSI(qprev)->tsi_suc = p;
-	(*rp) = p;		/* new tail */
-    } else {			/* insert between qprev and q */
-	rpmteTSI(p)->tsi_suc = q;
-	rpmteTSI(qprev)->tsi_suc = p;
-    }
+    og->suc[x] = q;
+    if (qprev < 0)		/* insert at beginning of list */
+	(*qp) = x;
+    else			/* insert after qprev */
+	og->suc[qprev] = x;
+    if (q < 0)			/* new tail */
+	(*rp) = x;
 }
 
-/*@unchecked@*/
-#ifdef	NOTYET
-static rpmuint32_t _autobits = _notpre(_ALL_REQUIRES_MASK);
-#else
-static rpmuint32_t _autobits = 0xffffffff;
-#endif
-#define isAuto(_x)	((_x) & _autobits)
-
-typedef struct sccData_s {
-    int index;			/* DFS node number counter */
-#ifdef	REFERENCE
-    tsortInfo *stack;		/* Stack of nodes */
-#else
-    rpmte * stack;		/* Stack of nodes */
-#endif
-    int stackcnt;		/* Stack top counter */
-    scc SCCs;			/* Array of SCC's found */
-    int sccCnt;			/* Number of SCC's found */
-} * sccData;
-
-#ifdef	REFERENCE
-static void tarjan(sccData sd, tsortInfo tsi)
-{
-    tsortInfo tsi_q;
-    relation rel;
-
-    /* use negative index numbers */
-    sd->index--;
-    /* Set the depth index for p */
-    tsi->tsi_SccIdx = sd->index;
-    tsi->tsi_SccLowlink = sd->index;
-
-    sd->stack[sd->stackcnt++] = tsi;                   /* Push p on the stack */
-    for (rel = tsi->tsi_relations; rel != NULL; rel = rel->rel_next) {
-	/* Consider successors of p */
-	tsi_q = rel->rel_suc;
-	if (tsi_q->tsi_SccIdx > 0)
-	    /* Ignore already found SCCs */
-	    continue;
-	if (tsi_q->tsi_SccIdx == 0) {
-	    /* Was successor q not yet visited? */
-	    tarjan(sd, tsi_q);                       /* Recurse */
-	    /* negative index numbers: use max as it is closer to 0 */
-	    tsi->tsi_SccLowlink = (tsi->tsi_SccLowlink > tsi_q->tsi_SccLowlink)
-		? tsi->tsi_SccLowlink : tsi_q->tsi_SccLowlink;
-	} else {
-	    tsi->tsi_SccLowlink = (tsi->tsi_SccLowlink > tsi_q->tsi_SccIdx)
-		? tsi->tsi_SccLowlink : tsi_q->tsi_SccIdx;
-	}
-    }
-
-    if (tsi->tsi_SccLowlink == tsi->tsi_SccIdx) {
-	/* v is the root of an SCC? */
-	if (sd->stack[sd->stackcnt-1] == tsi) {
-	    /* ignore trivial SCCs */
-	    tsi_q = sd->stack[--sd->stackcnt];
-	    tsi_q->tsi_SccIdx = 1;
-	} else {
-	    int stackIdx = sd->stackcnt;
-	    do {
-		tsi_q = sd->stack[--stackIdx];
-		tsi_q->tsi_SccIdx = sd->sccCnt;
-	    } while (tsi_q != tsi);
-
-	    stackIdx = sd->stackcnt;
-	    do {
-		tsi_q = sd->stack[--stackIdx];
-		/* Calculate count for the SCC */
-		sd->SCCs[sd->sccCnt].count += tsi_q->tsi_count;
-		/* Subtract internal relations */
-		for (rel=tsi_q->tsi_relations; rel != NULL; rel=rel->rel_next) {
-		    if (rel->rel_suc != tsi_q
-		     && rel->rel_suc->tsi_SccIdx == sd->sccCnt)
-			sd->SCCs[sd->sccCnt].count--;
-		}
-	    } while (tsi_q != tsi);
-	    sd->SCCs[sd->sccCnt].size = sd->stackcnt - stackIdx;
-	    /* copy members */
-	    sd->SCCs[sd->sccCnt].members =
-			xcalloc(sd->SCCs[sd->sccCnt].size, sizeof(tsortInfo));
-	    memcpy(sd->SCCs[sd->sccCnt].members, sd->stack + stackIdx,
-		   sd->SCCs[sd->sccCnt].size * sizeof(tsortInfo));
-	    sd->stackcnt = stackIdx;
-	    sd->sccCnt++;
-	}
-    }
-}
-#else	/* REFERENCE */
-static void tarjan(sccData sd, rpmte p)
+/**
+ * Find loops (strongly connected components) among unordered elements.
+ * @param og		ordering graph
+ */
+static void orderGraphLoops(orderGraph og)
+	/*@modifies og @*/
 {
-    tsortInfo tsi = rpmteTSI(p);
-    rpmte q;
-    tsortInfo tsi_q;
-    relation rel;
-
-    /* use negative index numbers */
-    sd->index--;
-    /* Set the depth index for p */
-    tsi->tsi_SccIdx = sd->index;
-    tsi->tsi_SccLowlink = sd->index;
-
-    sd->stack[sd->stackcnt++] = p;                   /* Push p on the stack */
-    for (rel = tsi->tsi_relations; rel != NULL; rel = rel->rel_next) {
-	/* Consider successors of p */
-	q = rel->rel_suc;
-	tsi_q = rpmteTSI(q);
-	if (tsi_q->tsi_SccIdx > 0)
-	    /* Ignore already found SCCs */
+    int n = og->nte;
+    int * idx = xcalloc(n + 1, sizeof(*idx));
+    int * low = xcalloc(n + 1, sizeof(*low));
+    int * stack = xmalloc((n + 1) * sizeof(*stack));
+    int * cs = xmalloc((n + 1) * sizeof(*cs));
+    int * ce = xmalloc((n + 1) * sizeof(*ce));
+    unsigned char * onstack = xcalloc(n + 1, sizeof(*onstack));
+    int nstack = 0;
+    int ncs;
+    int index = 0;
+    int nm = 0;
+    int i, r, s, v, w, x;
+
+    og->sccx = xmalloc((n + 1) * sizeof(*og->sccx));
+    og->sccmx = xmalloc((n + 2) * sizeof(*og->sccmx));
+    og->sccm = xmalloc((n + 1) * sizeof(*og->sccm));
+    for (x = 0; x < n; x++)
+	og->sccx[x] = -1;
+    og->nsccs = 0;
+
+    /* Tarjan's algorithm, with an explicit depth first search stack. */
+    for (x = 0; x < n; x++) {
+	if (og->done[x] || idx[x] != 0)
 	    continue;
-	if (tsi_q->tsi_SccIdx == 0) {
-	    /* Was successor q not yet visited? */
-	    tarjan(sd, q);                       /* Recurse */
-	    /* negative index numbers: use max as it is closer to 0 */
-	    tsi->tsi_SccLowlink = (tsi->tsi_SccLowlink > tsi_q->tsi_SccLowlink)
-		    ? tsi->tsi_SccLowlink : tsi_q->tsi_SccLowlink;
-	} else {
-	    tsi->tsi_SccLowlink = (tsi->tsi_SccLowlink > tsi_q->tsi_SccIdx)
-		    ? tsi->tsi_SccLowlink : tsi_q->tsi_SccIdx;
-	}
-    }
-
-    if (tsi->tsi_SccLowlink == tsi->tsi_SccIdx) {
-	/* v is the root of an SCC? */
-	if (sd->stack[sd->stackcnt-1] == p) {
-	    /* ignore trivial SCCs */
-	    q = sd->stack[--sd->stackcnt];
-	    tsi_q = rpmteTSI(q);
-	    tsi_q->tsi_SccIdx = 1;
-	} else {
-	    int stackIdx = sd->stackcnt;
-	    do {
-		q = sd->stack[--stackIdx];
-		tsi_q = rpmteTSI(q);
-		tsi_q->tsi_SccIdx = sd->sccCnt;
-	    } while (q != p);
-
-	    stackIdx = sd->stackcnt;
-	    do {
-		q = sd->stack[--stackIdx];
-		tsi_q = rpmteTSI(q);
-		/* Calculate count for the SCC */
-		sd->SCCs[sd->sccCnt].count += tsi_q->tsi_count;
-		/* Subtract internal relations */
-		for (rel=tsi_q->tsi_relations; rel != NULL; rel=rel->rel_next) {
-		    if (rel->rel_suc != q
-		     && rpmteTSI(rel->rel_suc)->tsi_SccIdx == sd->sccCnt)
-			sd->SCCs[sd->sccCnt].count--;
-		}
-	    } while (q != p);
-	    sd->SCCs[sd->sccCnt].size = sd->stackcnt - stackIdx;
-	    /* copy members */
-	    sd->SCCs[sd->sccCnt].members =
-			xcalloc(sd->SCCs[sd->sccCnt].size, sizeof(rpmte));
-	    memcpy(sd->SCCs[sd->sccCnt].members, sd->stack + stackIdx,
-		   sd->SCCs[sd->sccCnt].size * sizeof(rpmte));
-	    sd->stackcnt = stackIdx;
-	    sd->sccCnt++;
-	}
-    }
-}
-#endif	/* REFERENCE */
-
-/* Search for SCCs and return an array last entry has a .size of 0 */
-#ifdef	REFERENCE
-static scc detectSCCs(tsortInfo orderInfo, int nelem, int debugloops)
-#else	/* REFERENCE */
-static scc detectSCCs(rpmts ts)
-#endif	/* REFERENCE */
-{
-int nelem = ts->orderCount;
-    scc _SCCs = xcalloc(nelem+3, sizeof(*_SCCs));
-#ifdef	REFERENCE
-    tsortInfo *_stack = xcalloc(nelem, sizeof(*_stack));
-#else
-    rpmte * _stack = xcalloc(nelem , sizeof(*_stack));
-#endif
-    struct sccData_s sd = { 0, _stack, 0, _SCCs, 2 };
-
-#ifdef	REFERENCE
-    for (int i = 0; i < nelem; i++) {
-	tsortInfo tsi = &orderInfo[i];
-	/* Start a DFS at each node */
-	if (tsi->tsi_SccIdx == 0)
-	    tarjan(&sd, tsi);
-    }
-#else	/* REFERENCE */
-    {	rpmtsi pi;
-	rpmte p;
-
-	pi = rpmtsiInit(ts);
-	while ((p = rpmtsiNext(pi, 0)) != NULL) {
-	    /* Start a DFS at each node */
-	    if (rpmteTSI(p)->tsi_SccIdx == 0)
-		tarjan(&sd, p);
-	}
-	pi = rpmtsiFree(pi);
-    }
-#endif	/* REFERENCE */
-
-    sd.stack = _free(sd.stack);
-
-    sd.SCCs = xrealloc(sd.SCCs, (sd.sccCnt+1)*sizeof(*sd.SCCs));
-
-    /* Debug output */
-    if (sd.sccCnt > 2) {
-#ifdef	REFERENCE
-int debugloops = (rpmtsDFlags(ts) & RPMDEPS_FLAG_DEPLOOPS);
-	int msglvl = debugloops ?  RPMLOG_WARNING : RPMLOG_DEBUG;
-#else	/* REFERENCE */
-int debugloops = (rpmtsDFlags(ts) & (RPMDEPS_FLAG_ANACONDA|RPMDEPS_FLAG_DEPLOOPS));
-	rpmlogLvl msglvl = debugloops ? RPMLOG_WARNING : RPMLOG_ERR;
-	int i, j;
-#endif	/* REFERENCE */
-
-	rpmlog(msglvl, "%d Strongly Connected Components\n", sd.sccCnt-2);
-	for (i = 2; i < sd.sccCnt; i++) {
-	    rpmlog(msglvl, "SCC #%d: requires %d packages\n",
-		   i, sd.SCCs[i].count);
-	    /* loop over members */
-	    for (j = 0; j < sd.SCCs[i].size; j++) {
-#ifdef	REFERENCE
-		tsortInfo member = SCCs[i].members[j];
-		rpmlog(msglvl, "\t%s\n", rpmteNEVRA(member->te));
-		/* show relations between members */
-		relation rel = member->tsi_forward_relations;
-		for (; rel != NULL; rel=rel->rel_next) {
-		    if (rel->rel_suc->tsi_SccIdx!=i) continue;
-		    rpmlog(msglvl, "\t\t%s %s\n",
-			   rel->rel_flags ? "=>" : "->",
-			   rpmteNEVRA(rel->rel_suc->te));
-		}
-#else	/* REFERENCE */
-		/* show relations between members */
-		rpmte member = sd.SCCs[i].members[j];
-		rpmlog(msglvl, "\t%s\n", rpmteNEVRA(sd.SCCs[i].members[j]));
-		relation rel = rpmteTSI(member)->tsi_forward_relations;
-		for (; rel != NULL; rel=rel->rel_next) {
-		    if (rpmteTSI(rel->rel_suc)->tsi_SccIdx!=i) continue;
-		    rpmlog(msglvl, "\t\t%s %s\n",
-			   rel->rel_flags ? "=>" : "->",
-			   rpmteNEVRA(rel->rel_suc));
-		}
-#endif	/* REFERENCE */
-	    }
-	}
-    }
-
-    return sd.SCCs;
-}
-
-#ifdef	REFERENCE
-static void collectTE(rpm_color_t prefcolor, tsortInfo q,
-		      rpmte * newOrder, int * newOrderCount,
-		      scc SCCs,
-		      tsortInfo * queue_end,
-		      tsortInfo * outer_queue,
-		      tsortInfo * outer_queue_end)
-{
-    char deptypechar = (rpmteType(q->te) == TR_REMOVED ? '-' : '+');
-
-    if (rpmIsDebug()) {
-	int depth = 1;
-	/* figure depth in tree for nice formatting */
-	for (rpmte p = q->te; (p = rpmteParent(p)); depth++) {}
-	rpmlog(RPMLOG_DEBUG, "%5d%5d%5d%5d %*s%c%s\n",
-	       *newOrderCount, q->tsi_count, q->tsi_qcnt,
-	       depth, (2 * depth), "",
-	       deptypechar, rpmteNEVRA(q->te));
-    }
-
-    newOrder[*newOrderCount] = q->te;
-    (*newOrderCount)++;
-
-    /* T6. Erase relations. */
-    for (relation rel = q->tsi_relations; rel != NULL; rel = rel->rel_next) {
-	tsortInfo p = rel->rel_suc;
-	/* ignore already collected packages */
-	if (p->tsi_SccIdx == 0) continue;
-	if (p == q) continue;
-
-	if (p && (--p->tsi_count) == 0) {
-	    (void) rpmteSetParent(p->te, q->te);
-
-	    if (q->tsi_SccIdx > 1 && q->tsi_SccIdx != p->tsi_SccIdx) {
-                /* Relation point outside of this SCC: add to outside queue */
-		assert(outer_queue != NULL && outer_queue_end != NULL);
-		addQ(p, outer_queue, outer_queue_end, prefcolor);
-	    } else {
-		addQ(p, &q->tsi_suc, queue_end, prefcolor);
-	    }
-	}
-	if (p && p->tsi_SccIdx > 1 &&
-	                 p->tsi_SccIdx != q->tsi_SccIdx) {
-	    if (--SCCs[p->tsi_SccIdx].count == 0) {
-		/* New SCC is ready, add this package as representative */
-		(void) rpmteSetParent(p->te, q->te);
-
-		if (outer_queue != NULL) {
-		    addQ(p, outer_queue, outer_queue_end, prefcolor);
-		} else {
-		    addQ(p, &q->tsi_suc, queue_end, prefcolor);
-		}
-	    }
-	}
-    }
-    q->tsi_SccIdx = 0;
-}
-#endif	/* REFERENCE */
-
-static void collectTE(rpm_color_t prefcolor, rpmte q,
-		      rpmte * newOrder, int * newOrderCount,
-		      scc SCCs,
-		      rpmte * queue_end,
-		      rpmte * outer_queue,
-		      rpmte * outer_queue_end)
-{
-    int treex = rpmteTree(q);
-    int depth = rpmteDepth(q);
-    char deptypechar = (rpmteType(q) == TR_REMOVED ? '-' : '+');
-    tsortInfo tsi = rpmteTSI(q);
-    relation rel;
-
-    rpmlog(RPMLOG_DEBUG, "%5d%5d%5d%5d%5d %*s%c%s\n",
-	   *newOrderCount, rpmteNpreds(q),
-	   rpmteTSI(q)->tsi_qcnt,
-	   treex, depth,
-	   (2 * depth), "",
-	   deptypechar,
-	   (rpmteNEVRA(q) ? rpmteNEVRA(q) : "???"));
-
-    (void) rpmteSetDegree(q, 0);
-
-    newOrder[*newOrderCount] = q;
-    (*newOrderCount)++;
-
-    /* T6. Erase relations. */
-    for (rel = rpmteTSI(q)->tsi_relations; rel != NULL; rel = rel->rel_next) {
-	rpmte p = rel->rel_suc;
-	tsortInfo p_tsi = rpmteTSI(p);
-
-	/* ignore already collected packages */
-	if (p_tsi->tsi_SccIdx == 0) continue;
-	if (p == q) continue;
-
-	if (p && (--p_tsi->tsi_count) == 0) {
-
-	    (void) rpmteSetTree(p, treex);
-	    (void) rpmteSetDepth(p, depth+1);
-	    (void) rpmteSetParent(p, q);
-	    (void) rpmteSetDegree(q, rpmteDegree(q)+1);
-
-	    if (tsi->tsi_SccIdx > 1 && tsi->tsi_SccIdx != p_tsi->tsi_SccIdx) {
-                /* Relation point outside of this SCC: add to outside queue */
-		assert(outer_queue != NULL && outer_queue_end != NULL);
-		addQ(p, outer_queue, outer_queue_end, prefcolor);
-	    } else {
-		addQ(p, &tsi->tsi_suc, queue_end, prefcolor);
-	    }
-	}
-	if (p && p_tsi->tsi_SccIdx > 1 &&
-	                 p_tsi->tsi_SccIdx != rpmteTSI(q)->tsi_SccIdx) {
-	    if (--SCCs[p_tsi->tsi_SccIdx].count == 0) {
-		/* New SCC is ready, add this package as representative */
-
-		(void) rpmteSetTree(p, treex);
-		(void) rpmteSetDepth(p, depth+1);
-		(void) rpmteSetParent(p, q);
-		(void) rpmteSetDegree(q, rpmteDegree(q)+1);
-
-		if (outer_queue != NULL) {
-		    addQ(p, outer_queue, outer_queue_end, prefcolor);
-		} else {
-		    addQ(p, &rpmteTSI(q)->tsi_suc, queue_end, prefcolor);
-		}
-	    }
-	}
-    }
-    tsi->tsi_SccIdx = 0;
-}
-
-#ifdef	REFERENCE
-static void collectSCC(rpm_color_t prefcolor, tsortInfo p_tsi,
-		       rpmte * newOrder, int * newOrderCount,
-		       scc SCCs, tsortInfo * queue_end)
-{
-    int sccNr = p_tsi->tsi_SccIdx;
-    struct scc_s SCC = SCCs[sccNr];
-    int i;
-    int start, end;
-    relation rel;
-
-    /* remove p from the outer queue */
-    tsortInfo outer_queue_start = p_tsi->tsi_suc;
-    p_tsi->tsi_suc = NULL;
-
-    /*
-     * Run a multi source Dijkstra's algorithm to find relations
-     * that can be zapped with least danger to pre reqs.
-     * As weight of the edges is always 1 it is not necessary to
-     * sort the vertices by distance as the queue gets them
-     * already in order
-    */
-
-    /* can use a simple queue as edge weights are always 1 */
-    tsortInfo * queue = xmalloc((SCC.size+1) * sizeof(*queue));
-
-    /*
-     * Find packages that are prerequired and use them as
-     * starting points for the Dijkstra algorithm
-     */
-    start = end = 0;
-    for (i = 0; i < SCC.size; i++) {
-	tsortInfo tsi = SCC.members[i];
-	tsi->tsi_SccLowlink = INT_MAX;
-	for (rel=tsi->tsi_forward_relations; rel != NULL; rel=rel->rel_next) {
-	    if (rel->rel_flags && rel->rel_suc->tsi_SccIdx == sccNr) {
-		if (rel->rel_suc != tsi) {
-		    tsi->tsi_SccLowlink =  0;
-		    queue[end++] = tsi;
-		} else {
-		    tsi->tsi_SccLowlink =  INT_MAX/2;
-		}
-		break;
-	    }
-	}
-    }
-
-    if (start == end) { /* no regular prereqs; add self prereqs to queue */
-	for (i = 0; i < SCC.size; i++) {
-	    tsortInfo tsi = SCC.members[i];
-	    if (tsi->tsi_SccLowlink != INT_MAX) {
-		queue[end++] = tsi;
+	idx[x] = low[x] = ++index;
+	stack[nstack++] = x;
+	onstack[x] = 1;
+	cs[0] = x;
+	ce[0] = og->succx[x];
+	ncs = 1;
+	while (ncs > 0) {
+	    v = cs[ncs - 1];
+	    if (ce[ncs - 1] < og->succx[v + 1]) {
+		r = og->succ[ce[ncs - 1]++];
+		w = og->rels[r].p;
+		if (og->zapped[r] || og->done[w])
+		    /*@innercontinue@*/ continue;
+		if (idx[w] == 0) {
+		    idx[w] = low[w] = ++index;
+		    stack[nstack++] = w;
+		    onstack[w] = 1;
+		    cs[ncs] = w;
+		    ce[ncs] = og->succx[w];
+		    ncs++;
+		} else if (onstack[w] && idx[w] < low[v])
+		    low[v] = idx[w];
+		/*@innercontinue@*/ continue;
 	    }
-	}
-    }
+	    ncs--;
+	    if (ncs > 0 && low[v] < low[cs[ncs - 1]])
+		low[cs[ncs - 1]] = low[v];
+	    if (low[v] != idx[v])
+		/*@innercontinue@*/ continue;
 
-    /* Do Dijkstra */
-    while (start != end) {
-	tsortInfo tsi = queue[start++];
-	for (rel=tsi->tsi_forward_relations; rel != NULL; rel=rel->rel_next) {
-	    tsortInfo next_tsi = rel->rel_suc;
-	    if (next_tsi->tsi_SccIdx != sccNr) continue;
-	    if (next_tsi->tsi_SccLowlink > tsi->tsi_SccLowlink+1) {
-		next_tsi->tsi_SccLowlink = tsi->tsi_SccLowlink + 1;
-		queue[end++] = rel->rel_suc;
+	    /* v is the root of a component, ignore trivial components. */
+	    if (stack[nstack - 1] == v) {
+		onstack[stack[--nstack]] = 0;
+		/*@innercontinue@*/ continue;
 	    }
+	    og->sccmx[og->nsccs] = nm;
+	    do {
+		w = stack[--nstack];
+		onstack[w] = 0;
+		og->sccx[w] = og->nsccs;
+		og->sccm[nm++] = w;
+	    } while (w != v);
+	    og->nsccs++;
 	}
     }
-    queue = _free(queue);
-
-
-    while (1) {
-	tsortInfo best = NULL;
-	tsortInfo inner_queue_start, inner_queue_end;
-	int best_score = 0;
-
-	/* select best candidate to start with */
-	for (int i = 0; i < SCC.size; i++) {
-	    tsortInfo tsi = SCC.members[i];
-	    if (tsi->tsi_SccIdx == 0) /* package already collected */
-		continue;
-	    if (tsi->tsi_SccLowlink >= best_score) {
-		best = tsi;
-		best_score = tsi->tsi_SccLowlink;
-	    }
-	}
-
-	if (best == NULL) /* done */
-	    break;
-
-	/* collect best candidate and all packages that get freed */
-	inner_queue_start = inner_queue_end = NULL;
-	addQ(best, &inner_queue_start, &inner_queue_end, prefcolor);
-
-	for (; inner_queue_start != NULL;
-	     inner_queue_start = inner_queue_start->tsi_suc) {
-	    /* Mark the package as unqueued. */
-	    inner_queue_start->tsi_reqx = 0;
-	    collectTE(prefcolor, inner_queue_start, newOrder, newOrderCount,
-		      SCCs, &inner_queue_end, &outer_queue_start, queue_end);
+    og->sccmx[og->nsccs] = nm;
+
+    /* Count remaining members, and relations from outside, of each loop. */
+    og->sccext = xcalloc(og->nsccs + 1, sizeof(*og->sccext));
+    og->sccleft = xcalloc(og->nsccs + 1, sizeof(*og->sccleft));
+    for (s = 0; s < og->nsccs; s++)
+    for (i = og->sccmx[s]; i < og->sccmx[s + 1]; i++) {
+	x = og->sccm[i];
+	og->sccleft[s]++;
+	for (r = og->predx[x]; r < og->predx[x + 1]; r++) {
+	    int q = og->rels[og->pred[r]].q;
+	    if (og->zapped[og->pred[r]] || og->done[q] || og->sccx[q] == s)
+		/*@innercontinue@*/ continue;
+	    og->sccext[s]++;
 	}
     }
 
-    /* restore outer queue */
-    p_tsi->tsi_suc = outer_queue_start;
+    onstack = _free(onstack);
+    ce = _free(ce);
+    cs = _free(cs);
+    stack = _free(stack);
+    low = _free(low);
+    idx = _free(idx);
 }
-#endif	/* REFERENCE */
 
-static void collectSCC(rpm_color_t prefcolor, rpmte p,
-		       rpmte * newOrder, int * newOrderCount,
-		       scc SCCs, rpmte * queue_end)
+/**
+ * Break a loop by removing the relations that hold back one of its members.
+ * @param og		ordering graph
+ * @param msglvl	message level at which to spew
+ * @return		released element index, -1 if none
+ */
+static int orderGraphBreakLoop(orderGraph og, int msglvl)
+	/*@globals rpmGlobalMacroContext, h_errno, internalState @*/
+	/*@modifies og, rpmGlobalMacroContext, internalState @*/
 {
-    int sccNr = rpmteTSI(p)->tsi_SccIdx;
-    struct scc_s SCC = SCCs[sccNr];
-    int i;
-    int start, end;
-    relation rel;
-
-    /* remove p from the outer queue */
-    rpmte outer_queue_start = rpmteTSI(p)->tsi_suc;
-    rpmteTSI(p)->tsi_suc = NULL;
-
-    /*
-     * Run a multi source Dijkstra's algorithm to find relations
-     * that can be zapped with least danger to pre reqs.
-     * As weight of the edges is always 1 it is not necessary to
-     * sort the vertices by distance as the queue gets them
-     * already in order
-    */
-
-    /* can use a simple queue as edge weights are always 1 */
-    rpmte * queue = xmalloc((SCC.size+1) * sizeof(rpmte));
-
-    /*
-     * Find packages that are prerequired and use them as
-     * starting points for the Dijkstra algorithm
-     */
-    start = end = 0;
-    for (i = 0; i < SCC.size; i++) {
-	rpmte q = SCC.members[i];
-	tsortInfo tsi = rpmteTSI(q);
-	tsi->tsi_SccLowlink = INT_MAX;
-	for (rel=tsi->tsi_forward_relations; rel != NULL; rel=rel->rel_next) {
-	    if (rel->rel_flags && rpmteTSI(rel->rel_suc)->tsi_SccIdx == sccNr) {
-		if (rel->rel_suc != q) {
-		    tsi->tsi_SccLowlink =  0;
-		    queue[end++] = q;
-		} else {
-		    tsi->tsi_SccLowlink =  INT_MAX/2;
-		}
-		break;
-	    }
-	}
-    }
+    int bx = -1;
+    int i, s, x;
 
-    if (start == end) { /* no regular prereqs; add self prereqs to queue */
-	for (i = 0; i < SCC.size; i++) {
-	    rpmte q = SCC.members[i];
-	    tsortInfo tsi = rpmteTSI(q);
-	    if (tsi->tsi_SccLowlink != INT_MAX) {
-		queue[end++] = q;
-	    }
-	}
-    }
+    if (og->sccx == NULL)
+	orderGraphLoops(og);
 
-    /* Do Dijkstra */
-    while (start != end) {
-	rpmte q = queue[start++];
-	tsortInfo tsi = rpmteTSI(q);
-	for (rel=tsi->tsi_forward_relations; rel != NULL; rel=rel->rel_next) {
-	    tsortInfo next_tsi = rpmteTSI(rel->rel_suc);
-	    if (next_tsi->tsi_SccIdx != sccNr) continue;
-	    if (next_tsi->tsi_SccLowlink > tsi->tsi_SccLowlink+1) {
-		next_tsi->tsi_SccLowlink = tsi->tsi_SccLowlink + 1;
-		queue[end++] = rel->rel_suc;
-	    }
-	}
-    }
-    queue = _free(queue);
-
-
-    while (1) {
-	rpmte best = NULL;
-	rpmte inner_queue_start, inner_queue_end;
-	int best_score = 0;
-	int i;
-
-	/* select best candidate to start with */
-	for (i = 0; i < SCC.size; i++) {
-	    rpmte q = SCC.members[i];
-	    tsortInfo tsi = rpmteTSI(q);
-	    if (tsi->tsi_SccIdx == 0) /* package already collected */
-		continue;
-	    if (tsi->tsi_SccLowlink >= best_score) {
-		best = q;
-		best_score = tsi->tsi_SccLowlink;
-	    }
-	}
-
-	if (best == NULL) /* done */
+    /* Find a loop that no other remaining element is a predecessor of. */
+    for (s = 0; s < og->nsccs; s++) {
+	if (og->sccleft[s] > 0 && og->sccext[s] == 0)
 	    break;
-
-	/* collect best candidate and all packages that get freed */
-	inner_queue_start = inner_queue_end = NULL;
-	addQ(best, &inner_queue_start, &inner_queue_end, prefcolor);
-
-	for (; inner_queue_start != NULL;
-	     inner_queue_start = rpmteTSI(inner_queue_start)->tsi_suc) {
-	    /* Mark the package as unqueued. */
-	    rpmteTSI(inner_queue_start)->tsi_reqx = 0;
-	    collectTE(prefcolor, inner_queue_start, newOrder, newOrderCount,
-		      SCCs, &inner_queue_end, &outer_queue_start, queue_end);
-	}
-    }
-
-    /* restore outer queue */
-    rpmteTSI(p)->tsi_suc = outer_queue_start;
-}
-
-#ifdef	REFERENCE
-int rpmtsOrder(rpmts ts)
-{
-    tsMembers tsmem = rpmtsMembers(ts);
-    rpm_color_t prefcolor = rpmtsPrefColor(ts);
-    rpmtsi pi; rpmte p;
-    tsortInfo q, r;
-    rpmte * newOrder;
-    int newOrderCount = 0;
-    int rc;
-    rpmal erasedPackages = rpmalCreate(5, rpmtsColor(ts), prefcolor);
-    scc SCCs;
-    int nelem = rpmtsNElements(ts);
-    tsortInfo sortInfo = xcalloc(nelem, sizeof(struct tsortInfo_s));
-
-    (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
-
-    /* Create erased package index. */
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, TR_REMOVED)) != NULL) {
-        rpmalAdd(erasedPackages, p);
-    }
-    pi = rpmtsiFree(pi);
-
-    for (int i = 0; i < nelem; i++) {
-	sortInfo[i].te = tsmem->order[i];
-	rpmteSetTSI(tsmem->order[i], &sortInfo[i]);
-    }
-
-    /* Record relations. */
-    rpmlog(RPMLOG_DEBUG, "========== recording tsort relations\n");
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL) {
-	rpmal al = (rpmteType(p) == TR_REMOVED) ? 
-		   erasedPackages : tsmem->addedPackages;
-	rpmds requires = rpmdsInit(rpmteDS(p, RPMTAG_REQUIRENAME));
-
-	while (rpmdsNext(requires) >= 0) {
-	    /* Record next "q <- p" relation (i.e. "p" requires "q"). */
-	    (void) addRelation(ts, al, p, requires);
-	}
-    }
-    pi = rpmtsiFree(pi);
-
-    newOrder = xcalloc(tsmem->orderCount, sizeof(*newOrder));
-    SCCs = detectSCCs(sortInfo, nelem, (rpmtsFlags(ts) & RPMTRANS_FLAG_DEPLOOPS));
-
-    rpmlog(RPMLOG_DEBUG, "========== tsorting packages (order, #predecessors, #succesors, depth)\n");
-
-    for (int i = 0; i < 2; i++) {
-	/* Do two separate runs: installs first - then erases */
-	int oType = !i ? TR_ADDED : TR_REMOVED;
-	q = r = NULL;
-	/* Scan for zeroes and add them to the queue */
-	for (int e = 0; e < nelem; e++) {
-	    tsortInfo p = &sortInfo[e];
-	    if (rpmteType(p->te) != oType) continue;
-	    if (p->tsi_count != 0)
-		continue;
-	    p->tsi_suc = NULL;
-	    addQ(p, &q, &r, prefcolor);
-	}
-
-	/* Add one member of each leaf SCC */
-	for (int i = 2; SCCs[i].members != NULL; i++) {
-	    tsortInfo member = SCCs[i].members[0];
-	    if (SCCs[i].count == 0 && rpmteType(member->te) == oType) {
-		addQ(member, &q, &r, prefcolor);
-	    }
-	}
-
-	while (q != NULL) {
-	    /* Mark the package as unqueued. */
-	    q->tsi_reqx = 0;
-	    if (q->tsi_SccIdx > 1) {
-		collectSCC(prefcolor, q, newOrder, &newOrderCount, SCCs, &r);
-	    } else {
-		collectTE(prefcolor, q, newOrder, &newOrderCount, SCCs, &r,
-			  NULL, NULL);
-	    }
-	    q = q->tsi_suc;
-	}
-    }
-
-    /* Clean up tsort data */
-    for (int i = 0; i < nelem; i++) {
-	rpmteSetTSI(tsmem->order[i], NULL);
-	rpmTSIFree(&sortInfo[i]);
-    }
-    free(sortInfo);
-
-    assert(newOrderCount == tsmem->orderCount);
-
-    tsmem->order = _free(tsmem->order);
-    tsmem->order = newOrder;
-    tsmem->orderAlloced = tsmem->orderCount;
-    rc = 0;
-
-    freeBadDeps();
-
-    for (int i = 2; SCCs[i].members != NULL; i++) {
-	free(SCCs[i].members);
     }
-    free(SCCs);
-    rpmalFree(erasedPackages);
-
-    (void) rpmswExit(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
-
-    return rc;
-}
-#endif	/* REFERENCE */
-
-int _orgrpmtsOrder(rpmts ts)
-{
-    rpm_color_t prefcolor = rpmtsPrefColor(ts);
-    rpmtsi pi; rpmte p;
-    rpmte q;
-    rpmte r;
-    rpmte * newOrder;
-    int newOrderCount = 0;
-    int treex;
-    int rc;
-#ifdef	REFERENCE
-    rpmal erasedPackages = rpmalCreate(5, rpmtsColor(ts), prefcolor);
-#endif
-    scc SCCs;
-    int j;
-    int i;
-
-    (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
-
-    /*
-     * XXX FIXME: this gets needlesly called twice on normal usage patterns,
-     * should track the need for generating the index somewhere
-     */
-    rpmalMakeIndex(ts->addedPackages);
-
-    /* Create erased package index. */
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, TR_REMOVED)) != NULL) {
-#ifdef	REFERENCE
-        rpmalAdd(ts->erasedPackages, p);
-#else
-	alKey pkgKey;
-	fnpyKey key;
-	rpmuint32_t tscolor = rpmtsColor(ts);
-	pkgKey = RPMAL_NOMATCH;
-/*@-abstract@*/
-	key = (fnpyKey) p;
-/*@=abstract@*/
-	pkgKey = rpmalAdd(&ts->erasedPackages, pkgKey, key,
-			rpmteDS(p, RPMTAG_PROVIDENAME),
-			rpmteFI(p, RPMTAG_BASENAMES), tscolor);
-	/* XXX pretend erasedPackages are just appended to addedPackages. */
-	pkgKey = (alKey)(((long)pkgKey) + ts->numAddedPackages);
-	(void) rpmteSetAddedKey(p, pkgKey);
-#endif
-    }
-    pi = rpmtsiFree(pi);
-    rpmalMakeIndex(ts->erasedPackages);
-
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL)
-	rpmteNewTSI(p);
-    pi = rpmtsiFree(pi);
-
-    /* Record relations. */
-    rpmlog(RPMLOG_DEBUG, "========== recording tsort relations\n");
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL) {
-	rpmal al = (rpmteType(p) == TR_REMOVED) ? 
-		   ts->erasedPackages : ts->addedPackages;
-	rpmds requires = rpmdsInit(rpmteDS(p, RPMTAG_REQUIRENAME));
-
-	while (rpmdsNext(requires) >= 0) {
-	    /* Record next "q <- p" relation (i.e. "p" requires "q"). */
-	    (void) orgrpmAddRelation(ts, al, p, requires);
-	}
-
-#ifdef	NOTYET
-	/* Ensure that erasures follow installs during upgrades. */
-      if (rpmteType(p) == TR_REMOVED && p->flink.Pkgid && p->flink.Pkgid[0]) {
-	rpmtsi qi;
-
-	qi = rpmtsiInit(ts);
-	while ((q = rpmtsiNext(qi, TR_ADDED)) != NULL) {
-
-	    if (strcmp(q->pkgid, p->flink.Pkgid[0]))
-		/*@innercontinue@*/ continue;
-
-	    requires = rpmdsFromPRCO(q->PRCO, RPMTAG_NAME);
-	    if (requires != NULL) {
-		/* XXX disable erased arrow reversal. */
-		p->type = TR_ADDED;
-		(void) orgrpmAddRelation(ts, ts->addedPackages, p, requires);
-		p->type = TR_REMOVED;
-	    }
-	}
-	qi = rpmtsiFree(qi);
-      }
-#endif	/* NOTYET */
-
-#ifdef	NOTYET
-	/* Order by requiring parent directories as prerequisites. */
-	requires = rpmdsInit(rpmteDS(p, RPMTAG_DIRNAMES));
-	if (requires != NULL)
-	while (rpmdsNext(requires) >= 0) {
-
-#ifdef	DYING
-	    /* XXX Attempt to avoid loops by filtering out deep paths. */
-	    if (countSlashes(rpmdsN(requires)) > slashDepth)
-		/*@innercontinue@*/ continue;
-#endif
-
-	    /* T3. Record next "q <- p" relation (i.e. "p" requires "q"). */
-	    (void) orgrpmAddRelation(ts, al, p, requires);
-
-	}
-#endif	/* NOTYET */
-
-#ifdef	NOTYET
-	/* Order by requiring no dangling symlinks. */
-	requires = rpmdsInit(rpmteDS(p, RPMTAG_FILELINKTOS));
-	if (requires != NULL)
-	while (rpmdsNext(requires) >= 0) {
-
-	    /* T3. Record next "q <- p" relation (i.e. "p" requires "q"). */
-	    (void) orgrpmAddRelation(ts, al, p, requires);
-
-	}
-#endif	/* NOTYET */
+    if (s >= og->nsccs)
+	return -1;
 
+    /* Release the member with the fewest remaining predecessors. */
+    for (i = og->sccmx[s]; i < og->sccmx[s + 1]; i++) {
+	x = og->sccm[i];
+	if (og->done[x])
+	    continue;
+	if (bx < 0 || og->count[x] < og->count[bx]
+	 || (og->count[x] == og->count[bx] && x < bx))
+	    bx = x;
     }
-    pi = rpmtsiFree(pi);
+    if (bx < 0)			/* XXX can't happen */
+	return -1;
 
-    /* Save predecessor count and mark tree roots. */
-    treex = 0;
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL) {
-	int npreds = rpmteTSI(p)->tsi_count;
-
-	(void) rpmteSetNpreds(p, npreds);
-	(void) rpmteSetDepth(p, 1);
+    rpmlog(msglvl, _("LOOP:\n"));
+    for (i = og->predx[bx]; i < og->predx[bx + 1]; i++) {
+	struct orderRel_s * rel = og->rels + og->pred[i];
+	rpmte p = og->te[rel->who];
+	rpmds requires;
+	const char * dp;
 
-	if (npreds == 0)
-	    (void) rpmteSetTree(p, treex++);
-	else
-	    (void) rpmteSetTree(p, -1);
-    }
-    pi = rpmtsiFree(pi);
-    ts->ntrees = treex;
-
-    newOrder = xcalloc(ts->orderCount, sizeof(*newOrder));
-    SCCs = detectSCCs(ts);
-
-    rpmlog(RPMLOG_DEBUG, "========== tsorting packages (order, #predecessors, #succesors, tree, depth)\n");
-
-    for (j = 0; j < 2; j++) {
-	/* Do two separate runs: installs first - then erases */
-	unsigned oType = (j == 0 ? TR_ADDED : TR_REMOVED);
-	q = r = NULL;
-	pi = rpmtsiInit(ts);
-	/* Scan for zeroes and add them to the queue */
-	while ((p = rpmtsiNext(pi, oType)) != NULL) {
-	    if (rpmteTSI(p)->tsi_count != 0)
-		continue;
-	    rpmteTSI(p)->tsi_suc = NULL;
-	    addQ(p, &q, &r, prefcolor);
-	}
-	pi = rpmtsiFree(pi);
-
-	/* Add one member of each leaf SCC */
-	for (i = 2; SCCs[i].members != NULL; i++) {
-	    if (SCCs[i].count == 0 && rpmteType(SCCs[i].members[0]) == oType) {
-		p = SCCs[i].members[0];
-		rpmteTSI(p)->tsi_suc = NULL;
-		addQ(p, &q, &r, prefcolor);
-	    }
-	}
+	if (og->zapped[og->pred[i]] || og->done[rel->q])
+	    continue;
+	og->zapped[og->pred[i]] = 1;
 
-	/* Process queue */
-	for (; q != NULL; q = rpmteTSI(q)->tsi_suc) {
-	    /* Mark the package as unqueued. */
-	    rpmteTSI(q)->tsi_reqx = 0;
-	    if (rpmteTSI(q)->tsi_SccIdx > 1) {
-		collectSCC(prefcolor, q, newOrder, &newOrderCount, SCCs, &r);
-	    } else {
-		collectTE(prefcolor, q, newOrder, &newOrderCount, SCCs, &r,
-			  NULL, NULL);
-	    }
-	}
+	requires = rpmteDS(p, rel->tagN);
+	if (requires == NULL)
+	    continue;
+	(void) rpmdsSetIx(requires, rel->ix);
+	dp = rpmdsNewDNEVR(identifyDepend(rpmdsFlags(requires)), requires);
+	rpmlog(msglvl, _("removing %s \"%s\" from tsort relations.\n"),
+		(rpmteNEVRA(p) ?  rpmteNEVRA(p) : "???"), dp);
+	dp = _free(dp);
     }
+    og->count[bx] = 0;
 
-    /* Clean up tsort data */
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL)
-	rpmteFreeTSI(p);
-    pi = rpmtsiFree(pi);
-
-    assert(newOrderCount == ts->orderCount);
-
-    ts->order = _free(ts->order);
-    ts->order = newOrder;
-    ts->orderAlloced = ts->orderCount;
-    rc = 0;
-
-    for (i = 2; SCCs[i].members != NULL; i++)
-	SCCs[i].members = _free(SCCs[i].members);
-    SCCs = _free(SCCs);
-
-#ifdef	DYING
-    rpmalFree(ts->erasedPackages);
-    ts->erasedPackages = NULL;
-#endif
-    freeBadDeps();
-
-    (void) rpmswExit(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
-
-    return rc;
+    return bx;
 }
 
 int _rpmtsOrder(rpmts ts)
 {
-    rpmds requires;
-    rpmuint32_t Flags;
-
     rpmuint32_t prefcolor = rpmtsPrefColor(ts);
-    rpmtsi pi; rpmte p;
-    rpmtsi qi; rpmte q;
-    rpmtsi ri; rpmte r;
+    int anaconda = rpmtsDFlags(ts) & RPMDEPS_FLAG_ANACONDA;
+    rpmlogLvl msglvl = (anaconda || (rpmtsDFlags(ts) & RPMDEPS_FLAG_DEPLOOPS))
+			? RPMLOG_WARNING : RPMLOG_ERR;
+    orderGraph og;
     rpmte * newOrder;
     int newOrderCount = 0;
-    int treex;
-    int rc = -1;	/* assume failure */
-    int i;
-    int j;
-
-    rpmal al;
-
-#ifdef  REFERENCE
-    rpmal erasedPackages = rpmalCreate(5, rpmtsColor(ts), prefcolor);
-    scc SCCs;
-#else	/* REFERENCE */
-    rpmuint32_t tscolor = rpmtsColor(ts);
-    int anaconda = rpmtsDFlags(ts) & RPMDEPS_FLAG_ANACONDA;
-
-    tsortInfo tsi;
-    tsortInfo tsi_next;
-    alKey * ordering;
-    int orderingCount = 0;
-
-    unsigned char * selected = alloca(sizeof(*selected) * (ts->orderCount + 1));
-    int loopcheck;
-    orderListIndex orderList;
-    int numOrderList;
     int npeer = 128;	/* XXX more than deep enough for now. */
     int * peer = memset(alloca(npeer*sizeof(*peer)), 0, (npeer*sizeof(*peer)));
-    int nrescans = 100;
     int _printed = 0;
     char deptypechar;
     size_t tsbytes = 0;
-    int oType = 0;
+    int loopcheck;
+    int treex;
     int depth;
     int breadth;
-    int qlen;
-#endif	/* REFERENCE */
+    int qlen = 0;
+    int qx, rx, px;
+    int segprev;
+    int rc = -1;	/* assume failure */
+    int i;
+    int x;
 
 if (_rpmts_debug)
 fprintf(stderr, "--> %s(%p) tsFlags 0x%x\n", __FUNCTION__, ts, rpmtsFlags(ts));
 
     (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
 
-    /* Create added package index. */
-#ifdef	REFERENCE
-    rpmalMakeIndex(ts->addedPackages);
-#else
-#endif
-
-    /* Create erased package index. */
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, TR_REMOVED)) != NULL) {
-#ifdef	REFERENCE
-	rpmalAdd(ts->erasedPackages, p);
-#else
-/*@-abstract@*/
-	fnpyKey key = (fnpyKey) p;
-/*@=abstract@*/
-	alKey pkgKey = RPMAL_NOMATCH;
-
-	pkgKey = rpmalAdd(&ts->erasedPackages, pkgKey, key,
-			rpmteDS(p, RPMTAG_PROVIDENAME),
-			rpmteFI(p, RPMTAG_BASENAMES), tscolor);
-	/* XXX pretend erasedPackages are just appended to addedPackages. */
-	pkgKey = (alKey)(((long)pkgKey) + ts->numAddedPackages);
-	(void) rpmteSetAddedKey(p, pkgKey);
-#endif
-    }
-    pi = rpmtsiFree(pi);
-    rpmalMakeIndex(ts->erasedPackages);
-
-    /* T1. Initialize. */
-#ifdef	REFERENCE
-#else
-    if (oType == 0)
-	numOrderList = ts->orderCount;
-    else {
-	numOrderList = 0;
-	if (oType & TR_ADDED)
-	    numOrderList += ts->numAddedPackages;
-	if (oType & TR_REMOVED)
-	    numOrderList += ts->numRemovedPackages;
-     }
-    ordering = alloca(sizeof(*ordering) * (numOrderList + 1));
-    loopcheck = numOrderList;
+#if defined(RPM_VENDOR_MANDRIVA) /* loop-detection-optional-loglevel */
+    // Report loops as debug-level message by default (7 = RPMLOG_DEBUG), overridable
+    msglvl = rpmExpandNumeric("%{?_loop_detection_loglevel}%{?!_loop_detection_loglevel:7}");
 #endif
 
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, oType)) != NULL)
-	rpmteNewTSI(p);
-    pi = rpmtsiFree(pi);
+    orderErasedIndex(ts);
 
     /* Record all relations. */
     rpmlog(RPMLOG_DEBUG, D_("========== recording tsort relations\n"));
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, oType)) != NULL) {
-	al = (rpmteType(p) == TR_ADDED ? ts->addedPackages : ts->erasedPackages);
-
-	/* T2. Next "q <- p" relation. */
-
-#ifdef	REFERENCE
-#else
-	memset(selected, 0, sizeof(*selected) * ts->orderCount);
-
-	/* Avoid narcisstic relations. */
-	selected[rpmtsiOc(pi)] = 1;
-#endif
-
-	requires = rpmteDS(p, RPMTAG_REQUIRENAME);
-	requires = rpmdsInit(requires);
-	if (requires != NULL)
-	while (rpmdsNext(requires) >= 0) {
-
-	    Flags = rpmdsFlags(requires);
-	    if (!isAuto(Flags))
-		/*@innercontinue@*/ continue;
-
-	    /* T3. Record next "q <- p" relation (i.e. "p" requires "q"). */
-#ifdef	REFERENCE
-	    (void) orgrpmAddRelation(ts, al, p, requires);
-#else
-	    (void) addRelation(ts, al, p, selected, requires);
-#endif
-
-	}
-
-#ifdef	REFERENCE
-#else	/* REFERENCE */
-	/* Ensure that erasures follow installs during upgrades. */
-      if (rpmteType(p) == TR_REMOVED && p->flink.Pkgid && p->flink.Pkgid[0]) {
-
-	qi = rpmtsiInit(ts);
-	while ((q = rpmtsiNext(qi, TR_ADDED)) != NULL) {
-
-	    if (strcmp(q->pkgid, p->flink.Pkgid[0]))
-		/*@innercontinue@*/ continue;
-
-	    requires = rpmdsFromPRCO(q->PRCO, RPMTAG_NAME);
-	    if (requires != NULL) {
-		/* XXX disable erased arrow reversal. */
-		p->type = TR_ADDED;
-#ifdef	REFERENCE
-		(void) orgrpmAddRelation(ts, ts->addedPackages, p, requires);
-#else
-		(void) addRelation(ts, ts->addedPackages, p, selected, requires);
-#endif
-		p->type = TR_REMOVED;
-	    }
-	}
-	qi = rpmtsiFree(qi);
-      }
-
-	/* Order by requiring parent directories as prerequisites. */
-	requires = rpmdsInit(rpmteDS(p, RPMTAG_DIRNAMES));
-	if (requires != NULL)
-	while (rpmdsNext(requires) >= 0) {
-
-	    /* T3. Record next "q <- p" relation (i.e. "p" requires "q"). */
-#ifdef	REFERENCE
-	    (void) orgrpmAddRelation(ts, al, p, requires);
-#else
-	    (void) addRelation(ts, al, p, selected, requires);
-#endif
-
-	}
-
-	/* Order by requiring no dangling symlinks. */
-	requires = rpmdsInit(rpmteDS(p, RPMTAG_FILELINKTOS));
-	if (requires != NULL)
-	while (rpmdsNext(requires) >= 0) {
-
-	    /* T3. Record next "q <- p" relation (i.e. "p" requires "q"). */
-#ifdef	REFERENCE
-	    (void) orgrpmAddRelation(ts, al, p, requires);
-#else
-	    (void) addRelation(ts, al, p, selected, requires);
-#endif
-
-	}
-#endif	/* REFERENCE */
-    }
-    pi = rpmtsiFree(pi);
+    og = orderGraphNew(ts);
+    orderGraphRelations(og);
+    orderGraphCompile(og);
 
     /* Save predecessor count and mark tree roots. */
     treex = 0;
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, oType)) != NULL) {
-	int npreds = rpmteTSI(p)->tsi_count;
+    for (x = 0; x < og->nte; x++) {
+	rpmte p = og->te[x];
 
-	(void) rpmteSetNpreds(p, npreds);
-#ifdef	REFERENCE
-	(void) rpmteSetDepth(p, 1);
-#else
+	(void) rpmteSetNpreds(p, og->count[x]);
 	(void) rpmteSetDepth(p, 0);
-#endif
+	(void) rpmteSetWave(p, 0);
 
-	if (npreds == 0) {
-#ifdef	REFERENCE
-	    (void) rpmteSetTree(p, treex++);
-#else
+	if (og->count[x] == 0) {
 	    (void) rpmteSetTree(p, ++treex);
 	    (void) rpmteSetBreadth(p, treex);
-#endif
 	} else
 	    (void) rpmteSetTree(p, -1);
-#ifdef	UNNECESSARY
-	(void) rpmteSetParent(p, NULL);
-#endif
 
+	/* Prefer packages in chainsaw or anaconda presentation order. */
+	if (anaconda)
+	    og->qcnt[x] = (og->nte - x);
     }
-    pi = rpmtsiFree(pi);
     ts->ntrees = treex;
 
-#ifdef	REFERENCE
-    /* Remove dependency loops. */
-    newOrder = xcalloc(ts->orderCount, sizeof(*newOrder));
-    SCCs = detectSCCs(ts);
-#endif
-
     /* T4. Scan for zeroes. */
     rpmlog(RPMLOG_DEBUG, D_("========== tsorting packages (order, #predecessors, #succesors, tree, Ldepth, Rbreadth)\n"));
 
-#ifdef	REFERENCE
-  for (j = 0; j < 2; j++) {
-    /* Do two separate runs: installs first - then erases */
-    unsigned oType = (j == 0 ? TR_ADDED : TR_REMOVED);
-
-#else
-rescan:
-    if (pi != NULL) pi = rpmtsiFree(pi);
-#endif
-    q = r = NULL;
-    qlen = 0;
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, oType)) != NULL) {
-
-	/* Prefer packages in chainsaw or anaconda presentation order. */
-	if (anaconda)
-	    rpmteTSI(p)->tsi_qcnt = (ts->orderCount - rpmtsiOc(pi));
-
-	if (rpmteTSI(p)->tsi_count != 0)
+    newOrder = xcalloc(og->nte + 1, sizeof(*newOrder));
+    loopcheck = og->nte;
+    qx = rx = -1;
+    for (x = 0; x < og->nte; x++) {
+	if (og->count[x] != 0)
 	    continue;
-
 	/* Mark the package as queued. */
-	rpmteTSI(p)->tsi_queued = orderingCount + 1;
-	rpmteTSI(p)->tsi_suc = NULL;
-	addQ(p, &q, &r, prefcolor);
+	og->queued[x] = newOrderCount + 1;
+	orderGraphAddQ(og, x, &qx, &rx, prefcolor);
 	qlen++;
     }
-    pi = rpmtsiFree(pi);
 
-    /* T5. Output front of queue (T7. Remove from queue.) */
-    for (; q != NULL; q = rpmteTSI(q)->tsi_suc) {
-
-	/* Mark the package as unqueued. */
-	rpmteTSI(q)->tsi_queued = 0;
-
-	if (oType != 0)
-	switch (rpmteType(q)) {
-	case TR_ADDED:
-	    if (!(oType & TR_ADDED))
-		continue;
-	    /*@switchbreak@*/ break;
-	case TR_REMOVED:
-	    if (!(oType & TR_REMOVED))
-		continue;
-	    /*@switchbreak@*/ break;
-	default:
-	    continue;
-	    /*@notreached@*/ /*@switchbreak@*/ break;
-	}
-	deptypechar = (rpmteType(q) == TR_REMOVED ? '-' : '+');
+    while (qx >= 0) {
 
-	treex = rpmteTree(q);
-	depth = rpmteDepth(q);
-	breadth = ((depth < npeer) ? peer[depth]++ : 0);
-	(void) rpmteSetBreadth(q, breadth);
+	/* T5. Output front of queue (T7. Remove from queue.) */
+	for (; qx >= 0; qx = og->suc[qx]) {
+	    rpmte q = og->te[qx];
 
-	rpmlog(RPMLOG_DEBUG, "%5d%5d%5d%5d%5d%5d %*s%c%s\n",
-			orderingCount, rpmteNpreds(q),
-			rpmteTSI(q)->tsi_qcnt,
+	    /* Mark the package as unqueued. */
+	    og->queued[qx] = 0;
+	    og->done[qx] = 1;
+	    if (og->sccx != NULL && og->sccx[qx] >= 0)
+		og->sccleft[og->sccx[qx]]--;
+
+	    deptypechar = (rpmteType(q) == TR_REMOVED ? '-' : '+');
+	    treex = rpmteTree(q);
+	    depth = rpmteDepth(q);
+	    breadth = ((depth < npeer) ? peer[depth]++ : 0);
+	    (void) rpmteSetBreadth(q, breadth);
+
+	    rpmlog(RPMLOG_DEBUG, "%5d%5d%5d%5d%5d%5d %*s%c%s\n",
+			newOrderCount, rpmteNpreds(q),
+			og->qcnt[qx],
 			treex, depth, breadth,
 			(2 * depth), "",
 			deptypechar,
 			(rpmteNEVRA(q) ? rpmteNEVRA(q) : "???"));
 
-	(void) rpmteSetDegree(q, 0);
-	tsbytes += rpmtePkgFileSize(q);
+	    (void) rpmteSetDegree(q, 0);
+	    tsbytes += rpmtePkgFileSize(q);
 
-	ordering[orderingCount] = rpmteAddedKey(q);
-	orderingCount++;
-	qlen--;
-	loopcheck--;
+	    newOrder[newOrderCount++] = q;
+	    qlen--;
+	    loopcheck--;
 
-	/* T6. Erase relations. */
-	tsi_next = rpmteTSI(q)->tsi_next;
-	rpmteTSI(q)->tsi_next = NULL;
-	while ((tsi = tsi_next) != NULL) {
-	    tsi_next = tsi->tsi_next;
-	    tsi->tsi_next = NULL;
-	    p = tsi->tsi_suc;
-	    if (p && (--rpmteTSI(p)->tsi_count) <= 0) {
+	    /* T6. Erase relations, queueing behind all previous generations. */
+	    segprev = rx;
+	    for (i = og->succx[qx]; i < og->succx[qx + 1]; i++) {
+		int r = og->succ[i];
+		rpmte p;
+
+		if (og->zapped[r])
+		    /*@innercontinue@*/ continue;
+		px = og->rels[r].p;
+		p = og->te[px];
+		if (rpmteWave(p) <= rpmteWave(q))
+		    (void) rpmteSetWave(p, rpmteWave(q) + 1);
+		if (og->sccx != NULL && og->sccx[px] >= 0
+		 && og->sccx[px] != og->sccx[qx])
+		    og->sccext[og->sccx[px]]--;
+		if (--og->count[px] != 0)
+		    /*@innercontinue@*/ continue;
 
 		(void) rpmteSetTree(p, treex);
 		(void) rpmteSetDepth(p, depth+1);
@@ -2085,193 +992,49 @@ rescan:
 		(void) rpmteSetDegree(q, rpmteDegree(q)+1);
 
 		/* Mark the package as queued. */
-		rpmteTSI(p)->tsi_queued = orderingCount + 1;
-		/* XXX TODO: add control bit. */
-		rpmteTSI(p)->tsi_suc = NULL;
-/*@-nullstate@*/	/* XXX FIX: rpmteTSI(q)->tsi_suc can be NULL. */
-		addQ(p, &rpmteTSI(q)->tsi_suc, &r, prefcolor);
-/*@=nullstate@*/
+		og->queued[px] = newOrderCount + 1;
+		orderGraphAddQ(og, px, &og->suc[segprev], &rx, prefcolor);
 		qlen++;
 	    }
-	    tsi = _free(tsi);
-	}
-	if (!_printed && loopcheck == qlen && rpmteTSI(q)->tsi_suc != NULL) {
-	    _printed++;
-	    (void) rpmtsUnorderedSuccessors(ts, orderingCount);
-	    rpmlog(RPMLOG_DEBUG,
-		D_("========== successors only (%d bytes)\n"), (int)tsbytes);
-
-	    /* Relink the queue in presentation order. */
-	    tsi = rpmteTSI(q);
-	    pi = rpmtsiInit(ts);
-	    while ((p = rpmtsiNext(pi, oType)) != NULL) {
-		/* Is this element in the queue? */
-		if (rpmteTSI(p)->tsi_queued == 0)
-		    /*@innercontinue@*/ continue;
-		tsi->tsi_suc = p;
-		tsi = rpmteTSI(p);
-	    }
-	    pi = rpmtsiFree(pi);
-	    tsi->tsi_suc = NULL;
-	}
-    }
-#ifdef	REFERENCE
-  }
-#else	/* REFERENCE */
-    /* T8. End of process. Check for loops. */
-    if (loopcheck != 0) {
-	int nzaps;
-
-	/* T9. Initialize predecessor chain. */
-	nzaps = 0;
-	qi = rpmtsiInit(ts);
-	while ((q = rpmtsiNext(qi, oType)) != NULL) {
-	    rpmteTSI(q)->tsi_chain = NULL;
-	    rpmteTSI(q)->tsi_queued = 0;
-	    /* Mark packages already sorted. */
-	    if (rpmteTSI(q)->tsi_count == 0)
-		rpmteTSI(q)->tsi_count = -1;
-	}
-	qi = rpmtsiFree(qi);
-
-	/* T10. Mark all packages with their predecessors. */
-	qi = rpmtsiInit(ts);
-	while ((q = rpmtsiNext(qi, oType)) != NULL) {
-	    if ((tsi = rpmteTSI(q)->tsi_next) == NULL)
-		continue;
-	    rpmteTSI(q)->tsi_next = NULL;
-	    markLoop(tsi, q);
-	    rpmteTSI(q)->tsi_next = tsi;
-	}
-	qi = rpmtsiFree(qi);
-
-	/* T11. Print all dependency loops. */
-	ri = rpmtsiInit(ts);
-	while ((r = rpmtsiNext(ri, oType)) != NULL)
-	{
-	    int printed;
 
-	    printed = 0;
-
-	    /* T12. Mark predecessor chain, looking for start of loop. */
-	    for (q = rpmteTSI(r)->tsi_chain; q != NULL;
-		 q = rpmteTSI(q)->tsi_chain)
-	    {
-		if (rpmteTSI(q)->tsi_queued)
-		    /*@innerbreak@*/ break;
-		rpmteTSI(q)->tsi_queued = 1;
-	    }
-
-	    /* T13. Print predecessor chain from start of loop. */
-	    while ((p = q) != NULL && (q = rpmteTSI(p)->tsi_chain) != NULL) {
-#if 0
-		const char * nevra;
-#endif
-		const char * dp;
-		rpmlogLvl msglvl = (anaconda || (rpmtsDFlags(ts) & RPMDEPS_FLAG_DEPLOOPS))
-			? RPMLOG_WARNING : RPMLOG_ERR;
-#if defined(RPM_VENDOR_MANDRIVA) /* loop-detection-optional-loglevel */
-		// Report loops as debug-level message by default (7 = RPMLOG_DEBUG), overridable
-		msglvl = rpmExpandNumeric("%{?_loop_detection_loglevel}%{?!_loop_detection_loglevel:7}");
-#endif
-
-		/* Unchain predecessor loop. */
-		rpmteTSI(p)->tsi_chain = NULL;
-
-		if (!printed) {
-		    rpmlog(msglvl, _("LOOP:\n"));
-		    printed = 1;
+	    if (!_printed && loopcheck == qlen && og->suc[qx] >= 0) {
+		_printed++;
+		(void) rpmtsUnorderedSuccessors(ts, newOrderCount);
+		rpmlog(RPMLOG_DEBUG,
+		    D_("========== successors only (%d bytes)\n"), (int)tsbytes);
+
+		/* Relink the queue in presentation order. */
+		rx = qx;
+		for (x = 0; x < og->nte; x++) {
+		    /* Is this element in the queue? */
+		    if (og->queued[x] == 0)
+			/*@innercontinue@*/ continue;
+		    og->suc[rx] = x;
+		    rx = x;
 		}
-
-		/* Find (and destroy if co-requisite) "q <- p" relation. */
-		dp = zapRelation(q, p, 1, &nzaps, msglvl);
-
-#if 0
-		/* Print next member of loop. */
-		nevra = rpmteNEVRA(p);
-		rpmlog(msglvl, "    %-40s %s\n", (nevra ? nevra : "???"),
-			(dp ? dp : "not found!?!"));
-#endif
-
-		dp = _free(dp);
-	    }
-
-	    /* Walk (and erase) linear part of predecessor chain as well. */
-	    for (p = r, q = rpmteTSI(r)->tsi_chain; q != NULL;
-		 p = q, q = rpmteTSI(q)->tsi_chain)
-	    {
-		/* Unchain linear part of predecessor loop. */
-		rpmteTSI(p)->tsi_chain = NULL;
-		rpmteTSI(p)->tsi_queued = 0;
+		og->suc[rx] = -1;
 	    }
 	}
-	ri = rpmtsiFree(ri);
 
-	/* If a relation was eliminated, then continue sorting. */
-	/* XXX TODO: add control bit. */
-	if (nzaps && nrescans-- > 0) {
-	    rpmlog(RPMLOG_DEBUG, D_("========== continuing tsort ...\n"));
-	    goto rescan;
-	}
+	/* T8. End of process. Break a loop (if any) and continue sorting. */
+	if (loopcheck == 0)
+	    break;
+	rx = -1;
+	if ((x = orderGraphBreakLoop(og, msglvl)) < 0)
+	    break;
+	og->queued[x] = newOrderCount + 1;
+	orderGraphAddQ(og, x, &qx, &rx, prefcolor);
+	qlen++;
+    }
 
+    if (loopcheck != 0) {	/* XXX can't happen */
 	/* Return no. of packages that could not be ordered. */
 	rpmlog(RPMLOG_ERR, _("rpmtsOrder failed, %d elements remain\n"),
 			loopcheck);
-
-#ifdef	NOTYET
-	/* Do autorollback goal since we could not sort this transaction properly. */
-	(void) rpmtsRollback(ts, RPMPROB_FILTER_NONE, 0, NULL);
-#endif
-
-	return loopcheck;
-    }
-#endif	/* REFERENCE */
-
-    /* Clean up tsort remnants (if any). */
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, 0)) != NULL)
-	rpmteFreeTSI(p);
-    pi = rpmtsiFree(pi);
-
-#ifdef	REFERENCE
-#else	/* REFERENCE */
-    /* The order ends up as installed packages followed by removed packages. */
-    orderList = xcalloc(numOrderList, sizeof(*orderList));
-    j = 0;
-    pi = rpmtsiInit(ts);
-    while ((p = rpmtsiNext(pi, oType)) != NULL) {
-	/* Prepare added/erased package ordering permutation. */
-	orderList[j].pkgKey = rpmteAddedKey(p);
-	orderList[j].orIndex = rpmtsiOc(pi);
-	j++;
+	newOrder = _free(newOrder);
+	rc = loopcheck;
+	goto exit;
     }
-    pi = rpmtsiFree(pi);
-
-    qsort(orderList, numOrderList, sizeof(*orderList), orderListIndexCmp);
-
-/*@-type@*/
-    newOrder = xcalloc(ts->orderCount, sizeof(*newOrder));
-/*@=type@*/
-    for (i = 0, newOrderCount = 0; i < orderingCount; i++)
-    {
-	struct orderListIndex_s key;
-	orderListIndex needle;
-
-	key.pkgKey = ordering[i];
-	needle = bsearch(&key, orderList, numOrderList,
-				sizeof(key), orderListIndexCmp);
-	if (needle == NULL)	/* XXX can't happen */
-	    continue;
-
-	j = needle->orIndex;
-	if ((q = ts->order[j]) == NULL || needle->pkgKey == RPMAL_NOMATCH)
-	    continue;
-
-	newOrder[newOrderCount++] = q;
-	ts->order[j] = NULL;
-    }
-    orderList = _free(orderList);
-#endif	/* REFERENCE */
 
 assert(newOrderCount == ts->orderCount);
     rc = 0;
@@ -2281,20 +1044,10 @@ assert(newOrderCount == ts->orderCount);
 /*@=voidabstract@*/
     ts->order = newOrder;
     ts->orderAlloced = ts->orderCount;
+    orderWaves(ts);
 
-#ifdef	REFERENCE
-    for (i = 2; SCCs[i].members != NULL; i++)
-	SCCs[i].members = _free(SCCs[i].members);
-    SCCs = _free(SCCs);
-
-    rpmalFree(ts->erasedPackages);
-    ts->erasedPackages = NULL;
-#else	/* REFERENCE */
-#ifdef	DYING	/* XXX now done at the CLI level just before rpmtsRun(). */
-    rpmtsClean(ts);
-#endif
-#endif	/* REFERENCE */
-
+exit:
+    og = orderGraphFree(og);
     freeBadDeps();
 
     (void) rpmswExit(rpmtsOp(ts, RPMTS_OP_ORDER), 0);
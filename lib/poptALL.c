@@ -20,6 +20,7 @@ const char *__localedir = LOCALEDIR;
 #include <fts.h>
 #include <mire.h>
 #include <poptIO.h>
+#include <rpmstrpool.h>
 
 #include <rpmjs.h>
 #include <rpmruby.h>
@@ -67,6 +68,8 @@ extern int _fsm_threads;
 /*@unchecked@*/
 extern int _hdr_debug;
 /*@unchecked@*/
+extern int _hdr_lazy;
+/*@unchecked@*/
 extern int _hdrqf_debug;
 
 /*@unchecked@*/
@@ -95,6 +98,8 @@ extern rpmioPool _rpmalPool;
 extern int _rpmds_debug;
 /*@unchecked@*/
 extern rpmioPool _rpmdsPool;
+/*@unchecked@*/
+extern rpmstrPool _rpmdsStrPool;
 
 /*@unchecked@*/
        int _rpmfc_debug;
@@ -441,6 +446,10 @@ struct poptOption rpmcliAllPoptTable[] = {
 	NULL, NULL},
  { "hdrqfdebug", '\0', POPT_ARG_VAL|POPT_ARGFLAG_DOC_HIDDEN, &_hdrqf_debug, -1,
 	NULL, NULL},
+ { "hdrlazy", '\0', POPT_ARG_VAL|POPT_ARGFLAG_DOC_HIDDEN, &_hdr_lazy, 1,
+	N_("Decode header tags only when they are used"), NULL},
+ { "nohdrlazy", '\0', POPT_ARG_VAL|POPT_ARGFLAG_DOC_HIDDEN, &_hdr_lazy, 0,
+	N_("Decode all header tags when a header is loaded"), NULL},
  { "macrosused", '\0', POPT_ARG_VAL|POPT_ARGFLAG_DOC_HIDDEN, &_rpmts_macros, -1,
 	N_("Display macros used"), NULL},
  { "pkgiodebug", '\0', POPT_ARG_VAL|POPT_ARGFLAG_DOC_HIDDEN, &_pkgio_debug, -1,
@@ -532,6 +541,7 @@ rpmcliFini(poptContext optCon)
     rpmnsClean();
 
     _rpmdsPool = rpmioFreePool(_rpmdsPool);
+    _rpmdsStrPool = rpmstrPoolFree(_rpmdsStrPool);
     _rpmfiPool = rpmioFreePool(_rpmfiPool);
 
     _rpmwfPool = rpmioFreePool(_rpmwfPool);
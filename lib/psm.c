@@ -1712,6 +1712,7 @@ static const char * pkgStageString(pkgStage a)
     case PSM_IMMED_TRIGGERS:	return "immedtriggers";
 
     case PSM_RPMIO_FLAGS:	return "rpmioflags";
+    case PSM_UNPACK:		return "unpack";
 
     case PSM_RPMDB_LOAD:	return "rpmdbload";
     case PSM_RPMDB_ADD:		return "rpmdbadd";
@@ -1735,6 +1736,17 @@ void rpmpsmSetAsync(rpmpsm psm, int async)
 #endif
 }
 
+void rpmpsmSetGoal(rpmpsm psm, pkgStage goal)
+{
+    assert(psm != NULL);
+    psm->goal = goal;
+    psm->rc = RPMRC_OK;
+    psm->unpackrc = 0;
+    memset(psm->unpackops, 0, sizeof(psm->unpackops));
+    psm->flags &= ~RPMPSM_FLAGS_UNPACKED;
+    psm->stepName = pkgStageString(goal);
+}
+
 rpmRC rpmpsmScriptStage(rpmpsm psm, rpmTag scriptTag, rpmTag progTag)
 {
 assert(psm != NULL);
@@ -2589,41 +2601,20 @@ assert(psm->te != NULL);
 		break;
 	    }
 
-	    /* Retrieve type of payload compression. */
-	    rc = rpmpsmNext(psm, PSM_RPMIO_FLAGS);
-
-	    if (rpmteFd(fi->te) == NULL) {	/* XXX can't happen */
-		rc = RPMRC_FAIL;
-		break;
-	    }
-
-	    /*@-nullpass@*/	/* LCL: fi->fd != NULL here. */
-	    psm->cfd = Fdopen(fdDup(Fileno(rpmteFd(fi->te))), psm->rpmio_flags);
-	    /*@=nullpass@*/
-	    if (psm->cfd == NULL) {	/* XXX can't happen */
-		rc = RPMRC_FAIL;
-		break;
+	    if (F_ISSET(psm, UNPACKED)) {
+		/* The payload was unpacked (concurrently) ahead of time. */
+		psm->what = RPMCALLBACK_INST_START;
+		psm->amount = 0;
+		psm->total = (fi->archiveSize ? fi->archiveSize : 100);
+		xx = rpmpsmNext(psm, PSM_NOTIFY);
+		rc = psm->unpackrc;
+	    } else {
+		xx = rpmtxnBegin(rpmtsGetRdb(ts), psm->te->txn, NULL);
+		rc = rpmpsmNext(psm, PSM_UNPACK);
 	    }
-
-	    xx = rpmtxnBegin(rpmtsGetRdb(ts), psm->te->txn, NULL);
-
-	    rc = fsmSetup(fi->fsm, IOSM_PKGINSTALL, psm->payload_format, ts, fi,
-			psm->cfd, NULL, &psm->failedFile);
-	    (void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_UNCOMPRESS),
-			fdstat_op(psm->cfd, FDSTAT_READ));
-	    (void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_DIGEST),
-			fdstat_op(psm->cfd, FDSTAT_DIGEST));
-	    xx = fsmTeardown(fi->fsm);
-
-	    saveerrno = errno; /* XXX FIXME: Fclose with libio destroys errno */
-	    xx = Fclose(psm->cfd);
-	    psm->cfd = NULL;
-	    /*@-mods@*/
-	    errno = saveerrno; /* XXX FIXME: Fclose with libio destroys errno */
-	    /*@=mods@*/
-
-	    if (!rc)
-		rc = rpmpsmNext(psm, PSM_COMMIT);
+	    (void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_UNCOMPRESS), &psm->unpackops[0]);
+	    (void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_DIGEST), &psm->unpackops[1]);
+	    memset(psm->unpackops, 0, sizeof(psm->unpackops));
 
 	    /* Commit/abort the SRPM install transaction. */
 	    /* XXX move into the PSM package state machine w PSM_COMMIT */
@@ -2882,9 +2873,7 @@ assert(psm->te != NULL);
     case PSM_PKGINSTALL:
     case PSM_PKGERASE:
     case PSM_PKGSAVE:
-	psm->goal = stage;
-	psm->rc = RPMRC_OK;
-	psm->stepName = pkgStageString(stage);
+	rpmpsmSetGoal(psm, stage);
 
 	rc = rpmpsmNext(psm, PSM_INIT);
 	if (!rc) rc = rpmpsmNext(psm, PSM_PRE);
@@ -2906,14 +2895,64 @@ assert(psm->te != NULL);
     case PSM_DESTROY:
 	break;
     case PSM_COMMIT:
-	if (!(rpmtsFlags(ts) & RPMTRANS_FLAG_PKGCOMMIT)) break;
+	if (!(rpmtsFlags(ts) & RPMTRANS_FLAG_PKGCOMMIT)
+	 && rpmtsGetSyncMode(ts) != RPMTS_SYNC_PACKAGE) break;
 	if (rpmtsFlags(ts) & RPMTRANS_FLAG_APPLYONLY) break;
 
+	/* Make the package data durable before renaming it into place. */
+	if (rpmtsGetSyncMode(ts) == RPMTS_SYNC_PACKAGE && rpmtsSync(ts)) {
+	    rc = RPMRC_FAIL;
+	    break;
+	}
+
 	rc = fsmSetup(fi->fsm, IOSM_PKGCOMMIT, psm->payload_format, ts, fi,
 			NULL, NULL, &psm->failedFile);
 	xx = fsmTeardown(fi->fsm);
 	break;
 
+    case PSM_UNPACK:
+	if (rpmtsFlags(ts) & RPMTRANS_FLAG_TEST)	break;
+	if (rpmtsFlags(ts) & RPMTRANS_FLAG_JUSTDB)	break;
+	if (psm->goal != PSM_PKGINSTALL || rpmfiFC(fi) <= 0)	break;
+
+	/* Retrieve type of payload compression. */
+	rc = rpmpsmNext(psm, PSM_RPMIO_FLAGS);
+
+	if (rpmteFd(fi->te) == NULL) {	/* XXX can't happen */
+	    rc = RPMRC_FAIL;
+	    goto unpacked;
+	}
+
+	/*@-nullpass@*/	/* LCL: fi->fd != NULL here. */
+	psm->cfd = Fdopen(fdDup(Fileno(rpmteFd(fi->te))), psm->rpmio_flags);
+	/*@=nullpass@*/
+	if (psm->cfd == NULL) {	/* XXX can't happen */
+	    rc = RPMRC_FAIL;
+	    goto unpacked;
+	}
+
+	rc = fsmSetup(fi->fsm, IOSM_PKGINSTALL, psm->payload_format, ts, fi,
+			psm->cfd, NULL, &psm->failedFile);
+	/* The ts op counters are added (serially) by PSM_PROCESS. */
+	(void) rpmswAdd(&psm->unpackops[0], fdstat_op(psm->cfd, FDSTAT_READ));
+	(void) rpmswAdd(&psm->unpackops[1], fdstat_op(psm->cfd, FDSTAT_DIGEST));
+	xx = fsmTeardown(fi->fsm);
+
+	saveerrno = errno; /* XXX FIXME: Fclose with libio destroys errno */
+	xx = Fclose(psm->cfd);
+	psm->cfd = NULL;
+	/*@-mods@*/
+	errno = saveerrno; /* XXX FIXME: Fclose with libio destroys errno */
+	/*@=mods@*/
+
+	if (!rc)
+	    rc = rpmpsmNext(psm, PSM_COMMIT);
+
+unpacked:
+	psm->unpackrc = rc;
+	F_SET(psm, UNPACKED);
+	break;
+
     case PSM_CHROOT_IN:
     {	const char * rootDir = rpmtsRootDir(ts);
 	/* Change root directory if requested and not already done. */
@@ -55,6 +55,7 @@ typedef enum pkgStage_e {
     PSM_TRIGGERS	= 54,
     PSM_IMMED_TRIGGERS	= 55,
     PSM_RPMIO_FLAGS	= 56,
+    PSM_UNPACK		= 57,
 
     PSM_RPMDB_LOAD	= 97,
     PSM_RPMDB_ADD	= 98,
@@ -75,6 +76,7 @@ typedef enum rpmpsmFlags_e {
     RPMPSM_FLAGS_CHROOTDONE	= (1 << 1), /*!< Was chroot(2) done? */
     RPMPSM_FLAGS_UNORDERED	= (1 << 2), /*!< Are all pre-requsites done? */
     RPMPSM_FLAGS_GOTTRIGGERS	= (1 << 3), /*!< Triggers were retrieved? */
+    RPMPSM_FLAGS_UNPACKED	= (1 << 4), /*!< Payload was unpacked already? */
 } rpmpsmFlags;
 
 /**
@@ -132,6 +134,8 @@ struct rpmpsm_s {
     rpmCallbackType what;	/*!< Callback type. */
     unsigned long long amount;	/*!< Callback amount. */
     unsigned long long total;	/*!< Callback total. */
+    int unpackrc;		/*!< Payload unpack (PSM_UNPACK) result. */
+    struct rpmop_s unpackops[2];/*!< Payload unpack uncompress/digest stats. */
     rpmRC rc;
     pkgStage goal;
 /*@unused@*/
@@ -223,6 +227,19 @@ rpmRC rpmpsmScriptStage(rpmpsm psm, rpmTag scriptTag, rpmTag progTag)
 void rpmpsmSetAsync(rpmpsm psm, int async)
 	/*@modifies psm @*/;
 
+/**
+ * Set the goal of a package state machine that is driven stage by stage.
+ *
+ * rpmpsmStage(psm, PSM_PKGINSTALL) is (roughly) rpmpsmSetGoal() followed by
+ * the PSM_INIT, PSM_PRE, PSM_PROCESS, PSM_POST and PSM_FINI stages. The
+ * PSM_UNPACK stage may be run (from another thread) before PSM_PROCESS, in
+ * which case PSM_PROCESS does not extract the payload again.
+ * @param psm		package state machine data
+ * @param goal		one of PSM_PKGINSTALL, PSM_PKGERASE, PSM_PKGSAVE
+ */
+void rpmpsmSetGoal(rpmpsm psm, pkgStage goal)
+	/*@modifies psm @*/;
+
 #ifdef __cplusplus
 }
 #endif
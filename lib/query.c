@@ -137,20 +137,53 @@ static void printFileInfo(char * te, const char * name,
 }
 
 /**
+ * The query format (and its compiled form) used for the last package.
  */
-static inline /*@null@*/ const char * queryHeader(Header h, const char * qfmt)
-	/*@globals internalState @*/
-	/*@modifies h, internalState @*/
+/*@unchecked@*/ /*@only@*/ /*@null@*/
+static const char * _query_qfmt;
+/*@unchecked@*/ /*@only@*/ /*@null@*/
+static headerSprintfArgs _query_hsa;
+
+/**
+ * Pass a piece of query format output to rpmlog.
+ */
+static int queryHeaderSink(/*@unused@*/ void * arg, const char * b,
+		/*@unused@*/ size_t nb)
+	/*@*/
+{
+    rpmlog(RPMLOG_NOTICE, "%s", b);
+    return 0;
+}
+
+/**
+ * Display query format output, streamed as it is formatted.
+ * @return		0 on success
+ */
+static inline int queryHeader(Header h, const char * qfmt)
+	/*@globals _query_qfmt, _query_hsa, internalState @*/
+	/*@modifies h, _query_qfmt, _query_hsa, internalState @*/
 {
     const char * errstr = "(unkown error)";
-    const char * str;
+    int rc = 1;
 
+    /* Compile the query format once, not for every package. */
+    if (_query_qfmt == NULL || strcmp(_query_qfmt, qfmt)) {
+	_query_hsa = headerSprintfFree(_query_hsa);
+	_query_qfmt = _free(_query_qfmt);
 /*@-modobserver@*/
-    str = headerSprintf(h, qfmt, NULL, rpmHeaderFormats, &errstr);
+	_query_hsa = headerSprintfCompile(qfmt, NULL, rpmHeaderFormats, &errstr);
 /*@=modobserver@*/
-    if (str == NULL)
-	rpmlog(RPMLOG_ERR, _("incorrect format: %s\n"), errstr);
-    return str;
+	if (_query_hsa == NULL)
+	    rpmlog(RPMLOG_ERR, _("incorrect format: %s\n"), errstr);
+	_query_qfmt = xstrdup(qfmt);
+    }
+
+    if (_query_hsa != NULL) {
+	rc = headerSprintfWrite(_query_hsa, h, queryHeaderSink, NULL, &errstr);
+	if (rc)
+	    rpmlog(RPMLOG_ERR, _("incorrect format: %s\n"), errstr);
+    }
+    return rc;
 }
 
 /**
@@ -191,27 +224,11 @@ JBJDEBUG((stderr, "--> %s(%p,%p,%p)\n", __FUNCTION__, qva, ts, h));
     *te = '\0';
 
     if (qva->qva_queryFormat != NULL) {
-	const char * str;
 /*@-type@*/	/* FIX rpmtsGetRDB()? */
 	(void) headerSetRpmdb(h, ts->rdb);
 /*@=type@*/
-	str = queryHeader(h, qva->qva_queryFormat);
+	(void) queryHeader(h, qva->qva_queryFormat);
 	(void) headerSetRpmdb(h, NULL);
-	if (str) {
-	    size_t tx = (te - t);
-
-	    sb = strlen(str);
-	    if (sb) {
-		tb += sb;
-		t = xrealloc(t, tb);
-		te = t + tx;
-	    }
-	    /*@-usereleased@*/
-	    te = stpcpy(te, str);
-	    /*@=usereleased@*/
-	    str = _free(str);
-	    flushBuffer(&t, &te, 1);
-	}
     }
 
     if (!(qva->qva_flags & QUERY_FOR_LIST))
@@ -918,6 +935,9 @@ JBJDEBUG((stderr, "--> %s(%p,%p,%p)\n", __FUNCTION__, ts, qva, argv));
     if (qva->qva_showPackage == showQueryPackage)
 	qva->qva_showPackage = NULL;
 
+    _query_hsa = headerSprintfFree(_query_hsa);
+    _query_qfmt = _free(_query_qfmt);
+
 JBJDEBUG((stderr, "<-- %s(%p,%p,%p) rc %d\n", __FUNCTION__, ts, qva, argv, ec));
     return ec;
 }
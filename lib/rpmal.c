@@ -6,7 +6,7 @@
 
 #include <rpmio.h>
 #include <rpmiotypes.h>		/* XXX fnpyKey */
-#include <rpmbf.h>
+#include <rpmurl.h>
 
 #include <rpmtag.h>
 #include <rpmtypes.h>
@@ -36,8 +36,6 @@ int _rpmal_debug = 0;
 struct availablePackage_s {
 /*@refcounted@*/ /*@null@*/
     rpmds provides;		/*!< Provides: dependencies. */
-/*@refcounted@*/ /*@null@*/
-    rpmbf bf;			/*!< File name Bloom filter. */
 
     rpmuint32_t tscolor;	/*!< Transaction color bits. */
 
@@ -55,12 +53,14 @@ typedef /*@abstract@*/ struct availableIndexEntry_s *	availableIndexEntry;
 struct availableIndexEntry_s {
 /*@exposed@*/ /*@dependent@*/ /*@null@*/
     alKey pkgKey;		/*!< Containing package. */
-/*@observer@*/
-    const char * entry;		/*!< Dependency name. */
-    unsigned short entryLen;	/*!< No. of bytes in name. */
+    rpmsid entryId;		/*!< Name (or dirname) id (rpmdsStrPool). */
+    rpmsid baseId;		/*!< File basename id (0 for provides). */
+    int next;			/*!< Next item in hash chain (-1 ends). */
     unsigned short entryIx;	/*!< Dependency index. */
     enum indexEntryType {
-	IET_PROVIDES=1			/*!< A Provides: dependency. */
+	IET_DELETED=0,			/*!< A deleted item. */
+	IET_PROVIDES=1,			/*!< A Provides: dependency. */
+	IET_FILE=2			/*!< A file path. */
     } type;			/*!< Type of available item. */
 };
 
@@ -68,13 +68,20 @@ typedef /*@abstract@*/ struct availableIndex_s *	availableIndex;
 /*@access availableIndex@*/
 
 /** \ingroup rpmdep
- * Index of all available items.
+ * Index of all available items, hashed on (entryId, baseId).
+ * Items are appended as packages are added, so each hash chain is in
+ * reverse order of addition. Deleted items stay in place until the next
+ * rehash.
  */
 struct availableIndex_s {
-/*@null@*/
+/*@only@*/ /*@null@*/
     availableIndexEntry index;	/*!< Array of available items. */
-    int size;			/*!< No. of available items. */
-    int k;			/*!< Current index. */
+    int size;			/*!< No. of items allocated. */
+    int k;			/*!< No. of items used. */
+    int ndeleted;		/*!< No. of deleted items. */
+/*@only@*/ /*@null@*/
+    int * heads;		/*!< Hash chain heads (-1 ends). */
+    int nheads;			/*!< No. of hash chains (a power of 2). */
 };
 
 /** \ingroup rpmdep
@@ -84,7 +91,8 @@ struct rpmal_s {
     struct rpmioItem_s _item;	/*!< usage mutex and pool identifier. */
 /*@owned@*/ /*@null@*/
     availablePackage list;	/*!< Set of packages. */
-    struct availableIndex_s index;	/*!< Set of available items. */
+    struct availableIndex_s index;	/*!< Set of available provides. */
+    struct availableIndex_s findex;	/*!< Set of available files. */
     int delta;			/*!< Delta for pkg list reallocation. */
     int size;			/*!< No. of pkgs in list. */
     int alloced;		/*!< No. of pkgs allocated for list. */
@@ -115,6 +123,124 @@ static inline alKey alNum2Key(/*@unused@*/ /*@null@*/ const rpmal al,
     /*@=nullret =temptrans =retalias @*/
 }
 
+/**
+ * Destroy available item index.
+ * @param ai		available index
+ */
+static void aiFree(availableIndex ai)
+	/*@modifies ai @*/
+{
+    ai->index = _free(ai->index);
+    ai->heads = _free(ai->heads);
+    ai->size = ai->k = ai->ndeleted = ai->nheads = 0;
+}
+
+/**
+ * Return hash chain of an available item key.
+ * @param ai		available index
+ * @param entryId	name (or dirname) id
+ * @param baseId	basename id (0 for provides)
+ * @return		hash chain index
+ */
+static inline int aiChain(availableIndex ai, rpmsid entryId, rpmsid baseId)
+	/*@*/
+{
+    rpmuint32_t h = (entryId * 0x9e3779b1U) ^ (baseId * 0x85ebca6bU);
+    return (int) ((h ^ (h >> 16)) & (ai->nheads - 1));
+}
+
+/**
+ * Rehash available index, dropping deleted items.
+ * @param ai		available index
+ * @param nheads	no. of hash chains (a power of 2)
+ */
+static void aiRehash(availableIndex ai, int nheads)
+	/*@modifies ai @*/
+{
+    availableIndexEntry aie;
+    int i, j;
+
+    /* Compact the live items, preserving the order of addition. */
+    for (i = j = 0; i < ai->k; i++) {
+	if (ai->index[i].type == IET_DELETED)
+	    continue;
+	if (j != i)
+	    ai->index[j] = ai->index[i];
+	j++;
+    }
+    ai->k = j;
+    ai->ndeleted = 0;
+
+    ai->heads = xrealloc(ai->heads, nheads * sizeof(*ai->heads));
+    ai->nheads = nheads;
+    for (i = 0; i < nheads; i++)
+	ai->heads[i] = -1;
+    for (i = 0, aie = ai->index; i < ai->k; i++, aie++) {
+	j = aiChain(ai, aie->entryId, aie->baseId);
+	aie->next = ai->heads[j];
+	ai->heads[j] = i;
+    }
+}
+
+/**
+ * Append an item to an available index.
+ * @param ai		available index
+ * @param pkgKey	containing package
+ * @param entryId	name (or dirname) id
+ * @param baseId	basename id (0 for provides)
+ * @param entryIx	dependency index
+ * @param type		item type
+ */
+static void aiAdd(availableIndex ai, /*@dependent@*/ alKey pkgKey,
+		rpmsid entryId, rpmsid baseId, int entryIx,
+		enum indexEntryType type)
+	/*@modifies ai @*/
+{
+    availableIndexEntry aie;
+    int j;
+
+    if (ai->k == ai->size) {
+	ai->size = (ai->size ? 2 * ai->size : 256);
+	ai->index = xrealloc(ai->index, ai->size * sizeof(*ai->index));
+    }
+    /* Keep the load factor at or below one. */
+    if (ai->k >= ai->nheads)
+	aiRehash(ai, (ai->nheads ? 2 * ai->nheads : 256));
+
+/* XXX make sure that element index fits in unsigned short */
+assert(entryIx < 0x10000);
+
+    aie = ai->index + ai->k;
+    aie->pkgKey = pkgKey;
+    aie->entryId = entryId;
+    aie->baseId = baseId;
+    aie->entryIx = (unsigned short) entryIx;
+    aie->type = type;
+    j = aiChain(ai, entryId, baseId);
+    aie->next = ai->heads[j];
+    ai->heads[j] = ai->k++;
+}
+
+/**
+ * Delete all items of a package from an available index.
+ * @param ai		available index
+ * @param pkgKey	containing package
+ */
+static void aiDel(availableIndex ai, /*@null@*/ alKey pkgKey)
+	/*@modifies ai @*/
+{
+    availableIndexEntry aie;
+    int i;
+
+    /* XXX linear, but packages are rarely removed from an available list. */
+    for (i = 0, aie = ai->index; i < ai->k; i++, aie++) {
+	if (aie->type == IET_DELETED || aie->pkgKey != pkgKey)
+	    continue;
+	aie->type = IET_DELETED;
+	ai->ndeleted++;
+    }
+}
+
 /**
  * Destroy available item index.
  * @param al		available list
@@ -122,11 +248,8 @@ static inline alKey alNum2Key(/*@unused@*/ /*@null@*/ const rpmal al,
 static void rpmalFreeIndex(rpmal al)
 	/*@modifies al @*/
 {
-    availableIndex ai = &al->index;
-    if (ai->size > 0) {
-	ai->index = _free(ai->index);
-	ai->size = 0;
-    }
+    aiFree(&al->index);
+    aiFree(&al->findex);
 }
 
 static void rpmalFini(void * _al)
@@ -139,8 +262,6 @@ static void rpmalFini(void * _al)
     for (i = 0; i < al->size; i++, alp++) {
 	(void)rpmdsFree(alp->provides);
 	alp->provides = NULL;
-	(void)rpmbfFree(alp->bf);
-	alp->bf = NULL;
     }
 
     al->list = _free(al->list);
@@ -170,16 +291,12 @@ static rpmal rpmalGetPool(/*@null@*/ rpmioPool pool)
 rpmal rpmalNew(int delta)
 {
     rpmal al = rpmalGetPool(_rpmalPool);
-    availableIndex ai = &al->index;
 
     al->delta = delta;
     al->size = 0;
     al->list = xcalloc(al->delta, sizeof(*al->list));
     al->alloced = al->delta;
 
-    ai->index = NULL;
-    ai->size = 0;
-
     return rpmalLink(al, __FUNCTION__);
 }
 
@@ -193,10 +310,11 @@ void rpmalDel(rpmal al, alKey pkgKey)
 
     alp = al->list + pkgNum;
 
+    aiDel(&al->index, pkgKey);
+    aiDel(&al->findex, pkgKey);
+
     (void)rpmdsFree(alp->provides);
     alp->provides = NULL;
-    (void)rpmbfFree(alp->bf);
-    alp->bf = NULL;
 
     memset(alp, 0, sizeof(*alp));	/* XXX trash and burn */
     return;
@@ -235,50 +353,25 @@ alKey rpmalAdd(rpmal * alistp, alKey pkgKey, fnpyKey key,
 
 /*@-assignexpose -castexpose @*/
     alp->provides = rpmdsLink(provides, "Provides (rpmalAdd)");
-    alp->bf = rpmbfLink(rpmfiFNBF(fi));
 /*@=assignexpose =castexpose @*/
 
-    rpmalFreeIndex(al);
+    pkgKey = alNum2Key(al, pkgNum);
+    rpmalAddProvides(al, pkgKey, alp->provides, tscolor);
+    rpmalAddFiles(al, pkgKey, fi);
 
 assert(((alNum)(alp - al->list)) == pkgNum);
     return ((alKey)(alp - al->list));
 }
 
-/**
- * Compare two available index entries by name (qsort/bsearch).
- * @param one		1st available index entry
- * @param two		2nd available index entry
- * @return		result of comparison
- */
-static int indexcmp(const void * one, const void * two)
-	/*@*/
-{
-    /*@-castexpose@*/
-    const availableIndexEntry a = (const availableIndexEntry) one;
-    const availableIndexEntry b = (const availableIndexEntry) two;
-    /*@=castexpose@*/
-    int lenchk;
-
-    lenchk = a->entryLen - b->entryLen;
-    if (lenchk)
-	return lenchk;
-
-    return strcmp(a->entry, b->entry);
-}
-
 void rpmalAddProvides(rpmal al, alKey pkgKey, rpmds provides, rpmuint32_t tscolor)
 {
     rpmuint32_t dscolor;
     const char * Name;
     alNum pkgNum = alKey2Num(al, pkgKey);
-    availableIndex ai = &al->index;
-    availableIndexEntry aie;
-    int ix;
+    rpmsid entryId;
 
     if (provides == NULL || pkgNum < 0 || pkgNum >= al->size)
 	return;
-    if (ai->index == NULL || ai->k < 0 || ai->k >= ai->size)
-	return;
 
     if (rpmdsInit(provides) != NULL)
     while (rpmdsNext(provides) >= 0) {
@@ -291,87 +384,132 @@ void rpmalAddProvides(rpmal al, alKey pkgKey, rpmds provides, rpmuint32_t tscolo
 	if (tscolor && dscolor && !(tscolor & dscolor))
 	    continue;
 
-	aie = ai->index + ai->k;
-	ai->k++;
+	entryId = rpmdsNid(provides);
+	if (entryId == 0)
+	    entryId = rpmstrPoolId(rpmdsStrPool(), Name, 1);
+	aiAdd(&al->index, pkgKey, entryId, 0, rpmdsIx(provides),
+		IET_PROVIDES);
+    }
+}
 
-	aie->pkgKey = pkgKey;
-/*@-assignexpose@*/
-	aie->entry = Name;
-/*@=assignexpose@*/
-	aie->entryLen = (unsigned short)strlen(Name);
-	ix = rpmdsIx(provides);
+void rpmalAddFiles(rpmal al, alKey pkgKey, rpmfi fi)
+{
+    rpmstrPool pool = rpmdsStrPool();
+    alNum pkgNum = alKey2Num(al, pkgKey);
+    const char * DN;
+    const char * BN;
+    const char * dn;
+    rpmsid dnId;
+    rpmsid bnId;
 
-/* XXX make sure that element index fits in unsigned short */
-assert(ix < 0x10000);
+    if (fi == NULL || pkgNum < 0 || pkgNum >= al->size)
+	return;
 
-	aie->entryIx = ix;
-	aie->type = IET_PROVIDES;
+    if ((fi = rpmfiInit(fi, 0)) != NULL)
+    while (rpmfiNext(fi) >= 0) {
+	if ((DN = rpmfiDN(fi)) == NULL || (BN = rpmfiBN(fi)) == NULL)
+	    continue;	/* XXX can't happen */
+	dn = NULL;
+	(void) urlPath(DN, &dn);
+	dnId = rpmstrPoolId(pool, dn, 1);
+	bnId = rpmstrPoolId(pool, BN, 1);
+	aiAdd(&al->findex, pkgKey, dnId, bnId, 0, IET_FILE);
     }
 }
 
 void rpmalMakeIndex(rpmal al)
 {
     availableIndex ai;
-    availablePackage alp;
-    int i;
 
-    if (al == NULL || al->list == NULL) return;
+    if (al == NULL) return;
+
+    /* The index is maintained as packages are added: just drop deletions. */
     ai = &al->index;
+    if (ai->ndeleted > 0)
+	aiRehash(ai, ai->nheads);
+    ai = &al->findex;
+    if (ai->ndeleted > 0)
+	aiRehash(ai, ai->nheads);
+}
 
-    ai->size = 0;
-    for (i = 0; i < al->size; i++) {
-	alp = al->list + i;
-	if (alp->provides != NULL)
-	    ai->size += rpmdsCount(alp->provides);
-    }
-    if (ai->size == 0) return;
+/**
+ * Reverse the order of a NULL terminated key array.
+ * Hash chains are in reverse order of addition, keys are returned in order.
+ * @param ret		key array
+ * @param found		no. of keys
+ */
+static void alReverse(/*@null@*/ fnpyKey * ret, int found)
+	/*@modifies ret @*/
+{
+    int i;
 
-    ai->index = xrealloc(ai->index, ai->size * sizeof(*ai->index));
-    ai->k = 0;
-    for (i = 0; i < al->size; i++) {
-	alp = al->list + i;
-	rpmalAddProvides(al, alNum2Key(NULL, (alNum)i), alp->provides, alp->tscolor);
+    if (ret != NULL)
+    for (i = 0; i < found / 2; i++) {
+	fnpyKey key = ret[i];
+	ret[i] = ret[found - 1 - i];
+	ret[found - 1 - i] = key;
     }
-
-    /* Reset size to the no. of provides added. */
-    ai->size = ai->k;
-    qsort(ai->index, ai->size, sizeof(*ai->index), indexcmp);
 }
 
 fnpyKey *
 rpmalAllFileSatisfiesDepend(const rpmal al, const rpmds ds, alKey * keyp)
 {
+    rpmstrPool pool = rpmdsStrPool();
+    availableIndex ai;
+    availableIndexEntry aie;
     fnpyKey * ret = NULL;
     int found = 0;
     const char * fn;
-    size_t nfn;
+    const char * bn;
+    char * dn;
+    rpmsid dnId;
+    rpmsid bnId;
     int i;
 
     if (keyp) *keyp = RPMAL_NOMATCH;
 
     if (al == NULL || (fn = rpmdsN(ds)) == NULL || *fn != '/')
 	goto exit;
-    nfn = strlen(fn);
 
-    if (al->list != NULL)	/* XXX always true */
-    for (i = 0; i < al->size; i++) {
-	availablePackage alp = al->list + i;
+    ai = &al->findex;
+    if (ai->k <= ai->ndeleted)
+	goto exit;
+
+    /* Split into dirname (with trailing '/') and basename. */
+    bn = strrchr(fn, '/') + 1;
+    dn = alloca((bn - fn) + 1);
+    strncpy(dn, fn, (bn - fn));
+    dn[bn - fn] = '\0';
+
+    /* A path that was never interned cannot be provided. */
+    if ((dnId = rpmstrPoolId(pool, dn, 0)) == 0
+     || (bnId = rpmstrPoolId(pool, bn, 0)) == 0)
+	goto exit;
 
-	if (!rpmbfChk(alp->bf, fn, nfn))
+    if (al->list != NULL)	/* XXX always true */
+    for (i = ai->heads[aiChain(ai, dnId, bnId)]; i >= 0; i = aie->next) {
+	aie = ai->index + i;
+	if (aie->type != IET_FILE
+	 || aie->entryId != dnId || aie->baseId != bnId)
 	    continue;
 
 	rpmdsNotify(ds, _("(added files)"), 0);
 
 	ret = xrealloc(ret, (found + 2) * sizeof(*ret));
 	if (ret)	/* can't happen */
-	    ret[found] = alp->key;
-	if (keyp)
-	    *keyp = alNum2Key(al, i);
+	    ret[found] = al->list[alKey2Num(al, aie->pkgKey)].key;
+	/* The last added package is reported, as before. */
+/*@-dependenttrans@*/
+	if (keyp && found == 0)
+	    *keyp = aie->pkgKey;
+/*@=dependenttrans@*/
 	found++;
     }
 
-    if (ret)
+    if (ret) {
 	ret[found] = NULL;
+	alReverse(ret, found);
+    }
 
 exit:
 /*@-nullstate@*/ /* FIX: *keyp may be NULL */
@@ -383,13 +521,14 @@ fnpyKey *
 rpmalAllSatisfiesDepend(const rpmal al, const rpmds ds, alKey * keyp)
 {
     availableIndex ai;
-    availableIndexEntry needle;
     availableIndexEntry match;
     fnpyKey * ret = NULL;
     int found = 0;
     const char * KName;
     availablePackage alp;
+    rpmsid entryId;
     int rc;
+    int i;
 
     if (keyp) *keyp = RPMAL_NOMATCH;
 
@@ -406,34 +545,23 @@ rpmalAllSatisfiesDepend(const rpmal al, const rpmds ds, alKey * keyp)
     }
 
     ai = &al->index;
-    if (ai->index == NULL || ai->size <= 0)
+    if (ai->k <= ai->ndeleted)
 	goto exit;
 
-    needle = memset(alloca(sizeof(*needle)), 0, sizeof(*needle));
-    /*@-assignexpose -temptrans@*/
-    needle->entry = KName;
-    /*@=assignexpose =temptrans@*/
-    needle->entryLen = (unsigned short)strlen(needle->entry);
-
-    match = bsearch(needle, ai->index, ai->size, sizeof(*ai->index), indexcmp);
-    if (match == NULL)
+    /* A name that was never interned cannot be provided. */
+    if ((entryId = rpmstrPoolId(rpmdsStrPool(), KName, 0)) == 0)
 	goto exit;
 
-    /* rewind to the first match */
-    while (match > ai->index && indexcmp(match-1, needle) == 0)
-	match--;
-
     if (al->list != NULL)	/* XXX always true */
-    for (ret = NULL, found = 0;
-	 match < ai->index + ai->size && indexcmp(match, needle) == 0;
-	 match++)
-    {
+    for (i = ai->heads[aiChain(ai, entryId, 0)]; i >= 0; i = match->next) {
+	match = ai->index + i;
+	if (match->type != IET_PROVIDES || match->entryId != entryId)
+	    continue;
+
 	alp = al->list + alKey2Num(al, match->pkgKey);
 
 	rc = 0;
-	if (alp->provides != NULL)	/* XXX can't happen */
-	switch (match->type) {
-	case IET_PROVIDES:
+	if (alp->provides != NULL) {	/* XXX can't happen */
 	    /* XXX single step on rpmdsNext to regenerate DNEVR string */
 	    (void) rpmdsSetIx(alp->provides, match->entryIx - 1);
 	    if (rpmdsNext(alp->provides) >= 0)
@@ -441,24 +569,25 @@ rpmalAllSatisfiesDepend(const rpmal al, const rpmds ds, alKey * keyp)
 
 	    if (rc)
 		rpmdsNotify(ds, _("(added provide)"), 0);
-
-	    /*@switchbreak@*/ break;
 	}
 
 	if (rc) {
 	    ret = xrealloc(ret, (found + 2) * sizeof(*ret));
 	    if (ret)	/* can't happen */
 		ret[found] = alp->key;
+	    /* The last added package is reported, as before. */
 /*@-dependenttrans@*/
-	    if (keyp)
+	    if (keyp && found == 0)
 		*keyp = match->pkgKey;
 /*@=dependenttrans@*/
 	    found++;
 	}
     }
 
-    if (ret)
+    if (ret) {
 	ret[found] = NULL;
+	alReverse(ret, found);
+    }
 
 exit:
 /*@-nullstate@*/ /* FIX: *keyp may be NULL */
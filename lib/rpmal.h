@@ -121,8 +121,23 @@ void rpmalAddProvides(rpmal al,
 	/*@modifies al, provides @*/;
 /*@=exportlocal@*/
 
+/**
+ * Add package files to available list index.
+ * @param al		available list
+ * @param pkgKey	package key
+ * @param fi		added package file info set
+ */
+/*@-exportlocal@*/
+void rpmalAddFiles(rpmal al,
+		/*@dependent@*/ /*@null@*/ alKey pkgKey,
+		/*@null@*/ rpmfi fi)
+	/*@modifies al, fi @*/;
+/*@=exportlocal@*/
+
 /**
  * Generate index for available list.
+ * The index is maintained as packages are added and deleted, this
+ * only compacts away the items of deleted packages.
  * @param al		available list
  */
 void rpmalMakeIndex(/*@null@*/ rpmal al)
@@ -117,6 +117,15 @@ int _rpmds_debug = 0;
 /*@unchecked@*/
 int _rpmds_nopromote = 1;
 
+/*@unchecked@*/
+int _rpmds_intern = 1;
+
+/*@unchecked@*/
+int _rpmds_evrcache = 1;
+
+/*@unchecked@*/ /*@only@*/ /*@null@*/
+rpmstrPool _rpmdsStrPool;
+
 /*@unchecked@*/
 /*@-exportheadervar@*/
 int _rpmds_unspecified_epoch_noise = 0;
@@ -156,13 +165,30 @@ const char * rpmdsType(const rpmds ds)
     return rpmdsTagName(rpmdsTagN(ds));
 }
 
+/**
+ * Destroy the parsed EVR cache of a dependency set.
+ * @param ds		dependency set
+ */
+static void rpmdsFreeEVRc(rpmds ds)
+	/*@modifies ds @*/
+{
+    rpmuint32_t i;
+
+    if (ds->EVRc != NULL)
+    for (i = 0; i < ds->Count; i++)
+	ds->EVRc[i] = rpmEVRfree(ds->EVRc[i]);
+    ds->EVRc = _free(ds->EVRc);
+}
+
 static void rpmdsFini(void * _ds)
 {
     rpmds ds = _ds;
 
+    rpmdsFreeEVRc(ds);
     if (ds->Count > 0) {
 	ds->N = _free(ds->N);
 	ds->EVR = _free(ds->EVR);
+	ds->Nid = _free(ds->Nid);
 	ds->Flags = _free(ds->Flags);
 	(void)headerFree(ds->h);
 	ds->h = NULL;
@@ -227,6 +253,61 @@ assert(argv[ac] != NULL);
 /*@=nullret@*/
 }
 
+rpmstrPool rpmdsStrPool(void)
+{
+#if defined(WITH_PTHREADS)
+    /* XXX dependency sets are created by concurrent dependency checks. */
+    static pthread_mutex_t _pool_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+    rpmstrPool pool;
+
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&_pool_mutex);
+#endif
+    if (_rpmdsStrPool == NULL)
+	_rpmdsStrPool = rpmstrPoolNew(16 * 1024);
+    pool = _rpmdsStrPool;
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&_pool_mutex);
+#endif
+    return pool;
+}
+
+/**
+ * Replace dependency names/EVRs with strings interned in rpmdsStrPool().
+ * @param ds		dependency set
+ */
+static void rpmdsIntern(rpmds ds)
+	/*@globals _rpmdsStrPool, internalState @*/
+	/*@modifies ds, _rpmdsStrPool, internalState @*/
+{
+    rpmstrPool pool = rpmdsStrPool();
+    size_t nb = (ds->Count + 1) * sizeof(*ds->N);
+    const char ** N = xmalloc(nb);
+    const char ** EVR = (ds->EVR != NULL ? xmalloc(nb) : NULL);
+    rpmsid * Nid = xmalloc(ds->Count * sizeof(*Nid));
+    unsigned i;
+
+    /* The header strings are released, only pointers to pool strings kept. */
+    for (i = 0; i < ds->Count; i++) {
+	Nid[i] = rpmstrPoolId(pool, ds->N[i], 1);
+	N[i] = rpmstrPoolStr(pool, Nid[i]);
+	if (EVR != NULL)
+	    EVR[i] = rpmstrPoolStr(pool, rpmstrPoolId(pool, ds->EVR[i], 1));
+    }
+    N[ds->Count] = NULL;
+    if (EVR != NULL)
+	EVR[ds->Count] = NULL;
+
+/*@-unqualifiedtrans@*/
+    ds->N = _free(ds->N);
+    ds->EVR = _free(ds->EVR);
+/*@=unqualifiedtrans@*/
+    ds->N = N;
+    ds->EVR = EVR;
+    ds->Nid = Nid;
+}
+
 rpmds rpmdsNew(Header h, rpmTag tagN, int flags)
 {
     int scareMem = (flags & 0x1);
@@ -391,7 +472,9 @@ assert(scareMem == 0);		/* XXX always allocate memory */
 	    av = argvFree(av);
 	    ds->EVR = _free(ds->EVR);
 	    ds->Flags = _free(ds->Flags);
-	}
+	} else
+	if (_rpmds_intern)
+	    rpmdsIntern(ds);
 
 /*@-modfilesys@*/
 if (_rpmds_debug < 0)
@@ -669,6 +752,17 @@ const char * rpmdsN(const rpmds ds)
     return N;
 }
 
+rpmsid rpmdsNid(const rpmds ds)
+{
+    rpmsid Nid = 0;
+
+    if (ds != NULL && ds->i >= 0 && ds->i < (int)ds->Count) {
+	if (ds->Nid != NULL)
+	    Nid = ds->Nid[ds->i];
+    }
+    return Nid;
+}
+
 const char * rpmdsEVR(const rpmds ds)
 {
     const char * EVR = NULL;
@@ -959,8 +1053,9 @@ static rpmds rpmdsDup(const rpmds ods)
     ds->l = ods->l;
     ds->u = ods->u;
 
+    /* Interned strings are shared, only the pointers are copied. */
     nb = (ds->Count+1) * sizeof(*ds->N);
-    ds->N = (ds->h != NULL
+    ds->N = (ds->h != NULL || ods->Nid != NULL
 	? memcpy(xmalloc(nb), ods->N, nb)
 	: rpmdsDupArgv(ods->N, ods->Count) );
 
@@ -969,10 +1064,18 @@ assert(ods->EVR != NULL);
 assert(ods->Flags != NULL);
 
     nb = (ds->Count+1) * sizeof(*ds->EVR);
-    ds->EVR = (ds->h != NULL
+    ds->EVR = (ds->h != NULL || ods->Nid != NULL
 	? memcpy(xmalloc(nb), ods->EVR, nb)
 	: rpmdsDupArgv(ods->EVR, ods->Count) );
 
+    if (ods->Nid != NULL) {
+	nb = ds->Count * sizeof(*ds->Nid);
+	ds->Nid = memcpy(xmalloc(nb), ods->Nid, nb);
+	/* XXX ds->N[ds->Count] is not NULL when Count was trimmed. */
+	ds->N[ds->Count] = NULL;
+	ds->EVR[ds->Count] = NULL;
+    }
+
     nb = (ds->Count * sizeof(*ds->Flags));
     ds->Flags = (ds->h != NULL
 	? ods->Flags
@@ -987,6 +1090,18 @@ assert(ods->Flags != NULL);
 /*@=compmempass@*/
 }
 
+/**
+ * Compare dependency strings, interned strings are equal iff identical.
+ * @param a		1st string
+ * @param b		2nd string
+ * @return		result of comparison
+ */
+static inline int dsstrcmp(const char * a, const char * b)
+	/*@*/
+{
+    return (a == b ? 0 : strcmp(a, b));
+}
+
 int rpmdsFind(rpmds ds, const rpmds ods)
 {
     int comparison;
@@ -999,12 +1114,12 @@ int rpmdsFind(rpmds ds, const rpmds ods)
     while (ds->l < ds->u) {
 	ds->i = (ds->l + ds->u) / 2;
 
-	comparison = strcmp(ods->N[ods->i], ds->N[ds->i]);
+	comparison = dsstrcmp(ods->N[ods->i], ds->N[ds->i]);
 
 	/* XXX rpm prior to 3.0.2 did not always supply EVR and Flags. */
 /*@-nullderef@*/
 	if (comparison == 0 && ods->EVR && ds->EVR)
-	    comparison = strcmp(ods->EVR[ods->i], ds->EVR[ds->i]);
+	    comparison = dsstrcmp(ods->EVR[ods->i], ds->EVR[ds->i]);
 	if (comparison == 0 && ods->Flags && ds->Flags)
 	    comparison = (ods->Flags[ods->i] - ds->Flags[ds->i]);
 /*@=nullderef@*/
@@ -1055,27 +1170,48 @@ save = ods->i;
 	if (rpmdsFind(ds, ods) >= 0)
 	    continue;
 
-	/*
-	 * Insert new entry.
-	 */
-	for (j = ds->Count; j > (int)ds->u; j--)
-	    ds->N[j] = ds->N[j-1];
-	ds->N[ds->u] = ods->N[ods->i];
-	N = rpmdsDupArgv(ds->N, ds->Count+1);
-	ds->N = _free(ds->N);
-	ds->N = N;
-	
 	/* XXX rpm prior to 3.0.2 did not always supply EVR and Flags. */
 /*@-nullderef -nullpass -nullptrarith @*/
 assert(ods->EVR != NULL);
 assert(ods->Flags != NULL);
 
-	for (j = ds->Count; j > (int)ds->u; j--)
-	    ds->EVR[j] = ds->EVR[j-1];
-	ds->EVR[ds->u] = ods->EVR[ods->i];
-	EVR = rpmdsDupArgv(ds->EVR, ds->Count+1);
-	ds->EVR = _free(ds->EVR);
-	ds->EVR = EVR;
+	/*
+	 * Insert new entry.
+	 */
+	rpmdsFreeEVRc(ds);
+	if (ds->Nid != NULL && ods->Nid != NULL) {
+	    /* Both interned: insert pointers (and id), copy no strings. */
+	    ds->N = xrealloc(ds->N, (ds->Count+2) * sizeof(*ds->N));
+	    ds->EVR = xrealloc(ds->EVR, (ds->Count+2) * sizeof(*ds->EVR));
+	    ds->Nid = xrealloc(ds->Nid, (ds->Count+1) * sizeof(*ds->Nid));
+	    for (j = ds->Count; j > (int)ds->u; j--) {
+		ds->N[j] = ds->N[j-1];
+		ds->EVR[j] = ds->EVR[j-1];
+		ds->Nid[j] = ds->Nid[j-1];
+	    }
+	    ds->N[ds->u] = ods->N[ods->i];
+	    ds->EVR[ds->u] = ods->EVR[ods->i];
+	    ds->Nid[ds->u] = ods->Nid[ods->i];
+	    ds->N[ds->Count+1] = NULL;
+	    ds->EVR[ds->Count+1] = NULL;
+	} else {
+	    for (j = ds->Count; j > (int)ds->u; j--)
+		ds->N[j] = ds->N[j-1];
+	    ds->N[ds->u] = ods->N[ods->i];
+	    N = rpmdsDupArgv(ds->N, ds->Count+1);
+	    ds->N = _free(ds->N);
+	    ds->N = N;
+
+	    for (j = ds->Count; j > (int)ds->u; j--)
+		ds->EVR[j] = ds->EVR[j-1];
+	    ds->EVR[ds->u] = ods->EVR[ods->i];
+	    EVR = rpmdsDupArgv(ds->EVR, ds->Count+1);
+	    ds->EVR = _free(ds->EVR);
+	    ds->EVR = EVR;
+
+	    /* The strings are private copies now. */
+	    ds->Nid = _free(ds->Nid);
+	}
 
 	Flags = xmalloc((ds->Count+1) * sizeof(*Flags));
 	if (ds->u > 0)
@@ -1112,7 +1248,7 @@ int rpmdsSearch(rpmds ds, rpmds ods)
     while (l < u) {
 	i = (l + u) / 2;
 
-	comparison = strcmp(ods->N[ods->i], ds->N[i]);
+	comparison = dsstrcmp(ods->N[ods->i], ds->N[i]);
 
 	if (comparison < 0)
 	    u = i;
@@ -1120,15 +1256,15 @@ int rpmdsSearch(rpmds ds, rpmds ods)
 	    l = i + 1;
 	else {
 	    /* Set l to 1st member of set that contains N. */
-	    if (strcmp(ods->N[ods->i], ds->N[l]))
+	    if (dsstrcmp(ods->N[ods->i], ds->N[l]))
 		l = i;
-	    while (l > 0 && !strcmp(ods->N[ods->i], ds->N[l-1]))
+	    while (l > 0 && !dsstrcmp(ods->N[ods->i], ds->N[l-1]))
 		l--;
 	    /* Set u to 1st member of set that does not contain N. */
-	    if (u >= (int)ds->Count || strcmp(ods->N[ods->i], ds->N[u]))
+	    if (u >= (int)ds->Count || dsstrcmp(ods->N[ods->i], ds->N[u]))
 		u = i;
 	    while (++u < (int)ds->Count) {
-		if (strcmp(ods->N[ods->i], ds->N[u]))
+		if (dsstrcmp(ods->N[ods->i], ds->N[u]))
 		    /*@innerbreak@*/ break;
 	    }
 	    break;
@@ -4004,12 +4140,36 @@ assert(evr_tuple_order != NULL && evr_tuple_order[0] != '\0');
 /*@=freshtrans@*/
 }
 
+/**
+ * Return the parsed and segmented EVR of the current dependency.
+ * The EVR is parsed once, and cached until the dependency set changes.
+ * @param ds		dependency set
+ * @return		parsed EVR
+ */
+/*@dependent@*/
+static EVR_t rpmdsEVRc(rpmds ds)
+	/*@modifies ds @*/
+{
+    EVR_t evr;
+
+    if (ds->EVRc == NULL)
+	ds->EVRc = xcalloc(ds->Count, sizeof(*ds->EVRc));
+    if ((evr = ds->EVRc[ds->i]) == NULL) {
+	int xx;
+	evr = rpmEVRnew(0, 0);
+	xx = (ds->EVRparse ? ds->EVRparse : rpmEVRparse) (ds->EVR[ds->i], evr);
+	xx = rpmEVRcompile(evr);
+	ds->EVRc[ds->i] = evr;
+    }
+    return evr;
+}
+
 int rpmdsCompare(const rpmds A, const rpmds B)
 {
-    const char *aDepend = (A->DNEVR != NULL ? xstrdup(A->DNEVR+2) : "");
-    const char *bDepend = (B->DNEVR != NULL ? xstrdup(B->DNEVR+2) : "");
-    EVR_t a = memset(alloca(sizeof(*a)), 0, sizeof(*a));
-    EVR_t b = memset(alloca(sizeof(*a)), 0, sizeof(*a));
+    const char *aDepend = (A->DNEVR != NULL ? A->DNEVR+2 : "");
+    const char *bDepend = (B->DNEVR != NULL ? B->DNEVR+2 : "");
+    EVR_t a = NULL;
+    EVR_t b = NULL;
     evrFlags aFlags = A->ns.Flags;
     evrFlags bFlags = B->ns.Flags;
     int (*EVRcmp) (const char *a, const char *b);
@@ -4040,8 +4200,15 @@ assert((rpmdsFlags(B) & RPMSENSE_SENSEMASK) == B->ns.Flags);
 	goto exit;
 
     /* Both AEVR and BEVR exist. */
-    xx = (A->EVRparse ? A->EVRparse : rpmEVRparse) (A->EVR[A->i], a);
-    xx = (B->EVRparse ? B->EVRparse : rpmEVRparse) (B->EVR[B->i], b);
+    if (_rpmds_evrcache) {
+	a = rpmdsEVRc(A);
+	b = rpmdsEVRc(B);
+    } else {
+	a = memset(alloca(sizeof(*a)), 0, sizeof(*a));
+	b = memset(alloca(sizeof(*b)), 0, sizeof(*b));
+	xx = (A->EVRparse ? A->EVRparse : rpmEVRparse) (A->EVR[A->i], a);
+	xx = (B->EVRparse ? B->EVRparse : rpmEVRparse) (B->EVR[B->i], b);
+    }
 
     /* If EVRcmp is identical, use that, otherwise use default. */
     EVRcmp = (A->EVRcmp && B->EVRcmp && A->EVRcmp == B->EVRcmp)
@@ -4084,13 +4251,20 @@ assert((rpmdsFlags(B) & RPMSENSE_SENSEMASK) == B->ns.Flags);
 #else
 	if (a->F[ix] && *a->F[ix] && b->F[ix] && *b->F[ix])
 #endif
-/*@i@*/	    sense = EVRcmp(a->F[ix], b->F[ix]);
+	{
+	    if (a->vs[ix] && b->vs[ix] && EVRcmp == rpmEVRcmp)
+		sense = rpmvstrCmp(a->vs[ix], b->vs[ix]);
+	    else
+/*@i@*/		sense = EVRcmp(a->F[ix], b->F[ix]);
+	}
 	if (sense)
 	    break;
     }
 
-    a->str = _free(a->str);
-    b->str = _free(b->str);
+    if (!_rpmds_evrcache) {
+	a->str = _free(a->str);
+	b->str = _free(b->str);
+    }
 
     /* Detect overlap of {A,B} range. */
     if (aFlags == RPMSENSE_NOTEQUAL || bFlags == RPMSENSE_NOTEQUAL) {
@@ -4112,8 +4286,6 @@ exit:
     if (_noisy_range_comparison_debug_message)
     rpmlog(RPMLOG_DEBUG, D_("  %s    A %s\tB %s\n"),
 	(result ? _("YES") : _("NO ")), aDepend, bDepend);
-    aDepend = _free(aDepend);
-    bDepend = _free(bDepend);
     return result;
 }
 
@@ -10,6 +10,7 @@
 #define	_RPMNS_INTERNAL
 #include <rpmns.h>
 #include <rpmps.h>
+#include <rpmstrpool.h>
 
 /** \ingroup rpmds
  */
@@ -30,6 +31,22 @@ extern const char *_sysinfo_path;
 extern int _rpmds_nopromote;
 /*@=exportlocal@*/
 
+/** \ingroup rpmds
+ * Intern dependency names/EVRs in rpmdsStrPool()? (default 1)
+ */
+/*@-exportlocal@*/
+/*@unchecked@*/
+extern int _rpmds_intern;
+/*@=exportlocal@*/
+
+/** \ingroup rpmds
+ * Cache parsed and segmented EVRs for rpmdsCompare()? (default 1)
+ */
+/*@-exportlocal@*/
+/*@unchecked@*/
+extern int _rpmds_evrcache;
+/*@=exportlocal@*/
+
 #if defined(_RPMDS_INTERNAL)
 #include <mire.h>
 
@@ -48,6 +65,10 @@ struct rpmds_s {
     const char ** N;		/*!< Name. */
 /*@only@*/ /*@relnull@*/
     const char ** EVR;		/*!< Epoch-Version-Release. */
+/*@only@*/ /*@null@*/
+    rpmsid * Nid;		/*!< Name ids (N/EVR are interned if set). */
+/*@only@*/ /*@null@*/
+    EVR_t * EVRc;		/*!< Parsed and segmented EVRs (on demand). */
 /*@only@*/ /*@relnull@*/
     evrFlags * Flags;		/*!< Bit(s) identifying context/comparison. */
 /*@only@*/ /*@null@*/
@@ -168,6 +189,25 @@ rpmds rpmdsFree(/*@killref@*/ /*@null@*/ rpmds ds)
 #define	rpmdsFree(_ds)	\
     ((rpmds)rpmioFreePoolItem((rpmioItem)(_ds), __FUNCTION__, __FILE__, __LINE__))
 
+/** \ingroup rpmds
+ * Return the string pool that dependency names and EVRs are interned in.
+ * Interned strings are shared by all dependency sets, and live until
+ * the pool is freed (when all dependency sets are gone).
+ * @return		dependency string pool
+ */
+/*@observer@*/
+rpmstrPool rpmdsStrPool(void)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/;
+
+/** \ingroup rpmds
+ * Return current dependency name id.
+ * @param ds		dependency set
+ * @return		id of the (unparsed) name in rpmdsStrPool(), 0 if not interned
+ */
+rpmsid rpmdsNid(/*@null@*/ const rpmds ds)
+	/*@*/;
+
 /** \ingroup rpmds
  * Create and load a dependency set.
  * @param h		header
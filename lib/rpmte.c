@@ -32,6 +32,9 @@ int _rpmte_debug = 0;
 void rpmteCleanDS(rpmte te)
 {
     te->PRCO = rpmdsFreePRCO(te->PRCO);
+    te->probs = rpmpsFree(te->probs);
+    te->checkrc = 0;
+    te->checked = 0;
 }
 
 /**
@@ -51,10 +54,10 @@ static void delTE(rpmte p)
         p->fd = fdFree(p->fd, "delTE");
 /*@=refcounttrans@*/
 
-    p->os = _free(p->os);
-    p->arch = _free(p->arch);
+    p->os = NULL;		/* interned */
+    p->arch = NULL;		/* interned */
     p->epoch = _free(p->epoch);
-    p->name = _free(p->name);
+    p->name = NULL;		/* interned */
     p->version = _free(p->version);
     p->release = _free(p->release);
 #ifdef	RPM_VENDOR_MANDRIVA
@@ -87,6 +90,22 @@ assert(p->txn == NULL);		/* XXX FIXME */
     /*@=nullstate@*/
 }
 
+/**
+ * Return a string interned in rpmdsStrPool(), freeing the original.
+ * @param s		string
+ * @return		interned string
+ */
+/*@observer@*/
+static const char * rpmteIntern(/*@only@*/ const char * s)
+	/*@globals internalState @*/
+	/*@modifies internalState @*/
+{
+    rpmstrPool pool = rpmdsStrPool();
+    const char * t = rpmstrPoolStr(pool, rpmstrPoolId(pool, s, 1));
+    s = _free(s);
+    return t;
+}
+
 /**
  * Initialize transaction element data from header.
  * @param ts		transaction set
@@ -113,7 +132,7 @@ assert(he->p.str != NULL);
 
     he->tag = RPMTAG_NAME;
     xx = headerGet(h, he, 0);
-    p->name = (xx ? he->p.str : xstrdup("?RPMTAG_NAME?"));
+    p->name = rpmteIntern(xx ? he->p.str : xstrdup("?RPMTAG_NAME?"));
     he->tag = RPMTAG_VERSION;
     xx = headerGet(h, he, 0);
     p->version = (char *)(xx ? he->p.str : xstrdup("?RPMTAG_VERSION?"));
@@ -150,11 +169,11 @@ assert(he->p.str != NULL);
 
     he->tag = RPMTAG_ARCH;
     xx = headerGet(h, he, 0);
-    p->arch = (xx ? he->p.str : xstrdup("?RPMTAG_ARCH?"));
+    p->arch = rpmteIntern(xx ? he->p.str : xstrdup("?RPMTAG_ARCH?"));
 
     he->tag = RPMTAG_OS;
     xx = headerGet(h, he, 0);
-    p->os = (xx ? he->p.str : xstrdup("?RPMTAG_OS?"));
+    p->os = rpmteIntern(xx ? he->p.str : xstrdup("?RPMTAG_OS?"));
 
     p->isSource =
 	(headerIsEntry(h, RPMTAG_SOURCERPM) == 0 &&
@@ -248,6 +267,7 @@ rpmte rpmteNew(const rpmts ts, Header h,
     int xx;
 
     p->type = type;
+    p->wave = -1;
 
     addTE(ts, p, h, key, relocs);
     switch (type) {
@@ -411,6 +431,21 @@ int rpmteSetBreadth(rpmte te, int nbreadth)
     return obreadth;
 }
 
+int rpmteWave(rpmte te)
+{
+    return (te != NULL ? te->wave : -1);
+}
+
+int rpmteSetWave(rpmte te, int nwave)
+{
+    int owave = -1;
+    if (te != NULL) {
+	owave = te->wave;
+	te->wave = nwave;
+    }
+    return owave;
+}
+
 int rpmteNpreds(rpmte te)
 {
     return (te != NULL ? te->npreds : 0);
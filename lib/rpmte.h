@@ -36,16 +36,7 @@ typedef enum rpmElementType_e {
 #include <argv.h>
 #include <rpmtxn.h>
 #include <rpmal.h>
-
-typedef struct relation_s * relation;
-
-#if defined(_RPMTS_ORDER_INTERNAL)
-struct relation_s {
-    rpmte   rel_suc;  // pkg requiring this package
-    rpmsenseFlags rel_flags; // accumulated flags of the requirements
-    struct relation_s * rel_next;
-};
-#endif
+#include <rpmps.h>
 
 /** \ingroup rpmte
  * Dependncy ordering information.
@@ -62,11 +53,7 @@ struct tsortInfo_s {
     int		tsi_count;
     int		tsi_qcnt;
     int		tsi_reqx;
-    relation	tsi_relations;
-    relation	tsi_forward_relations;
     rpmte	tsi_suc;
-    int		tsi_SccIdx;
-    int		tsi_SccLowlink;
 };
 /*@=fielduse@*/
 
@@ -115,8 +102,8 @@ struct rpmte_s {
     const char * hdrid;		/*!< Package header identifier (header sha1). */
 /*@only@*/ /*@null@*/
     const char * sourcerpm;	/*!< Source package. */
-/*@only@*/
-    const char * name;		/*!< Name: */
+/*@observer@*/
+    const char * name;		/*!< Name: (interned) */
 /*@only@*/ /*@null@*/
     char * epoch;
 /*@only@*/ /*@null@*/
@@ -127,10 +114,10 @@ struct rpmte_s {
 /*@only@*/ /*@null@*/
     char * distepoch;
 #endif
-/*@only@*/ /*@null@*/
-    const char * arch;		/*!< Architecture hint. */
-/*@only@*/ /*@null@*/
-    const char * os;		/*!< Operating system hint. */
+/*@observer@*/ /*@null@*/
+    const char * arch;		/*!< Architecture hint. (interned) */
+/*@observer@*/ /*@null@*/
+    const char * os;		/*!< Operating system hint. (interned) */
     int isSource;		/*!< (TR_ADDED) source rpm? */
 
     rpmte parent;		/*!< Parent transaction element. */
@@ -139,12 +126,17 @@ struct rpmte_s {
     int tree;			/*!< Tree index. */
     int depth;			/*!< Depth in dependency tree. */
     int breadth;		/*!< Breadth in dependency tree. */
+    int wave;			/*!< Parallel install schedule wave. */
     uint32_t db_instance;	/*!< Database Instance after add */
 /*@owned@*/
     tsortInfo tsi;		/*!< Dependency ordering chains. */
 
 /*@null@*/
     rpmPRCO PRCO;		/*!< Current dependencies. */
+/*@refcounted@*/ /*@null@*/
+    rpmps probs;		/*!< Dependency problems from last check. */
+    int checkrc;		/*!< Dependency check result from last check. */
+    int checked;		/*!< Has the element been dependency checked? */
 
 /*@null@*/
     rpmtxn txn;			/*!< Package transaction pointer. */
@@ -462,6 +454,24 @@ int rpmteBreadth(rpmte te)
 int rpmteSetBreadth(rpmte te, int nbreadth)
 	/*@modifies te @*/;
 
+/** \ingroup rpmte
+ * Retrieve schedule wave of transaction element.
+ * Elements in the same wave have no ordering relations between them.
+ * @param te		transaction element
+ * @return		wave (-1 if not scheduled)
+ */
+int rpmteWave(rpmte te)
+	/*@*/;
+
+/** \ingroup rpmte
+ * Set schedule wave of transaction element.
+ * @param te		transaction element
+ * @param nwave		new wave
+ * @return		previous wave
+ */
+int rpmteSetWave(rpmte te, int nwave)
+	/*@modifies te @*/;
+
 /** \ingroup rpmte
  * Retrieve tsort no. of predecessors of transaction element.
  * @param te		transaction element
@@ -555,7 +565,7 @@ void rpmteNewTSI(rpmte te)
 	/*@modifies te @*/;
 
 /** \ingroup rpmte
- * Destroy dependency set info of transaction element.
+ * Destroy dependency set (and dependency check) info of transaction element.
  * @param te		transaction element
  */
 /*@unused@*/
@@ -99,6 +99,8 @@ int rpmtsCloseDB(rpmts ts)
 	(void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_DBGET), &ts->rdb->db_getops);
 	(void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_DBPUT), &ts->rdb->db_putops);
 	(void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_DBDEL), &ts->rdb->db_delops);
+	ts->bfprobes += (unsigned) ts->rdb->db_bfprobes;
+	ts->bfavoided += (unsigned) ts->rdb->db_bfavoided;
 	rc = rpmdbClose(ts->rdb);
 	ts->rdb = NULL;
     }
@@ -610,6 +612,14 @@ void rpmtsClean(rpmts ts)
 
     ts->probs = rpmpsFree(ts->probs);
 
+    rpmtsCleanDepCache(ts);
+
+    ts->depchanged = (ts->depchanged ? htFree(ts->depchanged) : NULL);
+    ts->depchangedkeys = argvFree(ts->depchangedkeys);
+    ts->ndepchangedkeys = 0;
+    ts->depretry = 0;
+    ts->depcheckall = 1;
+
     rpmtsCleanDig(ts);
 }
 
@@ -637,6 +647,9 @@ void rpmtsEmpty(rpmts ts)
     ts->orderCount = 0;
     ts->ntrees = 0;
     ts->maxDepth = 0;
+    ts->waves = _free(ts->waves);
+    ts->wavex = _free(ts->wavex);
+    ts->nwaves = 0;
 
     ts->numRemovedPackages = 0;
 /*@-nullstate@*/	/* FIX: partial annotations */
@@ -692,6 +705,20 @@ static void rpmtsPrintStats(rpmts ts)
     rpmtsPrintStat("readhdr:     ", rpmtsOp(ts, RPMTS_OP_READHDR));
     rpmtsPrintStat("hdrload:     ", rpmtsOp(ts, RPMTS_OP_HDRLOAD));
     rpmtsPrintStat("hdrget:      ", rpmtsOp(ts, RPMTS_OP_HDRGET));
+    rpmtsPrintStat("sync:        ", rpmtsOp(ts, RPMTS_OP_SYNC));
+    rpmtsPrintStat("copy:        ", fdCopyOp(FDCOPY_RW));
+    rpmtsPrintStat("reflink:     ", fdCopyOp(FDCOPY_CLONE));
+    rpmtsPrintStat("copyrange:   ", fdCopyOp(FDCOPY_RANGE));
+    rpmtsPrintStat("splice:      ", fdCopyOp(FDCOPY_SPLICE));
+    if (ts->depcachehits + ts->depcachemisses > 0)
+	fprintf(stderr, "   depcache:     %8u hits %8u misses %5.1f%%\n",
+		ts->depcachehits, ts->depcachemisses,
+		(100.0 * ts->depcachehits)
+			/ (ts->depcachehits + ts->depcachemisses));
+    if (ts->bfprobes > 0)
+	fprintf(stderr, "   basenames bf: %8u probes %8u avoided %5.1f%%\n",
+		ts->bfprobes, ts->bfavoided,
+		(100.0 * ts->bfavoided) / ts->bfprobes);
 /*@-globstate@*/
     return;
 /*@=globstate@*/
@@ -736,6 +763,11 @@ assert(ts->txn == NULL);	/* XXX FIXME */
 /*@=refcounttrans@*/
 	ts->scriptFd = NULL;
     }
+    while (ts->nsyncfds > 0)
+	(void) close(ts->syncfds[--ts->nsyncfds]);
+    ts->syncfds = _free(ts->syncfds);
+    ts->syncdevs = _free(ts->syncdevs);
+
     ts->rootDir = _free(ts->rootDir);
     ts->currDir = _free(ts->currDir);
 
@@ -743,6 +775,9 @@ assert(ts->txn == NULL);	/* XXX FIXME */
     ts->order = _free(ts->order);
 /*@=type =voidabstract @*/
     ts->orderAlloced = 0;
+    ts->waves = _free(ts->waves);
+    ts->wavex = _free(ts->wavex);
+    ts->nwaves = 0;
 
     ts->keyring = rpmKeyringFree(ts->keyring);
     (void) rpmhkpFree(ts->hkp);
@@ -1032,6 +1067,116 @@ rpmuint32_t rpmtsSetTid(rpmts ts, rpmuint32_t tid)
     return otid;
 }
 
+rpmtsSyncMode rpmtsGetSyncMode(rpmts ts)
+{
+    return (ts != NULL ? ts->syncmode : RPMTS_SYNC_NONE);
+}
+
+rpmtsSyncMode rpmtsSetSyncMode(rpmts ts, rpmtsSyncMode syncmode)
+{
+    rpmtsSyncMode osyncmode = RPMTS_SYNC_NONE;
+    if (ts != NULL) {
+	osyncmode = ts->syncmode;
+	ts->syncmode = syncmode;
+    }
+    return osyncmode;
+}
+
+/**
+ * Files are synced from concurrent payload unpacks.
+ */
+#if defined(WITH_PTHREADS)
+/*@unchecked@*/
+static pthread_mutex_t _sync_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+int rpmtsSyncFile(rpmts ts, int fdno)
+{
+    struct rpmop_s op;
+    struct stat sb;
+    int rc = 0;
+    int i;
+
+    if (ts == NULL || ts->syncmode == RPMTS_SYNC_NONE || fdno < 0)
+	return 0;
+
+    memset(&op, 0, sizeof(op));
+    (void) rpmswEnter(&op, 0);
+    if (ts->syncmode == RPMTS_SYNC_FILE) {
+	rc = fdatasync(fdno);
+    } else {
+#if defined(HAVE_SYNC_FILE_RANGE) && defined(SYNC_FILE_RANGE_WRITE)
+	/* Start writeback now, rpmtsSync() waits for it. */
+	(void) sync_file_range(fdno, 0, 0, SYNC_FILE_RANGE_WRITE);
+#endif
+	if (fstat(fdno, &sb) < 0)
+	    rc = -1;
+    }
+    (void) rpmswExit(&op, 0);
+
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&_sync_mutex);
+#endif
+    if (rc == 0 && ts->syncmode != RPMTS_SYNC_FILE) {
+	for (i = 0; i < ts->nsyncfds; i++) {
+	    if (ts->syncdevs[i] == sb.st_dev)
+		/*@innerbreak@*/ break;
+	}
+	if (i == ts->nsyncfds) {
+	    int nfdno = dup(fdno);
+	    if (nfdno >= 0) {
+		ts->syncfds = xrealloc(ts->syncfds,
+				(ts->nsyncfds + 1) * sizeof(*ts->syncfds));
+		ts->syncdevs = xrealloc(ts->syncdevs,
+				(ts->nsyncfds + 1) * sizeof(*ts->syncdevs));
+		ts->syncfds[ts->nsyncfds] = nfdno;
+		ts->syncdevs[ts->nsyncfds] = sb.st_dev;
+		ts->nsyncfds++;
+	    }
+	}
+    }
+    op.count = 0;
+    (void) rpmswAdd(rpmtsOp(ts, RPMTS_OP_SYNC), &op);
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&_sync_mutex);
+#endif
+
+    return rc;
+}
+
+int rpmtsSync(rpmts ts)
+{
+    int rc = 0;
+
+    if (ts == NULL)
+	return 0;
+
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&_sync_mutex);
+#endif
+    if (ts->nsyncfds > 0) {
+	(void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_SYNC), 0);
+#if !defined(HAVE_SYNCFS)
+	sync();
+#endif
+	/* One syncfs(2) per file system written, waiting for the writeback. */
+	while (ts->nsyncfds > 0) {
+	    int fdno = ts->syncfds[--ts->nsyncfds];
+#if defined(HAVE_SYNCFS)
+	    if (syncfs(fdno) < 0)
+		rc = -1;
+#endif
+	    (void) close(fdno);
+	}
+	(void) rpmswExit(rpmtsOp(ts, RPMTS_OP_SYNC), 0);
+    }
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&_sync_mutex);
+#endif
+
+    return rc;
+}
+
 rpmPRCO rpmtsPRCO(rpmts ts)
 {
     rpmPRCO PRCO = NULL;
@@ -1273,7 +1418,7 @@ void * rpmtsNotify(rpmts ts, rpmte te,
 		rpmCallbackType what, rpmuint64_t amount, rpmuint64_t total)
 {
     void * ptr = NULL;
-    if (ts && ts->notify) {
+    if (ts && ts->notify && !ts->nonotify) {
 	Header h;
 	fnpyKey cbkey;
 	/*@-type@*/ /* FIX: cast? */
@@ -1317,6 +1462,29 @@ rpmte rpmtsElement(rpmts ts, int ix)
     /*@=compdef@*/
 }
 
+int rpmtsNWaves(rpmts ts)
+{
+    return (ts != NULL && ts->order != NULL ? ts->nwaves : 0);
+}
+
+int rpmtsWaveNElements(rpmts ts, int wave)
+{
+    int nelements = 0;
+    if (wave >= 0 && wave < rpmtsNWaves(ts))
+	nelements = ts->wavex[wave+1] - ts->wavex[wave];
+    return nelements;
+}
+
+rpmte rpmtsWaveElement(rpmts ts, int wave, int ix)
+{
+    rpmte te = NULL;
+    if (ix >= 0 && ix < rpmtsWaveNElements(ts, wave))
+	te = rpmtsElement(ts, ts->waves[ts->wavex[wave] + ix]);
+    /*@-compdef@*/
+    return te;
+    /*@=compdef@*/
+}
+
 rpmprobFilterFlags rpmtsFilterFlags(rpmts ts)
 {
     return (ts != NULL ? ts->ignoreSet : 0);
@@ -1500,6 +1668,22 @@ rpmts rpmtsCreate(void)
     ts->removedPackages = xcalloc(ts->allocedRemovedPackages,
 			sizeof(*ts->removedPackages));
 
+    ts->depcache = NULL;
+    ts->depcachekeys = NULL;
+    ts->ndepcachekeys = 0;
+    ts->depcachehits = 0;
+    ts->depcachemisses = 0;
+    ts->bfprobes = 0;
+    ts->bfavoided = 0;
+    ts->dlock = NULL;
+    ts->depchanged = NULL;
+    ts->depchangedkeys = NULL;
+    ts->ndepchangedkeys = 0;
+    ts->depretry = 0;
+    ts->depcheckall = 1;
+    ts->depcheckflags = 0;
+    ts->depcheckcolor = 0;
+
     ts->rootDir = NULL;
     ts->currDir = NULL;
     ts->chrootDone = 0;
@@ -1520,6 +1704,9 @@ rpmts rpmtsCreate(void)
     ts->order = NULL;
     ts->ntrees = 0;
     ts->maxDepth = 0;
+    ts->waves = NULL;
+    ts->wavex = NULL;
+    ts->nwaves = 0;
 
     ts->probs = NULL;
 
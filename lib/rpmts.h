@@ -136,9 +136,20 @@ typedef	enum rpmtsOpX_e {
     RPMTS_OP_HDRLOAD		= 18,
     RPMTS_OP_HDRGET		= 19,
     RPMTS_OP_DEBUG		= 20,
-    RPMTS_OP_MAX		= 20
+    RPMTS_OP_MAX		= 20,
+    RPMTS_OP_SYNC		= 21	/* XXX after MAX to keep the values above. */
 } rpmtsOpX;
 
+/** \ingroup rpmts
+ * When installed files are synced to disk (%_install_durability).
+ */
+typedef enum rpmtsSyncMode_e {
+    RPMTS_SYNC_NONE		= 0,	/*!< never (the default) */
+    RPMTS_SYNC_FILE		= 1,	/*!< fdatasync(2) each file before rename */
+    RPMTS_SYNC_PACKAGE		= 2,	/*!< syncfs(2) before a package's renames */
+    RPMTS_SYNC_TRANSACTION	= 3	/*!< syncfs(2) once per transaction */
+} rpmtsSyncMode;
+
 /** \ingroup rpmts
  * Transaction Types
  */
@@ -228,6 +239,7 @@ struct rpmts_s {
     rpmCallbackFunction notify;	/*!< Callback function. */
 /*@observer@*/ /*@null@*/
     rpmCallbackData notifyData;	/*!< Callback private data. */
+    int nonotify;		/*!< Suppress callbacks (concurrent unpacks)? */
 
 /*@null@*/
     rpmPRCO PRCO;		/*!< Current transaction dependencies. */
@@ -258,6 +270,27 @@ struct rpmts_s {
     int numRemovedPackages;	/*!< No. removed package instances. */
     int allocedRemovedPackages;	/*!< Size of removed packages array. */
 
+/*@only@*/ /*@null@*/
+    hashTable depcache;		/*!< Resolved dependency results. */
+/*@only@*/ /*@null@*/
+    const char ** depcachekeys;	/*!< Resolved dependency result keys. */
+    int ndepcachekeys;		/*!< No. of resolved dependency results. */
+    unsigned depcachehits;	/*!< No. of dependency result cache hits. */
+    unsigned depcachemisses;	/*!< No. of dependency result cache misses. */
+    unsigned bfprobes;		/*!< No. of basenames Bloom filter lookups. */
+    unsigned bfavoided;		/*!< No. of Basenames probes avoided. */
+/*@null@*/
+    yarnLock dlock;		/*!< Shared state lock (threaded checks). */
+/*@only@*/ /*@null@*/
+    hashTable depchanged;	/*!< Names added/erased since last check. */
+/*@only@*/ /*@null@*/
+    const char ** depchangedkeys; /*!< Names added/erased since last check. */
+    int ndepchangedkeys;	/*!< No. of names added/erased since last check. */
+    int depretry;		/*!< Re-check elements that had problems? */
+    int depcheckall;		/*!< Re-check all elements? */
+    rpmdepFlags depcheckflags;	/*!< Dependency flags at last check. */
+    rpmuint32_t depcheckcolor;	/*!< Transaction color at last check. */
+
 /*@only@*/
     rpmal addedPackages;	/*!< Set of packages being installed. */
     int numAddedPackages;	/*!< No. added package instances. */
@@ -284,6 +317,11 @@ struct rpmts_s {
     int unorderedSuccessors;	/*!< Index of 1st element of successors. */
     int ntrees;			/*!< No. of dependency trees. */
     int maxDepth;		/*!< Maximum depth of dependency tree(s). */
+/*@only@*/ /*@null@*/
+    int * waves;		/*!< Element indices, grouped by wave. */
+/*@only@*/ /*@null@*/
+    int * wavex;		/*!< Wave w is waves[wavex[w]:wavex[w+1]]. */
+    int nwaves;			/*!< No. of schedule waves (0 if unordered). */
 
 /*@dependent@*/ /*@relnull@*/
     rpmte teInstall;		/*!< current rpmtsAddInstallElement element. */
@@ -301,6 +339,13 @@ struct rpmts_s {
     int delta;			/*!< Delta for reallocation. */
     rpmuint32_t tid[2];		/*!< Transaction id. */
 
+    rpmtsSyncMode syncmode;	/*!< When are installed files synced? */
+/*@only@*/ /*@null@*/
+    int * syncfds;		/*!< Written file systems (to syncfs(2)). */
+/*@only@*/ /*@null@*/
+    dev_t * syncdevs;		/*!< Devices of the written file systems. */
+    int nsyncfds;		/*!< No. of written file systems. */
+
     rpmuint32_t color;		/*!< Transaction color bits. */
     rpmuint32_t prefcolor;	/*!< Preferred file color. */
 
@@ -312,7 +357,7 @@ struct rpmts_s {
 /*@relnull@*/
     void * hkp;			/*!< Pubkey validation container. */
 
-    struct rpmop_s ops[RPMTS_OP_MAX];
+    struct rpmop_s ops[RPMTS_OP_SYNC+1];
 
 /*@refcounted@*/ /*@relnull@*/
     pgpDig dig;			/*!< Current signature/pubkey parameters. */
@@ -359,6 +404,10 @@ int _rpmtsCheck(rpmts ts)
  * topological sort (Knuth vol. 1, p. 262). Use rpmtsCheck() to verify
  * that all dependencies can be resolved.
  *
+ * Relations are kept as arrays indexed by element, and each loop is broken
+ * by removing the Requires's that hold back a single member of the loop,
+ * so the sort is linear in the no. of elements and relations.
+ *
  * The final order ends up as installed packages followed by removed packages,
  * with packages removed for upgrades immediately following the new package
  * to be installed.
@@ -372,9 +421,6 @@ extern int (*rpmtsOrder) (rpmts ts)
 int _rpmtsOrder(rpmts ts)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
 	/*@modifies ts, rpmGlobalMacroContext, fileSystem, internalState @*/;
-int _orgrpmtsOrder(rpmts ts)
-	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
-	/*@modifies ts, rpmGlobalMacroContext, fileSystem, internalState @*/;
 
 /** \ingroup rpmts
  * Process all package elements in a transaction set.  Before calling
@@ -633,6 +679,13 @@ void rpmtsCleanDig(rpmts ts)
 	/*@globals fileSystem @*/
 	/*@modifies ts, fileSystem @*/;
 
+/** \ingroup rpmts
+ * Invalidate resolved dependency results cached by rpmtsCheck().
+ * @param ts		transaction set
+ */
+void rpmtsCleanDepCache(rpmts ts)
+	/*@modifies ts @*/;
+
 /** \ingroup rpmts
  * Free memory needed only for dependency checks and ordering.
  * @param ts		transaction set
@@ -801,6 +854,46 @@ rpmuint32_t rpmtsGetTid(rpmts ts)
 rpmuint32_t rpmtsSetTid(rpmts ts, rpmuint32_t tid)
 	/*@modifies ts @*/;
 
+/** \ingroup rpmts
+ * Get when installed files are synced to disk.
+ * @param ts		transaction set
+ * @return		sync mode
+ */
+rpmtsSyncMode rpmtsGetSyncMode(rpmts ts)
+	/*@*/;
+
+/** \ingroup rpmts
+ * Set when installed files are synced to disk.
+ * @param ts		transaction set
+ * @param syncmode	new sync mode
+ * @return		previous sync mode
+ */
+rpmtsSyncMode rpmtsSetSyncMode(rpmts ts, rpmtsSyncMode syncmode)
+	/*@modifies ts @*/;
+
+/** \ingroup rpmts
+ * Apply the sync mode to a just written (installed) file.
+ *
+ * RPMTS_SYNC_FILE waits for the file data with fdatasync(2). Otherwise
+ * writeback of the file is started (sync_file_range(2)) and its file
+ * system is remembered for rpmtsSync().
+ * @param ts		transaction set
+ * @param fdno		file descriptor of the written file
+ * @return		0 on success, -1 on error
+ */
+int rpmtsSyncFile(rpmts ts, int fdno)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies ts, fileSystem, internalState @*/;
+
+/** \ingroup rpmts
+ * Sync (syncfs(2)) the file systems written since the last sync.
+ * @param ts		transaction set
+ * @return		0 on success, -1 on error
+ */
+int rpmtsSync(rpmts ts)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies ts, fileSystem, internalState @*/;
+
 /** \ingroup rpmts
  * Get OpenPGP packet parameters, i.e. signature/pubkey constants.
  * @param ts		transaction set
@@ -906,6 +999,41 @@ int rpmtsNElements(rpmts ts)
 rpmte rpmtsElement(rpmts ts, int ix)
 	/*@*/;
 
+/** \ingroup rpmts
+ * Return no. of waves in the parallel install schedule from rpmtsOrder().
+ *
+ * Each element is scheduled in the wave after the last wave of the
+ * elements that it is ordered behind, so that elements within a wave
+ * have no ordering relations between them (except relations removed to
+ * break dependency loops), and each wave need only wait for the waves
+ * before it. The schedule is discarded when elements are added or erased.
+ * @param ts		transaction set
+ * @return		no. of waves (0 if not ordered)
+ */
+int rpmtsNWaves(rpmts ts)
+	/*@*/;
+
+/** \ingroup rpmts
+ * Return no. of transaction set elements in a schedule wave.
+ * @param ts		transaction set
+ * @param wave		wave index
+ * @return		no. of elements in wave
+ */
+int rpmtsWaveNElements(rpmts ts, int wave)
+	/*@*/;
+
+/** \ingroup rpmts
+ * Return transaction set element in a schedule wave.
+ * Elements within a wave are in the (linear) order of rpmtsElement().
+ * @param ts		transaction set
+ * @param wave		wave index
+ * @param ix		element index within wave
+ * @return		transaction element (or NULL)
+ */
+/*@null@*/ /*@dependent@*/
+rpmte rpmtsWaveElement(rpmts ts, int wave, int ix)
+	/*@*/;
+
 /** \ingroup rpmts
  * Get problem ignore bit mask, i.e. bits to filter encountered problems.
  * @param ts		transaction set
@@ -0,0 +1,246 @@
+#include "system.h"
+#include <sys/resource.h>
+#include <rpmio.h>
+#include <rpmiotypes.h>
+#include <rpmsw.h>
+#include <rpmstrpool.h>
+
+#include <rpmtag.h>
+#include <rpmtypes.h>
+#include <rpmmacro.h>
+#define	_RPMDS_INTERNAL
+#include <rpmds.h>
+#include <rpmal.h>
+#include <rpmps.h>
+#include <rpmte.h>
+#include <rpmts.h>
+#include "tsynth.h"
+
+#include "debug.h"
+
+/*
+ * Benchmark: dependency sets with and without interned names/EVRs.
+ *	tds [intern [npkgs [nprovides [nrequires]]]]
+ * Run once with intern 0 and once with intern 1 (default) to compare
+ * peak RSS.
+ *
+ * The problems from a threaded, incremental rpmtsCheck() are then compared
+ * with those from a serial check of a fresh transaction, exit status is
+ * non-zero on any mismatch.
+ */
+
+static unsigned npkgs = 5000;
+static unsigned nprovides = 10;
+static unsigned nrequires = 30;
+static unsigned nwords = 2000;
+
+/* Build a synthetic package header, dependencies drawn from a vocabulary. */
+static Header mkHeader(unsigned ix)
+{
+    Header h;
+    unsigned nb = (nprovides > nrequires ? nprovides : nrequires) + 1;
+    const char ** N = xcalloc(nb, sizeof(*N));
+    const char ** EVR = xcalloc(nb, sizeof(*EVR));
+    rpmuint32_t * F = xcalloc(nb, sizeof(*F));
+    char * b = xcalloc(nb, 64);
+    char n[64];
+    unsigned i;
+
+    (void) snprintf(n, sizeof(n), "package-%u", ix);
+    h = tsynthNew(n, "1.0", "1", NULL);
+
+    N[0] = n;
+    EVR[0] = "0:1.0-1";
+    F[0] = RPMSENSE_EQUAL;
+    for (i = 1; i < nprovides + 1; i++) {
+	N[i] = b + 64 * i;
+	(void) snprintf(b + 64 * i, 64, "libword%u.so.1()(64bit)",
+		(ix * nprovides + i) % nwords);
+	EVR[i] = "";
+	F[i] = 0;
+    }
+    tsynthDeps(h, RPMTAG_PROVIDENAME, N, EVR, F, nprovides + 1);
+
+    for (i = 0; i < nrequires; i++) {
+	N[i] = b + 64 * i;
+	(void) snprintf(b + 64 * i, 64, "libword%u.so.1()(64bit)",
+		(ix * 7919 + i * 104729) % (nwords + nwords / 10));
+	EVR[i] = "";
+	F[i] = 0;
+    }
+    tsynthDeps(h, RPMTAG_REQUIRENAME, N, EVR, F, nrequires);
+
+    b = _free(b);
+    F = _free(F);
+    EVR = _free(EVR);
+    N = _free(N);
+    return h;
+}
+
+static int run(FILE * fp)
+{
+    rpmds * R = xcalloc(npkgs, sizeof(*R));
+    rpmal al = rpmalNew(npkgs);
+    struct rpmsw_s begin, end;
+    unsigned nfound = 0;
+    unsigned nmissing = 0;
+    unsigned i;
+
+    (void) rpmswNow(&begin);
+    for (i = 0; i < npkgs; i++) {
+	Header h = mkHeader(i);
+	rpmds P = rpmdsNew(h, RPMTAG_PROVIDENAME, 0);
+	R[i] = rpmdsNew(h, RPMTAG_REQUIRENAME, 0);
+	(void) rpmalAdd(&al, RPMAL_NOMATCH, (fnpyKey)(long)(i + 1), P, NULL, 0);
+	(void)rpmdsFree(P);
+	(void)headerFree(h);
+    }
+    rpmalMakeIndex(al);
+    fprintf(fp, "    build:   %10u usecs\n",
+	(unsigned) rpmswDiff(rpmswNow(&end), &begin));
+
+    (void) rpmswNow(&begin);
+    for (i = 0; i < npkgs; i++) {
+	rpmds ds = rpmdsInit(R[i]);
+	while (rpmdsNext(ds) >= 0) {
+	    fnpyKey * keys = rpmalAllSatisfiesDepend(al, ds, NULL);
+	    if (keys != NULL)
+		nfound++;
+	    else
+		nmissing++;
+	    keys = _free(keys);
+	}
+    }
+    fprintf(fp, "    resolve: %10u usecs %u found %u missing\n",
+	(unsigned) rpmswDiff(rpmswNow(&end), &begin), nfound, nmissing);
+    rpmstrPoolPrintStats(rpmdsStrPool(), fp);
+
+    for (i = 0; i < npkgs; i++)
+	(void)rpmdsFree(R[i]);
+    R = _free(R);
+    (void)rpmalFree(al);
+    return 0;
+}
+
+/* Add synthetic (binary) packages [from, to) to a transaction. */
+static void addElements(rpmts ts, unsigned from, unsigned to)
+{
+    unsigned i;
+
+    for (i = from; i < to; i++) {
+	Header h = mkHeader(i);
+	tsynthPut(h, RPMTAG_ARCH, RPM_STRING_TYPE, "noarch", 1);
+	tsynthPut(h, RPMTAG_OS, RPM_STRING_TYPE, "linux", 1);
+	tsynthPut(h, RPMTAG_SOURCERPM, RPM_STRING_TYPE,
+		"package-1.0-1.src.rpm", 1);
+	(void) rpmtsAddInstallElement(ts, h, (fnpyKey)(long)(i + 1), 0, NULL);
+	(void)headerFree(h);
+    }
+}
+
+/* Create a transaction without an rpmdb or a solver. */
+static rpmts mkTransaction(void)
+{
+    rpmts ts = rpmtsCreate();
+    (void) rpmtsSetDBMode(ts, -1);
+    (void) rpmtsSetSolveCallback(ts, NULL, NULL);
+    return ts;
+}
+
+/* Check a transaction with nthreads workers, return its problems. */
+static rpmps checkTransaction(rpmts ts, const char * nthreads)
+{
+    addMacro(NULL, "_dependency_threads", NULL, nthreads, RMIL_CMDLINE);
+    (void) rpmtsCheck(ts);
+    delMacro(NULL, "_dependency_threads");
+    return rpmtsProblems(ts);
+}
+
+/* Count the problems that differ between two problem sets. */
+static unsigned cmpProblems(FILE * fp, rpmps a, rpmps b)
+{
+    rpmpsi ai = rpmpsInitIterator(a);
+    rpmpsi bi = rpmpsInitIterator(b);
+    unsigned nbad = 0;
+
+    while (1) {
+	int ax = rpmpsNextIterator(ai);
+	int bx = rpmpsNextIterator(bi);
+	const char * as;
+	const char * bs;
+
+	if (ax < 0 && bx < 0)
+	    break;
+	as = (ax >= 0 ? rpmProblemString(rpmpsProblem(ai)) : xstrdup("(none)"));
+	bs = (bx >= 0 ? rpmProblemString(rpmpsProblem(bi)) : xstrdup("(none)"));
+	if (strcmp(as, bs)) {
+	    if (nbad++ == 0)
+		fprintf(fp, "    serial:   %s\n    threaded: %s\n", as, bs);
+	}
+	as = _free(as);
+	bs = _free(bs);
+    }
+    ai = rpmpsFreeIterator(ai);
+    bi = rpmpsFreeIterator(bi);
+    return nbad;
+}
+
+/*
+ * Grow a transaction in steps, checking it threaded and incrementally after
+ * each step, and compare with a serial check of the same packages. The last
+ * step adds nothing, all the saved results are reused.
+ */
+static int verify(FILE * fp)
+{
+    unsigned nmax = (npkgs < 1000 ? npkgs : 1000);
+    unsigned steps[] = { nmax / 16, nmax / 4, nmax, nmax };
+    rpmts its = mkTransaction();
+    unsigned nbad = 0;
+    unsigned i;
+
+    for (i = 0; i < sizeof(steps)/sizeof(steps[0]); i++) {
+	rpmts sts = mkTransaction();
+	rpmps sps, ips;
+	unsigned nstep;
+
+	addElements(sts, 0, steps[i]);
+	addElements(its, (i > 0 ? steps[i-1] : 0), steps[i]);
+
+	sps = checkTransaction(sts, "0");
+	ips = checkTransaction(its, "4");
+	nstep = cmpProblems(fp, sps, ips);
+	fprintf(fp, "    check:   %10u elements %d problems %u mismatched\n",
+		steps[i], rpmpsNumProblems(sps), nstep);
+	nbad += nstep;
+
+	ips = rpmpsFree(ips);
+	sps = rpmpsFree(sps);
+	(void)rpmtsFree(sts);
+    }
+    (void)rpmtsFree(its);
+    return (nbad != 0);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct rusage ru;
+    int ec;
+
+    _rpmds_intern = (argc > 1 ? atoi(argv[1]) : 1);
+    if (argc > 2) npkgs = (unsigned) atol(argv[2]);
+    if (argc > 3) nprovides = (unsigned) atol(argv[3]);
+    if (argc > 4) nrequires = (unsigned) atol(argv[4]);
+
+    (void) rpmswInit();
+    fprintf(stdout, "%u packages, %u provides, %u requires each\n",
+	npkgs, nprovides + 1, nrequires);
+    fprintf(stdout, "_rpmds_intern = %d\n", _rpmds_intern);
+
+    ec = (run(stdout) ? EXIT_FAILURE : EXIT_SUCCESS);
+    if (verify(stdout))
+	ec = EXIT_FAILURE;
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+	fprintf(stdout, "    peak RSS: %8ld KB\n", ru.ru_maxrss);
+    return ec;
+}
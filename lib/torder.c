@@ -0,0 +1,150 @@
+#include "system.h"
+#include <sys/resource.h>
+#include <rpmio.h>
+#include <rpmiotypes.h>
+#include <rpmsw.h>
+
+#include <rpmtag.h>
+#include <rpmtypes.h>
+#include <rpmds.h>
+#include <rpmte.h>
+#include <rpmts.h>
+#include "tsynth.h"
+
+#include "debug.h"
+
+/*
+ * Benchmark: rpmtsOrder() on a synthetic transaction with loops.
+ *	torder [nelements [nrequires [nloops]]]
+ * Every package requires its predecessor and nrequires pseudo-random earlier
+ * packages, and every nloops'th package also requires a later package,
+ * closing a loop.
+ */
+
+static unsigned nelements = 20000;
+static unsigned nrequires = 8;
+static unsigned nloops = 50;
+
+/* Return the packages required by package ix. */
+static unsigned mkRequires(unsigned ix, unsigned * R)
+{
+    unsigned nr = 0;
+    unsigned i;
+
+    if (ix > 0)
+	R[nr++] = ix - 1;
+    for (i = 0; ix > 1 && i < nrequires; i++)
+	R[nr++] = (ix * 7919 + i * 104729) % ix;
+    if (nloops > 0 && (ix % nloops) == 0 && ix + 3 < nelements)
+	R[nr++] = ix + 3;
+    return nr;
+}
+
+/* Build a synthetic (binary) package header. */
+static Header mkHeader(unsigned ix, unsigned * R)
+{
+    Header h;
+    unsigned nr = mkRequires(ix, R);
+    const char ** N = xcalloc(nr + 1, sizeof(*N));
+    const char ** EVR = xcalloc(nr + 1, sizeof(*EVR));
+    rpmuint32_t * F = xcalloc(nr + 1, sizeof(*F));
+    char * b = xcalloc(nr + 1, 32);
+    char n[32];
+    unsigned i;
+
+    (void) snprintf(n, sizeof(n), "package-%u", ix);
+    h = tsynthNew(n, "1.0", "1", "noarch");
+    tsynthPut(h, RPMTAG_OS, RPM_STRING_TYPE, "linux", 1);
+    tsynthPut(h, RPMTAG_SOURCERPM, RPM_STRING_TYPE, "package-1.0-1.src.rpm", 1);
+
+    N[0] = n;
+    EVR[0] = "1.0-1";
+    F[0] = RPMSENSE_EQUAL;
+    tsynthDeps(h, RPMTAG_PROVIDENAME, N, EVR, F, 1);
+
+    for (i = 0; i < nr; i++) {
+	N[i] = b + 32 * i;
+	(void) snprintf(b + 32 * i, 32, "package-%u", R[i]);
+	EVR[i] = "";
+	F[i] = 0;
+    }
+    tsynthDeps(h, RPMTAG_REQUIRENAME, N, EVR, F, nr);
+
+    b = _free(b);
+    F = _free(F);
+    EVR = _free(EVR);
+    N = _free(N);
+    return h;
+}
+
+static int run(FILE * fp)
+{
+    rpmts ts = rpmtsCreate();
+    unsigned * R = xcalloc(nrequires + 3, sizeof(*R));
+    unsigned * pos = xcalloc(nelements, sizeof(*pos));
+    struct rpmsw_s begin, end;
+    struct rusage ru0, ru1;
+    unsigned nviolated = 0;
+    unsigned nordered = 0;
+    rpmtsi pi;
+    rpmte p;
+    unsigned i, j;
+    int rc;
+
+    (void) rpmswNow(&begin);
+    for (i = 0; i < nelements; i++) {
+	Header h = mkHeader(i, R);
+	(void) rpmtsAddInstallElement(ts, h, (fnpyKey)(long)(i + 1), 0, NULL);
+	(void)headerFree(h);
+    }
+    fprintf(fp, "    add:     %10u usecs\n",
+	(unsigned) rpmswDiff(rpmswNow(&end), &begin));
+
+    (void) getrusage(RUSAGE_SELF, &ru0);
+    (void) rpmswNow(&begin);
+    rc = rpmtsOrder(ts);
+    fprintf(fp, "    order:   %10u usecs rc %d\n",
+	(unsigned) rpmswDiff(rpmswNow(&end), &begin), rc);
+    (void) getrusage(RUSAGE_SELF, &ru1);
+    fprintf(fp, "    RSS growth: %7ld KB\n", ru1.ru_maxrss - ru0.ru_maxrss);
+
+    /* Count the requires that are not ordered before their requirer. */
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, 0)) != NULL)
+	pos[(long) rpmteKey(p) - 1] = nordered++;
+    pi = rpmtsiFree(pi);
+    for (i = 0; i < nelements; i++) {
+	unsigned nr = mkRequires(i, R);
+	for (j = 0; j < nr; j++)
+	    if (pos[R[j]] > pos[i])
+		nviolated++;
+    }
+    fprintf(fp, "    %u elements, %u requires ordered after their requirer\n",
+	nordered, nviolated);
+    fprintf(fp, "    %d waves\n", rpmtsNWaves(ts));
+
+    pos = _free(pos);
+    R = _free(R);
+    (void)rpmtsFree(ts);
+    return (rc != 0 || nordered != nelements);
+}
+
+int
+main(int argc, char *argv[])
+{
+    struct rusage ru;
+    int ec;
+
+    if (argc > 1) nelements = (unsigned) atol(argv[1]);
+    if (argc > 2) nrequires = (unsigned) atol(argv[2]);
+    if (argc > 3) nloops = (unsigned) atol(argv[3]);
+
+    (void) rpmswInit();
+    fprintf(stdout, "%u elements, %u requires each, a loop every %u\n",
+	nelements, nrequires + 1, nloops);
+
+    ec = (run(stdout) ? EXIT_FAILURE : EXIT_SUCCESS);
+    if (getrusage(RUSAGE_SELF, &ru) == 0)
+	fprintf(stdout, "    peak RSS: %8ld KB\n", ru.ru_maxrss);
+    return ec;
+}
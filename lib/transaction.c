@@ -874,6 +874,9 @@ rpmmi rpmtsFindBaseNamesInDB(rpmts ts, uint32_t fileCount)
     size_t m = 0;
     size_t k = 0;
     rpmbf bf;
+    ARGV_t av = NULL;
+    unsigned nprobes = 0;
+    unsigned navoided = 0;
 
 FPSDEBUG(0, (stderr, "--> %s(%p,%u)\n", __FUNCTION__, ts, (unsigned)fileCount));
     rpmbfParams(n, e, &m, &k);
@@ -892,7 +895,7 @@ FPSDEBUG(0, (stderr, "--> %s(%p,%u)\n", __FUNCTION__, ts, (unsigned)fileCount));
 	ptr = rpmtsNotify(ts, NULL, RPMCALLBACK_TRANS_PROGRESS, rpmtsiOc(pi),
 		    ts->orderCount);
 
-	/* Gather all installed headers with matching basename's. */
+	/* Collect the unique basenames, the index is searched once. */
 	fi = rpmfiInit(fi, 0);
 	while ((i = rpmfiNext(fi)) >= 0) {
 	    s = rpmfiBN(fi);
@@ -902,15 +905,28 @@ FPSDEBUG(0, (stderr, "--> %s(%p,%u)\n", __FUNCTION__, ts, (unsigned)fileCount));
 		/*@innercontinue@*/ continue;
 	    if (rpmbfChk(bf, s, ns))
 		/*@innercontinue@*/ continue;
+	    xx = rpmbfAdd(bf, s, ns);
+	    nprobes++;
 
-	    xx = rpmmiGrowBasename(mi, s);
+	    /* Skip the index probe if no installed file has the basename. */
+	    if (!rpmdbChkBasename(rpmtsGetRdb(ts), s, ns)) {
+		navoided++;
+		/*@innercontinue@*/ continue;
+	    }
 
-	    xx = rpmbfAdd(bf, s, ns);
+	    xx = argvAdd(&av, s);
 	 }
     }
     pi = rpmtsiFree(pi);
     bf = rpmbfFree(bf);
 
+    /* Gather all installed headers with matching basename's. */
+    xx = rpmmiGrowKeys(mi, _tag, av);
+    av = argvFree(av);
+
+    rpmlog(RPMLOG_DEBUG, D_("%u of %u Basenames index probes avoided\n"),
+		navoided, nprobes);
+
     (void) rpmmiSort(mi);
 
     return mi;
@@ -1265,11 +1281,16 @@ static void rpmtsAddFingerprints(rpmts ts, uint32_t fileCount, hashTable ht,
     rpmtsi pi;
     rpmte p;
     rpmfi fi;
+    rpmte * pa;
+    int npa;
     int i;
+    int j;
 
     hashTable symlinks = htCreate(fileCount/16+16, 0, 0, fpHashFunction, fpEqual);
 
 FPSDEBUG(0, (stderr, "--> %s(%p,%u,%p,%p)\n", __FUNCTION__, ts, (unsigned)fileCount, ht, fpc));
+    pa = xcalloc(rpmtsNElements(ts) + 1, sizeof(*pa));
+    npa = 0;
     pi = rpmtsiInit(ts);
     while ((p = rpmtsiNext(pi, 0)) != NULL) {
 	(void) rpmdbCheckSignals();
@@ -1277,12 +1298,26 @@ FPSDEBUG(0, (stderr, "--> %s(%p,%u,%p,%p)\n", __FUNCTION__, ts, (unsigned)fileCo
 	if (p->isSource) continue;
 	if ((fi = rpmtsiFi(pi)) == NULL)
 	    continue;	/* XXX can't happen */
+	pa[npa++] = p;
+    }
+    pi = rpmtsiFree(pi);
 
-	(void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), 0);
-
-	rpmfiFpLookup(fi, fpc);
-
-	/* Collect symlinks. */
+    /*
+     * Compute finger prints for all elements. Each element's finger
+     * prints are independent, and the (sharded) cache is safe to share.
+     */
+    (void) rpmswEnter(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), 0);
+#if defined(_OPENMP)
+    #pragma omp parallel for schedule(dynamic) if (npa > 1)
+#endif
+    for (j = 0; j < npa; j++)
+	rpmfiFpLookup(rpmteFI(pa[j], RPMTAG_BASENAMES), fpc);
+    (void) rpmswExit(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), fileCount);
+
+    /* Collect symlinks (in transaction order). */
+    for (j = 0; j < npa; j++) {
+	p = pa[j];
+	fi = rpmteFI(p, RPMTAG_BASENAMES);
  	fi = rpmfiInit(fi, 0);
  	if (fi != NULL)		/* XXX lclint */
 	while ((i = rpmfiNext(fi)) >= 0) {
@@ -1308,11 +1343,8 @@ FPSDEBUG(0, (stderr, "--> %s(%p,%u,%p,%p)\n", __FUNCTION__, ts, (unsigned)fileCo
 	    }
 #endif
 	}
-
-	(void) rpmswExit(rpmtsOp(ts, RPMTS_OP_FINGERPRINT), rpmfiFC(fi));
-
     }
-    pi = rpmtsiFree(pi);
+    pa = _free(pa);
 
     /* ===============================================
      * Check fingerprints if they contain symlinks
@@ -1433,6 +1465,92 @@ FPSDEBUG(0, (stderr, "--> %s(%p,%p)\n", __FUNCTION__, ts, sx));
     return 0;
 }
 
+/**
+ * Persist the directory finger print cache for the next transaction.
+ * Paths of removed packages are left out, they may be gone afterwards.
+ * The cache is written as fn.new, rpmtsCommitFingerprints() renames it
+ * once the transaction has succeeded.
+ * @param ts		transaction set
+ * @param fpc		finger print cache
+ * @param fn		persisted cache file name
+ */
+static void rpmtsSaveFingerprints(rpmts ts, fingerPrintCache fpc,
+		const char * fn)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies ts, fileSystem, internalState @*/
+{
+    ARGV_t av = NULL;
+    hashTable exclude;
+    rpmtsi pi;
+    rpmte p;
+    rpmfi fi;
+    int ac;
+    int i;
+    int xx;
+
+    pi = rpmtsiInit(ts);
+    while ((p = rpmtsiNext(pi, TR_REMOVED)) != NULL) {
+	if ((fi = rpmteFI(p, RPMTAG_BASENAMES)) == NULL)
+	    continue;	/* XXX can't happen */
+	for (i = 0; i < (int)fi->dc; i++) {
+	    char * dn = xstrdup(fi->dnl[i]);
+	    size_t ndn = strlen(dn);
+	    if (ndn > 1 && dn[ndn-1] == '/')
+		dn[ndn-1] = '\0';
+	    xx = argvAdd(&av, dn);
+	    dn = _free(dn);
+	}
+	fi = rpmfiInit(fi, 0);
+	if (fi != NULL)
+	while ((i = rpmfiNext(fi)) >= 0)
+	    xx = argvAdd(&av, rpmfiFN(fi));
+    }
+    pi = rpmtsiFree(pi);
+
+    ac = argvCount(av);
+    exclude = htCreate(ac + 1, 0, 0, NULL, NULL);
+    for (i = 0; i < ac; i++)
+	htAddEntry(exclude, av[i], av[i]);
+    {	const char * nfn = rpmGetPath(fn, ".new", NULL);
+	xx = fpCacheSave(fpc, nfn, exclude);
+	nfn = _free(nfn);
+    }
+    exclude = htFree(exclude);
+    av = argvFree(av);
+}
+
+/**
+ * Replace the persisted finger print cache with the one written by
+ * rpmtsSaveFingerprints(), or discard it.
+ * @param ts		transaction set
+ * @param ok		did the transaction succeed?
+ */
+static void rpmtsCommitFingerprints(rpmts ts, int ok)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    const char * rootDir = rpmtsRootDir(ts);
+    const char * fn = rpmGetPath("%{?_fprint_cache}", NULL);
+    const char * nfn;
+    int xx;
+
+    /* The cache was written inside the chroot. */
+    if (fn == NULL || *fn != '/' || (rpmtsFlags(ts) & RPMTRANS_FLAG_TEST)) {
+	fn = _free(fn);
+	return;
+    }
+    if (rootDir != NULL && strcmp(rootDir, "/") && *rootDir == '/') {
+	const char * rfn = rpmGetPath(rootDir, fn, NULL);
+	fn = _free(fn);
+	fn = rfn;
+    }
+    nfn = rpmGetPath(fn, ".new", NULL);
+    if (!(ok && Rename(nfn, fn) == 0))
+	xx = Unlink(nfn);
+    nfn = _free(nfn);
+    fn = _free(fn);
+}
+
 static int rpmtsPrepare(rpmts ts, rpmsx sx, uint32_t fileCount,
 		uint32_t * nrmvdp)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
@@ -1441,6 +1559,7 @@ static int rpmtsPrepare(rpmts ts, rpmsx sx, uint32_t fileCount,
     rpmtsi pi;
     rpmte p;
     fingerPrintCache fpc;
+    const char * fpcfn = NULL;
     rpmfi fi;
     int xx;
     int rc = 0;
@@ -1542,6 +1661,9 @@ rpmlog(RPMLOG_DEBUG, D_("computing %u file fingerprints\n"), (unsigned)fileCount
 
     ts->ht = htCreate(fileCount/2 + 1, 0, 1, fpHashFunction, fpEqual);
     fpc = fpCacheCreate(fileCount/2 + 10001);
+    fpcfn = rpmGetPath("%{?_fprint_cache}", NULL);
+    xx = fpCacheLoad(fpc, fpcfn,
+		(time_t) rpmExpandNumeric("%{?_fprint_cache_ttl}"));
 
 #endif	/* REFERENCE */
 
@@ -1604,6 +1726,11 @@ rpmlog(RPMLOG_DEBUG, D_("computing %u file fingerprints\n"), (unsigned)fileCount
     }
     pi = rpmtsiFree(pi);
 
+    /* Persist directory finger prints (still inside the chroot). */
+    if (fpcfn != NULL && *fpcfn == '/'
+     && !(rpmtsFlags(ts) & RPMTRANS_FLAG_TEST))
+	rpmtsSaveFingerprints(ts, fpc, fpcfn);
+
     if (rpmtsChrootDone(ts)) {
 	const char * rootDir = rpmtsRootDir(ts);
 	const char * currDir = rpmtsCurrDir(ts);
@@ -1647,10 +1774,330 @@ exit:
     ts->ht = htFree(ts->ht);
 #endif	/* REFERENCE */
     fpc = fpCacheFree(fpc);
+    fpcfn = _free(fpcfn);
 
     return rc;
 }
 
+/**
+ * Force add a failed package into the rpmdb.
+ * @param ts		current transaction set
+ * @param p 		failed rpmte. 
+ * @return 		RPMRC_OK, or RPMRC_FAIL
+ */
+static rpmRC _processFailedPackage(rpmts ts, rpmte p)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, p, rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/;
+
+/**
+ * Open the package of an added element, recreating its file info set.
+ * @param ts		transaction set
+ * @param p		added element
+ * @param psm		package state machine data
+ * @return		1 if the package was opened
+ */
+static int rpmtsOpenAdded(rpmts ts, rpmte p, rpmpsm psm)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, p, psm, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    rpmfi fi = p->fi;
+
+    if ((p->h = rpmteFDHeader(ts, p)) == NULL || rpmteFd(p) == NULL)
+	return 0;
+
+    /*
+     * XXX Sludge necessary to transfer existing fstates/actions
+     * XXX around a recreated file info set.
+     */
+    {	rpmuint8_t * fstates = fi->fstates;
+	iosmFileAction * actions = (iosmFileAction *) fi->actions;
+	int mapflags = fi->mapflags;
+	rpmte savep;
+	int scareMem = 0;
+
+	psm->fi = rpmfiFree(psm->fi);
+
+	fi->fstates = NULL;
+	fi->actions = NULL;
+/*@-nullstate@*/ /* FIX: fi->actions is NULL */
+	fi = rpmfiFree(fi);
+/*@=nullstate@*/
+
+	savep = rpmtsSetRelocateElement(ts, p);
+	fi = rpmfiNew(ts, p->h, RPMTAG_BASENAMES, scareMem);
+	(void) rpmtsSetRelocateElement(ts, savep);
+
+	if (fi != NULL) {	/* XXX can't happen */
+	    fi->te = p;
+	    fi->fstates = _free(fi->fstates);
+	    fi->fstates = fstates;
+	    fi->actions = _free(fi->actions);
+	    fi->actions = (int *) actions;
+	    if (mapflags & IOSM_SBIT_CHECK)
+		fi->mapflags |= IOSM_SBIT_CHECK;
+	    p->fi = fi;
+	}
+    }
+
+    psm->fi = rpmfiLink(p->fi, __FUNCTION__);
+    return 1;
+}
+
+/**
+ * Collect the added elements, starting at an order index, whose payloads
+ * can be unpacked concurrently.
+ *
+ * Consecutive elements of the same install wave have no ordering relations
+ * between them. Elements that share a file path are not batched, so that
+ * no two unpacks race on the same file.
+ * @param ts		transaction set
+ * @param oc		order index of the first element
+ * @param nthreads	max. no. of elements in a batch
+ * @retval batch	batch elements
+ * @return		no. of elements in the batch
+ */
+static int rpmtsUnpackBatch(rpmts ts, int oc, int nthreads, rpmte * batch)
+	/*@modifies batch @*/
+{
+    hashTable ht;
+    ARGV_t keys = NULL;
+    int nkeys = 0;
+    int wave;
+    int nb = 0;
+
+    if (nthreads <= 1 || rpmtsNWaves(ts) <= 0)
+	return 0;
+    if (rpmtsFlags(ts) & (RPMTRANS_FLAG_TEST | RPMTRANS_FLAG_JUSTDB))
+	return 0;
+    /* XXX a serial unpack runs within a rpmdb transaction, a batch can't. */
+    if (rpmdbTxnEnabled(rpmtsGetRdb(ts)))
+	return 0;
+
+    wave = rpmteWave(rpmtsElement(ts, oc));
+    ht = htCreate(1023, 0, 0, NULL, NULL);
+    while (nb < nthreads) {
+	rpmte p = rpmtsElement(ts, oc + nb);
+	rpmfi fi;
+	int conflict = 0;
+
+	if (p == NULL || rpmteType(p) != TR_ADDED || rpmteFailed(p)
+	 || rpmteIsSource(p) || rpmteWave(p) != wave)
+	    break;
+
+	fi = rpmfiInit(rpmteFI(p, RPMTAG_BASENAMES), 0);
+	if (fi != NULL)
+	while (rpmfiNext(fi) >= 0) {
+	    if (htHasEntry(ht, rpmfiFN(fi))) {
+		conflict = 1;
+		/*@innerbreak@*/ break;
+	    }
+	}
+	if (conflict)
+	    break;
+
+	fi = rpmfiInit(fi, 0);
+	if (fi != NULL)
+	while (rpmfiNext(fi) >= 0) {
+	    (void) argvAdd(&keys, rpmfiFN(fi));
+	    htAddEntry(ht, keys[nkeys++], NULL);
+	}
+	batch[nb++] = p;
+    }
+    ht = htFree(ht);
+    keys = argvFree(keys);
+    return nb;
+}
+
+/**
+ * Unpack the payload of a batch element (in a worker thread).
+ * @param _psm		package state machine data
+ */
+static void unpackWorker(void * _psm)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies _psm, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    rpmpsm psm = _psm;
+    (void) rpmpsmStage(psm, PSM_UNPACK);
+}
+
+/**
+ * Install a batch of added elements, unpacking their payloads concurrently.
+ *
+ * Scriptlets, rpmdb updates and callbacks are run serially in the original
+ * order, only the payload extraction (PSM_UNPACK) runs in a thread per
+ * element. The progress of the unpacks, and their op stats, are reported
+ * after all are done. Batches are not used when rpmdb transactions are
+ * enabled (the serial unpack runs within a rpmdb transaction).
+ *
+ * A failure does not stop the batch: the remaining elements are installed,
+ * and, if failures are rolled back, all failed elements are added to the
+ * rpmdb so that the rollback erases them as well.
+ * @param ts		transaction set
+ * @param oc		order index of the first element
+ * @param batch		batch elements
+ * @param nb		no. of elements in the batch
+ * @param ignoreSet	problem filter flags
+ * @param rollbackFailures	roll back the transaction on failure?
+ * @retval *stopp	1 if the transaction was rolled back
+ * @return		no. of failed elements
+ */
+static int rpmtsInstallBatch(rpmts ts, int oc, rpmte * batch, int nb,
+		rpmprobFilterFlags ignoreSet, int rollbackFailures, int * stopp)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies ts, batch, *stopp, rpmGlobalMacroContext, h_errno,
+		fileSystem, internalState @*/
+{
+    rpmop sw = rpmtsOp(ts, RPMTS_OP_INSTALL);
+    struct rpmop_s op;
+    rpmpsm * psms = xcalloc(nb, sizeof(*psms));
+    yarnThread * threads = xcalloc(nb, sizeof(*threads));
+    int * opened = xcalloc(nb, sizeof(*opened));
+    int * failed = xcalloc(nb, sizeof(*failed));
+    rpmte rbte = NULL;
+    int nfailed = 0;
+    int async;
+    int i;
+    int xx;
+
+    memset(&op, 0, sizeof(op));
+    (void) rpmswEnter(&op, 0);
+
+    /* Open the packages (before chroot'ing). */
+    async = rpmtsUnorderedSuccessors(ts, -1);
+    for (i = 0; i < nb; i++) {
+	rpmte p = batch[i];
+	rpmlog(RPMLOG_DEBUG, "========== +++ %s %s-%s 0x%x\n",
+		rpmteNEVR(p), rpmteA(p), rpmteO(p), rpmteColor(p));
+	psms[i] = rpmpsmNew(ts, p, rpmteFI(p, RPMTAG_BASENAMES));
+	rpmpsmSetAsync(psms[i], (oc + i >= async ? 1 : 0));
+	opened[i] = rpmtsOpenAdded(ts, p, psms[i]);
+	failed[i] = !opened[i];
+    }
+
+    /* Change root directory once for the whole batch. */
+    if (!rpmtsChrootDone(ts)) {
+	const char * rootDir = rpmtsRootDir(ts);
+	if (rootDir != NULL && strcmp(rootDir, "/") && *rootDir == '/') {
+	    static int _pw_loaded = 0;
+	    static int _gr_loaded = 0;
+
+	    if (!_pw_loaded) {
+		(void)getpwnam("root");
+		endpwent();
+		_pw_loaded++;
+	    }
+	    if (!_gr_loaded) {
+		(void)getgrnam("root");
+		endgrent();
+		_gr_loaded++;
+	    }
+
+	    xx = Chdir("/");
+	    /*@-modobserver@*/
+	    xx = Chroot(rootDir);
+	    /*@=modobserver@*/
+	    (void) rpmtsSetChrootDone(ts, 1);
+	}
+    }
+
+    /* Run %pre scriptlets in order. */
+    for (i = 0; i < nb; i++) {
+	if (!opened[i])
+	    continue;
+	rpmpsmSetGoal(psms[i], PSM_PKGINSTALL);
+	failed[i] = (rpmpsmStage(psms[i], PSM_INIT) != RPMRC_OK
+		  || rpmpsmStage(psms[i], PSM_PRE) != RPMRC_OK);
+    }
+
+    /* Unpack the payloads concurrently, deferring the callbacks. */
+    ts->nonotify = 1;
+    for (i = 0; i < nb; i++)
+	if (!failed[i])
+	    threads[i] = yarnLaunch(unpackWorker, psms[i]);
+    for (i = 0; i < nb; i++)
+	if (threads[i] != NULL)
+	    threads[i] = yarnJoin(threads[i]);
+    ts->nonotify = 0;
+
+    /* Finish the installs (%post scriptlets, rpmdb) in order. */
+    for (i = 0; i < nb; i++) {
+	if (!opened[i])
+	    continue;
+	if (!failed[i])
+	    failed[i] = (rpmpsmStage(psms[i], PSM_PROCESS) != RPMRC_OK
+		      || rpmpsmStage(psms[i], PSM_POST) != RPMRC_OK);
+	xx = rpmpsmStage(psms[i], PSM_FINI);
+    }
+
+    /* Restore root directory if changed. */
+    if (rpmtsChrootDone(ts)) {
+	const char * rootDir = rpmtsRootDir(ts);
+	const char * currDir = rpmtsCurrDir(ts);
+	/*@-modobserver@*/
+	if (rootDir != NULL && strcmp(rootDir, "/") && *rootDir == '/')
+	    xx = Chroot(".");
+	/*@=modobserver@*/
+	(void) rpmtsSetChrootDone(ts, 0);
+	if (currDir != NULL)
+	    xx = Chdir(currDir);
+    }
+
+    for (i = 0; i < nb; i++) {
+	rpmte p = batch[i];
+
+	if (opened[i])
+	    xx = rpmteClose(p, ts, 0);
+
+#if defined(RPM_VENDOR_MANDRIVA)
+	if (!failed[i]) {
+	    xx = mayAddToFilesAwaitingFiletriggers(rpmtsRootDir(ts),
+				p->fi, 1);
+	    p->done = 1;
+	}
+#endif
+
+/*@-nullstate@*/ /* FIX: psm->fi may be NULL */
+	psms[i] = rpmpsmFree(psms[i], __FUNCTION__);
+/*@=nullstate@*/
+
+	if (failed[i]) {
+	    nfailed++;
+	    xx = rpmtsMarkLinkedFailed(ts, p);
+	    if (rbte == NULL)
+		rbte = p;
+	    else if (rollbackFailures)
+		xx = _processFailedPackage(ts, p);
+	}
+    }
+
+    /* XXX count the batch elements, not the batch. */
+    (void) rpmswExit(&op, 0);
+    op.count = nb;
+    (void) rpmswAdd(sw, &op);
+
+    /* If we received an error, lets break out and rollback, provided
+     * autorollback is enabled.
+     */
+    if (rbte != NULL && rollbackFailures) {
+	xx = rpmtsRollback(ts, ignoreSet, 1, rbte);
+	*stopp = 1;
+    } else {
+	for (i = 0; i < nb; i++) {
+	    rpmte p = batch[i];
+	    if (p->h != NULL) {
+		(void) headerFree(p->h);
+		p->h = NULL;
+	    }
+	}
+    }
+
+    failed = _free(failed);
+    opened = _free(opened);
+    threads = _free(threads);
+    psms = _free(psms);
+    return nfailed;
+}
+
 /*
  * Transaction main loop: install and remove packages
  */
@@ -1659,8 +2106,10 @@ static int rpmtsProcess(rpmts ts, rpmprobFilterFlags ignoreSet,
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
 	/*@modifies ts, rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
 {
+    rpmte * batch = NULL;
     rpmtsi pi;
     rpmte p;
+    int nthreads = rpmExpandNumeric("%{?_unpack_threads}");
     int rc = 0;
 
 FPSDEBUG(0, (stderr, "--> %s(%p,0x%x,%d)\n", __FUNCTION__, ts, ignoreSet, rollbackFailures));
@@ -1671,7 +2120,7 @@ FPSDEBUG(0, (stderr, "--> %s(%p,0x%x,%d)\n", __FUNCTION__, ts, ignoreSet, rollba
 	rpmpsm psm = NULL;
 	pkgStage stage = PSM_UNKNOWN;
 	int failed;
-	int gotfd;
+	int nb;
 	int xx;
 
 #ifdef	REFERENCE
@@ -1682,7 +2131,6 @@ FPSDEBUG(0, (stderr, "--> %s(%p,0x%x,%d)\n", __FUNCTION__, ts, ignoreSet, rollba
 	(void) rpmdbCheckSignals();
 
 	failed = 1;
-	gotfd = 0;
 	if ((fi = rpmtsiFi(pi)) == NULL)
 	    continue;	/* XXX can't happen */
 	
@@ -1694,6 +2142,22 @@ FPSDEBUG(0, (stderr, "--> %s(%p,0x%x,%d)\n", __FUNCTION__, ts, ignoreSet, rollba
 	    continue;
 	}
 
+	/* Unpack independent added elements concurrently if requested. */
+	if (nthreads > 1 && batch == NULL)
+	    batch = xcalloc(nthreads, sizeof(*batch));
+	if (rpmteType(p) == TR_ADDED
+	 && (nb = rpmtsUnpackBatch(ts, rpmtsiOc(pi), nthreads, batch)) > 1)
+	{
+	    int stop = 0;
+	    rc += rpmtsInstallBatch(ts, rpmtsiOc(pi), batch, nb,
+			ignoreSet, rollbackFailures, &stop);
+	    if (stop)
+		break;
+	    while (--nb > 0)
+		(void) rpmtsiNext(pi, 0);
+	    continue;
+	}
+
 	psm = rpmpsmNew(ts, p, fi);
 	{   int async = (rpmtsiOc(pi) >= rpmtsUnorderedSuccessors(ts, -1)) ? 
 			1 : 0;
@@ -1714,51 +2178,14 @@ FPSDEBUG(0, (stderr, "--> %s(%p,0x%x,%d)\n", __FUNCTION__, ts, ignoreSet, rollba
 		rpmteClose(p, ts, 1);
 	    }
 #else	/* REFERENCE */
-	    if ((p->h = rpmteFDHeader(ts, p)) != NULL)
-		gotfd = 1;
-
-	    if (gotfd && rpmteFd(p) != NULL) {
-		/*
-		 * XXX Sludge necessary to transfer existing fstates/actions
-		 * XXX around a recreated file info set.
-		 */
-		rpmuint8_t * fstates = fi->fstates;
-		iosmFileAction * actions = (iosmFileAction *) fi->actions;
-		int mapflags = fi->mapflags;
-		rpmte savep;
-		int scareMem = 0;
-
-		psm->fi = rpmfiFree(psm->fi);
-
-		fi->fstates = NULL;
-		fi->actions = NULL;
-/*@-nullstate@*/ /* FIX: fi->actions is NULL */
-		fi = rpmfiFree(fi);
-/*@=nullstate@*/
-
-		savep = rpmtsSetRelocateElement(ts, p);
-		fi = rpmfiNew(ts, p->h, RPMTAG_BASENAMES, scareMem);
-		(void) rpmtsSetRelocateElement(ts, savep);
-
-		if (fi != NULL) {	/* XXX can't happen */
-		    fi->te = p;
-		    fi->fstates = _free(fi->fstates);
-		    fi->fstates = fstates;
-		    fi->actions = _free(fi->actions);
-		    fi->actions = (int *) actions;
-		    if (mapflags & IOSM_SBIT_CHECK)
-			fi->mapflags |= IOSM_SBIT_CHECK;
-		    p->fi = fi;
-		}
-
-		psm->fi = rpmfiLink(p->fi, __FUNCTION__);
+	    if (rpmtsOpenAdded(ts, p, psm)) {
+		fi = p->fi;
 
 		(void) rpmswEnter(sw, 0);
 		failed = (rpmpsmStage(psm, stage) != RPMRC_OK);
 		(void) rpmswExit(sw, 0);
 
 		xx = rpmteClose(p, ts, 0);
-		gotfd = 0;
 	    }
 
 #endif	/* REFERENCE */
@@ -1824,6 +2251,7 @@ FPSDEBUG(0, (stderr, "--> %s(%p,0x%x,%d)\n", __FUNCTION__, ts, ignoreSet, rollba
 
     }
     pi = rpmtsiFree(pi);
+    batch = _free(batch);
     return rc;
 }
 
@@ -2087,6 +2515,24 @@ fprintf(stderr, "--> %s(%p,%p,0x%x) tsFlags 0x%x\n", __FUNCTION__, ts, okProbs,
     if (rpmtsType(ts) & (RPMTRANS_TYPE_ROLLBACK | RPMTRANS_TYPE_AUTOROLLBACK))
 	rollbackFailures = 0;
 
+    /* How (and how often) installed files are made durable. */
+    {	const char * s = rpmExpand("%{?_install_durability}", NULL);
+	if (!strcmp(s, "none"))
+	    (void) rpmtsSetSyncMode(ts, RPMTS_SYNC_NONE);
+	else if (!strcmp(s, "file"))
+	    (void) rpmtsSetSyncMode(ts, RPMTS_SYNC_FILE);
+	else if (!strcmp(s, "package"))
+	    (void) rpmtsSetSyncMode(ts, RPMTS_SYNC_PACKAGE);
+	else if (!strcmp(s, "transaction"))
+	    (void) rpmtsSetSyncMode(ts, RPMTS_SYNC_TRANSACTION);
+	else if (*s != '\0')
+	    rpmlog(RPMLOG_WARNING,
+		_("unknown %%_install_durability \"%s\" ignored\n"), s);
+	s = _free(s);
+    }
+    if (rpmtsFlags(ts) & RPMTRANS_FLAG_TEST)
+	(void) rpmtsSetSyncMode(ts, RPMTS_SYNC_NONE);
+
     /* ===============================================
      * Setup flags and such, open the rpmdb in O_RDWR mode.
      */
@@ -2133,6 +2579,7 @@ fprintf(stderr, "--> %s(%p,%p,0x%x) tsFlags 0x%x\n", __FUNCTION__, ts, okProbs,
 		(okProbs == NULL || rpmpsTrim(ts->probs, okProbs)))
        )
     {
+	rpmtsCommitFingerprints(ts, 0);
 	lock = rpmtsFreeLock(lock);
 	if (sx != NULL) sx = rpmsxFree(sx);
 	return ts->orderCount;
@@ -2154,6 +2601,13 @@ fprintf(stderr, "--> %s(%p,%p,0x%x) tsFlags 0x%x\n", __FUNCTION__, ts, okProbs,
      */
     ourrc = rpmtsProcess(ts, ignoreSet, rollbackFailures);
 
+    /* Wait for the writeback started while unpacking. */
+    if (rpmtsSync(ts)) {
+	rpmlog(RPMLOG_ERR, _("syncing installed files failed: %s\n"),
+		strerror(errno));
+	ourrc++;
+    }
+
     /* ===============================================
      * Run post-transaction scripts unless disabled.
      */
@@ -2173,6 +2627,9 @@ fprintf(stderr, "--> %s(%p,%p,0x%x) tsFlags 0x%x\n", __FUNCTION__, ts, okProbs,
 exit:
     xx = rpmtsFinish(ts, sx);
 
+    /* Only a successful transaction replaces the finger print cache. */
+    rpmtsCommitFingerprints(ts, (ourrc == 0));
+
     lock = rpmtsFreeLock(lock);
 
     /*@-nullstate@*/ /* FIX: ts->flList may be NULL */
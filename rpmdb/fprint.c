@@ -4,8 +4,10 @@
 
 #include "system.h"
 
+#define	_RPMIOB_INTERNAL	/* XXX rpmiobSlurp */
 #include <rpmiotypes.h>	/* XXX rpmRC codes. */
 #include <rpmio.h>	/* XXX Realpath(). */
+#include <rpmlog.h>
 #include <rpmmacro.h>	/* XXX for rpmCleanPath */
 
 #include <rpmtag.h>
@@ -22,21 +24,191 @@ fingerPrintCache fpCacheCreate(int sizeHint)
 {
     fingerPrintCache fpc;
 
+    int i;
+
     fpc = xmalloc(sizeof(*fpc));
-    fpc->ht = htCreate(sizeHint * 2, 0, 1, NULL, NULL);
-assert(fpc->ht != NULL);
+    for (i = 0; i < FP_CACHE_NSHARDS; i++) {
+	fpc->ht[i] = htCreate((sizeHint * 2) / FP_CACHE_NSHARDS + 1,
+			0, 1, NULL, NULL);
+assert(fpc->ht[i] != NULL);
+	fpc->lock[i] = yarnNewLock(0);
+    }
     return fpc;
 }
 
 fingerPrintCache fpCacheFree(fingerPrintCache cache)
 {
-    cache->ht = htFree(cache->ht);
+    int i;
+
+    for (i = 0; i < FP_CACHE_NSHARDS; i++) {
+	cache->ht[i] = htFree(cache->ht[i]);
+	cache->lock[i] = yarnFreeLock(cache->lock[i]);
+    }
     free(cache);
     return NULL;
 }
 
+/**
+ * Return cache shard that holds a directory name.
+ * @param dirName	directory name
+ * @return		shard index
+ */
+static inline int cacheShard(const char * dirName)
+	/*@*/
+{
+    return (int)(hashFunctionString(0, dirName, 0) % FP_CACHE_NSHARDS);
+}
+
+int fpCacheLoad(fingerPrintCache cache, const char * fn, time_t ttl)
+{
+    unsigned long long rdev = 0, rino = 0, stamp = 0;
+    rpmiob iob = NULL;
+    struct stat sb;
+    char * b;
+    char * be;
+    char * t;
+    int nloaded = 0;
+
+    if (fn == NULL || *fn == '\0' || ttl <= 0)
+	return 0;
+    if (Stat("/", &sb) || rpmiobSlurp(fn, &iob))
+	goto exit;
+
+    /* Header: magic, identity of the root directory, time of save. */
+    b = rpmiobStr(iob);
+    be = b + rpmiobLen(iob);
+    if ((t = strchr(b, '\n')) == NULL
+     || sscanf(b, "FPC2 %llu %llu %llu", &rdev, &rino, &stamp) != 3)
+	goto exit;
+    if ((dev_t)rdev != sb.st_dev || (ino_t)rino != sb.st_ino
+     || (time_t)stamp + ttl < time(NULL))
+	goto exit;
+
+    /* Entries: "dev ino mtime dirName\n" */
+    for (b = t + 1; b < be; b = t + 1) {
+	struct fprintCacheEntry_s * newEntry;
+	unsigned long long dev, ino, mtime;
+	const char * dn;
+	size_t ndn;
+	char * dirName;
+	int sx;
+
+	if ((t = strchr(b, '\n')) == NULL)
+	    break;
+	*t = '\0';
+	dev = strtoull(b, &b, 10);
+	ino = strtoull(b, &b, 10);
+	mtime = strtoull(b, &b, 10);
+	if (*b++ != ' ' || *b != '/')
+	    continue;
+	dn = b;
+	ndn = t - b;
+
+	/* Directories are checked on first lookup, see cacheContainsDirectory. */
+	newEntry = xmalloc(sizeof(*newEntry) + ndn + 1);
+	dirName = (char *)(newEntry + 1);
+	memcpy(dirName, dn, ndn + 1);
+	newEntry->dirName = dirName;
+	newEntry->dev = (dev_t)dev;
+	newEntry->ino = (ino_t)ino;
+	newEntry->mtime = (time_t)mtime;
+	newEntry->flags = FP_ENTRY_UNVERIFIED;
+
+	sx = cacheShard(dirName);
+	if (!htHasEntry(cache->ht[sx], dirName)) {
+	    htAddEntry(cache->ht[sx], dirName, newEntry);
+	    nloaded++;
+	} else
+	    newEntry = _free(newEntry);
+    }
+
+exit:
+    if (nloaded > 0)
+	rpmlog(RPMLOG_DEBUG, D_("loaded %d directory finger prints from %s\n"),
+		nloaded, fn);
+    iob = rpmiobFree(iob);
+    return nloaded;
+}
+
+int fpCacheSave(fingerPrintCache cache, const char * fn, hashTable exclude)
+{
+    const char * tfn = NULL;
+    rpmiob iob = NULL;
+    struct stat sb;
+    char b[BUFSIZ];
+    FD_t fd;
+    int nsaved = 0;
+    int rc = -1;
+    int sx;
+    int xx;
+
+    if (fn == NULL || *fn == '\0')
+	return 0;
+    if (Stat("/", &sb))
+	goto exit;
+
+    iob = rpmiobNew(0);
+    (void) snprintf(b, sizeof(b), "FPC2 %llu %llu %llu",
+		(unsigned long long)sb.st_dev, (unsigned long long)sb.st_ino,
+		(unsigned long long)time(NULL));
+    iob = rpmiobAppend(iob, b, 1);
+
+    for (sx = 0; sx < FP_CACHE_NSHARDS; sx++) {
+	const void ** keys = htGetKeys(cache->ht[sx]);
+	const void ** kp;
+
+	for (kp = keys; *kp != NULL; kp++) {
+	    const char * dirName = *kp;
+	    const struct fprintCacheEntry_s * entry;
+	    const void ** data;
+
+	    if (*dirName != '/' || strchr(dirName, '\n') != NULL)
+		continue;
+	    if (exclude != NULL && htHasEntry(exclude, dirName))
+		continue;
+	    if (htGetEntry(cache->ht[sx], dirName, &data, NULL, NULL))
+		continue;
+	    entry = data[0];
+	    if (entry->flags & FP_ENTRY_STALE)
+		continue;
+	    (void) snprintf(b, sizeof(b), "%llu %llu %llu ",
+		(unsigned long long)entry->dev, (unsigned long long)entry->ino,
+		(unsigned long long)entry->mtime);
+	    iob = rpmiobAppend(iob, b, 0);
+	    iob = rpmiobAppend(iob, dirName, 1);
+	    nsaved++;
+	}
+	keys = _free(keys);
+    }
+
+    /* Write to a temporary file and rename, readers never see a partial cache. */
+    tfn = rpmGetPath(fn, ".tmp", NULL);
+    fd = Fopen(tfn, "w.ufdio");
+    if (fd == NULL || Ferror(fd)) {
+	if (fd) xx = Fclose(fd);
+	goto exit;
+    }
+    if (Fwrite(rpmiobStr(iob), 1, rpmiobLen(iob), fd) == rpmiobLen(iob)) {
+	xx = Fclose(fd);
+	rc = (xx == 0 ? Rename(tfn, fn) : -1);
+    } else
+	xx = Fclose(fd);
+    if (rc)
+	xx = Unlink(tfn);
+
+exit:
+    if (rc == 0)
+	rpmlog(RPMLOG_DEBUG, D_("saved %d directory finger prints to %s\n"),
+		nsaved, fn);
+    tfn = _free(tfn);
+    iob = rpmiobFree(iob);
+    return (rc == 0 ? nsaved : -1);
+}
+
 /**
  * Find directory name entry in cache.
+ * An entry loaded by fpCacheLoad() is checked with stat(2) on its first
+ * lookup. It has not been handed out yet, and is updated in place.
  * @param cache		pointer to fingerprint cache
  * @param dirName	string to locate in cache
  * @return pointer to directory name entry (or NULL if not found).
@@ -44,13 +216,78 @@ fingerPrintCache fpCacheFree(fingerPrintCache cache)
 static /*@null@*/ const struct fprintCacheEntry_s * cacheContainsDirectory(
 			    fingerPrintCache cache,
 			    const char * dirName)
-	/*@*/
+	/*@globals fileSystem, internalState @*/
+	/*@modifies cache, fileSystem, internalState @*/
+{
+    int sx = cacheShard(dirName);
+    const struct fprintCacheEntry_s * entry = NULL;
+    const void ** data;
+
+    yarnPossess(cache->lock[sx]);
+    if (!htGetEntry(cache->ht[sx], dirName, &data, NULL, NULL))
+	entry = data[0];
+    if (entry != NULL && (entry->flags & FP_ENTRY_UNVERIFIED)) {
+	struct fprintCacheEntry_s * e = (struct fprintCacheEntry_s *) entry;
+	struct stat sb;
+	int xx;
+
+	yarnRelease(cache->lock[sx]);
+	xx = stat(dirName, &sb);
+	yarnPossess(cache->lock[sx]);
+	/* Another thread may have checked the entry meanwhile. */
+	if (e->flags & FP_ENTRY_UNVERIFIED) {
+	    if (xx == 0) {
+		e->dev = (dev_t)sb.st_dev;
+		e->ino = (ino_t)sb.st_ino;
+		e->mtime = (time_t)sb.st_mtime;
+		e->flags = 0;
+	    } else
+		e->flags = FP_ENTRY_STALE;
+	}
+    }
+    if (entry != NULL && (entry->flags & FP_ENTRY_STALE))
+	entry = NULL;
+    yarnRelease(cache->lock[sx]);
+    return entry;
+}
+
+/**
+ * Add directory name entry to cache.
+ * If another thread has added the same directory meanwhile, that entry
+ * is returned (and the new entry is freed) so that all finger prints of
+ * a directory share a single cache entry.
+ * @param cache		pointer to fingerprint cache
+ * @param newEntry	directory name entry (malloc'd)
+ * @return		directory name entry in cache
+ */
+static const struct fprintCacheEntry_s * cacheAddDirectory(
+			    fingerPrintCache cache,
+			    /*@only@*/ struct fprintCacheEntry_s * newEntry)
+	/*@modifies cache, newEntry @*/
 {
+    int sx = cacheShard(newEntry->dirName);
+    const struct fprintCacheEntry_s * entry = newEntry;
     const void ** data;
 
-    if (htGetEntry(cache->ht, dirName, &data, NULL, NULL))
-	return NULL;
-    return data[0];
+    yarnPossess(cache->lock[sx]);
+    if (!htGetEntry(cache->ht[sx], newEntry->dirName, &data, NULL, NULL)) {
+	struct fprintCacheEntry_s * e = (struct fprintCacheEntry_s *) data[0];
+	/* A stale loaded entry was never handed out, reuse it. */
+	if (e->flags & FP_ENTRY_STALE) {
+	    e->dev = newEntry->dev;
+	    e->ino = newEntry->ino;
+	    e->mtime = newEntry->mtime;
+	    e->flags = 0;
+	}
+	entry = e;
+	newEntry = _free(newEntry);
+    } else {
+	/*@-kepttrans -dependenttrans @*/
+	htAddEntry(cache->ht[sx], newEntry->dirName, newEntry);
+	/*@=kepttrans =dependenttrans @*/
+    }
+    yarnRelease(cache->lock[sx]);
+    return entry;
 }
 
 /**
@@ -143,12 +380,10 @@ static fingerPrint doLookup(fingerPrintCache cache,
 	    strcpy(dn, (*buf != '\0' ? buf : "/"));
 	    newEntry->ino = (ino_t)sb.st_ino;
 	    newEntry->dev = (dev_t)sb.st_dev;
+	    newEntry->mtime = (time_t)sb.st_mtime;
+	    newEntry->flags = 0;
 	    newEntry->dirName = dn;
-	    fp.entry = newEntry;
-
-	    /*@-kepttrans -dependenttrans @*/
-	    htAddEntry(cache->ht, dn, fp.entry);
-	    /*@=kepttrans =dependenttrans @*/
+	    fp.entry = cacheAddDirectory(cache, newEntry);
 	    /*@=usereleased@*/
 	}
 
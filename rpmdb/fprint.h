@@ -6,6 +6,7 @@
  * Identify a file name path by a unique "finger print".
  */
 
+#include <yarn.h>
 #include "rpmhash.h"
 
 /**
@@ -27,13 +28,33 @@ struct fprintCacheEntry_s {
     const char * dirName;		/*!< path to existing directory */
     dev_t dev;				/*!< stat(2) device number */
     ino_t ino;				/*!< stat(2) inode number */
+    time_t mtime;			/*!< stat(2) modification time */
+    int flags;				/*!< FP_ENTRY_* bits */
 };
 
+/**
+ * Entry loaded by fpCacheLoad(), not yet checked with stat(2).
+ */
+#define	FP_ENTRY_UNVERIFIED	(1 << 0)
+/**
+ * Loaded entry whose directory has gone away.
+ */
+#define	FP_ENTRY_STALE		(1 << 1)
+
+/**
+ * No. of (independently locked) finger print cache shards.
+ */
+#define	FP_CACHE_NSHARDS	32
+
 /**
  * Finger print cache.
+ * Directories are spread across shards by dirName hash, each shard with
+ * its own lock, so that finger prints can be computed from several
+ * threads at once.
  */
 struct fprintCache_s {
-    hashTable ht;			/*!< hashed by dirName */
+    hashTable ht[FP_CACHE_NSHARDS];	/*!< hashed by dirName */
+    yarnLock lock[FP_CACHE_NSHARDS];	/*!< per-shard access lock */
 };
 
 #if defined(_FPRINT_INTERNAL)
@@ -94,6 +115,35 @@ fingerPrintCache fpCacheFree(/*@only@*/ fingerPrintCache cache)
 	/*@globals fileSystem @*/
 	/*@modifies cache, fileSystem @*/;
 
+/**
+ * Load directory finger prints persisted by fpCacheSave().
+ * The persisted cache is ignored if it was saved for a different root
+ * directory, or more than ttl seconds ago. Each directory is checked with
+ * stat(2) on its first lookup, entries whose (dev, ino, mtime) changed are
+ * replaced then.
+ * @param cache		pointer to fingerprint cache
+ * @param fn		persisted cache file name
+ * @param ttl		maximum age (in seconds) of persisted cache
+ * @return		no. of directories loaded
+ */
+int fpCacheLoad(fingerPrintCache cache, /*@null@*/ const char * fn, time_t ttl)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies cache, fileSystem, internalState @*/;
+
+/**
+ * Persist directory finger prints for use by the next transaction.
+ * The (dev, ino, mtime) from the last stat(2) of each directory are saved,
+ * nothing is stat(2)'d again.
+ * @param cache		pointer to fingerprint cache
+ * @param fn		persisted cache file name
+ * @param exclude	directory names not to persist (or NULL)
+ * @return		no. of directories saved, -1 on error
+ */
+int fpCacheSave(fingerPrintCache cache, /*@null@*/ const char * fn,
+		/*@null@*/ hashTable exclude)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies fileSystem, internalState @*/;
+
 /**
  * Return finger print of a file path.
  * @param cache		pointer to fingerprint cache
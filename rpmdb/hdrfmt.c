@@ -5461,10 +5461,6 @@ struct sprintfToken_s {
     } u;
 };
 
-/** \ingroup header
- */
-typedef /*@abstract@*/ struct headerSprintfArgs_s * headerSprintfArgs;
-
 /** \ingroup header
  */
 struct headerSprintfArgs_s {
@@ -5479,12 +5475,19 @@ struct headerSprintfArgs_s {
     HE_t ec;			/*!< Extension data cache. */
     int nec;			/*!< No. of extension cache items. */
     sprintfToken format;
+/*@observer@*/ /*@null@*/
+    spew_t spew;		/*!< Format spewer (for "[%{*:xml}]" et al). */
+    int allTags;		/*!< Does the format iterate over all tags? */
 /*@relnull@*/
     HeaderIterator hi;
 /*@owned@*/
     char * val;
     size_t vallen;
     size_t alloced;
+/*@null@*/
+    headerSprintfSink sink;	/*!< Output sink (NULL returns a string). */
+/*@null@*/
+    void * sinkarg;		/*!< Output sink argument. */
     size_t numTokens;
     size_t i;
 };
@@ -5585,6 +5588,41 @@ freeFormat( /*@only@*/ /*@null@*/ sprintfToken format, size_t num)
     return NULL;
 }
 
+/**
+ * Forget header data cached in a headerSprintf format array.
+ * @param format	sprintf format array
+ * @param num		number of elements
+ */
+static void resetFormat(/*@null@*/ sprintfToken format, size_t num)
+	/*@modifies *format @*/
+{
+    size_t i;
+
+    if (format == NULL) return;
+
+    for (i = 0; i < num; i++) {
+	switch (format[i].type) {
+	case PTOK_TAG:
+	    (void) rpmheClean(&format[i].u.tag.he);
+	    /*@switchbreak@*/ break;
+	case PTOK_ARRAY:
+	    resetFormat(format[i].u.array.format, format[i].u.array.numTokens);
+	    /*@switchbreak@*/ break;
+	case PTOK_COND:
+	    resetFormat(format[i].u.cond.ifFormat,
+			format[i].u.cond.numIfTokens);
+	    resetFormat(format[i].u.cond.elseFormat,
+			format[i].u.cond.numElseTokens);
+	    (void) rpmheClean(&format[i].u.cond.tag.he);
+	    /*@switchbreak@*/ break;
+	case PTOK_NONE:
+	case PTOK_STRING:
+	default:
+	    /*@switchbreak@*/ break;
+	}
+    }
+}
+
 /**
  * Initialize an hsa iteration.
  * @param hsa		headerSprintf args
@@ -5687,6 +5725,35 @@ static char * hsaReserve(headerSprintfArgs hsa, size_t need)
     return hsa->val + hsa->vallen;
 }
 
+/**
+ * Output buffered before handing it to a headerSprintfWrite() sink.
+ */
+#define	HSA_FLUSHSIZE	(64 * 1024)
+
+/**
+ * Pass buffered output to the sink, retaining a trailing part.
+ * @param hsa		headerSprintf args
+ * @param keep		no. of trailing bytes to retain (for spew chomp)
+ * @return		0 on success
+ */
+static int hsaFlush(headerSprintfArgs hsa, size_t keep)
+	/*@modifies hsa @*/
+{
+    size_t nb = (hsa->vallen > keep ? hsa->vallen - keep : 0);
+    int rc = 0;
+
+    if (nb > 0 && hsa->sink != NULL) {
+	char c = hsa->val[nb];
+	hsa->val[nb] = '\0';		/* sinks see a string */
+	rc = (*hsa->sink) (hsa->sinkarg, hsa->val, nb);
+	hsa->val[nb] = c;
+	memmove(hsa->val, hsa->val + nb, hsa->vallen - nb);
+	hsa->vallen -= nb;
+	hsa->val[hsa->vallen] = '\0';
+    }
+    return rc;
+}
+
 /**
  * Return tag name from value.
  * @param tbl		tag table
@@ -6807,21 +6874,17 @@ rpmecFree(const headerSprintfExtension exts, /*@only@*/ HE_t ec)
     return NULL;
 }
 
-char * headerSprintf(Header h, const char * fmt,
+headerSprintfArgs headerSprintfCompile(const char * fmt,
 		headerTagTableEntry tags,
 		headerSprintfExtension exts,
 		errmsg_t * errmsg)
 {
-    headerSprintfArgs hsa = memset(alloca(sizeof(*hsa)), 0, sizeof(*hsa));
-    sprintfToken nextfmt;
+    headerSprintfArgs hsa = xcalloc(1, sizeof(*hsa));
     sprintfTag tag;
-    char * t, * te;
-    size_t need;
-spew_t spew = NULL;
 
 /*@-modfilesys@*/
 if (_hdrqf_debug)
-fprintf(stderr, "==> headerSprintf(%p, \"%s\", %p, %p, %p)\n", h, fmt, tags, exts, errmsg);
+fprintf(stderr, "==> headerSprintfCompile(\"%s\", %p, %p, %p)\n", fmt, tags, exts, errmsg);
 /*@=modfilesys@*/
 
     /* Set some reasonable defaults */
@@ -6831,9 +6894,6 @@ fprintf(stderr, "==> headerSprintf(%p, \"%s\", %p, %p, %p)\n", h, fmt, tags, ext
     if (exts == NULL)
 	exts = headerCompoundFormats;
  
-/*@-assignexpose -castexpose @*/
-    hsa->h = headerLink(h);
-/*@=assignexpose =castexpose @*/
     hsa->fmt = xstrdup(fmt);
 /*@-assignexpose -dependenttrans@*/
     hsa->exts = exts;
@@ -6841,12 +6901,16 @@ fprintf(stderr, "==> headerSprintf(%p, \"%s\", %p, %p, %p)\n", h, fmt, tags, ext
 /*@=assignexpose =dependenttrans@*/
     hsa->errmsg = NULL;
 
-    if (parseFormat(hsa, hsa->fmt, &hsa->format, &hsa->numTokens, NULL, PARSER_BEGIN))
-	goto exit;
+    if (parseFormat(hsa, hsa->fmt, &hsa->format, &hsa->numTokens, NULL, PARSER_BEGIN)) {
+/*@-dependenttrans -observertrans @*/
+	if (errmsg)
+	    *errmsg = hsa->errmsg;
+/*@=dependenttrans =observertrans @*/
+	return headerSprintfFree(hsa);
+    }
 
     hsa->nec = 0;
     hsa->ec = rpmecNew(hsa->exts, &hsa->nec);
-    hsa->val = xstrdup("");
 
     tag =
 	(hsa->format->type == PTOK_TAG
@@ -6855,20 +6919,59 @@ fprintf(stderr, "==> headerSprintf(%p, \"%s\", %p, %p, %p)\n", h, fmt, tags, ext
 	    ? &hsa->format->u.array.format->u.tag :
 	NULL));
 
-spew = NULL;
+    hsa->allTags = (tag != NULL && tag->tagno != NULL
+		&& tag->tagno[0] == (rpmTag)-2);
+    hsa->spew = NULL;
     /* XXX Ick: +1 needed to handle :extractor |transformer marking. */
-    if (tag != NULL && tag->tagno != NULL && tag->tagno[0] == (rpmTag)-2
-     && tag->av != NULL && tag->av[0] != NULL && !strcmp(tag->av[0]+1, "xml"))
-	spew = &_xml_spew;
-    if (tag != NULL && tag->tagno != NULL && tag->tagno[0] == (rpmTag)-2
-     && tag->av != NULL && tag->av[0] != NULL && !strcmp(tag->av[0]+1, "yaml"))
-	spew = &_yaml_spew;
-    if (tag != NULL && tag->tagno != NULL && tag->tagno[0] == (rpmTag)-2
-     && tag->av != NULL && tag->av[0] != NULL && !strcmp(tag->av[0]+1, "json"))
-	spew = &_json_spew;
-    if (tag != NULL && tag->tagno != NULL && tag->tagno[0] == (rpmTag)-2
-     && tag->av != NULL && tag->av[0] != NULL && !strcmp(tag->av[0]+1, "mongo"))
-	spew = &_mongo_spew;
+    if (hsa->allTags && tag->av != NULL && tag->av[0] != NULL) {
+	if (!strcmp(tag->av[0]+1, "xml"))
+	    hsa->spew = &_xml_spew;
+	if (!strcmp(tag->av[0]+1, "yaml"))
+	    hsa->spew = &_yaml_spew;
+	if (!strcmp(tag->av[0]+1, "json"))
+	    hsa->spew = &_json_spew;
+	if (!strcmp(tag->av[0]+1, "mongo"))
+	    hsa->spew = &_mongo_spew;
+    }
+
+    if (errmsg)
+	*errmsg = NULL;
+    return hsa;
+}
+
+/**
+ * Format a header with a compiled query format into hsa->val.
+ * With a sink, output is passed on whenever HSA_FLUSHSIZE bytes accumulate.
+ * @param hsa		compiled query format
+ * @param h		header
+ * @return		0 on success
+ */
+static int hsaFormat(headerSprintfArgs hsa, Header h)
+	/*@globals rpmGlobalMacroContext, h_errno, internalState @*/
+	/*@modifies hsa, h, rpmGlobalMacroContext, internalState @*/
+{
+    sprintfToken nextfmt;
+    sprintfTag tag;
+    spew_t spew;
+    char * t, * te;
+    size_t need;
+    int rc = 0;
+
+/*@-assignexpose -castexpose @*/
+    hsa->h = headerLink(h);
+/*@=assignexpose =castexpose @*/
+    hsa->errmsg = NULL;
+
+    tag =
+	(hsa->format->type == PTOK_TAG
+	    ? &hsa->format->u.tag :
+	(hsa->format->type == PTOK_ARRAY
+	    ? &hsa->format->u.array.format->u.tag :
+	NULL));
+    /* Iterating over all tags reuses (and then zeroes) the tag number. */
+    if (hsa->allTags && tag != NULL)
+	tag->tagno[0] = (rpmTag)-2;
+    spew = hsa->spew;
 
     if (spew && spew->spew_init && spew->spew_init[0]) {
 	char * spew_init = rpmExpand(spew->spew_init, NULL);
@@ -6885,18 +6988,26 @@ spew = NULL;
 	te = singleSprintf(hsa, nextfmt, 0);
 /*@=globs =mods @*/
 	if (te == NULL) {
-	    hsa->val = _free(hsa->val);
+	    rc = 1;
+	    break;
+	}
+	/* Keep the last byte, a spew chomp may still remove it. */
+	if (hsa->sink != NULL && hsa->vallen >= HSA_FLUSHSIZE
+	 && hsaFlush(hsa, 1))
+	{
+	    hsa->errmsg = _("write failed");
+	    rc = 1;
 	    break;
 	}
     }
     hsa = hsaFini(hsa);
 
-    if (spew && spew->spew_chomp) {
+    if (rc == 0 && spew && spew->spew_chomp && hsa->vallen > 0) {
 	if (hsa->val[hsa->vallen - 1] == spew->spew_chomp)
 	    hsa->vallen--;
     }
 
-    if (spew && spew->spew_fini && spew->spew_fini[0]) {
+    if (rc == 0 && spew && spew->spew_fini && spew->spew_fini[0]) {
 	char * spew_fini = rpmExpand(spew->spew_fini, NULL);
 	need = strlen(spew_fini);
 	t = hsaReserve(hsa, need);
@@ -6905,22 +7016,128 @@ spew = NULL;
 	spew_fini = _free(spew_fini);
     }
 
-    if (hsa->val != NULL && hsa->vallen < hsa->alloced)
-	hsa->val = xrealloc(hsa->val, hsa->vallen+1);	
+    /* Forget this header's data before formatting the next header. */
+    {	int i;
+	for (i = 0; i < hsa->nec; i++)
+	    (void) rpmheClean(&hsa->ec[i]);
+    }
+    resetFormat(hsa->format, hsa->numTokens);
 
-    hsa->ec = rpmecFree(hsa->exts, hsa->ec);
-    hsa->nec = 0;
-    hsa->format = freeFormat(hsa->format, hsa->numTokens);
+    (void)headerFree(hsa->h);
+    hsa->h = NULL;
+    return rc;
+}
+
+char * headerSprintfExec(headerSprintfArgs hsa, Header h,
+		errmsg_t * errmsg)
+{
+    char * val;
+
+    if (hsa == NULL)
+	return NULL;
+
+    hsa->sink = NULL;
+    hsa->sinkarg = NULL;
+    hsa->val = _free(hsa->val);
+    hsa->val = xstrdup("");
+    hsa->vallen = 0;
+    hsa->alloced = 0;
+
+    if (hsaFormat(hsa, h))
+	hsa->val = _free(hsa->val);
+    else if (hsa->vallen < hsa->alloced)
+	hsa->val = xrealloc(hsa->val, hsa->vallen+1);	
 
-exit:
 /*@-dependenttrans -observertrans @*/
     if (errmsg)
 	*errmsg = hsa->errmsg;
 /*@=dependenttrans =observertrans @*/
-    (void)headerFree(hsa->h);
-    hsa->h = NULL;
-    hsa->fmt = _free(hsa->fmt);
+    val = hsa->val;
+    hsa->val = NULL;
+    hsa->vallen = 0;
+    hsa->alloced = 0;
 /*@-retexpose@*/
-    return hsa->val;
+    return val;
 /*@=retexpose@*/
 }
+
+int headerSprintfWrite(headerSprintfArgs hsa, Header h,
+		headerSprintfSink sink, void * arg, errmsg_t * errmsg)
+{
+    int rc = 1;
+
+    if (hsa == NULL || sink == NULL)
+	return rc;
+
+    /* The output buffer is retained between headers. */
+    hsa->sink = sink;
+    hsa->sinkarg = arg;
+    if (hsa->val == NULL) {
+	hsa->val = xstrdup("");
+	hsa->alloced = 0;
+    }
+    hsa->vallen = 0;
+
+    rc = hsaFormat(hsa, h);
+    if (rc == 0 && hsaFlush(hsa, 0)) {
+	hsa->errmsg = _("write failed");
+	rc = 1;
+    }
+    hsa->vallen = 0;
+    hsa->sink = NULL;
+    hsa->sinkarg = NULL;
+
+/*@-dependenttrans -observertrans @*/
+    if (errmsg)
+	*errmsg = hsa->errmsg;
+/*@=dependenttrans =observertrans @*/
+    return rc;
+}
+
+int headerSprintfFdSink(void * _fd, const char * b, size_t nb)
+{
+    FD_t fd = _fd;
+    return (Fwrite(b, 1, nb, fd) != nb || Ferror(fd));
+}
+
+int headerSprintfIobSink(void * _iob, const char * b, size_t nb)
+{
+    rpmiob iob = _iob;
+    (void) rpmiobAppend(iob, b, 0);
+    return 0;
+}
+
+headerSprintfArgs headerSprintfFree(headerSprintfArgs hsa)
+{
+    if (hsa != NULL) {
+	if (hsa->ec != NULL)
+	    hsa->ec = rpmecFree(hsa->exts, hsa->ec);
+	hsa->nec = 0;
+	hsa->format = freeFormat(hsa->format, hsa->numTokens);
+	hsa->val = _free(hsa->val);
+	hsa->fmt = _free(hsa->fmt);
+	hsa = _free(hsa);
+    }
+    return NULL;
+}
+
+char * headerSprintf(Header h, const char * fmt,
+		headerTagTableEntry tags,
+		headerSprintfExtension exts,
+		errmsg_t * errmsg)
+{
+    headerSprintfArgs hsa;
+    char * val = NULL;
+
+/*@-modfilesys@*/
+if (_hdrqf_debug)
+fprintf(stderr, "==> headerSprintf(%p, \"%s\", %p, %p, %p)\n", h, fmt, tags, exts, errmsg);
+/*@=modfilesys@*/
+
+    hsa = headerSprintfCompile(fmt, tags, exts, errmsg);
+    if (hsa != NULL) {
+	val = headerSprintfExec(hsa, h, errmsg);
+	hsa = headerSprintfFree(hsa);
+    }
+    return val;
+}
@@ -20,6 +20,9 @@
 /*@unchecked@*/
 int _hdr_debug = 0;
 
+/*@unchecked@*/
+int _hdr_lazy = 1;
+
 /*@access Header @*/
 /*@access HeaderIterator @*/
 /*@access headerSprintfExtension @*/
@@ -208,6 +211,9 @@ static int indexCmp(const void * avp, const void * bvp)
     return ((int)ap->info.tag - (int)bp->info.tag);
 }
 
+static int headerUnlazy(Header h)
+	/*@modifies h @*/;
+
 /** \ingroup header
  * Sort tags in header.
  * @param h		header
@@ -216,6 +222,8 @@ static
 void headerSort(Header h)
 	/*@modifies h @*/
 {
+    if (headerUnlazy(h))
+	return;
     if (!(h->flags & HEADERFLAG_SORTED)) {
 	qsort(h->index, h->indexUsed, sizeof(*h->index), indexCmp);
 	h->flags |= HEADERFLAG_SORTED;
@@ -249,6 +257,8 @@ static
 void headerUnsort(Header h)
 	/*@modifies h @*/
 {
+    if (headerUnlazy(h))
+	return;
     qsort(h->index, h->indexUsed, sizeof(*h->index), offsetCmp);
 }
 
@@ -518,7 +528,6 @@ static rpmuint32_t regionSwab(/*@null@*/ indexEntry entry, rpmuint32_t il, rpmui
     struct indexEntry_s ieprev;
 
 assert(dataEnd != NULL);
-assert(entry != NULL);
 assert(dl == 0);	/* XXX eliminate dl argument (its always 0) */
 
     memset(&ieprev, 0, sizeof(ieprev));
@@ -866,7 +875,7 @@ indexEntry findEntry(/*@null@*/ Header h, rpmTag tag, rpmTagType type)
     struct indexEntry_s key;
 
     if (h == NULL) return NULL;
-    if (!(h->flags & HEADERFLAG_SORTED)) headerSort(h);
+    headerSort(h);
 
     key.info.tag = tag;
 
@@ -945,66 +954,62 @@ int headerRemoveEntry(Header h, rpmTag tag)
     return 0;
 }
 
-Header headerLoad(void * uh)
+/**
+ * Is the (network order) index of a region suitable for lazy lookups?
+ * Both the region entries and any dribbles must be sorted by tag.
+ * @param pe		header physical entry pointer (region tag)
+ * @param il		no. of entries
+ * @param ril		no. of region entries (including region tag)
+ * @return		1 if lazy lookups are possible
+ */
+static int headerLazyOK(entryInfo pe, rpmuint32_t il, rpmuint32_t ril)
+	/*@*/
 {
-    void * sw = NULL;
-    rpmuint32_t * ei = (rpmuint32_t *) uh;
+    rpmuint32_t prev = 0;
+    rpmuint32_t i;
+
+    if (ril < 1 || ril > il)
+	return 0;
+    for (i = 1; i < il; i++) {
+	rpmuint32_t tag = (rpmuint32_t) ntohl(pe[i].tag);
+	if (tag < HEADER_I18NTABLE)
+	    return 0;
+	if (i != ril && tag <= prev)
+	    return 0;
+	prev = tag;
+    }
+    return 1;
+}
+
+/**
+ * Decode the header index from the header blob.
+ * @param h		header
+ * @param lazy		decode only the region tag?
+ * @return		0 on success
+ */
+static int headerLoadIndex(Header h, int lazy)
+	/*@modifies h @*/
+{
+    rpmuint32_t * ei = (rpmuint32_t *) h->blob;
     rpmuint32_t il = (rpmuint32_t) ntohl(ei[0]);		/* index length */
     rpmuint32_t dl = (rpmuint32_t) ntohl(ei[1]);		/* data length */
-    /*@-sizeoftype@*/
-    size_t pvlen = sizeof(il) + sizeof(dl) +
-               (il * sizeof(struct entryInfo_s)) + dl;
-    /*@=sizeoftype@*/
-    void * pv = uh;
-    Header h = NULL;
+    size_t pvlen = h->bloblen;
     entryInfo pe;
     unsigned char * dataStart;
     unsigned char * dataEnd;
     indexEntry entry; 
     rpmuint32_t rdlen;
-    int i;
-
-    /* Sanity checks on header intro. */
-    if (hdrchkTags(il) || hdrchkData(dl))
-	goto errxit;
 
-    ei = (rpmuint32_t *) pv;
     /*@-castexpose@*/
     pe = (entryInfo) &ei[2];
     /*@=castexpose@*/
     dataStart = (unsigned char *) (pe + il);
     dataEnd = dataStart + dl;
 
-    h = headerGetPool(_headerPool);
-    memset(&h->h_loadops, 0, sizeof(h->h_loadops));
-    if ((sw = headerGetStats(h, 18)) != NULL)	/* RPMTS_OP_HDRLOAD */
-	(void) rpmswEnter(sw, 0);
-    {	unsigned char * hmagic = header_magic;
-	(void) memcpy(h->magic, hmagic, sizeof(h->magic));
-    }
-    /*@-assignexpose -kepttrans@*/
-    h->blob = uh;
-    h->bloblen = pvlen;
-    /*@=assignexpose =kepttrans@*/
-    h->origin = NULL;
-    h->baseurl = NULL;
-    h->digest = NULL;
-    h->parent = NULL;
-    h->rpmdb = NULL;
-    memset(&h->sb, 0, sizeof(h->sb));
-    h->instance = 0;
-    h->startoff = 0;
-    h->endoff = (rpmuint32_t) pvlen;
-    memset(&h->h_getops, 0, sizeof(h->h_getops));
-    h->indexAlloced = il + 1;
     h->indexUsed = il;
-    h->index = DRD_xcalloc(h->indexAlloced, sizeof(*h->index));
-    h->flags = HEADERFLAG_SORTED;
-    h = headerLink(h);
-assert(h != NULL);
+    h->flags |= HEADERFLAG_SORTED;
 
     entry = h->index;
-    i = 0;
     if (!(htonl(pe->tag) < HEADER_I18NTABLE)) {
 	h->flags |= HEADERFLAG_LEGACY;
 	entry->info.type = REGION_TAG_TYPE;
@@ -1021,7 +1026,7 @@ assert(h != NULL);
 	rdlen = regionSwab(entry+1, il, 0, pe, dataStart, dataEnd, entry->info.offset);
 #if 0	/* XXX don't check, the 8/98 i18n bug fails here. */
 	if (rdlen != dl)
-	    goto errxit;
+	    return 1;
 #endif
 	entry->rdlen = rdlen;
 	entry++;
@@ -1036,14 +1041,14 @@ assert(h != NULL);
 	entry->info.count = (rpmuint32_t) htonl(pe->count);
 
 	if (hdrchkType(entry->info.type))
-	    goto errxit;
+	    return 1;
 	if (hdrchkTags(entry->info.count))
-	    goto errxit;
+	    return 1;
 
 	{   rpmint32_t off = (rpmint32_t) ntohl(pe->offset);
 
 	    if (hdrchkData(off))
-		goto errxit;
+		return 1;
 	    if (off) {
 /*@-sizeoftype@*/
 		size_t nb = REGION_TAG_COUNT;
@@ -1053,14 +1058,22 @@ assert(h != NULL);
 assert((rpmint32_t)rdl >= 0);	/* XXX insurance */
 		ril = (rpmuint32_t)(rdl/sizeof(*pe));
 		if (hdrchkTags(ril) || hdrchkData(rdl))
-		    goto errxit;
+		    return 1;
 		entry->info.tag = (rpmuint32_t) htonl(pe->tag);
+		/* Lazily: check only the region trailer, entries on use. */
+		lazy = (lazy && ril >= 1 && ril <= il
+		    && (rpmuint32_t)off + nb <= dl
+		    && stei[0] == pe->tag
+		    && (rpmuint32_t)ntohl(stei[1]) == REGION_TAG_TYPE
+		    && (rpmuint32_t)ntohl(stei[3]) == REGION_TAG_COUNT
+		    && rdl == ril * sizeof(*pe));
 	    } else {
 		ril = il;
 		/*@-sizeoftype@*/
 		rdl = (rpmuint32_t)(ril * sizeof(struct entryInfo_s));
 		/*@=sizeoftype@*/
 		entry->info.tag = HEADER_IMAGE;
+		lazy = 0;
 	    }
 	}
 	entry->info.offset = (rpmint32_t) -rdl;	/* negative offset */
@@ -1069,9 +1082,22 @@ assert((rpmint32_t)rdl >= 0);	/* XXX insurance */
 	entry->data = pe;
 	/*@=assignexpose@*/
 	entry->length = pvlen - sizeof(il) - sizeof(dl);
+
+	/*
+	 * Other entries are decoded (and checked) by lazyFindEntry() on use,
+	 * and cached in the (zeroed) index, or all at once by headerUnlazy().
+	 * The region data length is computed when the region is retrieved.
+	 */
+	if (lazy) {
+	    entry->rdlen = 0;
+	    h->flags |= HEADERFLAG_LAZY;
+	    h->flags &= ~HEADERFLAG_LAZYSORTED;
+	    return 0;
+	}
+
 	rdlen = regionSwab(entry+1, (ril-1), 0, pe+1, dataStart, dataEnd, entry->info.offset);
 	if (rdlen == 0)
-	    goto errxit;
+	    return 1;
 	entry->rdlen = rdlen;
 
 	if (ril < (rpmuint32_t)h->indexUsed) {
@@ -1083,7 +1109,7 @@ assert((rpmint32_t)rdl >= 0);	/* XXX insurance */
 	    /* Load dribble entries from region. */
 	    rc = regionSwab(newEntry, (rpmuint32_t)ne, 0, pe+ril, dataStart, dataEnd, rid);
 	    if (rc == 0)
-		goto errxit;
+		return 1;
 	    rdlen += rc;
 
 	  { indexEntry firstEntry = newEntry;
@@ -1111,6 +1137,236 @@ assert((rpmint32_t)rdl >= 0);	/* XXX insurance */
     h->flags &= ~HEADERFLAG_SORTED;
     headerSort(h);
 
+    return 0;
+}
+
+/**
+ * Decode all header index entries of a lazily loaded header.
+ * The index is decoded into a copy, which is swapped in while holding
+ * the header lock, so concurrent lazyFindEntry() callers are safe.
+ * @param h		header
+ * @return		0 on success
+ */
+static int headerUnlazy(Header h)
+	/*@modifies h @*/
+{
+    struct headerToken_s hcopy;
+    indexEntry oindex = NULL;
+    int rc = 0;
+
+    if (!(h->flags & HEADERFLAG_LAZY))
+	return rc;
+
+    hcopy = *h;		/* structure assignment */
+    hcopy.flags &= ~(HEADERFLAG_LAZY|HEADERFLAG_LAZYSORTED);
+    hcopy.index = DRD_xcalloc(hcopy.indexAlloced, sizeof(*hcopy.index));
+    if (headerLoadIndex(&hcopy, 0)) {
+if (_hdr_debug)
+fprintf(stderr, "--> h %p ==== %s: damaged blob %p[%u]\n", h, __FUNCTION__, h->blob, (unsigned)h->bloblen);
+	hcopy.index = _free(hcopy.index);
+	return 1;
+    }
+
+    yarnPossess(h->_item.use);
+    if (h->flags & HEADERFLAG_LAZY) {
+	/* Preserve the region tag (headerReload() may have changed it). */
+	if (ENTRY_IS_REGION(hcopy.index))
+	    hcopy.index[0].info.tag = h->index[0].info.tag;
+	oindex = h->index;
+	h->index = hcopy.index;
+	h->indexUsed = hcopy.indexUsed;
+	h->flags = hcopy.flags;
+    } else
+	oindex = hcopy.index;
+    yarnRelease(h->_item.use);
+
+    oindex = _free(oindex);
+    return rc;
+}
+
+/**
+ * Search a (sorted, network order) run of a header index for a tag.
+ * @param pe		header physical entry pointer
+ * @param lo		first entry of run
+ * @param hi		last+1 entry of run
+ * @param tag		entry tag
+ * @return		entry index (hi if not found)
+ */
+static rpmuint32_t lazyBsearch(entryInfo pe, rpmuint32_t lo, rpmuint32_t hi,
+		rpmTag tag)
+	/*@*/
+{
+    rpmuint32_t end = hi;
+
+    while (lo < hi) {
+	rpmuint32_t mid = lo + (hi - lo) / 2;
+	rpmuint32_t mtag = (rpmuint32_t) ntohl(pe[mid].tag);
+	if (mtag == (rpmuint32_t)tag)
+	    return mid;
+	if (mtag < (rpmuint32_t)tag)
+	    lo = mid + 1;
+	else
+	    hi = mid;
+    }
+    return end;
+}
+
+/**
+ * Find matching (tag,type) entry in header, decoding only that entry
+ * from a lazily loaded header. The network order index is binary searched,
+ * and the decoded entry is cached in the header index.
+ * @param h		header
+ * @param tag		entry tag
+ * @param type		entry type
+ * @retval *buf		decoded entry (lazily loaded header only)
+ * @return 		header entry
+ */
+static /*@null@*/
+indexEntry lazyFindEntry(/*@null@*/ Header h, rpmTag tag, rpmTagType type,
+		indexEntry buf)
+	/*@modifies h, *buf @*/
+{
+    rpmuint32_t * ei;
+    entryInfo pe;
+    unsigned char * dataStart;
+    unsigned char * dataEnd;
+    indexEntry entry = NULL;
+    indexEntry ie;
+    rpmuint32_t il;
+    rpmuint32_t ril;
+    rpmuint32_t end;
+    rpmuint32_t i;
+    rpmint32_t rid;
+
+    if (h == NULL || !(h->flags & HEADERFLAG_LAZY))
+	return findEntry(h, tag, type);
+
+    yarnPossess(h->_item.use);
+    if (!(h->flags & HEADERFLAG_LAZY)) {	/* headerUnlazy() won the race. */
+	yarnRelease(h->_item.use);
+	return findEntry(h, tag, type);
+    }
+
+    ei = (rpmuint32_t *) h->blob;
+    il = (rpmuint32_t) ntohl(ei[0]);
+    /*@-castexpose@*/
+    pe = (entryInfo) &ei[2];
+    /*@=castexpose@*/
+    dataStart = (unsigned char *) (pe + il);
+    dataEnd = dataStart + ntohl(ei[1]);
+    rid = h->index[0].info.offset;
+    ril = (rpmuint32_t)(-rid) / sizeof(*pe);
+
+    /* The region tag is the only region in a lazily loaded header. */
+    if (tag >= HEADER_IMAGE && tag < HEADER_REGIONS) {
+	if (h->index[0].info.tag == (rpmuint32_t)tag) {
+	    if (h->index[0].rdlen == 0)
+		h->index[0].rdlen = regionSwab(NULL, (ril-1), 0, pe+1,
+				dataStart, dataEnd, rid);
+	    if (h->index[0].rdlen > 0) {
+		*buf = h->index[0];	/* structure assignment */
+		entry = buf;
+	    }
+	}
+	goto exit;
+    }
+
+    /* Searching needs a sorted index, otherwise decode all entries. */
+    if (!(h->flags & HEADERFLAG_LAZYSORTED)) {
+	if (!headerLazyOK(pe, il, ril)) {
+	    yarnRelease(h->_item.use);
+	    return (headerUnlazy(h) ? NULL : findEntry(h, tag, type));
+	}
+	h->flags |= HEADERFLAG_LAZYSORTED;
+    }
+
+    /* Dribble entries replace duplicate region entries. */
+    end = il;
+    i = lazyBsearch(pe, ril, il, tag);
+    if (i < il)
+	rid++;
+    else {
+	if (tag == HEADER_OLDFILENAMES
+	 && lazyBsearch(pe, ril, il, HEADER_BASENAMES) < il)
+	    goto exit;
+	end = ril;
+	i = lazyBsearch(pe, 1, ril, tag);
+	if (i >= ril)
+	    goto exit;
+    }
+
+    /* Each entry is decoded (and checked) once, and cached in the index. */
+    ie = h->index + i;
+    if (ie->info.tag == 0) {
+	if (regionSwab(buf, 1, 0, pe+i, dataStart, dataEnd, rid) == 0)
+	    goto exit;
+	/* As with a full decode, the data extends to the next entry. */
+	if (i + 1 < end) {
+	    buf->length = (size_t) ((rpmuint32_t)ntohl(pe[i+1].offset)
+			- (rpmuint32_t)ntohl(pe[i].offset));
+	    if (buf->length == 0 || hdrchkData(buf->length)
+	     || (unsigned char *)buf->data + buf->length > dataEnd)
+		goto exit;
+	}
+	*ie = *buf;		/* structure assignment */
+    } else
+	*buf = *ie;		/* structure assignment */
+    entry = buf;
+
+exit:
+    yarnRelease(h->_item.use);
+    if (entry != NULL && type != 0 && entry->info.type != type)
+	entry = NULL;
+    return entry;
+}
+
+Header headerLoad(void * uh)
+{
+    void * sw = NULL;
+    rpmuint32_t * ei = (rpmuint32_t *) uh;
+    rpmuint32_t il = (rpmuint32_t) ntohl(ei[0]);		/* index length */
+    rpmuint32_t dl = (rpmuint32_t) ntohl(ei[1]);		/* data length */
+    /*@-sizeoftype@*/
+    size_t pvlen = sizeof(il) + sizeof(dl) +
+               (il * sizeof(struct entryInfo_s)) + dl;
+    /*@=sizeoftype@*/
+    Header h = NULL;
+
+    /* Sanity checks on header intro. */
+    if (hdrchkTags(il) || hdrchkData(dl))
+	goto errxit;
+
+    h = headerGetPool(_headerPool);
+    memset(&h->h_loadops, 0, sizeof(h->h_loadops));
+    if ((sw = headerGetStats(h, 18)) != NULL)	/* RPMTS_OP_HDRLOAD */
+	(void) rpmswEnter(sw, 0);
+    {	unsigned char * hmagic = header_magic;
+	(void) memcpy(h->magic, hmagic, sizeof(h->magic));
+    }
+    /*@-assignexpose -kepttrans@*/
+    h->blob = uh;
+    h->bloblen = pvlen;
+    /*@=assignexpose =kepttrans@*/
+    h->origin = NULL;
+    h->baseurl = NULL;
+    h->digest = NULL;
+    h->parent = NULL;
+    h->rpmdb = NULL;
+    memset(&h->sb, 0, sizeof(h->sb));
+    h->instance = 0;
+    h->startoff = 0;
+    h->endoff = (rpmuint32_t) pvlen;
+    memset(&h->h_getops, 0, sizeof(h->h_getops));
+    h->indexAlloced = il + 1;
+    h->indexUsed = il;
+    h->index = DRD_xcalloc(h->indexAlloced, sizeof(*h->index));
+    h->flags = HEADERFLAG_SORTED;
+    h = headerLink(h);
+assert(h != NULL);
+
+    if (headerLoadIndex(h, _hdr_lazy))
+	goto errxit;
+
     if (sw != NULL)	(void) rpmswExit(sw, pvlen);
 
     /*@-globstate -observertrans @*/
@@ -1400,10 +1656,39 @@ Header headerCopyLoad(const void * uh)
     return headerMap(uh, map);
 }
 
+int headerCopyBlob(Header h, int shared)
+{
+    unsigned char * ob;
+    unsigned char * nb;
+    size_t i;
+
+    if (h == NULL || h->blob == NULL
+     || (h->flags & (HEADERFLAG_ALLOCATED|HEADERFLAG_MAPPED)))
+	return 0;
+
+    /* The header lock also keeps lazyFindEntry() off the index. */
+    yarnPossess(h->_item.use);
+    if (!shared || yarnPeekLock(h->_item.use) > 1L) {
+	ob = h->blob;
+	nb = memcpy(xmalloc(h->bloblen), ob, h->bloblen);
+	for (i = 0; i < h->indexUsed; i++) {
+	    unsigned char * t = h->index[i].data;
+	    if (t != NULL && t >= ob && t < ob + h->bloblen)
+		h->index[i].data = nb + (t - ob);
+	}
+	h->blob = nb;
+	h->flags |= HEADERFLAG_ALLOCATED;
+	h->flags &= ~HEADERFLAG_RDONLY;
+    }
+    yarnRelease(h->_item.use);
+    return 0;
+}
+
 int headerIsEntry(Header h, rpmTag tag)
 {
+    struct indexEntry_s buf;
     /*@-mods@*/		/*@ FIX: h modified by sort. */
-    return (findEntry(h, tag, 0) ? 1 : 0);
+    return (lazyFindEntry(h, tag, 0, &buf) ? 1 : 0);
     /*@=mods@*/	
 }
 
@@ -1602,6 +1887,7 @@ headerFindI18NString(Header h, indexEntry entry)
 	/*@*/
 {
     const char *lang, *l, *le;
+    struct indexEntry_s buf;
     indexEntry table;
 
     /* XXX Drepper sez' this is the order. */
@@ -1612,7 +1898,7 @@ headerFindI18NString(Header h, indexEntry entry)
 	    return entry->data;
     
     /*@-mods@*/
-    if ((table = findEntry(h, HEADER_I18NTABLE, RPM_STRING_ARRAY_TYPE)) == NULL)
+    if ((table = lazyFindEntry(h, HEADER_I18NTABLE, RPM_STRING_ARRAY_TYPE, &buf)) == NULL)
 	return entry->data;
     /*@=mods@*/
 
@@ -1654,12 +1940,13 @@ static int intGetEntry(Header h, HE_t he, int flags)
 	/*@modifies he @*/
 {
     int minMem = 0;
+    struct indexEntry_s buf;
     indexEntry entry;
     int rc;
 
     /* First find the tag */
 /*@-mods@*/		/*@ FIX: h modified by sort. */
-    entry = findEntry(h, he->tag, 0);
+    entry = lazyFindEntry(h, he->tag, 0, &buf);
 /*@=mods@*/
     if (entry == NULL) {
 	he->t = 0;
@@ -1778,6 +2065,9 @@ int headerAddEntry(Header h, HE_t he)
     if (hdrchkData(he->c))
 	return rc;
 
+    if (headerUnlazy(h))
+	return rc;
+
     data.ptr = grabData(he, &length);
     if (data.ptr == NULL || length == 0)
 	return rc;
@@ -116,6 +116,8 @@ struct headerToken_s {
 #define HEADERFLAG_SIGNATURE	(1 << 4) /*!< Signature header? */
 #define HEADERFLAG_MAPPED	(1 << 5) /*!< Is 1st header region mmap'd? */
 #define HEADERFLAG_RDONLY	(1 << 6) /*!< Is 1st header region rdonly? */
+#define HEADERFLAG_LAZY		(1 << 7) /*!< Are index entries decoded on use? */
+#define HEADERFLAG_LAZYSORTED	(1 << 8) /*!< Is the lazy index sorted by tag? */
 #if defined(__LCLINT__)
 /*@refs@*/
     int nrefs;			/*!< (unused) keep splint happy */
@@ -138,6 +140,16 @@ extern "C" {
 int headerVerifyInfo(rpmuint32_t il, rpmuint32_t dl, const void * pev, void * iv, int negate)
 	/*@modifies *iv @*/;
 
+/**
+ * Copy a borrowed header blob (i.e. one neither allocated nor mapped by
+ * the header) into memory owned by the header.
+ * @param h		header
+ * @param shared	copy only if the header has other references?
+ * @return		0 on success
+ */
+int headerCopyBlob(Header h, int shared)
+	/*@modifies h @*/;
+
 #ifdef __cplusplus
 }   
 #endif
@@ -128,7 +128,8 @@ rpmop rpmtsOp(rpmts ts, rpmtsOpX opx)
 {
     rpmop op = NULL;
 
-    if (ts != NULL && (int)opx >= 0 && (int)opx < RPMTS_OP_MAX)
+    if (ts != NULL && (int)opx >= 0
+     && ((int)opx < RPMTS_OP_MAX || opx == RPMTS_OP_SYNC))
 	op = ts->ops + opx;
 /*@-usereleased -compdef @*/
     return op;
@@ -6,6 +6,7 @@
 
 #include <sys/file.h>
 
+#define	_RPMIOB_INTERNAL	/* XXX rpmiobSlurp */
 #include <rpmiotypes.h>
 #include <rpmlog.h>
 #include <rpmpgp.h>
@@ -28,6 +29,7 @@
 #include "rpmdb.h"
 #include "pkgio.h"
 #include "fprint.h"
+#include "rpmpack.h"
 #include "legacy.h"
 
 #include "debug.h"
@@ -453,6 +455,14 @@ struct rpmmi_s {
     int			mi_nre;
 /*@only@*/ /*@null@*/
     miRE		mi_re;
+    size_t		mi_bulksize;	/* Bulk fetch buffer size (0 disables). */
+/*@only@*/ /*@null@*/
+    void *		mi_bulk;	/* Bulk fetch buffer. */
+    DBT			mi_bulkv;	/* Bulk fetch DB_MULTIPLE_KEY records. */
+/*@dependent@*/ /*@null@*/
+    void *		mi_bulkp;	/* Next record in bulk fetch buffer. */
+    int			mi_pack;	/* Read packed headers? (0 undecided) */
+    size_t		mi_packx;	/* Next packed header index. */
 
 };
 
@@ -462,6 +472,14 @@ static rpmdb rpmdbRock;
 /*@unchecked@*/ /*@exposed@*/ /*@null@*/
 static rpmmi rpmmiRock;
 
+/**
+ * Iterators can be created and freed concurrently (e.g. threaded checks).
+ */
+#if defined(WITH_PTHREADS)
+/*@unchecked@*/
+static pthread_mutex_t rpmmiRockLock = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
 int rpmdbCheckTerminate(int terminate)
 	/*@globals rpmdbRock, rpmmiRock @*/
 	/*@modifies rpmdbRock, rpmmiRock @*/
@@ -559,25 +577,24 @@ static int unblockSignals(/*@unused@*/ rpmdb db, sigset_t * oldMask)
 }
 
 /**
- * Return header query string.
+ * Compile a header query format.
  * @warning Only compound header extensions are available here.
- * @param h		header
  * @param qfmt		header sprintf format
- * @return		header query string
+ * @return		compiled header query format
  */
-static inline /*@null@*/ const char * queryHeader(Header h, const char * qfmt)
-	/*@globals headerCompoundFormats, fileSystem, internalState @*/
-	/*@modifies h, fileSystem, internalState @*/
+static /*@null@*/ headerSprintfArgs queryHeaderCompile(const char * qfmt)
+	/*@globals headerCompoundFormats @*/
+	/*@modifies nothing @*/
 {
     const char * errstr = "(unkown error)";
-    const char * str;
+    headerSprintfArgs hsa;
 
 /*@-modobserver@*/
-    str = headerSprintf(h, qfmt, NULL, headerCompoundFormats, &errstr);
+    hsa = headerSprintfCompile(qfmt, NULL, headerCompoundFormats, &errstr);
 /*@=modobserver@*/
-    if (str == NULL)
+    if (hsa == NULL)
 	rpmlog(RPMLOG_ERR, _("incorrect format: \"%s\": %s\n"), qfmt, errstr);
-    return str;
+    return hsa;
 }
 
 /**
@@ -587,22 +604,30 @@ static inline /*@null@*/ const char * queryHeader(Header h, const char * qfmt)
  * @param adding	adding an rpmdb header?
  * @return		0 on success
  */
-static int rpmdbExportInfo(/*@unused@*/ rpmdb db, Header h, int adding)
+static int rpmdbExportInfo(rpmdb db, Header h, int adding)
 	/*@globals headerCompoundFormats, rpmGlobalMacroContext, h_errno,
 		fileSystem, internalState @*/
-	/*@modifies h, rpmGlobalMacroContext,
+	/*@modifies db, h, rpmGlobalMacroContext,
 		fileSystem, internalState @*/
 {
     static int oneshot;
     HE_t he = memset(alloca(sizeof(*he)), 0, sizeof(*he));
+    const char * fnfmt = rpmGetPath("%{?_hrmib_path}", NULL);
     const char * fn = NULL;
     int xx;
 
-    {	const char * fnfmt = rpmGetPath("%{?_hrmib_path}", NULL);
-	if (fnfmt && *fnfmt)
-	    fn = queryHeader(h, fnfmt);
-	fnfmt = _free(fnfmt);
+    /* Recompile the path format only when %{_hrmib_path} changes. */
+    if (db->db_hrmibfmt == NULL || strcmp(fnfmt, db->db_hrmibfmt)) {
+	db->db_hrmib = headerSprintfFree(db->db_hrmib);
+	db->db_hrmibfmt = _free(db->db_hrmibfmt);
+	if (*fnfmt)
+	    db->db_hrmib = queryHeaderCompile(fnfmt);
+	db->db_hrmibfmt = fnfmt;
+	fnfmt = NULL;
     }
+    fnfmt = _free(fnfmt);
+    if (db->db_hrmib != NULL)
+	fn = headerSprintfExec(db->db_hrmib, h, NULL);
 
     if (fn == NULL)
 	goto exit;
@@ -668,6 +693,10 @@ static rpmdb rpmdbGetPool(/*@null@*/ rpmioPool pool)
     return db;
 }
 
+static int rpmdbPackOpen(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/;
+
 int rpmdbOpenAll(rpmdb db)
 {
     int rc = 0;
@@ -698,6 +727,8 @@ int rpmdbOpenAll(rpmdb db)
 	(void) dbiOpen(db, db->db_tags[dbix].tag, db->db_flags);
     }
   }
+    /* Open the packed headers too, nothing is then opened lazily. */
+    (void) rpmdbPackOpen(db);
     return rc;
 }
 
@@ -744,6 +775,559 @@ int rpmdbCloseDBI(rpmdb db, int tag)
     return rc;
 }
 
+/* ================================================================= */
+/* Installed basenames Bloom filter. */
+
+/*@unchecked@*/
+static double _rpmdb_bf_e = 1.0e-3;
+
+/**
+ * Return path to a file in the rpmdb home directory.
+ * @param db		rpm database
+ * @param fn		file name
+ * @return		file path (malloc'd)
+ */
+static const char * rpmdbHomePath(rpmdb db, const char * fn)
+	/*@globals rpmGlobalMacroContext, h_errno @*/
+	/*@modifies rpmGlobalMacroContext @*/
+{
+    const char * root = db->db_root;
+
+    if (root == NULL || (root[0] == '/' && root[1] == '\0')
+     || db->db_chrootDone)
+	root = NULL;
+    return rpmGenPath(root, db->db_home, fn);
+}
+
+/**
+ * Return the Packages generation, a digest of the (dev, ino, size, mtime)
+ * of the Packages file. Every flushed Packages write changes it, also the
+ * writes of rpm builds that don't keep the derived copies (Bloom filter,
+ * packed headers) current. Each copy carries the generation it describes
+ * in its own file header, Packages itself is never written.
+ *
+ * A file modified within the current second (on file systems without
+ * sub-second timestamps) has no generation: a further write in the
+ * same second could leave the stamp unchanged.
+ * @param db		rpm database
+ * @retval *genp	Packages generation (0 if unknown)
+ * @return		0 on success
+ */
+static int rpmdbPackagesGen(rpmdb db, /*@out@*/ uint64_t * genp)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies *genp, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    const char * fn = rpmdbHomePath(db, "Packages");
+    struct stat sb;
+    uint64_t v[5];
+    uint64_t gen = 0xcbf29ce484222325ULL;	/* FNV-1a offset basis */
+    const unsigned char * s;
+    size_t i;
+    int rc;
+
+    *genp = 0;
+    rc = Stat(fn, &sb);
+    fn = _free(fn);
+    if (rc)
+	return rc;
+
+    v[0] = (uint64_t) sb.st_dev;
+    v[1] = (uint64_t) sb.st_ino;
+    v[2] = (uint64_t) sb.st_size;
+    v[3] = (uint64_t) sb.st_mtime;
+#if defined(_STATBUF_ST_NSEC) && defined(__USE_XOPEN2K8)
+    v[4] = (uint64_t) sb.st_mtim.tv_nsec;
+#else
+    v[4] = 0;
+#endif
+    if (v[4] == 0 && sb.st_mtime >= time(NULL))
+	return 0;
+
+    for (s = (const unsigned char *) v, i = 0; i < sizeof(v); i++) {
+	gen ^= s[i];
+	gen *= 0x100000001b3ULL;		/* FNV-1a prime */
+    }
+    *genp = (gen ? gen : 1);
+    return 0;
+}
+
+/**
+ * Note a Packages write before it is made.
+ * Loaded copies must have been current, otherwise they miss another
+ * writer's changes. From then on they follow this rpmdb's writes, and are
+ * saved with the generation that Packages has once it is flushed.
+ * Nothing is done unless a copy is loaded.
+ * @param db		rpm database
+ */
+static void rpmdbPackagesWrite(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    uint64_t gen = 0;
+
+    if (db->db_genwrite)
+	return;
+    db->db_genwrite = 1;
+    if (db->db_packstate <= 0 && db->db_bfstate <= 0)
+	return;
+
+    (void) rpmdbPackagesGen(db, &gen);
+    if (db->db_packstate > 0) {
+	if (gen == 0 || gen != db->db_gen)
+	    db->db_packstate = -1;
+    }
+    if (db->db_bfstate > 0) {
+	/* Once written, even an unchanged filter needs a new generation. */
+	if (gen == 0 || gen != db->db_bfgen)
+	    db->db_bfstate = -1;
+	else
+	    db->db_bfstate = 2;
+    }
+}
+
+/**
+ * Load a persisted Bloom filter, checking that it describes Packages.
+ * @param db		rpm database
+ * @param fn		Bloom filter path
+ * @return		0 on success
+ */
+static int rpmdbBFLoad(rpmdb db, const char * fn)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    uint64_t gen = 0;
+    unsigned long long m, k, n, nmax, nremoved, fgen;
+    rpmiob iob = NULL;
+    const char * b;
+    const char * t;
+    size_t nb;
+    int rc = -1;
+
+    /* Packages on disk doesn't show this rpmdb's (unflushed) writes yet. */
+    if (db->db_genwrite)
+	goto exit;
+    if (rpmdbPackagesGen(db, &gen) || gen == 0 || rpmiobSlurp(fn, &iob))
+	goto exit;
+
+    /* Header: magic, filter parameters, Packages generation; then the bits. */
+    b = rpmiobStr(iob);
+    if ((t = memchr(b, '\n', rpmiobLen(iob))) == NULL
+     || sscanf(b, "RPMBF2 %llu %llu %llu %llu %llu %llu",
+		&m, &k, &n, &nmax, &nremoved, &fgen) != 6)
+	goto exit;
+    if (fgen != (unsigned long long) gen)
+	goto exit;
+    if (m == 0 || k == 0 || n > nmax)
+	goto exit;
+    t++;
+    nb = (__PBM_IX(m - 1) + 1) * (__PBM_NBITS/8);
+    if ((size_t)(rpmiobLen(iob) - (t - b)) != nb)
+	goto exit;
+
+    db->db_bf = rpmbfNew((size_t)m, (size_t)k, 0);
+    memcpy(db->db_bf->bits, t, nb);
+    db->db_bf->n = (size_t) n;
+    db->db_bfmax = (size_t) nmax;
+    db->db_bfremoved = (size_t) nremoved;
+    db->db_bfgen = gen;
+    rc = 0;
+
+exit:
+    iob = rpmiobFree(iob);
+    return rc;
+}
+
+/**
+ * Rebuild the Bloom filter from the keys of the Basenames index.
+ * @param db		rpm database
+ * @return		0 on success
+ */
+static int rpmdbBFRebuild(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    DBC * dbcursor = NULL;
+    DBT k = DBT_INIT;
+    DBT v = DBT_INIT;
+    dbiIndex dbi;
+    ARGV_t av = NULL;
+    size_t m = 0;
+    size_t nk = 0;
+    int ac;
+    int i;
+    int rc;
+    int xx;
+
+    /* The generation is read first, a later write just makes it stale. */
+    if (rpmdbPackagesGen(db, &db->db_bfgen))
+	return -1;
+    dbi = dbiOpen(db, RPMTAG_BASENAMES, 0);
+    if (dbi == NULL)
+	return -1;
+
+    /* Only the keys are needed. */
+    v.flags |= DB_DBT_PARTIAL;
+
+    xx = dbiCopen(dbi, dbiTxnid(dbi), &dbcursor, 0);
+    while ((rc = dbiGet(dbi, dbcursor, &k, &v, DB_NEXT_NODUP)) == 0) {
+	char * a = memcpy(xmalloc(k.size + 1), k.data, k.size);
+	a[k.size] = '\0';
+	xx = argvAdd(&av, a);
+	a = _free(a);
+    }
+    xx = dbiCclose(dbi, dbcursor, 0);
+    dbcursor = NULL;
+    if (rc != DB_NOTFOUND) {
+	av = argvFree(av);
+	return -1;
+    }
+
+    /* Leave room for growth: the filter is rebuilt only when it fills. */
+    ac = argvCount(av);
+    db->db_bfmax = 2 * (size_t)ac + 16384;
+    rpmbfParams(db->db_bfmax, _rpmdb_bf_e, &m, &nk);
+    db->db_bf = rpmbfNew(m, nk, 0);
+    for (i = 0; i < ac; i++)
+	xx = rpmbfAdd(db->db_bf, av[i], 0);
+    db->db_bfremoved = 0;
+    av = argvFree(av);
+
+    rpmlog(RPMLOG_DEBUG, D_("rpmdb: rebuilt Bloom filter from %d basenames\n"),
+		ac);
+    return 0;
+}
+
+/**
+ * Discard the Bloom filter once it no longer screens effectively.
+ * Removed basenames are never cleared (that would permit false negatives),
+ * they just accumulate as false positives until the next rebuild.
+ * @param db		rpm database
+ */
+static void rpmdbBFCheckFill(rpmdb db)
+	/*@modifies db @*/
+{
+    if (db->db_bf == NULL)
+	return;
+    if (db->db_bf->n > db->db_bfmax || db->db_bfremoved > db->db_bfmax / 2) {
+	db->db_bf = rpmbfFree(db->db_bf);
+	db->db_bfstate = -1;
+    }
+}
+
+/**
+ * Add/remove a header's basenames to/from the Bloom filter.
+ * @param db		rpm database
+ * @param h		header
+ * @param adding	adding header?
+ */
+static void rpmdbBFUpdate(rpmdb db, Header h, int adding)
+	/*@modifies db @*/
+{
+    HE_t he = memset(alloca(sizeof(*he)), 0, sizeof(*he));
+    rpmuint32_t i;
+
+    if (db->db_bfstate <= 0 || db->db_bf == NULL)
+	return;
+
+    he->tag = RPMTAG_BASENAMES;
+    if (!headerGet(h, he, 0))
+	return;
+    if (adding) {
+	for (i = 0; i < he->c; i++)
+	    (void) rpmbfAdd(db->db_bf, he->p.argv[i], 0);
+    } else
+	db->db_bfremoved += he->c;
+    he->p.ptr = _free(he->p.ptr);
+    db->db_bfstate = 2;
+    rpmdbBFCheckFill(db);
+}
+
+/**
+ * Persist (or discard) the Bloom filter as the rpmdb is closed.
+ * Must be called after the Packages store is closed and flushed.
+ * @param db		rpm database
+ */
+static void rpmdbBFSave(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    const char * bfn = rpmExpand("%{?_rpmdb_bf}", NULL);
+    const char * fn = NULL;
+    const char * tfn = NULL;
+    uint64_t gen = 0;
+    char b[BUFSIZ];
+    FD_t fd;
+    size_t nb;
+    int rc = -1;
+    int xx;
+
+    if (!(bfn && *bfn))
+	goto exit;
+    fn = rpmdbHomePath(db, bfn);
+
+    /* A filter that didn't follow every write since it was built is stale. */
+    if (db->db_bfstate == 2 && db->db_bf != NULL) {
+	(void) rpmdbPackagesGen(db, &gen);
+	if (gen == 0 || (!db->db_genwrite && gen != db->db_bfgen))
+	    db->db_bfstate = -1;
+	else
+	    db->db_bfgen = gen;
+    }
+
+    /* An unusable filter is removed, the next user will rebuild it. */
+    if (db->db_bfstate < 0) {
+	xx = Unlink(fn);
+	goto exit;
+    }
+    if (db->db_bfstate != 2 || db->db_bf == NULL)
+	goto exit;
+
+    (void) snprintf(b, sizeof(b),
+		"RPMBF2 %llu %llu %llu %llu %llu %llu\n",
+		(unsigned long long)db->db_bf->m,
+		(unsigned long long)db->db_bf->k,
+		(unsigned long long)db->db_bf->n,
+		(unsigned long long)db->db_bfmax,
+		(unsigned long long)db->db_bfremoved,
+		(unsigned long long)db->db_bfgen);
+    nb = (__PBM_IX(db->db_bf->m - 1) + 1) * (__PBM_NBITS/8);
+
+    /* Write to a temporary file and rename, readers never see a partial filter. */
+    tfn = rpmGetPath(fn, ".tmp", NULL);
+    fd = Fopen(tfn, "w.ufdio");
+    if (fd == NULL || Ferror(fd)) {
+	if (fd) xx = Fclose(fd);
+	goto exit;
+    }
+    if (Fwrite(b, 1, strlen(b), fd) == strlen(b)
+     && Fwrite(db->db_bf->bits, 1, nb, fd) == nb)
+    {
+	xx = Fclose(fd);
+	rc = (xx == 0 ? Rename(tfn, fn) : -1);
+    } else
+	xx = Fclose(fd);
+    if (rc)
+	xx = Unlink(tfn);
+    else
+	db->db_bfstate = 1;
+
+exit:
+    tfn = _free(tfn);
+    fn = _free(fn);
+    bfn = _free(bfn);
+}
+
+int rpmdbChkBasename(rpmdb db, const char * s, size_t ns)
+{
+    int rc = 1;		/* assume possibly installed */
+
+    if (db == NULL || s == NULL)
+	return rc;
+
+    /* Load (or rebuild) the filter on first use. */
+    if (db->db_bfstate == 0) {
+	const char * bfn = rpmExpand("%{?_rpmdb_bf}", NULL);
+	db->db_bfstate = -1;
+	if (bfn && *bfn) {
+	    const char * fn = rpmdbHomePath(db, bfn);
+	    if (rpmdbBFLoad(db, fn) == 0)
+		db->db_bfstate = 1;
+	    else if (rpmdbBFRebuild(db) == 0)
+		db->db_bfstate = 2;
+	    fn = _free(fn);
+	}
+	bfn = _free(bfn);
+	rpmdbBFCheckFill(db);
+    }
+
+    if (db->db_bfstate > 0 && db->db_bf != NULL) {
+	db->db_bfprobes++;
+	if ((rc = rpmbfChk(db->db_bf, s, ns)) == 0)
+	    db->db_bfavoided++;
+    }
+    return rc;
+}
+
+/* ================================================================= */
+/* Packed headers, a read-only mmap(2) copy of Packages. */
+
+/**
+ * Return path to the packed headers (if configured).
+ * @param db		rpm database
+ * @return		packed headers path (NULL if not configured)
+ */
+/*@null@*/
+static const char * rpmdbPackPath(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno @*/
+	/*@modifies rpmGlobalMacroContext @*/
+{
+    const char * bfn = rpmExpand("%{?_rpmdb_pack}", NULL);
+    const char * fn = NULL;
+
+    if (bfn && *bfn)
+	fn = rpmdbHomePath(db, bfn);
+    bfn = _free(bfn);
+    return fn;
+}
+
+/**
+ * Open the packed headers on first use.
+ * @param db		rpm database
+ * @return		db->db_packstate
+ */
+static int rpmdbPackOpen(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    if (db->db_packstate == 0) {
+	const char * fn = rpmdbPackPath(db);
+
+	if (fn == NULL)
+	    db->db_packstate = -2;
+	/* Packages on disk doesn't show this rpmdb's (unflushed) writes yet. */
+	else if (!db->db_genwrite && !rpmdbPackagesGen(db, &db->db_gen)
+	      && (db->db_pack = rpmpackOpen(fn, db->db_gen)) != NULL)
+	    db->db_packstate = 1;
+	else
+	    db->db_packstate = -1;
+	fn = _free(fn);
+    }
+    return db->db_packstate;
+}
+
+/**
+ * Keep the packed headers in step with a Packages change.
+ * @param db		rpm database
+ * @param hdrNum	header instance
+ * @param uh		header blob (NULL if removed)
+ * @param uhlen		header blob length
+ */
+static void rpmdbPackUpdate(rpmdb db, uint32_t hdrNum,
+		/*@null@*/ const void * uh, size_t uhlen)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies db, fileSystem, internalState @*/
+{
+    if (db->db_packstate <= 0)
+	return;
+    /* Appended records aren't mapped, stop reading until re-opened. */
+    if (rpmpackAppend(db->db_pack, hdrNum, uh, uhlen) == 0)
+	db->db_packstate = 2;
+    else
+	db->db_packstate = -1;
+}
+
+/**
+ * Iterate Packages for rpmpackCreate().
+ */
+struct rpmdbPackIter_s {
+    dbiIndex dbi;
+    DBC * dbcursor;
+    DBT k;
+    DBT v;
+};
+
+static int rpmdbPackNext(void * _it, uint32_t * hdrNump,
+		const void ** uhp, size_t * uhlenp)
+	/*@modifies _it, *hdrNump, *uhp, *uhlenp @*/
+{
+    struct rpmdbPackIter_s * it = _it;
+    uint32_t hdrNum = 0;
+    int rc;
+
+    do {
+	rc = dbiGet(it->dbi, it->dbcursor, &it->k, &it->v, DB_NEXT);
+	if (rc)
+	    return (rc == DB_NOTFOUND ? 1 : -1);
+	if (it->k.size != sizeof(hdrNum))
+	    return -1;
+	memcpy(&hdrNum, it->k.data, sizeof(hdrNum));
+	hdrNum = _ntoh_ui(hdrNum);
+    } while (hdrNum == 0);	/* XXX skip the legacy instance counter. */
+
+    *hdrNump = hdrNum;
+    *uhp = it->v.data;
+    *uhlenp = (size_t) it->v.size;
+    return 0;
+}
+
+/**
+ * Write fresh packed headers (from a scan of Packages) if needed.
+ * Called before the Packages store is closed by a writer.
+ * @param db		rpm database
+ * @return		path of uncommitted packed headers (NULL if none)
+ */
+/*@null@*/
+static const char * rpmdbPackRebuild(rpmdb db)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    struct rpmdbPackIter_s it;
+    const char * fn;
+    const char * tfn = NULL;
+    int xx;
+
+    if (!(db->db_mode & (O_RDWR|O_WRONLY)))
+	return NULL;
+    if (db->db_packstate == 0)
+	(void) rpmdbPackOpen(db);
+    if (!(db->db_packstate == -1 || rpmpackWasted(db->db_pack)))
+	return NULL;
+    if ((fn = rpmdbPackPath(db)) == NULL)
+	return NULL;
+
+    memset(&it, 0, sizeof(it));
+    it.dbi = dbiOpen(db, RPMDBI_PACKAGES, 0);
+    if (it.dbi != NULL) {
+	tfn = rpmGetPath(fn, ".tmp", NULL);
+	xx = dbiCopen(it.dbi, dbiTxnid(it.dbi), &it.dbcursor, 0);
+	if (rpmpackCreate(tfn, rpmdbPackNext, &it))
+	    tfn = _free(tfn);
+	xx = dbiCclose(it.dbi, it.dbcursor, 0);
+    }
+    fn = _free(fn);
+    return tfn;
+}
+
+/**
+ * Commit the packed headers as the Packages store is closed.
+ * Must be called after the Packages store is closed and flushed.
+ * @param db		rpm database
+ * @param tfn		uncommitted packed headers from rpmdbPackRebuild()
+ */
+static void rpmdbPackCommit(rpmdb db, /*@null@*/ const char * tfn)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/
+{
+    const char * fn = NULL;
+    uint64_t gen = 0;
+    int xx;
+
+    if (tfn == NULL && !(db->db_packstate == 2 || db->db_packstate == -1))
+	goto exit;
+    if ((fn = rpmdbPackPath(db)) == NULL)
+	goto exit;
+
+    /* The records describe Packages as flushed (0 fails the commit). */
+    (void) rpmdbPackagesGen(db, &gen);
+
+    if (tfn != NULL) {
+	if (rpmpackCommit(tfn, gen, NULL) == 0 && Rename(tfn, fn) == 0)
+	    rpmlog(RPMLOG_DEBUG, D_("rpmdb: rewrote packed headers %s\n"), fn);
+	else
+	    xx = Unlink(tfn);
+    } else if (db->db_packstate == -1) {
+	/* A writer couldn't rewrite stale packed headers, remove them. */
+	if (db->db_mode & (O_RDWR|O_WRONLY))
+	    xx = Unlink(fn);
+    } else if (rpmpackCommit(fn, gen, db->db_pack) != 0)
+	xx = Unlink(fn);	/* a stale copy is discarded on open anyway */
+
+exit:
+    db->db_pack = rpmpackFree(db->db_pack);
+    db->db_packstate = 0;
+    fn = _free(fn);
+}
+
 /* XXX query.c, rpminstall.c, verify.c */
 /*@-incondefs@*/
 int rpmdbClose(rpmdb db)
@@ -765,6 +1349,7 @@ fprintf(stderr, "--> db %p -- %ld %s at %s:%u\n", db, yarnPeekLock(db->_item.use
 
     /*@-usereleased@*/
     if (yarnPeekLock(db->_item.use) <= 1L) {
+	const char * packfn = rpmdbPackRebuild(db);
 
 	if (db->_dbi)
 	for (dbix = db->db_ndbi; dbix;) {
@@ -778,6 +1363,13 @@ fprintf(stderr, "--> db %p -- %ld %s at %s:%u\n", db, yarnPeekLock(db->_item.use
 	    db->_dbi[dbix] = NULL;
 	    /*@=unqualifiedtrans@*/
 	}
+	rpmdbBFSave(db);
+	db->db_bf = rpmbfFree(db->db_bf);
+	db->db_bfstate = 0;
+	rpmdbPackCommit(db, packfn);
+	packfn = _free(packfn);
+	db->db_hrmib = headerSprintfFree(db->db_hrmib);
+	db->db_hrmibfmt = _free(db->db_hrmibfmt);
 	db->db_errpfx = _free(db->db_errpfx);
 	db->db_root = _free(db->db_root);
 	db->db_home = _free(db->db_home);
@@ -942,6 +1534,18 @@ fprintf(stderr, "==> rpmdbNew(%s, %s, 0x%x, 0%o, 0x%x) db %p\n", root, home, mod
     memset(&db->db_putops, 0, sizeof(db->db_putops));
     memset(&db->db_delops, 0, sizeof(db->db_delops));
 
+    db->db_bf = NULL;
+    db->db_bfstate = 0;
+    db->db_bfmax = 0;
+    db->db_bfremoved = 0;
+    db->db_bfprobes = 0;
+    db->db_bfavoided = 0;
+    db->db_bfgen = 0;
+    db->db_pack = NULL;
+    db->db_packstate = 0;
+    db->db_gen = 0;
+    db->db_genwrite = 0;
+
     /*@-globstate@*/
     return rpmdbLink(db, __FUNCTION__);
     /*@=globstate@*/
@@ -1111,6 +1715,16 @@ int rpmdbCountPackages(rpmdb db, const char * N)
     return rpmdbCount(db, RPMTAG_NAME, N, strlen(N));
 }
 
+int rpmdbTxnEnabled(rpmdb db)
+{
+#if defined(DB_INIT_TXN)
+    dbiIndex dbi = (db != NULL && db->_dbi != NULL ? db->_dbi[0] : NULL);
+    return (dbi != NULL && (dbi->dbi_eflags & DB_INIT_TXN) ? 1 : 0);
+#else
+    return 0;
+#endif
+}
+
 /* Return pointer to first RE character (or NUL terminator) */
 static const char * stemEnd(const char * s)
 	/*@*/
@@ -1394,6 +2008,180 @@ fprintf(stderr, "<-- %s(%p, \"%s\")\trc %d set %p %p[%u]\n", __FUNCTION__, mi, b
     return rc;
 }
 
+/**
+ * Compare a btree key with a string, in default btree (bytewise) order.
+ * @param k		btree key
+ * @param s		string
+ * @param ns		string length
+ * @return		<0, 0, >0 as with strcmp
+ */
+static int dbtKeyCmp(const DBT * k, const char * s, size_t ns)
+	/*@*/
+{
+    size_t nk = (size_t) k->size;
+    int rc = memcmp(k->data, s, (nk < ns ? nk : ns));
+    if (rc == 0)
+	rc = (nk < ns ? -1 : (nk > ns ? 1 : 0));
+    return rc;
+}
+
+/**
+ * Retrieve the primary keys for many secondary keys with one cursor.
+ *
+ * The keys are sorted and the btree is walked in order. After collecting
+ * the duplicates of a key, a single DB_NEXT usually lands on (or past)
+ * the next wanted key. DB_SET_RANGE is only needed to skip ahead.
+ * @param db		rpm database
+ * @param tag		rpm tag
+ * @param keys		secondary keys
+ * @retval *matches	set of header instances (tagNum is the key hash)
+ * @return		0 on success
+ */
+static int dbiMultiKeys(rpmdb db, rpmTag tag, ARGV_t keys,
+		dbiIndexSet * matches)
+	/*@globals internalState @*/
+	/*@modifies *matches, internalState @*/
+{
+    DBC * dbcursor = NULL;
+    DBT k = DBT_INIT;
+    DBT p = DBT_INIT;
+    DBT v = DBT_INIT;
+    dbiIndex dbi;
+    dbiIndexSet set = NULL;
+    ARGV_t av = NULL;
+    int ac;
+    int i;
+    int ret = 1;		/* assume error */
+    int rc;
+    int xx;
+
+    dbi = dbiOpen(db, tag, 0);
+    if (dbi == NULL)
+	goto exit;
+
+    /* Only btrees can be walked in key order. */
+    if (dbi->dbi_type != DB_BTREE) {
+	ac = argvCount(keys);
+	for (i = 0; i < ac; i++) {
+	    dbiIndexSet kset = NULL;
+	    if (dbiMireKeys(db, tag, RPMMIRE_STRCMP, keys[i], &kset, NULL))
+		goto exit;
+	    if (kset != NULL) {
+		rpmuint32_t tagNum = hashFunctionString(0, keys[i], 0);
+		unsigned int j;
+		for (j = 0; j < kset->count; j++)
+		    kset->recs[j].tagNum = tagNum;
+		if (set == NULL)
+		    set = xcalloc(1, sizeof(*set));
+		(void) dbiAppendSet(set, kset->recs, kset->count,
+			sizeof(*kset->recs), 0);
+	    }
+	    kset = dbiFreeIndexSet(kset);
+	}
+	ret = 0;
+	goto exit;
+    }
+
+    xx = argvAppend(&av, keys);
+    xx = argvSort(av, NULL);
+    ac = argvCount(av);
+
+    p.flags |= DB_DBT_PARTIAL;
+    v.flags |= DB_DBT_PARTIAL;
+
+    xx = dbiCopen(dbi, dbiTxnid(dbi), &dbcursor, 0);
+
+    rc = DB_NOTFOUND;		/* cursor is not positioned yet */
+    for (i = 0; i < ac; i++) {
+	const char * s = av[i];
+	size_t ns = strlen(s);
+	rpmuint32_t tagNum;
+
+	if (ns == 0 || (i > 0 && !strcmp(s, av[i-1])))
+	    continue;
+
+	/* Skip ahead unless the cursor is already at (or past) the key. */
+	if (rc != 0 || dbtKeyCmp(&k, s, ns) < 0) {
+	    memset(&k, 0, sizeof(k));
+	    k.data = (void *) s;
+	    k.size = (UINT32_T) ns;
+	    rc = dbiPget(dbi, dbcursor, &k, &p, &v, DB_SET_RANGE);
+	    if (rc)
+		break;
+	}
+	if (dbtKeyCmp(&k, s, ns) != 0)
+	    continue;
+
+	/* Collect the primary keys, then step to the next secondary key. */
+	tagNum = hashFunctionString(0, s, 0);
+	if (set == NULL)
+	    set = xcalloc(1, sizeof(*set));
+	do {
+	    struct _dbiIndexItem rec;
+	    memset(&rec, 0, sizeof(rec));
+	    memcpy(&rec.hdrNum, p.data, sizeof(rec.hdrNum));
+	    rec.hdrNum = _ntoh_ui(rec.hdrNum);
+	    rec.tagNum = tagNum;
+	    (void) dbiAppendSet(set, &rec, 1, sizeof(rec), 0);
+	} while ((rc = dbiPget(dbi, dbcursor, &k, &p, &v, DB_NEXT_DUP)) == 0);
+	if (rc == DB_NOTFOUND)
+	    rc = dbiPget(dbi, dbcursor, &k, &p, &v, DB_NEXT_NODUP);
+	if (rc)
+	    break;
+    }
+
+    xx = dbiCclose(dbi, dbcursor, 0);
+    dbcursor = NULL;
+
+    switch (rc) {
+    case 0:
+    case DB_NOTFOUND:
+	ret = 0;
+	break;
+    default:
+	rpmlog(RPMLOG_ERR, _("error(%d) getting keys from %s index\n"),
+		rc, tagName(dbi->dbi_rpmtag));
+	break;
+    }
+
+exit:
+    if (ret == 0 && matches) {
+	*matches = set;
+	set = NULL;
+    }
+    set = dbiFreeIndexSet(set);
+    av = argvFree(av);
+if (_rpmmi_debug || (dbi && dbi->dbi_debug))
+fprintf(stderr, "<-- %s(%p, %s(%u), %p[%d]) rc %d %p[%u]\n", __FUNCTION__, db, tagName(tag), (unsigned)tag, keys, argvCount(keys), ret, (matches && *matches ? (*matches)->recs : NULL), (matches && *matches ? (*matches)->count : 0));
+    return ret;
+}
+
+int rpmmiGrowKeys(rpmmi mi, rpmTag tag, const char ** keys)
+{
+    dbiIndexSet set = NULL;
+    int rc = 1;		/* assume error */
+
+    if (mi == NULL || mi->mi_db == NULL)
+	goto exit;
+    if (keys == NULL || keys[0] == NULL) {
+	rc = 0;
+	goto exit;
+    }
+
+    rc = dbiMultiKeys(mi->mi_db, tag, keys, &set);
+    if (rc == 0 && set != NULL) {
+	if (mi->mi_set == NULL)
+	    mi->mi_set = xcalloc(1, sizeof(*mi->mi_set));
+	(void) dbiAppendSet(mi->mi_set, set->recs, set->count, sizeof(*set->recs), 0);
+    }
+
+exit:
+if (_rpmmi_debug)
+fprintf(stderr, "<-- %s(%p, %s(%u), %p)\trc %d set %p %p[%u]\n", __FUNCTION__, mi, tagName(tag), (unsigned)tag, keys, rc, set, (set ? set->recs : NULL), (unsigned)(set ? set->count : 0));
+    set = dbiFreeIndexSet(set);
+    return rc;
+}
+
 /**
  * Attempt partial matches on name[-version[-release]] strings.
  * @param dbi		index database handle (always RPMTAG_NVRA)
@@ -1522,13 +2310,16 @@ static int miFreeHeader(rpmmi mi, dbiIndex dbi)
 	if (v.data != NULL) {
 	    sigset_t signalMask;
 	    (void) blockSignals(dbi->dbi_rpmdb, &signalMask);
+	    rpmdbPackagesWrite(dbi->dbi_rpmdb);
 	    rc = dbiPut(dbi, mi->mi_dbc, &k, &v, DB_KEYLAST);
 	    if (rc) {
 		rpmlog(RPMLOG_ERR,
 			_("error(%d) storing record h#%u into %s\n"),
 			rc, (unsigned)_ntoh_ui(mi->mi_prevoffset),
 			tagName(dbi->dbi_rpmtag));
-	    }
+	    } else
+		rpmdbPackUpdate(dbi->dbi_rpmdb, _ntoh_ui(mi->mi_prevoffset),
+			v.data, (size_t)v.size);
 	    xx = dbiSync(dbi, 0);
 	    (void) unblockSignals(dbi->dbi_rpmdb, &signalMask);
 	}
@@ -1536,6 +2327,8 @@ static int miFreeHeader(rpmmi mi, dbiIndex dbi)
 	v.size = 0;
     }
 
+    /* A header loaded in place must not outlive the iterator's store. */
+    (void) headerCopyBlob(mi->mi_h, 1);
     (void)headerFree(mi->mi_h);
     mi->mi_h = NULL;
 
@@ -1544,15 +2337,19 @@ static int miFreeHeader(rpmmi mi, dbiIndex dbi)
 /*@=nullstate@*/
 }
 
-static void rpmmiFini(void * _mi)
+/**
+ * Remove an iterator from the chain of iterators to teardown on exit.
+ * @param mi		rpm database iterator
+ */
+static void rpmmiUnchain(rpmmi mi)
 	/*@globals rpmmiRock @*/
-	/*@modifies _mi, rpmmiRock @*/
+	/*@modifies mi, rpmmiRock @*/
 {
-    rpmmi mi = _mi;
     rpmmi * prev, next;
-    dbiIndex dbi;
-    int xx;
 
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&rpmmiRockLock);
+#endif
     prev = &rpmmiRock;
     while ((next = *prev) != NULL && next != mi)
 	prev = &next->mi_next;
@@ -1560,6 +2357,20 @@ static void rpmmiFini(void * _mi)
 /*@i@*/	*prev = next->mi_next;
 	next->mi_next = NULL;
     }
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&rpmmiRockLock);
+#endif
+}
+
+static void rpmmiFini(void * _mi)
+	/*@globals rpmmiRock @*/
+	/*@modifies _mi, rpmmiRock @*/
+{
+    rpmmi mi = _mi;
+    dbiIndex dbi;
+    int xx;
+
+    rpmmiUnchain(mi);
 
     /* XXX NOTFOUND exits traverse here w mi->mi_db == NULL. b0rked imho. */
     if (mi->mi_db) {
@@ -1585,6 +2396,12 @@ assert(dbi != NULL);				/* XXX sanity */
     mi->mi_bf = NULL;
     mi->mi_set = dbiFreeIndexSet(mi->mi_set);
 
+    mi->mi_bulk = _free(mi->mi_bulk);
+    mi->mi_bulkp = NULL;
+    mi->mi_bulksize = 0;
+    mi->mi_pack = 0;
+    mi->mi_packx = 0;
+
     mi->mi_keyp = _free(mi->mi_keyp);
     mi->mi_keylen = 0;
     mi->mi_primary = _free(mi->mi_primary);
@@ -2114,6 +2931,62 @@ fprintf(stderr, "<-- %s(%p(%s),%p,%p,%p,0x%x) rc %d\n", __FUNCTION__, dbi, tagNa
     return rc;
 }
 
+/**
+ * Return next Packages record, fetching many records per dbiGet().
+ *
+ * Records are returned in place in the (reused) bulk buffer, which is
+ * refilled with DB_NEXT|DB_MULTIPLE_KEY when exhausted, and grown if a
+ * single record does not fit. The current header (loaded in place) is
+ * copied out of the buffer first.
+ * @param dbi		index database handle (always RPMDBI_PACKAGES)
+ * @param mi		rpm database iterator
+ * @retval kp		primary key of next record
+ * @retval vp		next record (points into bulk buffer)
+ * @return		0 on success
+ */
+static int rpmmiGetBulk(dbiIndex dbi, rpmmi mi, DBT * kp, DBT * vp)
+	/*@globals internalState @*/
+	/*@modifies dbi, mi, *kp, *vp, internalState @*/
+{
+    void * kd, * vd;
+    UINT32_T kl, vl;
+    int rc;
+
+    while (1) {
+	if (mi->mi_bulkp != NULL) {
+	    DB_MULTIPLE_KEY_NEXT(mi->mi_bulkp, &mi->mi_bulkv, kd, kl, vd, vl);
+	    if (mi->mi_bulkp != NULL) {
+		kp->data = kd;
+		kp->size = kl;
+		vp->data = vd;
+		vp->size = vl;
+		return 0;
+	    }
+	}
+
+	/* Refill the bulk buffer. */
+	(void) headerCopyBlob(mi->mi_h, 0);
+	if (mi->mi_bulk == NULL)
+	    mi->mi_bulk = xmalloc(mi->mi_bulksize);
+	memset(kp, 0, sizeof(*kp));
+	memset(&mi->mi_bulkv, 0, sizeof(mi->mi_bulkv));
+	mi->mi_bulkv.data = mi->mi_bulk;
+	mi->mi_bulkv.ulen = (UINT32_T) mi->mi_bulksize;
+	mi->mi_bulkv.flags = DB_DBT_USERMEM;
+	rc = dbiGet(dbi, mi->mi_dbc, kp, &mi->mi_bulkv, DB_NEXT | DB_MULTIPLE_KEY);
+	if (rc == DB_BUFFER_SMALL) {
+	    /* A header larger than the buffer, grow to fit (KiB multiple). */
+	    mi->mi_bulksize = 2 * (((size_t)mi->mi_bulkv.size + 1023) & ~1023);
+	    mi->mi_bulk = xrealloc(mi->mi_bulk, mi->mi_bulksize);
+	    continue;
+	}
+	if (rc)
+	    return rc;
+	DB_MULTIPLE_INIT(mi->mi_bulkp, &mi->mi_bulkv);
+    }
+    /*@notreached@*/
+}
+
 Header rpmmiNext(rpmmi mi)
 {
     dbiIndex dbi;
@@ -2125,6 +2998,8 @@ Header rpmmiNext(rpmmi mi)
 rpmTag tag;
 unsigned int _flags;
     int map;
+    int bulk;
+    int pack;
     int rc;
     int xx;
 
@@ -2143,6 +3018,16 @@ unsigned int _flags;
     case 3:	map = _rpmmi_usermem;	break;	/* Berkeley DB */
     }
 
+    /* Packed headers are used only if current (and not rewriting). */
+    if (mi->mi_pack == 0)
+	mi->mi_pack = (!(mi->mi_cflags & DB_WRITECURSOR)
+		&& rpmdbPackOpen(mi->mi_db) == 1 ? 1 : -1);
+    pack = (mi->mi_pack > 0 && !dbi->dbi_primary);
+
+    /* Bulk fetch only while scanning (and not rewriting) Packages. */
+    bulk = (!pack && map && mi->mi_bulksize > 0 && mi->mi_set == NULL
+		&& !dbi->dbi_primary && !(mi->mi_cflags & DB_WRITECURSOR));
+
 if (_rpmmi_debug || dbi->dbi_debug)
 fprintf(stderr, "--> %s(%p) dbi %p(%s)\n", __FUNCTION__, mi, dbi, tagName(tag));
 
@@ -2181,9 +3066,16 @@ next:
 	    goto next;
 
 	/* Fetch header by offset. */
-	k.data = &mi->mi_offset;
-	k.size = (UINT32_T)sizeof(mi->mi_offset);
-	rc = rpmmiGet(dbi, mi->mi_dbc, &k, NULL, &v, DB_SET);
+	if (pack && (v.data = (void *) rpmpackFind(mi->mi_db->db_pack,
+			_ntoh_ui(mi->mi_offset), &uhlen)) != NULL) {
+	    v.size = (UINT32_T) uhlen;
+	    rc = 0;
+	} else {
+	    pack = 0;
+	    k.data = &mi->mi_offset;
+	    k.size = (UINT32_T)sizeof(mi->mi_offset);
+	    rc = rpmmiGet(dbi, mi->mi_dbc, &k, NULL, &v, DB_SET);
+	}
     }
     else if (dbi->dbi_primary) {
 	rc = rpmmiGet(dbi, mi->mi_dbc, &k, &p, &v, _flags);
@@ -2205,6 +3097,30 @@ assert((size_t)p.size == sizeof(mi->mi_offset));
 	}
 	_flags = DB_NEXT_DUP;
     }
+    else if (pack) {
+	/* Iterating packed headers, no dbiGet() needed. */
+	uint32_t hdrNum = 0;
+	size_t uhlen = 0;
+assert(mi->mi_rpmtag == RPMDBI_PACKAGES);
+
+	v.data = (void *) rpmpackGet(mi->mi_db->db_pack, mi->mi_packx++,
+			&hdrNum, &uhlen);
+	v.size = (UINT32_T) uhlen;
+	mi->mi_offset = _hton_ui(hdrNum);
+	rc = (v.data != NULL ? 0 : DB_NOTFOUND);
+    }
+    else if (bulk) {
+	/* Iterating Packages database, many headers per dbiGet(). */
+assert(mi->mi_rpmtag == RPMDBI_PACKAGES);
+
+	do {
+	    rc = rpmmiGetBulk(dbi, mi, &k, &v);
+	    if (rc == 0) {
+assert((size_t)k.size == sizeof(mi->mi_offset));
+		memcpy(&mi->mi_offset, k.data, sizeof(mi->mi_offset));
+	    }
+	} while (rc == 0 && mi->mi_offset == 0);
+    }
     else {
 	/* Iterating Packages database. */
 assert(mi->mi_rpmtag == RPMDBI_PACKAGES);
@@ -2238,7 +3154,32 @@ assert((size_t)k.size == sizeof(mi->mi_offset));
     /* Rewrite current header (if necessary) and unlink. */
     xx = miFreeHeader(mi, dbi);
 
-    if (map) {
+    if (pack) {
+	/*
+	 * Packed headers are loaded in place, the mapping lives as long as
+	 * the iterator's rpmdb reference. The blob is neither allocated nor
+	 * mapped by the header, miFreeHeader() copies it if the header is
+	 * still referenced elsewhere.
+	 */
+/*@-onlytrans@*/
+	mi->mi_h = headerLoad(uh);
+/*@=onlytrans@*/
+	if (mi->mi_h)
+	    mi->mi_h->flags |= HEADERFLAG_RDONLY;
+    } else if (bulk) {
+	/*
+	 * Aligned records are loaded in place from the bulk buffer, which
+	 * rpmmiGetBulk() refills only after copying the current header out.
+	 */
+	if (!(((unsigned long)uh) & 0x3)) {
+/*@-onlytrans@*/
+	    mi->mi_h = headerLoad(uh);
+/*@=onlytrans@*/
+	    if (mi->mi_h)
+		mi->mi_h->flags |= HEADERFLAG_RDONLY;
+	} else
+	    mi->mi_h = headerCopyLoad(uh);
+    } else if (map) {
 /*@-onlytrans@*/
 	mi->mi_h = headerLoad(uh);
 /*@=onlytrans@*/
@@ -2420,13 +3361,24 @@ if (_rpmmi_debug || (dbi && dbi->dbi_debug))
 fprintf(stderr, "--> %s(%p, %s, %p[%u]=\"%s\") dbi %p mi %p\n", __FUNCTION__, db, tagName(tag), keyp, (unsigned)keylen, (keylen == 0 || ((const char *)keyp)[keylen] == '\0' ? (const char *)keyp : "???"), dbi, mi);
 
     /* Chain cursors for teardown on abnormal exit. */
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&rpmmiRockLock);
+#endif
     mi->mi_next = rpmmiRock;
     rpmmiRock = mi;
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&rpmmiRockLock);
+#endif
 
     if (tag == RPMDBI_PACKAGES && keyp == NULL) {
 	/* Special case #1: sequentially iterate Packages database. */
 	assert(keylen == 0);
 	/* This should be the only case when (set == NULL). */
+	mi->mi_bulksize = (size_t) rpmExpandNumeric(
+		"%{?_rpmmi_bulksize}%{!?_rpmmi_bulksize:1048576}");
+	if (mi->mi_bulksize > 0 && mi->mi_bulksize < 65536)
+	    mi->mi_bulksize = 65536;
+	mi->mi_bulksize = (mi->mi_bulksize + 1023) & ~1023;
     }
     else if (tag == RPMDBI_PACKAGES) {
 	/* Special case #2: will fetch header instance. */
@@ -2538,8 +3490,7 @@ assert(keylen == sizeof(hdrNum));
 
 	if ((rc  && rc != RPMRC_NOTFOUND) || set == NULL || set->count < 1) { /* error or empty set */
 	    set = dbiFreeIndexSet(set);
-	    rpmmiRock = mi->mi_next;
-	    mi->mi_next = NULL;
+	    rpmmiUnchain(mi);
 	    mi = (rpmmi)rpmioFreePoolItem((rpmioItem)mi, __FUNCTION__, __FILE__, __LINE__);
 	    return NULL;
 	}
@@ -2669,6 +3620,9 @@ int rpmdbRemove(rpmdb db, /*@unused@*/ int rid, uint32_t hdrNum,
 
     (void) blockSignals(db, &signalMask);
 
+    /* Packed headers must be opened before Packages is changed. */
+    (void) rpmdbPackOpen(db);
+
     dbix = db->db_ndbi - 1;
     if (db->db_tags != NULL)
     do {
@@ -2718,8 +3672,12 @@ int rpmdbRemove(rpmdb db, /*@unused@*/ int rid, uint32_t hdrNum,
 
 	    rc = dbiCopen(dbi, dbiTxnid(dbi), &dbcursor, DB_WRITECURSOR);
 	    rc = dbiGet(dbi, dbcursor, &k, &v, DB_SET);
-	    if (!rc)
+	    if (!rc) {
+		rpmdbPackagesWrite(db);
 		rc = dbiDel(dbi, dbcursor, &k, &v, 0);
+	    }
+	    if (!rc)
+		rpmdbPackUpdate(db, hdrNum, NULL, 0);
 	    xx = dbiCclose(dbi, dbcursor, DB_WRITECURSOR);
 
 	    /* Unreference db_h used by associated secondary index callbacks. */
@@ -2733,6 +3691,9 @@ int rpmdbRemove(rpmdb db, /*@unused@*/ int rid, uint32_t hdrNum,
 	}
     } while (dbix-- > 0);
 
+    /* Removed basenames stay in the Bloom filter (until rebuilt). */
+    rpmdbBFUpdate(db, h, 0);
+
     /* Unreference header used by associated secondary index callbacks. */
     (void) headerFree(h);
     h = NULL;
@@ -2782,6 +3743,9 @@ assert(headerIsEntry(h, RPMTAG_PACKAGECOLOR) != 0);	/* XXX sanity */
 
     (void) blockSignals(db, &signalMask);
 
+    /* Packed headers must be opened before Packages is changed. */
+    (void) rpmdbPackOpen(db);
+
     /* Assign a primary Packages key for new Header's. */
     if (hdrNum == 0) {
 	int64_t seqno = 0;
@@ -2859,7 +3823,10 @@ assert(v.data != NULL);
 	    if (dbi == NULL) goto exit;
 
 	    xx = dbiCopen(dbi, dbiTxnid(dbi), &dbcursor, DB_WRITECURSOR);
+	    rpmdbPackagesWrite(db);
 	    xx = dbiPut(dbi, dbcursor, &k, &v, DB_KEYLAST);
+	    if (!xx)
+		rpmdbPackUpdate(db, hdrNum, v.data, (size_t)v.size);
 	    xx = dbiCclose(dbi, dbcursor, DB_WRITECURSOR);
 
 	    /* Unreference db_h used by associated secondary index callbacks. */
@@ -2875,6 +3842,8 @@ assert(v.data != NULL);
 	}
 
     } while (dbix-- > 0);
+
+    rpmdbBFUpdate(db, h, 1);
     rc = RPMRC_OK;			/* XXX RPMRC */
 
 exit:
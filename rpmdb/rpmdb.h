@@ -499,6 +499,26 @@ struct rpmdb_s {
     struct rpmop_s db_putops;	/*!< dbiPut statistics. */
     struct rpmop_s db_delops;	/*!< dbiDel statistics. */
 
+/*@only@*/ /*@null@*/
+    rpmbf	db_bf;		/*!< Installed basenames Bloom filter. */
+    int		db_bfstate;	/*!< 0 unloaded, 1 clean, 2 dirty, -1 unusable */
+    size_t	db_bfmax;	/*!< Bloom filter design population. */
+    size_t	db_bfremoved;	/*!< No. of basenames removed since rebuild. */
+    uint64_t	db_bfgen;	/*!< Packages generation of the Bloom filter. */
+    size_t	db_bfprobes;	/*!< No. of Bloom filter lookups. */
+    size_t	db_bfavoided;	/*!< No. of index probes avoided. */
+
+/*@only@*/ /*@null@*/
+    void *	db_pack;	/*!< Packed headers (an rpmpack). */
+    int		db_packstate;	/*!< 0 unopened, 1 clean, 2 appended, <0 unusable */
+    uint64_t	db_gen;		/*!< Packages generation of the packed headers. */
+    int		db_genwrite;	/*!< Packages written (copies are saved at close). */
+
+/*@only@*/ /*@null@*/
+    const char * db_hrmibfmt;	/*!< %{_hrmib_path} db_hrmib was compiled from. */
+/*@only@*/ /*@null@*/
+    headerSprintfArgs db_hrmib;	/*!< Compiled %{_hrmib_path} format. */
+
 #if defined(__LCLINT__)
 /*@refs@*/
     int nrefs;			/*!< (unused) keep splint happy */
@@ -1202,7 +1222,7 @@ int rpmdbClose (/*@killref@*/ /*@only@*/ /*@null@*/ rpmdb db)
 	/*@modifies db, fileSystem @*/;
 
 /** \ingroup rpmdb
- * Open all database indices.
+ * Open all database indices (and packed headers).
  * @param db		rpm database
  * @return		0 on success
  */
@@ -1235,6 +1255,29 @@ int rpmdbCountPackages(/*@null@*/ rpmdb db, const char * N)
 	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
 	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/;
 
+/** \ingroup rpmdb
+ * Is the database environment opened with transactions (DB_INIT_TXN)?
+ * @param db		rpm database
+ * @return		1 if transactional, 0 otherwise
+ */
+int rpmdbTxnEnabled(/*@null@*/ rpmdb db)
+	/*@*/;
+
+/** \ingroup rpmdb
+ * Check a file basename against the installed basenames Bloom filter.
+ *
+ * The filter is persisted as %{_dbpath}/%{_rpmdb_bf}, maintained by
+ * rpmdbAdd(), and rebuilt from the Basenames index whenever the Packages
+ * store has been changed behind its back.
+ * @param db		rpm database
+ * @param s		file basename
+ * @param ns		basename length (0 will use strlen(s))
+ * @return		0 if not installed, 1 if possibly installed
+ */
+int rpmdbChkBasename(/*@null@*/ rpmdb db, const char * s, size_t ns)
+	/*@globals rpmGlobalMacroContext, h_errno, fileSystem, internalState @*/
+	/*@modifies db, rpmGlobalMacroContext, fileSystem, internalState @*/;
+
 /** \ingroup rpmdb
  * Return header instance for current position of rpmdb iterator.
  * @param mi		rpm database iterator
@@ -1279,6 +1322,22 @@ int rpmmiGrow(/*@null@*/ rpmmi mi,
 int rpmmiGrowBasename(rpmmi mi, const char * bn)
 	/*@modifies mi @*/;
 
+/** \ingroup rpmdb
+ * Append packages matching any of a set of secondary keys to iterator.
+ *
+ * The keys are looked up in sorted order with a single cursor, which is
+ * much cheaper than one rpmmiGrowBasename() per key for large key sets.
+ * The tagNum of each appended instance is the hash of the matching key.
+ * @param mi		rpm database iterator
+ * @param tag		rpm tag (index to search)
+ * @param keys		secondary keys (unsorted, duplicates permitted)
+ * @return		0 on success, 1 on failure
+ */
+int rpmmiGrowKeys(/*@null@*/ rpmmi mi, rpmTag tag,
+		/*@null@*/ const char ** keys)
+	/*@globals internalState @*/
+	/*@modifies mi, internalState @*/;
+
 /** \ingroup rpmdb
  * Sort iterator instances.
  * @param mi		rpm database iterator
@@ -39,6 +39,9 @@ EVR_t rpmEVRnew(uint32_t Flags, int initialize)
 EVR_t rpmEVRfree(EVR_t evr)
 {
     if (evr != NULL) {
+	int i;
+	for (i = 0; i < (int)(sizeof(evr->vs)/sizeof(evr->vs[0])); i++)
+	    evr->vs[i] = rpmvstrFree(evr->vs[i]);
 	evr->str = _free(evr->str);
 	memset(evr, 0, sizeof(*evr));
 	evr = _free(evr);
@@ -138,6 +141,109 @@ assert(b != NULL);
     return rc;
 }
 
+/**
+ * Find the next segment of a version string, as rpmEVRcmp() would.
+ * @param p		version string position
+ * @retval *seg		segment
+ * @return		end of segment
+ */
+static const char * rpmvstrSegment(const char * p,
+		/*@out@*/ struct rpmvseg_s * seg)
+	/*@modifies *seg @*/
+{
+    const char * pe;
+
+    /* Skip leading non-alpha, non-digit characters. */
+    while (*p && !(xisdigit((int)*p) || xisrpmalpha((int)*p))) p++;
+
+    seg->n = 0;
+    if (xisdigit((int)*p)) {
+	/* Discard leading zeroes. */
+	while (p[0] == '0' && xisdigit((int)p[1])) p++;
+	for (pe = p; xisdigit((int)*pe); pe++)
+	    seg->n = 10 * seg->n + (*pe - '0');
+	seg->digits = 1;
+    } else {
+	for (pe = p; xisrpmalpha((int)*pe); pe++)
+	    {};
+	seg->digits = 0;
+    }
+/*@-temptrans@*/
+    seg->s = p;
+/*@=temptrans@*/
+    seg->ns = (unsigned)(pe - p);
+    seg->c = *p;
+    seg->ec = *pe;
+    return pe;
+}
+
+rpmvstr rpmvstrNew(const char * s)
+{
+    struct rpmvseg_s seg;
+    size_t ns = strlen(s);
+    unsigned nsegs = 0;
+    const char * p;
+    rpmvstr vs;
+    char * t;
+
+    for (p = s; *p != '\0'; nsegs++)
+	p = rpmvstrSegment(p, &seg);
+
+    vs = xmalloc(sizeof(*vs) + nsegs * sizeof(vs->segs[0]) + ns + 1);
+    t = ((char *)vs) + sizeof(*vs) + nsegs * sizeof(vs->segs[0]);
+    vs->str = memcpy(t, s, ns + 1);
+    vs->wild = (strchr(vs->str, '*') != NULL);
+    vs->nsegs = nsegs;
+    for (p = vs->str, nsegs = 0; *p != '\0'; nsegs++)
+	p = rpmvstrSegment(p, vs->segs + nsegs);
+    return vs;
+}
+
+rpmvstr rpmvstrFree(rpmvstr vs)
+{
+    if (vs != NULL)
+	vs = _free(vs);
+    return NULL;
+}
+
+int rpmvstrCmp(const rpmvstr a, const rpmvstr b)
+{
+    const struct rpmvseg_s * sa = a->segs;
+    const struct rpmvseg_s * sb = b->segs;
+    int ca = (int) a->str[0];
+    int cb = (int) b->str[0];
+    int rc = 0;
+
+    /* XXX Wildcards are rare, let rpmEVRcmp() deal with them. */
+    if (a->wild || b->wild)
+	return rpmEVRcmp(a->str, b->str);
+
+    /* Compare version strings segment by segment. */
+    for (; ca && cb && rc == 0; ca = (int) sa->ec, cb = (int) sb->ec, sa++, sb++) {
+	if (sa->digits != sb->digits)
+	    rc = ((int)sa->c - (int)sb->c) * _invert_digits_alphas_comparison;
+	else if (sa->digits) {
+	    /* Longer digit string wins, else compare values. */
+	    rc = (int)sa->ns - (int)sb->ns;
+	    if (!rc)
+		rc = (sa->ns < 20
+		    ? (sa->n > sb->n) - (sa->n < sb->n)
+		    : strncmp(sa->s, sb->s, sa->ns));
+	} else
+	    rc = strncmp(sa->s, sb->s, MAX(sa->ns, sb->ns));
+    }
+
+    /* Longer string wins. */
+    if (!rc)
+	rc = ca - cb;
+
+    /* Force strict -1, 0, 1 return. */
+    rc = (rc > 0 ? 1
+	: rc < 0 ? -1
+	: 0);
+    return rc;
+}
+
 /*@unchecked@*/ /*@observer@*/ /*@null@*/
 static const char * _evr_tuple_match =
 	"^(?:([^:-]+):)?([^:-]+)(?:-([^:-]+))?(?::([^:-]+))?$";
@@ -227,6 +333,17 @@ assert(offsets[i+1] >= 0 && offsets[i+1] <= (int)nb);
     return 0;
 }
 
+int rpmEVRcompile(EVR_t evr)
+{
+    int ix;
+
+    for (ix = RPMEVR_E; ix <= RPMEVR_D; ix++) {
+	evr->vs[ix] = rpmvstrFree(evr->vs[ix]);
+	evr->vs[ix] = rpmvstrNew(evr->F[ix] ? evr->F[ix] : "");
+    }
+    return 0;
+}
+
 /**
  * Dressed rpmEVRcmp, handling missing values.
  * @param a		1st string
@@ -292,7 +409,11 @@ assert(b->F[RPMEVR_D] != NULL);
 		break;
 #endif
 
-	rc = compare_values(a->F[ix], b->F[ix]);
+	/* Use the segmented fields unless rpmvercmp was changed. */
+	if (a->vs[ix] && b->vs[ix] && rpmvercmp == rpmEVRcmp)
+	    rc = rpmvstrCmp(a->vs[ix], b->vs[ix]);
+	else
+	    rc = compare_values(a->F[ix], b->F[ix]);
 	if (rc)
 	    break;
     }
@@ -19,6 +19,11 @@ extern int _rpmevr_debug;
 
 typedef	/*@abstract@*/ struct EVR_s * EVR_t;
 
+/** \ingroup rpmds
+ * A version string, split into segments once for repeated comparison.
+ */
+typedef	/*@abstract@*/ struct rpmvstr_s * rpmvstr;
+
 /**
  * Dependency Attributes.
  */
@@ -91,6 +96,32 @@ struct EVR_s {
 #define	RPMEVR_V	2
 #define	RPMEVR_R	3
 #define	RPMEVR_D	4
+/*@only@*/ /*@null@*/
+    rpmvstr vs[5];		/*!< Segmented fields (from rpmEVRcompile). */
+};
+
+/** \ingroup rpmds
+ * A segment of a version string, as seen by rpmEVRcmp().
+ */
+struct rpmvseg_s {
+/*@dependent@*/
+    const char * s;		/*!< Segment (leading zeroes stripped). */
+    rpmuint64_t n;		/*!< Value of a digit segment (< 20 digits). */
+    unsigned ns;		/*!< No. of bytes in segment. */
+    char digits;		/*!< Is this a digit segment? */
+    char c;			/*!< 1st character ('\0' at end of string). */
+    char ec;			/*!< Character following the segment. */
+};
+
+/** \ingroup rpmds
+ * A version string, split into segments.
+ */
+struct rpmvstr_s {
+/*@dependent@*/
+    const char * str;		/*!< Version string (stored after segs). */
+    int wild;			/*!< Does the string contain a '*' wildcard? */
+    unsigned nsegs;		/*!< No. of segments. */
+    struct rpmvseg_s segs[1];	/*!< Segments. */
 };
 
 #define	RPMSENSE_TRIGGER	\
@@ -150,6 +181,35 @@ EVR_t rpmEVRfree(/*@only@*/ EVR_t evr)
 int rpmEVRcmp(const char *a, const char *b)
 	/*@*/;
 
+/** \ingroup rpmds
+ * Split a version string into segments for repeated rpmvstrCmp() use.
+ * @param s		version string (copied)
+ * @return		segmented version string
+ */
+/*@only@*/
+rpmvstr rpmvstrNew(const char * s)
+	/*@*/;
+
+/** \ingroup rpmds
+ * Destroy a segmented version string.
+ * @param vs		segmented version string
+ * @return		NULL always
+ */
+/*@null@*/
+rpmvstr rpmvstrFree(/*@only@*/ /*@null@*/ rpmvstr vs)
+	/*@modifies vs @*/;
+
+/** \ingroup rpmds
+ * Segmented string compare of pre-segmented version strings.
+ * Same result as rpmEVRcmp() on the original strings, without rescanning
+ * them: digit segments compare as integers, alpha segments by length.
+ * @param a		1st segmented string
+ * @param b		2nd segmented string
+ * @return		+1 if a is "newer", 0 if equal, -1 if b is "newer"
+ */
+int rpmvstrCmp(const rpmvstr a, const rpmvstr b)
+	/*@*/;
+
 /** \ingroup rpmds
  * Split EVR string into epoch, version, and release components.
  * @param evrstr	[epoch:]version[-release] string
@@ -159,6 +219,16 @@ int rpmEVRcmp(const char *a, const char *b)
 int rpmEVRparse(const char * evrstr, EVR_t evr)
 	/*@modifies evrstr, evr @*/;
 
+/** \ingroup rpmds
+ * Segment the parsed fields of an EVR container for rpmEVRcompare().
+ * The segments are released by rpmEVRfree(); reparsing a compiled
+ * container leaks them.
+ * @param evr		EVR container (from rpmEVRparse)
+ * @return		0 always
+ */
+int rpmEVRcompile(EVR_t evr)
+	/*@modifies evr @*/;
+
 /** \ingroup rpmds
  * Compare EVR containers for equality.
  * @param a		1st EVR container
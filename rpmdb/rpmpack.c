@@ -0,0 +1,401 @@
+/** \ingroup rpmdb
+ * \file rpmdb/rpmpack.c
+ */
+
+#include "system.h"
+
+#include <rpmiotypes.h>
+#include <rpmio.h>
+#include <rpmlog.h>
+
+#define	_RPMPACK_INTERNAL
+#include "rpmpack.h"
+
+#include "debug.h"
+
+/*@unchecked@*/
+int _rpmpack_debug = 0;
+
+/**
+ * Packed header store preamble (native byte order).
+ */
+struct rpmpackPreamble_s {
+    unsigned char magic[8];		/*!< "RPMPACK" + version */
+    uint64_t gen;			/*!< Packages generation. */
+    uint64_t end;			/*!< Committed length (0 if none). */
+    uint64_t dead;			/*!< Bytes in dead records. */
+    uint32_t order;			/*!< Byte order check. */
+    uint32_t pad;
+};
+
+/**
+ * Packed header store record (native byte order), header blob follows.
+ */
+struct rpmpackRecord_s {
+    uint32_t hdrNum;			/*!< Header instance. */
+    uint32_t len;			/*!< Header blob length (0 if removed). */
+};
+
+/**
+ * Packed header store item.
+ */
+struct rpmpackItem_s {
+    uint32_t hdrNum;			/*!< Header instance. */
+    uint32_t len;			/*!< Header blob length. */
+    size_t off;				/*!< Header blob offset. */
+};
+
+/**
+ * Packed header store.
+ */
+struct rpmpack_s {
+/*@only@*/
+    const char * fn;			/*!< Packed header store path. */
+/*@relnull@*/
+    const unsigned char * map;		/*!< Read-only file mapping. */
+    size_t nmap;			/*!< Mapping length. */
+/*@only@*/
+    struct rpmpackItem_s * items;	/*!< Live headers, hdrNum order. */
+    size_t nitems;			/*!< No. of live headers. */
+    size_t live;			/*!< Bytes in live records. */
+    size_t dead;			/*!< Bytes in dead records. */
+};
+
+static const unsigned char _magic[8] = { 'R', 'P', 'M', 'P', 'A', 'C', 'K', 2 };
+static const uint32_t _order = 0x01020304;
+
+#define	RECLEN(_len)	\
+    ((sizeof(struct rpmpackRecord_s) + (size_t)(_len) + 7) & ~((size_t)7))
+
+/**
+ * Map a file read-only.
+ * The file is only ever appended to (or replaced by rename(2)), so a
+ * mapping stays valid while the file is being extended.
+ * @param fn		file path
+ * @retval *nmapp	mapping length
+ * @return		file mapping (NULL on error)
+ */
+/*@null@*/
+static const unsigned char * rpmpackMap(const char * fn, size_t * nmapp)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies *nmapp, fileSystem, internalState @*/
+{
+    const unsigned char * map = NULL;
+    struct stat sb;
+    FD_t fd;
+    void * p;
+
+    fd = Fopen(fn, "r.ufdio");
+    if (fd == NULL || Ferror(fd))
+	goto exit;
+    if (fstat(Fileno(fd), &sb) || sb.st_size < (off_t)sizeof(struct rpmpackPreamble_s))
+	goto exit;
+
+    p = mmap(NULL, (size_t)sb.st_size, PROT_READ, MAP_SHARED, Fileno(fd), 0);
+    if (p == NULL || p == (void *)-1) {
+	rpmlog(RPMLOG_DEBUG, D_("%s: mmap failed: %s\n"), fn, strerror(errno));
+	goto exit;
+    }
+    map = p;
+
+exit:
+    if (fd != NULL)
+	(void) Fclose(fd);
+    if (map != NULL)
+	*nmapp = (size_t) sb.st_size;
+    return map;
+}
+
+static int rpmpackItemCmp(const void * a, const void * b)
+	/*@*/
+{
+    const struct rpmpackItem_s * ia = a;
+    const struct rpmpackItem_s * ib = b;
+
+    if (ia->hdrNum != ib->hdrNum)
+	return (ia->hdrNum < ib->hdrNum ? -1 : 1);
+    /* Later records replace earlier ones. */
+    return (ia->off < ib->off ? -1 : (ia->off > ib->off ? 1 : 0));
+}
+
+/*@null@*/
+static struct rpmpackItem_s * rpmpackLookup(rpmpack pack, uint32_t hdrNum)
+	/*@*/
+{
+    size_t l = 0;
+    size_t u = pack->nitems;
+
+    while (l < u) {
+	size_t i = l + (u - l) / 2;
+	if (pack->items[i].hdrNum < hdrNum)
+	    l = i + 1;
+	else if (pack->items[i].hdrNum > hdrNum)
+	    u = i;
+	else
+	    return pack->items + i;
+    }
+    return NULL;
+}
+
+rpmpack rpmpackOpen(const char * fn, uint64_t gen)
+{
+    struct rpmpackPreamble_s pre;
+    rpmpack pack = NULL;
+    const unsigned char * map;
+    size_t nmap = 0;
+    size_t off;
+    size_t i, j;
+
+    if (fn == NULL || *fn == '\0')
+	return NULL;
+
+    /* Check the preamble before mapping the file. */
+    {	FD_t fd = Fopen(fn, "r.ufdio");
+	size_t nb = 0;
+	if (fd == NULL || Ferror(fd)) {
+	    if (fd) (void) Fclose(fd);
+	    return NULL;
+	}
+	nb = Fread(&pre, 1, sizeof(pre), fd);
+	(void) Fclose(fd);
+	if (nb != sizeof(pre))
+	    goto stale;
+    }
+    if (memcmp(pre.magic, _magic, sizeof(pre.magic)) || pre.order != _order)
+	goto stale;
+    if (gen == 0 || pre.gen != gen)
+	goto stale;
+
+    if ((map = rpmpackMap(fn, &nmap)) == NULL)
+	return NULL;
+    if (pre.end < sizeof(pre) || pre.end > nmap) {
+	(void) munmap((void *)map, nmap);
+	goto stale;
+    }
+
+    pack = xcalloc(1, sizeof(*pack));
+    pack->fn = xstrdup(fn);
+    pack->map = map;
+    pack->nmap = nmap;
+
+    /* Collect the committed records. */
+    for (off = sizeof(pre); off + sizeof(struct rpmpackRecord_s) <= pre.end;) {
+	struct rpmpackRecord_s rec;
+	struct rpmpackItem_s * item;
+
+	memcpy(&rec, map + off, sizeof(rec));
+	if (off + RECLEN(rec.len) > pre.end)
+	    break;
+	if ((pack->nitems % 1024) == 0)
+	    pack->items = xrealloc(pack->items,
+			(pack->nitems + 1024) * sizeof(*pack->items));
+	item = pack->items + pack->nitems++;
+	item->hdrNum = rec.hdrNum;
+	item->len = rec.len;
+	item->off = off + sizeof(rec);
+	off += RECLEN(rec.len);
+    }
+
+    /* Keep the last record of each header instance, drop removals. */
+    if (pack->nitems > 1)
+	qsort(pack->items, pack->nitems, sizeof(*pack->items), rpmpackItemCmp);
+    for (i = 0, j = 0; i < pack->nitems; i++) {
+	if (i + 1 < pack->nitems && pack->items[i+1].hdrNum == pack->items[i].hdrNum)
+	    continue;
+	if (pack->items[i].len == 0 || pack->items[i].hdrNum == 0)
+	    continue;
+	pack->live += RECLEN(pack->items[i].len);
+	pack->items[j++] = pack->items[i];
+    }
+    pack->nitems = j;
+    pack->dead = (size_t)pre.end - sizeof(pre) - pack->live;
+
+    rpmlog(RPMLOG_DEBUG, D_("%s: %u headers (%u live, %u dead bytes)\n"),
+		fn, (unsigned)pack->nitems, (unsigned)pack->live,
+		(unsigned)pack->dead);
+    return pack;
+
+stale:
+    rpmlog(RPMLOG_DEBUG, D_("%s: stale packed headers ignored\n"), fn);
+    return NULL;
+}
+
+rpmpack rpmpackFree(rpmpack pack)
+{
+    if (pack != NULL) {
+	if (pack->map != NULL)
+	    (void) munmap((void *)pack->map, pack->nmap);
+	pack->map = NULL;
+	pack->items = _free(pack->items);
+	pack->fn = _free(pack->fn);
+	pack = _free(pack);
+    }
+    return NULL;
+}
+
+size_t rpmpackCount(rpmpack pack)
+{
+    return (pack != NULL ? pack->nitems : 0);
+}
+
+const void * rpmpackGet(rpmpack pack, size_t ix, uint32_t * hdrNump,
+		size_t * uhlenp)
+{
+    if (pack == NULL || ix >= pack->nitems)
+	return NULL;
+    if (hdrNump)
+	*hdrNump = pack->items[ix].hdrNum;
+    if (uhlenp)
+	*uhlenp = pack->items[ix].len;
+    return pack->map + pack->items[ix].off;
+}
+
+const void * rpmpackFind(rpmpack pack, uint32_t hdrNum, size_t * uhlenp)
+{
+    struct rpmpackItem_s * item;
+
+    if (pack == NULL || (item = rpmpackLookup(pack, hdrNum)) == NULL)
+	return NULL;
+    if (uhlenp)
+	*uhlenp = item->len;
+    return pack->map + item->off;
+}
+
+/**
+ * Write a record.
+ * @param fd		file handle
+ * @param hdrNum	header instance
+ * @param uh		header blob (NULL if removed)
+ * @param uhlen		header blob length
+ * @return		0 on success
+ */
+static int rpmpackWrite(FD_t fd, uint32_t hdrNum,
+		/*@null@*/ const void * uh, size_t uhlen)
+	/*@globals fileSystem @*/
+	/*@modifies fd, fileSystem @*/
+{
+    static const char zeros[8] = { 0 };
+    struct rpmpackRecord_s rec;
+    size_t npad;
+
+    if (uh == NULL)
+	uhlen = 0;
+    rec.hdrNum = hdrNum;
+    rec.len = (uint32_t) uhlen;
+    npad = RECLEN(uhlen) - sizeof(rec) - uhlen;
+    if (Fwrite(&rec, 1, sizeof(rec), fd) != sizeof(rec))
+	return -1;
+    if (uhlen > 0 && Fwrite(uh, 1, uhlen, fd) != uhlen)
+	return -1;
+    if (npad > 0 && Fwrite(zeros, 1, npad, fd) != npad)
+	return -1;
+    return 0;
+}
+
+int rpmpackAppend(rpmpack pack, uint32_t hdrNum, const void * uh, size_t uhlen)
+{
+    struct rpmpackItem_s * item;
+    FD_t fd;
+    int rc = -1;
+
+    if (pack == NULL)
+	return rc;
+
+    fd = Fopen(pack->fn, "a.ufdio");
+    if (fd == NULL || Ferror(fd)) {
+	if (fd) (void) Fclose(fd);
+	return rc;
+    }
+    rc = rpmpackWrite(fd, hdrNum, uh, uhlen);
+    if (Fclose(fd))
+	rc = -1;
+
+    /* Account for the records made dead. */
+    if (rc == 0) {
+	if ((item = rpmpackLookup(pack, hdrNum)) != NULL)
+	    pack->dead += RECLEN(item->len);
+	if (uh == NULL)
+	    pack->dead += RECLEN(0);
+	else
+	    pack->live += RECLEN(uhlen);
+    }
+    return rc;
+}
+
+int rpmpackCreate(const char * fn,
+		int (*next) (void * arg, uint32_t * hdrNump,
+			const void ** uhp, size_t * uhlenp),
+		void * arg)
+{
+    struct rpmpackPreamble_s pre;
+    uint32_t hdrNum = 0;
+    const void * uh = NULL;
+    size_t uhlen = 0;
+    unsigned nrecs = 0;
+    FD_t fd;
+    int rc = -1;
+
+    fd = Fopen(fn, "w.ufdio");
+    if (fd == NULL || Ferror(fd))
+	goto exit;
+
+    /* Nothing is visible until rpmpackCommit(). */
+    memset(&pre, 0, sizeof(pre));
+    memcpy(pre.magic, _magic, sizeof(pre.magic));
+    pre.order = _order;
+    if (Fwrite(&pre, 1, sizeof(pre), fd) != sizeof(pre))
+	goto exit;
+
+    while ((rc = (*next) (arg, &hdrNum, &uh, &uhlen)) == 0) {
+	if ((rc = rpmpackWrite(fd, hdrNum, uh, uhlen)) != 0)
+	    break;
+	nrecs++;
+    }
+    if (rc > 0)		/* iterator exhausted */
+	rc = 0;
+
+exit:
+    if (fd != NULL) {
+	if (Fclose(fd))
+	    rc = -1;
+    }
+    if (rc)
+	(void) Unlink(fn);
+    else
+	rpmlog(RPMLOG_DEBUG, D_("%s: packed %u headers\n"), fn, nrecs);
+    return rc;
+}
+
+int rpmpackWasted(rpmpack pack)
+{
+    return (pack != NULL && pack->dead > pack->live);
+}
+
+int rpmpackCommit(const char * fn, uint64_t gen, rpmpack pack)
+{
+    struct rpmpackPreamble_s pre;
+    struct stat sb;
+    FD_t fd;
+    int rc = -1;
+
+    if (gen == 0 || Stat(fn, &sb) || sb.st_size < (off_t)sizeof(pre))
+	return rc;
+
+    memset(&pre, 0, sizeof(pre));
+    memcpy(pre.magic, _magic, sizeof(pre.magic));
+    pre.order = _order;
+    pre.gen = gen;
+    pre.end = (uint64_t) sb.st_size;
+    pre.dead = (uint64_t) (pack != NULL ? pack->dead : 0);
+
+    fd = Fopen(fn, "r+.ufdio");
+    if (fd == NULL || Ferror(fd)) {
+	if (fd) (void) Fclose(fd);
+	return rc;
+    }
+    if (Fwrite(&pre, 1, sizeof(pre), fd) == sizeof(pre))
+	rc = 0;
+    if (Fclose(fd))
+	rc = -1;
+    return rc;
+}
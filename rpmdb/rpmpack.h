@@ -0,0 +1,134 @@
+#ifndef H_RPMPACK
+#define H_RPMPACK
+
+/** \ingroup rpmdb
+ * \file rpmdb/rpmpack.h
+ * Packed, append-only copy of the Packages store, read through mmap(2).
+ *
+ * The file is a fixed size preamble followed by records of
+ *	{ hdrNum, len, header blob (len bytes), padding to 8 bytes }
+ * A record with len == 0 removes hdrNum, later records for a hdrNum
+ * replace earlier ones. Only records within the committed length noted
+ * in the preamble are visible, the preamble also carries the generation
+ * of the Packages store the records are a copy of.
+ */
+
+/*@-exportlocal@*/
+/*@unchecked@*/
+extern int _rpmpack_debug;
+/*@=exportlocal@*/
+
+typedef /*@abstract@*/ struct rpmpack_s * rpmpack;
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Open a packed header store.
+ * Header blobs returned are views into a read-only mapping of the file,
+ * valid until rpmpackFree().
+ * @param fn		packed header store path
+ * @param gen		expected Packages generation
+ * @return		packed header store (NULL if missing or stale)
+ */
+/*@null@*/
+rpmpack rpmpackOpen(const char * fn, uint64_t gen)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies fileSystem, internalState @*/;
+
+/**
+ * Destroy a packed header store handle, unmapping the file.
+ * @param pack		packed header store
+ * @return		NULL always
+ */
+/*@null@*/
+rpmpack rpmpackFree(/*@only@*/ /*@null@*/ rpmpack pack)
+	/*@modifies pack @*/;
+
+/**
+ * Return no. of headers in a packed header store.
+ * @param pack		packed header store
+ * @return		no. of headers
+ */
+size_t rpmpackCount(/*@null@*/ rpmpack pack)
+	/*@*/;
+
+/**
+ * Return the ix'th header blob (in header instance order).
+ * @param pack		packed header store
+ * @param ix		header index
+ * @retval *hdrNump	header instance
+ * @retval *uhlenp	header blob length
+ * @return		header blob (NULL if ix is out of range)
+ */
+/*@null@*/ /*@observer@*/
+const void * rpmpackGet(/*@null@*/ rpmpack pack, size_t ix,
+		/*@null@*/ /*@out@*/ uint32_t * hdrNump,
+		/*@null@*/ /*@out@*/ size_t * uhlenp)
+	/*@modifies *hdrNump, *uhlenp @*/;
+
+/**
+ * Return the header blob for a header instance.
+ * @param pack		packed header store
+ * @param hdrNum	header instance
+ * @retval *uhlenp	header blob length
+ * @return		header blob (NULL if not found)
+ */
+/*@null@*/ /*@observer@*/
+const void * rpmpackFind(/*@null@*/ rpmpack pack, uint32_t hdrNum,
+		/*@null@*/ /*@out@*/ size_t * uhlenp)
+	/*@modifies *uhlenp @*/;
+
+/**
+ * Append a header (or its removal) to a packed header store.
+ * The record is not visible until rpmpackCommit().
+ * @param pack		packed header store
+ * @param hdrNum	header instance
+ * @param uh		header blob (NULL removes hdrNum)
+ * @param uhlen		header blob length
+ * @return		0 on success
+ */
+int rpmpackAppend(rpmpack pack, uint32_t hdrNum,
+		/*@null@*/ const void * uh, size_t uhlen)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies pack, fileSystem, internalState @*/;
+
+/**
+ * Write a new packed header store (without a committed preamble).
+ * @param fn		packed header store path
+ * @param next		iterator returning next (hdrNum, header blob)
+ * @param arg		iterator argument
+ * @return		0 on success
+ */
+int rpmpackCreate(const char * fn,
+		int (*next) (void * arg, uint32_t * hdrNump,
+			const void ** uhp, size_t * uhlenp),
+		void * arg)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies fileSystem, internalState @*/;
+
+/**
+ * Return whether a packed header store is mostly dead records.
+ * @param pack		packed header store
+ * @return		1 if the store should be rewritten
+ */
+int rpmpackWasted(/*@null@*/ rpmpack pack)
+	/*@*/;
+
+/**
+ * Commit all records of a packed header store as a copy of Packages.
+ * @param fn		packed header store path
+ * @param gen		Packages generation
+ * @param pack		open packed header store (NULL if newly created)
+ * @return		0 on success
+ */
+int rpmpackCommit(const char * fn, uint64_t gen, /*@null@*/ rpmpack pack)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies fileSystem, internalState @*/;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* H_RPMPACK */
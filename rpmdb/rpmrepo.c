@@ -1415,42 +1415,29 @@ static Header rpmrepoReadHeader(rpmrepo repo, const char * path)
     return h;
 }
 
-/**
- * Return header query.
- * @param h		header
- * @param qfmt		query format
- * @return		query format result
- */
-static const char * rfileHeaderSprintf(Header h, const char * qfmt)
-	/*@globals fileSystem @*/
-	/*@modifies h, fileSystem @*/
-{
-    const char * msg = NULL;
-    const char * s = headerSprintf(h, qfmt, NULL, NULL, &msg);
-    if (s == NULL)
-	rpmrepoError(1, _("headerSprintf(%s): %s"), qfmt, msg);
-assert(s != NULL);
-    return s;
-}
-
 #if defined(WITH_SQLITE)
 /**
  * Return header query, with "XXX" replaced by rpmdb header instance.
  * @param h		header
  * @param qfmt		query format
+ * @param *hsap		compiled query format (compiled on 1st use)
  * @return		query format result
  */
-static const char * rfileHeaderSprintfHack(Header h, const char * qfmt)
+static const char * rfileHeaderSprintfHack(Header h, const char * qfmt,
+		headerSprintfArgs * hsap)
 	/*@globals fileSystem @*/
-	/*@modifies h, fileSystem @*/
+	/*@modifies h, *hsap, fileSystem @*/
 {
     static const char mark[] = "'XXX'";
     static size_t nmark = sizeof("'XXX'") - 1;
     const char * msg = NULL;
-    char * s = (char *) headerSprintf(h, qfmt, NULL, NULL, &msg);
+    char * s;
     char * f, * fe;
     int nsubs = 0;
 
+    if (*hsap == NULL)
+	*hsap = headerSprintfCompile(qfmt, NULL, NULL, &msg);
+    s = (*hsap != NULL ? headerSprintfExec(*hsap, h, &msg) : NULL);
     if (s == NULL)
 	rpmrepoError(1, _("headerSprintf(%s): %s"), qfmt, msg);
 assert(s != NULL);
@@ -1500,13 +1487,28 @@ static int rpmrepoWriteMDFile(rpmrepo repo, rpmrfile rfile, Header h)
     int rc = 0;
 
     if (rfile->xml_qfmt != NULL) {
-	if (rpmrfileXMLWrite(rfile, rfileHeaderSprintf(h, rfile->xml_qfmt)))
+	const char * msg = NULL;
+
+	/* Stream the metadata straight into the (compressed) file. */
+	if (rfile->xml_hsa == NULL) {
+	    rfile->xml_hsa =
+		headerSprintfCompile(rfile->xml_qfmt, NULL, NULL, &msg);
+	    if (rfile->xml_hsa == NULL)
+		rpmrepoError(1, _("headerSprintf(%s): %s"), rfile->xml_qfmt, msg);
+	}
+	if (headerSprintfWrite(rfile->xml_hsa, h,
+		headerSprintfFdSink, rfile->fd, &msg))
+	{
+	    rpmrepoError(0, _("headerSprintf(%s): %s: %s\n"), rfile->xml_qfmt,
+		(msg ? msg : ""), Fstrerror(rfile->fd));
 	    rc = 1;
+	}
     }
 
 #if defined(WITH_SQLITE)
     if (REPO_ISSET(DATABASE)) {
-	if (rpmrfileSQLWrite(rfile, rfileHeaderSprintfHack(h, rfile->sql_qfmt)))
+	if (rpmrfileSQLWrite(rfile,
+		rfileHeaderSprintfHack(h, rfile->sql_qfmt, &rfile->sql_hsa)))
 	    rc = 1;
     }
 #endif
@@ -1854,10 +1856,16 @@ static void rpmrepoFini(void * _repo)
 
     repo->primary.digest = _free(repo->primary.digest);
     repo->primary.Zdigest = _free(repo->primary.Zdigest);
+    repo->primary.xml_hsa = headerSprintfFree(repo->primary.xml_hsa);
+    repo->primary.sql_hsa = headerSprintfFree(repo->primary.sql_hsa);
     repo->filelists.digest = _free(repo->filelists.digest);
     repo->filelists.Zdigest = _free(repo->filelists.Zdigest);
+    repo->filelists.xml_hsa = headerSprintfFree(repo->filelists.xml_hsa);
+    repo->filelists.sql_hsa = headerSprintfFree(repo->filelists.sql_hsa);
     repo->other.digest = _free(repo->other.digest);
     repo->other.Zdigest = _free(repo->other.Zdigest);
+    repo->other.xml_hsa = headerSprintfFree(repo->other.xml_hsa);
+    repo->other.sql_hsa = headerSprintfFree(repo->other.sql_hsa);
     repo->repomd.digest = _free(repo->repomd.digest);
     repo->repomd.Zdigest = _free(repo->repomd.Zdigest);
     repo->outputdir = _free(repo->outputdir);
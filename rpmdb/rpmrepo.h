@@ -70,6 +70,10 @@ struct rpmrfile_s {
 /*@null@*/
     const char * Zdigest;
     time_t ctime;
+/*@only@*/ /*@null@*/
+    struct headerSprintfArgs_s * xml_hsa;	/*!< Compiled xml_qfmt. */
+/*@only@*/ /*@null@*/
+    struct headerSprintfArgs_s * sql_hsa;	/*!< Compiled sql_qfmt. */
 };
 
 /**
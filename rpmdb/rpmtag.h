@@ -756,6 +756,104 @@ char * headerSprintf(Header h, const char * fmt,
 	/*@globals headerCompoundFormats, fileSystem, internalState @*/
 	/*@modifies h, *errmsg, fileSystem, internalState @*/;
 
+/** \ingroup header
+ * A compiled headerSprintf() query format.
+ */
+typedef /*@abstract@*/ struct headerSprintfArgs_s * headerSprintfArgs;
+
+/** \ingroup header
+ * Consume a piece of headerSprintfWrite() output.
+ * @param arg		sink argument
+ * @param b		output (NUL terminated)
+ * @param nb		no. of bytes of output
+ * @return		0 on success
+ */
+typedef int (*headerSprintfSink) (void * arg, const char * b, size_t nb)
+	/*@*/;
+
+/** \ingroup header
+ * Compile a query format for use with many headers.
+ * Tag names, extensions and formatters are resolved once, here.
+ *
+ * @param fmt		format to use
+ * @param tags		array of tag name/value/type triples (NULL uses default)
+ * @param exts		formatting extensions chained table (NULL uses default)
+ * @retval errmsg	error message (if any)
+ * @return		compiled format (NULL on error)
+ */
+/*@only@*/ /*@null@*/
+headerSprintfArgs headerSprintfCompile(const char * fmt,
+		/*@null@*/ headerTagTableEntry tags,
+		/*@null@*/ headerSprintfExtension exts,
+		/*@null@*/ /*@out@*/ errmsg_t * errmsg)
+	/*@globals headerCompoundFormats @*/
+	/*@modifies *errmsg @*/;
+
+/** \ingroup header
+ * Return formatted output string from header tags using a compiled format.
+ * The returned string must be free()d.
+ *
+ * @param hsa		compiled format
+ * @param h		header
+ * @retval errmsg	error message (if any)
+ * @return		formatted output string (malloc'ed)
+ */
+/*@only@*/ /*@null@*/
+char * headerSprintfExec(/*@null@*/ headerSprintfArgs hsa, Header h,
+		/*@null@*/ /*@out@*/ errmsg_t * errmsg)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies hsa, h, *errmsg, fileSystem, internalState @*/;
+
+/** \ingroup header
+ * Stream formatted output from header tags using a compiled format.
+ * Output is passed to the sink in pieces as it is formatted, so memory
+ * use is bounded by the largest top level format item (a single tag
+ * with "[%{*:xml}]" et al) rather than by the whole output.
+ * Output already passed to the sink is not retracted on error.
+ *
+ * @param hsa		compiled format
+ * @param h		header
+ * @param sink		output sink
+ * @param arg		output sink argument
+ * @retval errmsg	error message (if any)
+ * @return		0 on success
+ */
+int headerSprintfWrite(/*@null@*/ headerSprintfArgs hsa, Header h,
+		headerSprintfSink sink, void * arg,
+		/*@null@*/ /*@out@*/ errmsg_t * errmsg)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies hsa, h, arg, *errmsg, fileSystem, internalState @*/;
+
+/** \ingroup header
+ * A headerSprintfWrite() sink that writes to an FD_t.
+ * @param _fd		I/O stream
+ * @param b		output
+ * @param nb		no. of bytes of output
+ * @return		0 on success
+ */
+int headerSprintfFdSink(void * _fd, const char * b, size_t nb)
+	/*@globals fileSystem @*/
+	/*@modifies _fd, fileSystem @*/;
+
+/** \ingroup header
+ * A headerSprintfWrite() sink that appends to an rpmiob.
+ * @param _iob		I/O buffer
+ * @param b		output
+ * @param nb		no. of bytes of output
+ * @return		0 on success
+ */
+int headerSprintfIobSink(void * _iob, const char * b, size_t nb)
+	/*@modifies _iob @*/;
+
+/** \ingroup header
+ * Destroy a compiled query format.
+ * @param hsa		compiled format
+ * @return		NULL always
+ */
+/*@null@*/
+headerSprintfArgs headerSprintfFree(/*@only@*/ /*@null@*/ headerSprintfArgs hsa)
+	/*@modifies hsa @*/;
+
 /** \ingroup header
  * Retrieve extension or tag value from a header.
  *
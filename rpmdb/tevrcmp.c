@@ -0,0 +1,165 @@
+#include "system.h"
+#include <rpmio.h>
+#include <rpmiotypes.h>
+#include <argv.h>
+#include <rpmsw.h>
+#include <rpmtag.h>
+#define	_RPMEVR_INTERNAL
+#include <rpmevr.h>
+#include "debug.h"
+
+/*
+ * Benchmark: rpmEVRcmp() on strings vs. rpmvstrCmp() on segmented strings,
+ * and parse-per-compare vs. parse-once EVR comparison, over all pairs.
+ *	tevrcmp [evrfile [loops]]
+ * The evrfile has one [epoch:]version[-release] per line, e.g. from
+ *	rpm -qa --qf '%|EPOCH?{%{EPOCH}:}|%{VERSION}-%{RELEASE}\n'
+ */
+
+static const char * corpus[] = {
+    "2.17-55.el7", "2.17-55.el7_0.1", "2.17-78.el7", "2.17-105.el7",
+    "2.12-1.132.el6", "2.12-1.132.el6_5.2", "2.12-1.149.el6",
+    "1:1.0.1e-30.el6", "1:1.0.1e-30.el6_5.2", "1:1.0.1e-42.el7",
+    "1:1.0.2k-8.el7", "1:1.1.1k-5.el8_5",
+    "0:2.6.32-431.el6", "0:2.6.32-431.1.2.el6", "0:2.6.32-504.el6",
+    "3.10.0-123.el7", "3.10.0-123.13.2.el7", "3.10.0-1160.el7",
+    "4.18.0-80.el8", "4.18.0-80.11.2.el8_0",
+    "4.8.0-37.el7", "4.8.0-38.el7", "4.11.3-40.el7",
+    "5.4.0-0.rc1.1", "5.4.0-0.rc2.1", "5.4.0-1", "5.4.0-1.1",
+    "1.2.3~rc1-1", "1.2.3-1", "1.2.3a-1", "1.2.3b-1",
+    "20140911git-2.fc21", "20140911git-3.fc21", "0.20150302svn-1",
+    "1.9.2p320-1", "1.9.3p194-1", "2.0.0p0-1",
+    "7.4.160-1.el7", "7.4.160-4.el7", "7.4.629-6.el7",
+    "2:7.4.160-1.el7", "2:8.0.1763-13.el8",
+    "1.0-0.1.beta1", "1.0-0.2.beta2", "1.0-0.3.rc1", "1.0-1",
+    "0.9.8zh-1", "0.9.8zg-1", "0.9.8-1",
+    "3.3.2-5.fc22", "3.3.2-10.fc23", "3.03-1", "3.3-1",
+    "1.00-1", "1.000-1", "1.0.0-1", "1..0-1", "1.0.-1",
+    "12345678901234567890-1", "12345678901234567891-1",
+    "10:4.4.1-2", "4.4.1-2",
+};
+
+static ARGV_t loadCorpus(const char * fn)
+{
+    ARGV_t av = NULL;
+    char b[BUFSIZ];
+    FILE * fp;
+
+    if (fn == NULL) {
+	size_t i;
+	for (i = 0; i < sizeof(corpus)/sizeof(corpus[0]); i++)
+	    (void) argvAdd(&av, corpus[i]);
+	return av;
+    }
+    if ((fp = fopen(fn, "r")) == NULL) {
+	fprintf(stderr, "%s: %s\n", fn, strerror(errno));
+	return NULL;
+    }
+    while (fgets(b, (int)sizeof(b), fp) != NULL) {
+	b[strcspn(b, "\r\n")] = '\0';
+	if (b[0] != '\0')
+	    (void) argvAdd(&av, b);
+    }
+    (void) fclose(fp);
+    return av;
+}
+
+static void report(const char * mode, struct rpmsw_s * begin, unsigned ncmps)
+{
+    struct rpmsw_s end;
+    rpmtime_t usecs = rpmswDiff(rpmswNow(&end), begin);
+    fprintf(stdout, "%-24s %10u usecs %8.1f nsecs/cmp\n", mode,
+	(unsigned) usecs, (ncmps ? (1000.0 * usecs) / ncmps : 0.0));
+}
+
+int
+main(int argc, char *argv[])
+{
+    ARGV_t av = loadCorpus(argc > 1 ? argv[1] : NULL);
+    int ac = argvCount(av);
+    unsigned loops = (argc > 2 ? (unsigned) atol(argv[2]) : 100);
+    unsigned ncmps = loops * ac * ac;
+    struct rpmsw_s begin;
+    rpmvstr * vs;
+    EVR_t * evr;
+    int * rc;
+    unsigned nbad = 0;
+    unsigned k;
+    int i, j;
+    int xx;
+
+    if (av == NULL || ac == 0)
+	return EXIT_FAILURE;
+    (void) rpmswInit();
+    fprintf(stdout, "%d EVRs, %u loops, %u comparisons\n", ac, loops, ncmps);
+
+    rc = xcalloc(ac * ac, sizeof(*rc));
+    vs = xcalloc(ac, sizeof(*vs));
+    evr = xcalloc(ac, sizeof(*evr));
+
+    /* Segmented string compare. */
+    (void) rpmswNow(&begin);
+    for (k = 0; k < loops; k++)
+    for (i = 0; i < ac; i++)
+    for (j = 0; j < ac; j++)
+	rc[i * ac + j] = rpmEVRcmp(av[i], av[j]);
+    report("rpmEVRcmp", &begin, ncmps);
+
+    (void) rpmswNow(&begin);
+    for (i = 0; i < ac; i++)
+	vs[i] = rpmvstrNew(av[i]);
+    for (k = 0; k < loops; k++)
+    for (i = 0; i < ac; i++)
+    for (j = 0; j < ac; j++)
+	if (rpmvstrCmp(vs[i], vs[j]) != rc[i * ac + j] && k == 0) {
+	    fprintf(stderr, "*** rpmvstrCmp(\"%s\", \"%s\") != %d\n",
+		av[i], av[j], rc[i * ac + j]);
+	    nbad++;
+	}
+    report("rpmvstrCmp", &begin, ncmps);
+
+    /* EVR compare, parsing each time (as rpmdsCompare did). */
+    (void) rpmswNow(&begin);
+    for (k = 0; k < loops; k++)
+    for (i = 0; i < ac; i++)
+    for (j = 0; j < ac; j++) {
+	EVR_t a = memset(alloca(sizeof(*a)), 0, sizeof(*a));
+	EVR_t b = memset(alloca(sizeof(*b)), 0, sizeof(*b));
+	xx = rpmEVRparse(av[i], a);
+	xx = rpmEVRparse(av[j], b);
+	rc[i * ac + j] = rpmEVRcompare(a, b);
+	a->str = _free(a->str);
+	b->str = _free(b->str);
+    }
+    report("rpmEVRparse+compare", &begin, ncmps);
+
+    /* EVR compare, parsed and segmented once. */
+    (void) rpmswNow(&begin);
+    for (i = 0; i < ac; i++) {
+	evr[i] = rpmEVRnew(0, 0);
+	xx = rpmEVRparse(av[i], evr[i]);
+	xx = rpmEVRcompile(evr[i]);
+    }
+    for (k = 0; k < loops; k++)
+    for (i = 0; i < ac; i++)
+    for (j = 0; j < ac; j++)
+	if (rpmEVRcompare(evr[i], evr[j]) != rc[i * ac + j] && k == 0) {
+	    fprintf(stderr, "*** rpmEVRcompare(\"%s\", \"%s\") != %d\n",
+		av[i], av[j], rc[i * ac + j]);
+	    nbad++;
+	}
+    report("rpmEVRcompile+compare", &begin, ncmps);
+
+    for (i = 0; i < ac; i++) {
+	vs[i] = rpmvstrFree(vs[i]);
+	evr[i] = rpmEVRfree(evr[i]);
+    }
+    evr = _free(evr);
+    vs = _free(vs);
+    rc = _free(rc);
+    av = argvFree(av);
+
+    if (nbad)
+	fprintf(stderr, "*** %u mismatches\n", nbad);
+    return (nbad ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,157 @@
+#include "system.h"
+#include <sys/resource.h>
+#include <rpmio.h>
+#include <rpmiotypes.h>
+#include <rpmsw.h>
+#include <rpmtag.h>
+#include "tsynth.h"
+#include "debug.h"
+
+/*
+ * Benchmark: headerSprintf() vs. compiled formats vs. streamed output.
+ *	tqfmt [mode [nheaders [nfiles [qfmt [output]]]]]
+ * The mode is one of headerSprintf (default), headerSprintfExec or
+ * headerSprintfWrite; run once per mode to compare peak RSS.
+ */
+
+static const char * dirs[] = {
+    "/usr/bin/", "/usr/lib64/", "/usr/share/doc/pkg/",
+    "/usr/share/man/man1/", "/usr/include/pkg/", "/etc/",
+};
+
+/* Build a synthetic installed package header. */
+static Header mkHeader(unsigned ix, unsigned nfiles)
+{
+    Header h;
+    const char ** bn = xcalloc(nfiles, sizeof(*bn));
+    rpmuint32_t * di = xcalloc(nfiles, sizeof(*di));
+    rpmuint32_t * fs = xcalloc(nfiles, sizeof(*fs));
+    rpmuint32_t sz = 0;
+    char n[64];
+    char b[64];
+    unsigned i;
+
+    (void) snprintf(n, sizeof(n), "package-%u", ix);
+    h = tsynthNew(n, "1.2.3", "4.el7", "x86_64");
+    tsynthPut(h, RPMTAG_SUMMARY, RPM_STRING_TYPE,
+	"A synthetic package for query format benchmarks", 1);
+    tsynthPut(h, RPMTAG_LICENSE, RPM_STRING_TYPE, "GPLv2+", 1);
+    for (i = 0; i < nfiles; i++) {
+	(void) snprintf(b, sizeof(b), "%s-file-%u", n, i);
+	bn[i] = xstrdup(b);
+	di[i] = i % (sizeof(dirs)/sizeof(dirs[0]));
+	fs[i] = 1024 * (i + 1);
+	sz += fs[i];
+    }
+    tsynthPut(h, RPMTAG_SIZE, RPM_UINT32_TYPE, &sz, 1);
+    tsynthPut(h, RPMTAG_BASENAMES, RPM_STRING_ARRAY_TYPE, bn, nfiles);
+    tsynthPut(h, RPMTAG_DIRINDEXES, RPM_UINT32_TYPE, di, nfiles);
+    tsynthPut(h, RPMTAG_DIRNAMES, RPM_STRING_ARRAY_TYPE, dirs,
+	(sizeof(dirs)/sizeof(dirs[0])));
+    tsynthPut(h, RPMTAG_FILESIZES, RPM_UINT32_TYPE, fs, nfiles);
+
+    for (i = 0; i < nfiles; i++)
+	bn[i] = _free(bn[i]);
+    bn = _free(bn);
+    di = _free(di);
+    fs = _free(fs);
+    return h;
+}
+
+enum { SPRINTF, EXEC, WRITE };
+static const char * modes[] = {
+    "headerSprintf", "headerSprintfExec", "headerSprintfWrite",
+};
+
+static int run(int mode, Header * hdrs, unsigned nhdrs, const char * qfmt,
+		FD_t fd)
+{
+    headerSprintfArgs hsa = NULL;
+    const char * errmsg = NULL;
+    unsigned i;
+    int rc = 0;
+
+    if (mode != SPRINTF
+     && (hsa = headerSprintfCompile(qfmt, NULL, NULL, &errmsg)) == NULL)
+	return 1;
+
+    for (i = 0; i < nhdrs && rc == 0; i++) {
+	char * s = NULL;
+
+	switch (mode) {
+	case SPRINTF:
+	    s = headerSprintf(hdrs[i], qfmt, NULL, NULL, &errmsg);
+	    break;
+	case EXEC:
+	    s = headerSprintfExec(hsa, hdrs[i], &errmsg);
+	    break;
+	case WRITE:
+	    rc = headerSprintfWrite(hsa, hdrs[i], headerSprintfFdSink, fd,
+			&errmsg);
+	    continue;
+	}
+	if (s == NULL)
+	    rc = 1;
+	else if (headerSprintfFdSink(fd, s, strlen(s)))
+	    rc = 1;
+	s = _free(s);
+    }
+    if (rc && errmsg)
+	fprintf(stderr, "%s: %s\n", modes[mode], errmsg);
+    hsa = headerSprintfFree(hsa);
+    return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+    const char * mname = (argc > 1 ? argv[1] : modes[SPRINTF]);
+    unsigned nhdrs = (argc > 2 ? (unsigned) atol(argv[2]) : 10000);
+    unsigned nfiles = (argc > 3 ? (unsigned) atol(argv[3]) : 200);
+    const char * qfmt = (argc > 4 ? argv[4] : "[%{*:xml}\n]");
+    const char * ofn = (argc > 5 ? argv[5] : "/dev/null");
+    struct rpmsw_s begin, end;
+    struct rusage ru;
+    Header * hdrs;
+    FD_t fd;
+    unsigned i;
+    int mode;
+    int rc;
+
+    for (mode = SPRINTF; mode <= WRITE; mode++)
+	if (!strcmp(mname, modes[mode]))
+	    break;
+    if (mode > WRITE) {
+	fprintf(stderr, "%s: unknown mode\n", mname);
+	return EXIT_FAILURE;
+    }
+
+    (void) rpmswInit();
+
+    hdrs = xcalloc(nhdrs, sizeof(*hdrs));
+    for (i = 0; i < nhdrs; i++)
+	hdrs[i] = mkHeader(i, nfiles);
+
+    fprintf(stdout, "%u headers, %u files each, \"%s\" > %s\n",
+	nhdrs, nfiles, qfmt, ofn);
+
+    (void) rpmswNow(&begin);
+    fd = Fopen(ofn, "w.ufdio");
+    rc = (fd == NULL || Ferror(fd));
+    if (rc == 0)
+	rc = run(mode, hdrs, nhdrs, qfmt, fd);
+    if (fd != NULL)
+	(void) Fclose(fd);
+    (void) rpmswNow(&end);
+    memset(&ru, 0, sizeof(ru));
+    (void) getrusage(RUSAGE_SELF, &ru);
+    fprintf(stdout, "%-20s %10u usecs %8.1f usecs/hdr %8ld KB peak RSS%s\n",
+	modes[mode], (unsigned) rpmswDiff(&end, &begin),
+	(nhdrs ? (double) rpmswDiff(&end, &begin) / nhdrs : 0.0),
+	ru.ru_maxrss, (rc ? " FAILED" : ""));
+
+    for (i = 0; i < nhdrs; i++)
+	(void) headerFree(hdrs[i]);
+    hdrs = _free(hdrs);
+    return (rc ? EXIT_FAILURE : EXIT_SUCCESS);
+}
@@ -0,0 +1,75 @@
+#ifndef	H_TSYNTH
+#define	H_TSYNTH
+
+/** \ingroup header
+ * \file rpmdb/tsynth.h
+ * Synthetic package headers for the tqfmt/tds/torder benchmarks.
+ */
+
+/**
+ * Add a tag to a synthetic header.
+ * @param h		header
+ * @param tag		tag
+ * @param t		tag type
+ * @param p		tag data
+ * @param c		no. of items
+ */
+static void tsynthPut(Header h, rpmTag tag, rpmTagType t, const void * p,
+		rpmTagCount c)
+	/*@modifies h @*/
+{
+    HE_t he = memset(alloca(sizeof(*he)), 0, sizeof(*he));
+    he->tag = tag;
+    he->t = t;
+    he->p.ptr = (void *) p;
+    he->c = c;
+    (void) headerPut(h, he, 0);
+}
+
+/**
+ * Create a synthetic header.
+ * @param N		name
+ * @param V		version
+ * @param R		release
+ * @param A		arch (or NULL)
+ * @return		new header
+ */
+static /*@unused@*/ Header tsynthNew(const char * N, const char * V,
+		const char * R, /*@null@*/ const char * A)
+	/*@*/
+{
+    Header h = headerNew();
+    tsynthPut(h, RPMTAG_NAME, RPM_STRING_TYPE, N, 1);
+    tsynthPut(h, RPMTAG_VERSION, RPM_STRING_TYPE, V, 1);
+    tsynthPut(h, RPMTAG_RELEASE, RPM_STRING_TYPE, R, 1);
+    if (A != NULL)
+	tsynthPut(h, RPMTAG_ARCH, RPM_STRING_TYPE, A, 1);
+    return h;
+}
+
+/**
+ * Add a dependency set (Provides: or Requires:) to a synthetic header.
+ * @param h		header
+ * @param tagN		RPMTAG_PROVIDENAME or RPMTAG_REQUIRENAME
+ * @param N		dependency names
+ * @param EVR		dependency versions
+ * @param F		dependency flags
+ * @param n		no. of dependencies
+ */
+static /*@unused@*/ void tsynthDeps(Header h, rpmTag tagN, const char ** N,
+		const char ** EVR, const rpmuint32_t * F, rpmTagCount n)
+	/*@modifies h @*/
+{
+    rpmTag tagEVR = (tagN == RPMTAG_PROVIDENAME
+		? RPMTAG_PROVIDEVERSION : RPMTAG_REQUIREVERSION);
+    rpmTag tagF = (tagN == RPMTAG_PROVIDENAME
+		? RPMTAG_PROVIDEFLAGS : RPMTAG_REQUIREFLAGS);
+
+    if (n == 0)
+	return;
+    tsynthPut(h, tagN, RPM_STRING_ARRAY_TYPE, N, n);
+    tsynthPut(h, tagEVR, RPM_STRING_ARRAY_TYPE, EVR, n);
+    tsynthPut(h, tagF, RPM_UINT32_TYPE, F, n);
+}
+
+#endif	/* H_TSYNTH */
@@ -21,9 +21,21 @@ typedef	enum { true = 1, false = 0 } bool;
 #include <zlib.h>
 /*@=noparams@*/
 
+#if defined(WITH_PTHREADS)
+#define	_RPMZQ_INTERNAL
+#include <rpmzlog.h>
+#include <rpmzq.h>
+#include "crc.h"
+#endif
+
 #include "debug.h"
 
 /*@access FD_t @*/
+#if defined(WITH_PTHREADS)
+/*@access rpmzSpace @*/
+/*@access rpmzPool @*/
+/*@access rpmzJob @*/
+#endif
 
 #define	GZDONLY(fd)	assert(fdGetIo(fd) == gzdio)
 
@@ -42,11 +54,15 @@ typedef struct rsync_state_s {
     unsigned char win[RSYNC_WIN];	/* window elements */
 } * rsync_state;
 
+typedef struct rpmGZQ_s * rpmGZQ;
+
 typedef struct rpmGZFILE_s {
     gzFile gz;				/* gzFile is a pointer */
     struct rsync_state_s rs;
     struct cpio_state_s cs;
     rpmuint32_t nb;			/* bytes pending for sync */
+/*@only@*/ /*@null@*/
+    rpmGZQ zq;				/* parallel deflate (gz is NULL) */
 } * rpmGZFILE;				/* like FILE, to use with star */
 
 /* Should gzflush be called only after RSYNC_WIN boundaries? */
@@ -221,6 +237,441 @@ rsyncable_gzwrite(rpmGZFILE rpmgz, const unsigned char *const buf, const size_t
     return n_written;
 }
 
+/* =============================================================== */
+/**
+ * Split the no. of compression threads out of a zlib mode.
+ * zlib takes 'T' as "transparent", so "T<n>" never reaches gzopen().
+ * @param fmode		mode, e.g. "w9T4"
+ * @retval zmode	mode without "T<n>" (at least as long as fmode)
+ * @return		no. of threads (<= 1 is single threaded)
+ */
+static int gzdMode(const char * fmode, /*@out@*/ char * zmode)
+	/*@globals internalState @*/
+	/*@modifies *zmode, internalState @*/
+{
+    int threads = 0;
+    int explicit = 0;
+
+    if (fmode[0] != 'w')		/* XXX only deflate is threaded */
+	threads = 1;
+    for (; *fmode != '\0'; fmode++) {
+	if (*fmode != 'T') {		/* e.g. "w9T4.gzdio", T0 is per CPU */
+	    *zmode++ = *fmode;
+	    continue;
+	}
+	threads = 0;
+	while (fmode[1] >= '0' && fmode[1] <= '9')
+	    threads = 10 * threads + (int)(*++fmode - '0');
+	if (threads == 0)
+	    threads = -1;
+	explicit = 1;
+    }
+    *zmode = '\0';
+    if (!explicit && threads == 0)
+	threads = rpmExpandNumeric("%{?_gz_threads}");
+    if (threads < 0) {
+#if defined(_SC_NPROCESSORS_ONLN)
+	threads = (int) sysconf(_SC_NPROCESSORS_ONLN);
+#else
+	threads = 1;
+#endif
+    }
+    return threads;
+}
+
+#if defined(WITH_PTHREADS)
+/* =============================================================== */
+/*
+ * Block-parallel deflate (as rpmpigz does). The input is cut into blocks
+ * that are deflated concurrently, each primed with the end of the previous
+ * block as dictionary and ended with a sync flush (the last one finishes
+ * the stream), so that the concatenated blocks are a single gzip member
+ * that any gunzip reads. The crc32 of each block is combined in order by
+ * the write thread. Jobs and buffers come from the rpmzq job queue.
+ */
+
+#define	GZDQ_BLOCK	(128 * 1024)	/* uncompressed bytes per job */
+#define	GZDQ_DICT	32768U		/* deflate window */
+
+/** A compression thread and its deflate stream. */
+typedef struct rpmGZQT_s {
+/*@dependent@*/
+    rpmGZQ zq;
+    z_stream strm;
+/*@relnull@*/
+    yarnThread thread;
+} * rpmGZQT;
+
+/** Parallel deflate state. */
+struct rpmGZQ_s {
+    int fdno;				/*!< output file descriptor */
+    int level;				/*!< compression level */
+    int rsync;				/*!< end blocks at rsync hints? */
+    unsigned nthreads;			/*!< max. no. of compression threads */
+    unsigned ncthreads;			/*!< no. of compression threads */
+/*@only@*/
+    rpmGZQT cthreads;			/*!< compression threads */
+/*@relnull@*/
+    yarnThread writer;			/*!< write thread */
+    rpmzPool ipool;			/*!< input buffers */
+    rpmzPool opool;			/*!< output buffers */
+    rpmzFIFO cq;			/*!< jobs to compress */
+    rpmzSEQ wq;				/*!< compressed jobs, written in order */
+    yarnLock written;			/*!< no. of jobs written */
+    int error;				/*!< errno of the first write failure */
+/*@null@*/
+    rpmzSpace next;			/*!< input being filled */
+/*@null@*/
+    rpmzSpace prev;			/*!< previous input (next dictionary) */
+    long seq;				/*!< no. of jobs queued */
+};
+
+static int gzdqWriteAll(int fdno, const unsigned char * b, size_t nb)
+	/*@globals errno, fileSystem @*/
+	/*@modifies errno, fileSystem @*/
+{
+    while (nb > 0) {
+	ssize_t rc = write(fdno, b, nb);
+	if (rc < 0) {
+	    if (errno == EINTR)
+		continue;
+	    return -1;
+	}
+	b += rc;
+	nb -= rc;
+    }
+    return 0;
+}
+
+/* get the next job off the compress list, deflate it and its crc32, then
+   put it on the write list -- return when the job with seq -1 shows up */
+static void gzdqCompressThread(void * _zt)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies _zt, fileSystem, internalState @*/
+{
+    rpmGZQT zt = _zt;
+    rpmGZQ zq = zt->zq;
+    z_stream * sp = &zt->strm;
+    rpmzJob job;
+
+    while ((job = rpmzqDelFIFO(zq->cq)) != NULL) {
+	rpmzSpace dict = job->out;	/* previous input, if any */
+
+	(void) deflateReset(sp);
+	if (dict != NULL) {
+	    size_t n = (dict->len < GZDQ_DICT ? dict->len : GZDQ_DICT);
+	    if (n > 0)
+		(void) deflateSetDictionary(sp, dict->buf + dict->len - n, (uInt)n);
+	    (void) rpmzqDropSpace(dict);
+	}
+
+	/* the output buffer is sized for the worst case expansion */
+/*@-mustfreeonly@*/
+	job->out = rpmzqNewSpace(zq->opool, zq->opool->size);
+/*@=mustfreeonly@*/
+	sp->next_in = job->in->buf;
+	sp->avail_in = (uInt) job->in->len;
+	sp->next_out = job->out->buf;
+	sp->avail_out = (uInt) job->out->len;
+	(void) deflate(sp, job->more ? Z_SYNC_FLUSH : Z_FINISH);
+assert(sp->avail_in == 0 && sp->avail_out != 0);
+	job->out->len = sp->next_out - job->out->buf;
+	job->check = crc32(0L, job->in->buf, (uInt) job->in->len);
+
+	rpmzqAddSEQ(zq->wq, job);
+    }
+}
+
+/* write the gzip header, then the compressed jobs in order, combining the
+   crc32's, and the trailer after the last job */
+static void gzdqWriteThread(void * _zq)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies _zq, errno, fileSystem, internalState @*/
+{
+    rpmGZQ zq = _zq;
+    unsigned char b[10];
+    rpmuint32_t crc = 0;
+    rpmuint32_t ulen = 0;
+    int xerrno = 0;
+    long seq = 0;
+    int more;
+
+    b[0] = 0x1f;	b[1] = 0x8b;	b[2] = Z_DEFLATED;	b[3] = 0;
+    b[4] = b[5] = b[6] = b[7] = 0;	/* no mtime */
+    b[8] = (zq->level == 9 ? 2 : zq->level == 1 ? 4 : 0);
+    b[9] = 3;				/* OS_CODE: unix */
+    if (gzdqWriteAll(zq->fdno, b, sizeof(b)))
+	xerrno = errno;
+
+    do {
+	rpmzJob job = rpmzqDelSEQ(zq->wq, seq);
+	size_t len = job->in->len;
+
+	more = job->more;
+	crc = __crc32_combine(crc, (rpmuint32_t)job->check, len);
+	ulen += (rpmuint32_t) len;
+	if (!xerrno && gzdqWriteAll(zq->fdno, job->out->buf, job->out->len))
+	    xerrno = errno;
+	(void) rpmzqDropSpace(job->in);
+	(void) rpmzqDropSpace(job->out);
+	job = rpmzqDropJob(job);
+	seq++;
+
+	if (!more) {
+	    b[0] = (crc      ) & 0xff;	b[1] = (crc >>  8) & 0xff;
+	    b[2] = (crc >> 16) & 0xff;	b[3] = (crc >> 24) & 0xff;
+	    b[4] = (ulen      ) & 0xff;	b[5] = (ulen >>  8) & 0xff;
+	    b[6] = (ulen >> 16) & 0xff;	b[7] = (ulen >> 24) & 0xff;
+	    if (!xerrno && gzdqWriteAll(zq->fdno, b, 8))
+		xerrno = errno;
+	}
+
+	yarnPossess(zq->written);
+	if (xerrno && !zq->error)
+	    zq->error = xerrno;
+	yarnTwist(zq->written, TO, seq);
+    } while (more);
+}
+
+/**
+ * Queue the input being filled as the next job.
+ * @param zq		parallel deflate
+ * @param more		0 if this is the last job
+ */
+static void gzdqQueue(rpmGZQ zq, int more)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies zq, fileSystem, internalState @*/
+{
+    rpmzJob job = rpmzqNewJob(zq->seq);
+
+    if (zq->next == NULL) {
+	zq->next = rpmzqNewSpace(zq->ipool, zq->ipool->size);
+	zq->next->len = 0;
+    }
+/*@-mustfreeonly@*/
+    job->in = zq->next;
+    job->out = zq->prev;		/* dictionary for compression */
+/*@=mustfreeonly@*/
+    job->more = more;
+    zq->next = NULL;
+    zq->prev = NULL;
+    if (more) {
+	rpmzqUseSpace(job->in);		/* hold as the next dictionary */
+	zq->prev = job->in;
+    }
+    zq->seq++;
+
+    /* start another compression thread if needed */
+    if (zq->ncthreads < (unsigned)zq->seq && zq->ncthreads < zq->nthreads) {
+	rpmGZQT zt = zq->cthreads + zq->ncthreads++;
+	zt->thread = yarnLaunch(gzdqCompressThread, zt);
+    }
+
+    rpmzqAddFIFO(zq->cq, job);
+}
+
+/**
+ * Return the errno of the first failed write, if any.
+ * @param zq		parallel deflate
+ * @return		0 or errno
+ */
+static int gzdqError(rpmGZQ zq)
+	/*@*/
+{
+    int error;
+    yarnPossess(zq->written);
+    error = zq->error;
+    yarnRelease(zq->written);
+    return error;
+}
+
+/**
+ * Create a parallel deflate onto a file descriptor.
+ * @param fdno		file descriptor (closed by gzdqFree)
+ * @param zmode		zlib mode (level/strategy, without "T<n>")
+ * @param threads	no. of compression threads
+ * @return		parallel deflate, NULL on failure
+ */
+/*@null@*/
+static rpmGZQ gzdqNew(int fdno, const char * zmode, int threads)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies fileSystem, internalState @*/
+{
+    rpmGZQ zq = xcalloc(1, sizeof(*zq));
+    int strategy = Z_DEFAULT_STRATEGY;
+    size_t isize;
+    int i;
+
+    zq->fdno = fdno;
+    zq->level = Z_DEFAULT_COMPRESSION;
+    for (; *zmode != '\0'; zmode++) {
+	switch (*zmode) {
+	case 'f':	strategy = Z_FILTERED;		/*@switchbreak@*/ break;
+	case 'h':	strategy = Z_HUFFMAN_ONLY;	/*@switchbreak@*/ break;
+	case 'R':	strategy = Z_RLE;		/*@switchbreak@*/ break;
+	case 'F':	strategy = Z_FIXED;		/*@switchbreak@*/ break;
+	default:
+	    if (*zmode >= '0' && *zmode <= '9')
+		zq->level = (int)(*zmode - '0');
+	    /*@switchbreak@*/ break;
+	}
+    }
+    zq->rsync = enable_rsync;
+    zq->nthreads = threads;
+    zq->cthreads = xcalloc(threads, sizeof(*zq->cthreads));
+    for (i = 0; i < threads; i++) {
+	rpmGZQT zt = zq->cthreads + i;
+	zt->zq = zq;
+	if (deflateInit2(&zt->strm, zq->level, Z_DEFLATED, -MAX_WBITS, 8,
+			strategy) != Z_OK)
+	{
+	    while (--i >= 0)
+		(void) deflateEnd(&zq->cthreads[i].strm);
+	    zq->cthreads = _free(zq->cthreads);
+	    zq = _free(zq);
+	    return NULL;
+	}
+    }
+
+    /* rsync blocks end at the first hint past GZDQ_BLOCK, or when full */
+    isize = (zq->rsync ? 2 * GZDQ_BLOCK : GZDQ_BLOCK);
+    zq->ipool = rpmzqNewPool(isize, 2 * threads + 2);
+    zq->opool = rpmzqNewPool(isize + (isize >> 11) + 64, -1);
+    zq->cq = rpmzqInitFIFO(0L);
+    zq->wq = rpmzqInitSEQ(-1L);
+    zq->written = yarnNewLock(0L);
+    zq->writer = yarnLaunch(gzdqWriteThread, zq);
+    return zq;
+}
+
+/**
+ * Finish the gzip stream, stop the threads and close the file descriptor.
+ * @param zq		parallel deflate
+ * @return		0 on success, Z_ERRNO (with errno) on failure
+ */
+static int gzdqFree(/*@only@*/ rpmGZQ zq)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies zq, errno, fileSystem, internalState @*/
+{
+    struct rpmzJob_s job;
+    unsigned i;
+    int error;
+
+    gzdqQueue(zq, 0);
+    zq->writer = yarnJoin(zq->writer);
+    error = zq->error;
+
+    /* command all of the compression threads to return */
+    yarnPossess(zq->cq->have);
+    job.seq = -1;
+    job.next = NULL;
+/*@-immediatetrans -mustfreeonly@*/
+    zq->cq->head = &job;
+/*@=immediatetrans =mustfreeonly@*/
+    zq->cq->tail = &job.next;
+    yarnTwist(zq->cq->have, BY, 1);	/* will wake them all up */
+    for (i = 0; i < zq->ncthreads; i++)
+	zq->cthreads[i].thread = yarnJoin(zq->cthreads[i].thread);
+    for (i = 0; i < zq->nthreads; i++)
+	(void) deflateEnd(&zq->cthreads[i].strm);
+    zq->cq->head = NULL;
+    zq->cq->tail = &zq->cq->head;
+
+    zq->ipool = rpmzqFreePool(zq->ipool, NULL);
+    zq->opool = rpmzqFreePool(zq->opool, NULL);
+    zq->cq = rpmzqFiniFIFO(zq->cq);
+    zq->wq = rpmzqFiniSEQ(zq->wq);
+    zq->written = yarnFreeLock(zq->written);
+    zq->cthreads = _free(zq->cthreads);
+
+    if (close(zq->fdno) && !error)
+	error = errno;
+    zq = _free(zq);
+
+    if (error) {
+	errno = error;
+	return Z_ERRNO;
+    }
+    return 0;
+}
+
+/**
+ * Queue the input being filled and wait until all of it is written.
+ * @param zq		parallel deflate
+ * @return		0 on success, Z_ERRNO (with errno) on failure
+ */
+static int gzdqFlush(rpmGZQ zq)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies zq, errno, fileSystem, internalState @*/
+{
+    int error;
+
+    if (zq->next != NULL && zq->next->len > 0)
+	gzdqQueue(zq, 1);
+    yarnPossess(zq->written);
+    yarnWaitFor(zq->written, TO_BE, zq->seq);
+    error = zq->error;
+    yarnRelease(zq->written);
+    if (error) {
+	errno = error;
+	return Z_ERRNO;
+    }
+    return 0;
+}
+
+static ssize_t gzdqWrite(rpmGZFILE rpmgz, const unsigned char * buf, size_t len)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies rpmgz, errno, fileSystem, internalState @*/
+{
+    rpmGZQ zq = rpmgz->zq;
+    size_t count = len;
+    int error;
+
+    if ((error = gzdqError(zq)) != 0) {
+	errno = error;
+	return -1;
+    }
+
+    while (count > 0) {
+	rpmzSpace space;
+	size_t room;
+	size_t n;
+	bool full;
+
+	if (zq->next == NULL) {
+	    zq->next = rpmzqNewSpace(zq->ipool, zq->ipool->size);
+	    zq->next->len = 0;
+	}
+	space = zq->next;
+	room = (zq->rsync ? zq->ipool->size : GZDQ_BLOCK) - space->len;
+	n = (count < room ? count : room);
+	full = (n == room);
+
+	/* end rsync blocks at a hint, so that they resync like gzflush's */
+	if (zq->rsync) {
+	    size_t i;
+	    for (i = 0; i < n; i++) {
+		if (!sync_hint(rpmgz, buf[i]))
+		    continue;
+		if (space->len + i + 1 < GZDQ_BLOCK)
+		    continue;
+		n = i + 1;
+		full = true;
+		break;
+	    }
+	}
+
+	memcpy(space->buf + space->len, buf, n);
+	space->len += n;
+	buf += n;
+	count -= n;
+	if (full)
+	    gzdqQueue(zq, 1);
+    }
+    return (ssize_t) len;
+}
+#endif	/* WITH_PTHREADS */
+
 /* =============================================================== */
 /*@-moduncon@*/
 
@@ -250,10 +701,23 @@ FD_t gzdOpen(const char * path, const char * fmode)
     FD_t fd;
     rpmGZFILE rpmgz;
     mode_t mode = (fmode && fmode[0] == 'w' ? O_WRONLY : O_RDONLY);
+    char * zmode;
+    int threads;
 
+    if (fmode == NULL) return NULL;
+    zmode = alloca(strlen(fmode) + 1);
+    threads = gzdMode(fmode, zmode);
     rpmgz = xcalloc(1, sizeof(*rpmgz));
-    rpmgz->gz = gzopen(path, fmode);
-    if (rpmgz->gz == NULL) {
+#if defined(WITH_PTHREADS)
+    if (mode == O_WRONLY && threads > 1) {
+	int fdno = open(path, O_WRONLY|O_CREAT|O_TRUNC, 0666);
+	if (fdno >= 0 && (rpmgz->zq = gzdqNew(fdno, zmode, threads)) == NULL)
+	    (void) close(fdno);
+    }
+    if (rpmgz->zq == NULL)
+#endif
+    rpmgz->gz = gzopen(path, zmode);
+    if (rpmgz->gz == NULL && rpmgz->zq == NULL) {
 	rpmgz = _free(rpmgz);
 	return NULL;
     }
@@ -272,14 +736,23 @@ static /*@null@*/ FD_t gzdFdopen(void * cookie, const char *fmode)
     FD_t fd = c2f(cookie);
     int fdno;
     rpmGZFILE rpmgz;
+    char * zmode;
+    int threads;
 
     if (fmode == NULL) return NULL;
+    zmode = alloca(strlen(fmode) + 1);
+    threads = gzdMode(fmode, zmode);
     fdno = fdFileno(fd);
     fdSetFdno(fd, -1);		/* XXX skip the fdio close */
     if (fdno < 0) return NULL;
     rpmgz = xcalloc(1, sizeof(*rpmgz));
-    rpmgz->gz = gzdopen(fdno, fmode);
-    if (rpmgz->gz == NULL) {
+#if defined(WITH_PTHREADS)
+    if (fmode[0] == 'w' && threads > 1)
+	rpmgz->zq = gzdqNew(fdno, zmode, threads);
+    if (rpmgz->zq == NULL)
+#endif
+    rpmgz->gz = gzdopen(fdno, zmode);
+    if (rpmgz->gz == NULL && rpmgz->zq == NULL) {
 	rpmgz = _free(rpmgz);
 	return NULL;
     }
@@ -296,6 +769,10 @@ static int gzdFlush(void * cookie)
     rpmGZFILE rpmgz;
     rpmgz = gzdFileno(fd);
     if (rpmgz == NULL) return -2;
+#if defined(WITH_PTHREADS)
+    if (rpmgz->zq != NULL)
+	return gzdqFlush(rpmgz->zq);
+#endif
     return gzflush(rpmgz->gz, Z_SYNC_FLUSH);	/* XXX W2DO? */
 }
 
@@ -313,6 +790,7 @@ static ssize_t gzdRead(void * cookie, /*@out@*/ char * buf, size_t count)
 
     rpmgz = gzdFileno(fd);
     if (rpmgz == NULL) return -2;	/* XXX can't happen */
+    if (rpmgz->gz == NULL) return -2;	/* XXX parallel deflate is write only */
 
     fdstat_enter(fd, FDSTAT_READ);
     rc = gzread(rpmgz->gz, buf, (unsigned)count);
@@ -348,12 +826,20 @@ static ssize_t gzdWrite(void * cookie, const char * buf, size_t count)
     if (rpmgz == NULL) return -2;	/* XXX can't happen */
 
     fdstat_enter(fd, FDSTAT_WRITE);
+#if defined(WITH_PTHREADS)
+    if (rpmgz->zq != NULL)
+	rc = gzdqWrite(rpmgz, (void *)buf, count);
+    else
+#endif
     if (enable_rsync)
 	rc = rsyncable_gzwrite(rpmgz, (void *)buf, (unsigned)count);
     else
 	rc = gzwrite(rpmgz->gz, (void *)buf, (unsigned)count);
 DBGIO(fd, (stderr, "==>\tgzdWrite(%p,%p,%u) rc %lx %s\n", cookie, buf, (unsigned)count, (unsigned long)rc, fdbg(fd)));
-    if (rc < (ssize_t)count) {
+    if (rc < (ssize_t)count && rpmgz->gz == NULL) {
+	fd->syserrno = errno;
+	fd->errcookie = strerror(fd->syserrno);
+    } else if (rc < (ssize_t)count) {
 	int zerror = 0;
 	fd->errcookie = gzerror(rpmgz->gz, &zerror);
 	if (zerror == Z_ERRNO) {
@@ -387,6 +873,7 @@ static int gzdSeek(void * cookie, _libio_pos_t pos, int whence)
 
     rpmgz = gzdFileno(fd);
     if (rpmgz == NULL) return -2;	/* XXX can't happen */
+    if (rpmgz->gz == NULL) return -2;	/* XXX parallel deflate can't seek */
 
     fdstat_enter(fd, FDSTAT_SEEK);
     rc = gzseek(rpmgz->gz, (long)p, whence);
@@ -419,6 +906,12 @@ static int gzdClose( /*@only@*/ void * cookie)
     if (rpmgz == NULL) return -2;	/* XXX can't happen */
 
     fdstat_enter(fd, FDSTAT_CLOSE);
+#if defined(WITH_PTHREADS)
+    if (rpmgz->zq != NULL) {
+	rc = gzdqFree(rpmgz->zq);
+	rpmgz->zq = NULL;
+    } else
+#endif
     /*@-dependenttrans@*/
     rc = gzclose(rpmgz->gz);
     /*@=dependenttrans@*/
@@ -10,6 +10,7 @@
 #include <ugid.h>		/* XXX unameToUid() and gnameToGid() */
 
 #include <rpmsq.h>		/* XXX rpmsqJoin()/rpmsqThread() */
+#include <yarn.h>		/* XXX payload read-ahead thread */
 #include <rpmsw.h>		/* XXX rpmswAdd() */
 #include <rpmsx.h>
 
@@ -450,6 +451,168 @@ static void * iosmThread(void * arg)
 }
 #endif
 
+#if defined(WITH_PTHREADS)
+/** \ingroup payload
+ * Payload read-ahead queue.
+ */
+typedef struct iosmRdq_s * iosmRdq;
+struct iosmRdq_s {
+    FD_t fd;			/*!< Payload file handle. */
+    yarnLock filled;		/*!< No. of filled buffers. */
+    yarnThread reader;		/*!< Read-ahead thread. */
+    char ** bufs;		/*!< Buffer ring. */
+    size_t * nbs;		/*!< No. of bytes in each buffer. */
+    int * errs;			/*!< Read error in each buffer? */
+    size_t bufsize;		/*!< Buffer size. */
+    int nbufs;			/*!< No. of buffers. */
+    int rx;			/*!< Next buffer to fill (reader). */
+    int cx;			/*!< Current buffer to consume. */
+    size_t coff;		/*!< Consumed bytes in current buffer. */
+    int eof;			/*!< Was the last buffer consumed? */
+    int err;			/*!< Did the last buffer have an error? */
+    int stop;			/*!< Stop the reader? */
+};
+
+/**
+ * Fill the buffer ring from the payload until EOF (or stopped).
+ * A short (or empty) buffer ends the payload.
+ * @param _rdq		read-ahead queue
+ */
+static void iosmRdqReader(void * _rdq)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies _rdq, fileSystem, internalState @*/
+{
+    iosmRdq rdq = _rdq;
+    int done = 0;
+
+    while (!done) {
+	char * b = rdq->bufs[rdq->rx];
+	size_t nb = 0;
+	size_t rc;
+
+	yarnPossess(rdq->filled);
+	yarnWaitFor(rdq->filled, TO_BE_LESS_THAN, rdq->nbufs);
+	done = rdq->stop;
+	yarnRelease(rdq->filled);
+	if (done)
+	    break;
+
+	while (nb < rdq->bufsize) {
+	    rc = Fread(b + nb, sizeof(*b), rdq->bufsize - nb, rdq->fd);
+	    if ((ssize_t)rc <= 0 || Ferror(rdq->fd))
+		/*@innerbreak@*/ break;
+	    nb += rc;
+	}
+	rdq->nbs[rdq->rx] = nb;
+	rdq->errs[rdq->rx] = Ferror(rdq->fd);
+	done = (nb < rdq->bufsize || rdq->errs[rdq->rx]);
+	rdq->rx = (rdq->rx + 1) % rdq->nbufs;
+
+	yarnPossess(rdq->filled);
+	yarnTwist(rdq->filled, BY, 1);
+    }
+}
+
+/**
+ * Copy payload bytes from the buffer ring.
+ * @param rdq		read-ahead queue
+ * @param b		destination
+ * @param len		no. of bytes requested
+ * @return		no. of bytes copied
+ */
+static size_t iosmRdqRead(iosmRdq rdq, char * b, size_t len)
+	/*@modifies rdq, b @*/
+{
+    size_t nr = 0;
+
+    while (nr < len && !rdq->eof) {
+	size_t nb;
+
+	yarnPossess(rdq->filled);
+	yarnWaitFor(rdq->filled, NOT_TO_BE, 0);
+	yarnRelease(rdq->filled);
+
+	nb = rdq->nbs[rdq->cx] - rdq->coff;
+	if (nb > len - nr)
+	    nb = len - nr;
+	memcpy(b + nr, rdq->bufs[rdq->cx] + rdq->coff, nb);
+	nr += nb;
+	rdq->coff += nb;
+
+	if (rdq->coff < rdq->nbs[rdq->cx])
+	    continue;
+	/* The reader has exited after a short buffer. */
+	if (rdq->nbs[rdq->cx] < rdq->bufsize || rdq->errs[rdq->cx]) {
+	    rdq->err = rdq->errs[rdq->cx];
+	    rdq->eof = 1;
+	    break;
+	}
+	rdq->coff = 0;
+	rdq->cx = (rdq->cx + 1) % rdq->nbufs;
+	yarnPossess(rdq->filled);
+	yarnTwist(rdq->filled, BY, -1);
+    }
+    return nr;
+}
+#endif
+
+int iosmReadAhead(IOSM_t iosm, int nbufs, size_t bufsize)
+{
+#if defined(WITH_PTHREADS)
+    iosmRdq rdq;
+    int i;
+
+    if (iosm->rdq != NULL || iosm->cfd == NULL || nbufs < 2 || bufsize == 0)
+	return 0;
+
+    rdq = xcalloc(1, sizeof(*rdq));
+/*@-assignexpose -castexpose @*/
+    rdq->fd = fdLink(iosm->cfd, "persist (iosm read-ahead)");
+/*@=assignexpose =castexpose @*/
+    rdq->nbufs = nbufs;
+    rdq->bufsize = bufsize;
+    rdq->bufs = xcalloc(nbufs, sizeof(*rdq->bufs));
+    rdq->nbs = xcalloc(nbufs, sizeof(*rdq->nbs));
+    rdq->errs = xcalloc(nbufs, sizeof(*rdq->errs));
+    for (i = 0; i < nbufs; i++)
+	rdq->bufs[i] = xmalloc(bufsize);
+    rdq->filled = yarnNewLock(0);
+    rdq->reader = yarnLaunch(iosmRdqReader, rdq);
+    iosm->rdq = rdq;
+#endif
+    return 0;
+}
+
+int iosmReadAheadStop(IOSM_t iosm)
+{
+#if defined(WITH_PTHREADS)
+    iosmRdq rdq = iosm->rdq;
+    int i;
+
+    if (rdq == NULL)
+	return 0;
+
+    /* Wake the reader if waiting for a free buffer. */
+    yarnPossess(rdq->filled);
+    rdq->stop = 1;
+    yarnTwist(rdq->filled, TO, 0);
+    rdq->reader = yarnJoin(rdq->reader);
+    rdq->filled = yarnFreeLock(rdq->filled);
+
+    for (i = 0; i < rdq->nbufs; i++)
+	rdq->bufs[i] = _free(rdq->bufs[i]);
+    rdq->bufs = _free(rdq->bufs);
+    rdq->nbs = _free(rdq->nbs);
+    rdq->errs = _free(rdq->errs);
+/*@-refcounttrans@*/
+    rdq->fd = fdFree(rdq->fd, "persist (iosm read-ahead)");
+/*@=refcounttrans@*/
+    rdq = _free(rdq);
+    iosm->rdq = NULL;
+#endif
+    return 0;
+}
+
 int iosmNext(IOSM_t iosm, iosmFileStage nstage)
 	/*@globals h_errno, fileSystem, internalState @*/
 	/*@modifies iosm, fileSystem, internalState @*/
@@ -800,6 +963,7 @@ fprintf(stderr, "--> iosmTeardown(%p)\n", iosm);
     if (!rc)
 	rc = iosmUNSAFE(iosm, IOSM_DESTROY);
 
+    (void) iosmReadAheadStop(iosm);
     iosm->lmtab = _free(iosm->lmtab);
 
     if (iosm->iter != NULL) {
@@ -2566,13 +2730,23 @@ assert(iosm->lpath != NULL);
 	rc = (*iosm->headerWrite) (iosm, st);	/* Write next payload header. */
 	break;
     case IOSM_DREAD:
-	iosm->rdnb = Fread(iosm->wrbuf, sizeof(*iosm->wrbuf), iosm->wrlen, iosm->cfd);
+#if defined(WITH_PTHREADS)
+	if (iosm->rdq != NULL) {
+	    iosmRdq rdq = iosm->rdq;
+	    iosm->rdnb = iosmRdqRead(rdq, iosm->wrbuf, iosm->wrlen);
+	    if (iosm->rdnb != iosm->wrlen || rdq->err)
+		rc = IOSMERR_READ_FAILED;
+	} else
+#endif
+	{
+	    iosm->rdnb = Fread(iosm->wrbuf, sizeof(*iosm->wrbuf), iosm->wrlen, iosm->cfd);
+	    if (iosm->rdnb != iosm->wrlen || Ferror(iosm->cfd))
+		rc = IOSMERR_READ_FAILED;
+	}
 	if (iosm->debug && (stage & IOSM_SYSCALL))
 	    rpmlog(RPMLOG_DEBUG, " %8s (%s, %d, cfd)\trdnb %d\n",
 		cur, (iosm->wrbuf == iosm->wrb ? "wrbuf" : "mmap"),
 		(int)iosm->wrlen, (int)iosm->rdnb);
-	if (iosm->rdnb != iosm->wrlen || Ferror(iosm->cfd))
-	    rc = IOSMERR_READ_FAILED;
 	if (iosm->rdnb > 0)
 	    fdSetCpioPos(iosm->cfd, fdGetCpioPos(iosm->cfd) + iosm->rdnb);
 	break;
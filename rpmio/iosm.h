@@ -319,6 +319,9 @@ struct iosm_s {
     size_t lmtaboff;		/*!< ar(1) current offset in lmtab. */
 
     struct rpmop_s op_digest;	/*!< RPMSW_OP_DIGEST accumulator. */
+
+/*@only@*/ /*@null@*/
+    void * rdq;			/*!< Payload read-ahead queue. */
 };
 #endif
 
@@ -399,6 +402,30 @@ int iosmTeardown(IOSM_t iosm)
 	/*@globals h_errno, fileSystem, internalState @*/
 	/*@modifies iosm, fileSystem, internalState @*/;
 
+/**
+ * Read (and decompress) the payload ahead on a thread of its own.
+ *
+ * The thread fills a ring of nbufs buffers from iosm->cfd while the state
+ * machine extracts (IOSM_DREAD) from the filled buffers, overlapping
+ * decompression with file writes.
+ * @param iosm		I/O state machine
+ * @param nbufs		no. of buffers (< 2 disables)
+ * @param bufsize	size of each buffer
+ * @return		0 on success
+ */
+int iosmReadAhead(IOSM_t iosm, int nbufs, size_t bufsize)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies iosm, fileSystem, internalState @*/;
+
+/**
+ * Stop reading the payload ahead.
+ * @param iosm		I/O state machine
+ * @return		0 always
+ */
+int iosmReadAheadStop(IOSM_t iosm)
+	/*@globals fileSystem, internalState @*/
+	/*@modifies iosm, fileSystem, internalState @*/;
+
 #if defined(_IOSM_INTERNAL)
 /*@-exportlocal@*/
 /**
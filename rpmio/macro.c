@@ -3140,13 +3140,23 @@ rpmMCExpand(MacroContext mc, const char *arg, ...)
 int
 rpmExpandNumeric(const char *arg)
 {
+#if defined(WITH_PTHREADS)
+    /* XXX payload unpacks may expand their tunables concurrently. */
+    static pthread_mutex_t _numeric_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
     const char *val;
     int rc;
 
     if (arg == NULL)
 	return 0;
 
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&_numeric_mutex);
+    val = rpmExpand(arg, NULL);
+    (void) pthread_mutex_unlock(&_numeric_mutex);
+#else
     val = rpmExpand(arg, NULL);
+#endif
     if (!(val && *val != '%'))
 	rc = 0;
     else if (*val == 'Y' || *val == 'y')
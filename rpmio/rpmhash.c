@@ -4,6 +4,13 @@
  */
 
 #include "system.h"
+
+#if defined(__AVX2__)
+#include <immintrin.h>
+#elif defined(__SSE2__)
+#include <emmintrin.h>
+#endif
+
 #include <rpmiotypes.h>
 #include <rpmio.h>
 #include <rpmhash.h>
@@ -14,25 +21,76 @@ int _ht_debug = 0;
 
 typedef /*@owned@*/ const void * voidptr;
 
-typedef	struct hashBucket_s * hashBucket;
+/*
+ * The table is a flat, open-addressed array of entries with a parallel
+ * array of one-octet control tags.  A control tag is either HT_EMPTY (high
+ * bit set) or the 7 high bits of the (mixed) key hash.  Probing compares
+ * a whole group of tags at once (SSE2/AVX2 when available), and only the
+ * entries whose tag matches are checked with ht->eq.  The control array
+ * carries a copy of its first group past the end so that unaligned group
+ * loads never need to wrap.
+ *
+ * The values attached to a key are kept in arena-allocated vectors so that
+ * growing the table never moves them, and a (data, dataCount) pair returned
+ * by htGetEntry() stays valid until more values are added to that key.
+ */
+#if defined(__AVX2__)
+#define	HT_GROUP	32
+#elif defined(__SSE2__)
+#define	HT_GROUP	16
+#else
+#define	HT_GROUP	8
+#endif
+
+#define	HT_EMPTY	((unsigned char)0x80)
+
+/* Maximum load factor is 7/8. */
+#define	HT_MAXLOAD(_capacity)	((_capacity) - (_capacity) / 8)
+
+typedef	struct hashEntry_s * hashEntry;
 
 /**
  */
-struct hashBucket_s {
+struct hashEntry_s {
     voidptr key;			/*!< hash key */
 /*@owned@*/ voidptr * data;		/*!< pointer to hashed data */
-    int dataCount;			/*!< length of data (0 if unknown) */
-/*@dependent@*/hashBucket next;		/*!< pointer to next item in bucket */
+    rpmuint32_t dataCount;		/*!< length of data */
+    rpmuint32_t hash;			/*!< hash value of key */
+};
+
+typedef	struct hashArena_s * hashArena;
+
+/**
+ * Octets allocated for the values (and copied keys) of a table.
+ */
+struct hashArena_s {
+/*@null@*/
+    hashArena next;			/*!< previous arena chunk */
+    size_t used;			/*!< no. of octets used */
+    size_t size;			/*!< no. of octets in b[] */
+    double b[1];			/*!< arena octets (aligned) */
 };
 
+#define	HT_ARENA_SIZE	(64 * 1024)
+#define	HT_NCLASSES	32
+
 /**
  */
 struct hashTable_s {
     struct rpmioItem_s _item;	/*!< usage mutex and pool identifier. */
-    int numBuckets;			/*!< number of hash buckets */
+    size_t mask;			/*!< no. of entries - 1 */
+    size_t nkeys;			/*!< no. of keys in table */
+    size_t growth;			/*!< no. of inserts before resize */
     size_t keySize;			/*!< size of key (0 if unknown) */
     int freeData;	/*!< should data be freed when table is destroyed? */
-    hashBucket * buckets;		/*!< hash bucket array */
+/*@owned@*/
+    unsigned char * ctrl;		/*!< control tags (+ HT_GROUP mirror) */
+/*@owned@*/
+    hashEntry entries;			/*!< entry array */
+/*@owned@*/ /*@null@*/
+    hashArena arena;			/*!< value/key storage */
+/*@dependent@*/ /*@null@*/
+    voidptr * avail[HT_NCLASSES];	/*!< free value vectors, by size class */
 /*@relnull@*/
     hashFunctionType fn;		/*!< generate hash value for key */
 /*@relnull@*/
@@ -43,28 +101,259 @@ struct hashTable_s {
 #endif
 };
 
+/**
+ * Return no. of trailing zero bits.
+ * @param mask		non-zero bit mask
+ * @return		index of lowest set bit
+ */
+static inline unsigned htCtz(rpmuint32_t mask)
+	/*@*/
+{
+#if defined(__GNUC__)
+    return (unsigned) __builtin_ctz(mask);
+#else
+    unsigned n = 0;
+    while (!(mask & 1)) {
+	mask >>= 1;
+	n++;
+    }
+    return n;
+#endif
+}
+
+/**
+ * Return bit mask of group members matching a control tag.
+ * @param g		control group
+ * @param tag		control tag to match
+ * @return		bit i is set if g[i] == tag
+ */
+static inline rpmuint32_t htMatch(const unsigned char * g, unsigned char tag)
+	/*@*/
+{
+#if defined(__AVX2__)
+    __m256i grp = _mm256_loadu_si256((const __m256i *)g);
+    return (rpmuint32_t)
+	_mm256_movemask_epi8(_mm256_cmpeq_epi8(grp, _mm256_set1_epi8((char)tag)));
+#elif defined(__SSE2__)
+    __m128i grp = _mm_loadu_si128((const __m128i *)g);
+    return (rpmuint32_t)
+	_mm_movemask_epi8(_mm_cmpeq_epi8(grp, _mm_set1_epi8((char)tag)));
+#else
+    rpmuint32_t mask = 0;
+    int i;
+    for (i = 0; i < HT_GROUP; i++)
+	if (g[i] == tag)
+	    mask |= (1U << i);
+    return mask;
+#endif
+}
+
+/**
+ * Return bit mask of empty group members.
+ * @param g		control group
+ * @return		bit i is set if g[i] is HT_EMPTY
+ */
+static inline rpmuint32_t htMatchEmpty(const unsigned char * g)
+	/*@*/
+{
+#if defined(__AVX2__)
+    return (rpmuint32_t)
+	_mm256_movemask_epi8(_mm256_loadu_si256((const __m256i *)g));
+#elif defined(__SSE2__)
+    return (rpmuint32_t)
+	_mm_movemask_epi8(_mm_loadu_si128((const __m128i *)g));
+#else
+    return htMatch(g, HT_EMPTY);
+#endif
+}
+
+/**
+ * Scramble a key hash so that both the probe start (low bits) and the
+ * control tag (high bits) depend on every bit of the key hash.
+ * @param hash		key hash
+ * @return		mixed hash
+ */
+static inline rpmuint64_t htMix(rpmuint32_t hash)
+	/*@*/
+{
+    return (rpmuint64_t)hash * 0x9e3779b97f4a7c15ULL;
+}
+
+#define	HT_H1(_m)	((size_t)((_m) >> 25))
+#define	HT_H2(_m)	((unsigned char)((_m) >> 57))
+
+/**
+ * Set an entry's control tag, keeping the mirrored group in sync.
+ * @param ht		hash table
+ * @param i		entry index
+ * @param tag		control tag
+ */
+static inline void htSetCtrl(hashTable ht, size_t i, unsigned char tag)
+	/*@modifies ht @*/
+{
+    ht->ctrl[i] = tag;
+    if (i < HT_GROUP)
+	ht->ctrl[i + ht->mask + 1] = tag;
+}
+
+/**
+ * Allocate octets from the table arena.
+ * @param ht		hash table
+ * @param nb		no. of octets
+ * @return		aligned (and uninitialized) storage
+ */
+static void * htArenaAlloc(hashTable ht, size_t nb)
+	/*@modifies ht @*/
+{
+    hashArena a = ht->arena;
+    void * p;
+
+    nb = (nb + sizeof(a->b[0]) - 1) & ~(sizeof(a->b[0]) - 1);
+    if (a == NULL || a->used + nb > a->size) {
+	size_t size = (nb > HT_ARENA_SIZE ? nb : HT_ARENA_SIZE);
+	a = xmalloc(sizeof(*a) + size);
+	a->next = ht->arena;
+	a->used = 0;
+	a->size = size;
+	ht->arena = a;
+    }
+    p = ((char *)a->b) + a->used;
+    a->used += nb;
+    return p;
+}
+
+/**
+ * Append a value to an entry's value vector.
+ * Vectors hold a power of 2 values: a full vector is replaced by one
+ * twice the size, and the old vector is kept for reuse.
+ * @param ht		hash table
+ * @param b		hash entry
+ * @param data		value to append
+ */
+static void htAppendData(hashTable ht, hashEntry b, const void * data)
+	/*@modifies ht, b @*/
+{
+    rpmuint32_t n = b->dataCount;
+
+    if ((n & (n - 1)) == 0) {		/* 0 or a power of 2: vector is full */
+	unsigned c = (n ? htCtz(n) + 1 : 0);
+	voidptr * v;
+
+	if ((v = ht->avail[c]) != NULL)
+	    ht->avail[c] = *(voidptr **)v;
+	else
+	    v = htArenaAlloc(ht, sizeof(*v) << c);
+	if (n > 0) {
+	    memcpy(v, b->data, n * sizeof(*v));
+	    c--;
+	    *(voidptr **)b->data = ht->avail[c];
+	    ht->avail[c] = b->data;
+	}
+	b->data = v;
+    }
+    b->data[b->dataCount++] = data;
+}
+
 /**
  * Find entry in hash table.
  * @param ht            pointer to hash table
  * @param key           pointer to key value
- * @return pointer to hash bucket of key (or NULL)
+ * @param hash		hash value of key
+ * @retval *slotp	free entry index to insert key (if not found)
+ * @return pointer to hash entry of key (or NULL)
  */
 static /*@shared@*/ /*@null@*/
-hashBucket findEntry(hashTable ht, const void * key)
-	/*@*/
+hashEntry findEntry(hashTable ht, const void * key, rpmuint32_t hash,
+		/*@null@*/ size_t * slotp)
+	/*@modifies *slotp @*/
 {
-    rpmuint32_t hash = 0;
-    hashBucket b;
+    rpmuint64_t m = htMix(hash);
+    unsigned char tag = HT_H2(m);
+    size_t pos = HT_H1(m) & ht->mask;
+    size_t stride = 0;
 
     /*@-modunconnomods@*/
-    hash = ht->fn(hash, key, 0) % ht->numBuckets;
-    b = ht->buckets[hash];
-
-    while (b && b->key && ht->eq(b->key, key))
-	b = b->next;
+    for (;;) {
+	const unsigned char * g = ht->ctrl + pos;
+	rpmuint32_t match = htMatch(g, tag);
+	rpmuint32_t empty;
+
+	while (match) {
+	    hashEntry b = ht->entries + ((pos + htCtz(match)) & ht->mask);
+	    if (b->hash == hash && !ht->eq(b->key, key))
+		return b;
+	    match &= match - 1;
+	}
+	if ((empty = htMatchEmpty(g)) != 0) {
+	    if (slotp)
+		*slotp = (pos + htCtz(empty)) & ht->mask;
+	    return NULL;
+	}
+	stride += HT_GROUP;
+	pos = (pos + stride) & ht->mask;
+    }
     /*@=modunconnomods@*/
+    /*@notreached@*/
+}
 
-    return b;
+/**
+ * Return index of first free entry for a hash (no keys are compared).
+ * @param ht            pointer to hash table
+ * @param hash		hash value of key
+ * @return		free entry index
+ */
+static size_t findFree(hashTable ht, rpmuint32_t hash)
+	/*@*/
+{
+    size_t pos = HT_H1(htMix(hash)) & ht->mask;
+    size_t stride = 0;
+    rpmuint32_t empty;
+
+    while ((empty = htMatchEmpty(ht->ctrl + pos)) == 0) {
+	stride += HT_GROUP;
+	pos = (pos + stride) & ht->mask;
+    }
+    return (pos + htCtz(empty)) & ht->mask;
+}
+
+/**
+ * Allocate (empty) entry and control arrays.
+ * @param ht            pointer to hash table
+ * @param capacity	no. of entries (a power of 2, >= HT_GROUP)
+ */
+static void htAllocEntries(hashTable ht, size_t capacity)
+	/*@modifies ht @*/
+{
+    ht->mask = capacity - 1;
+    ht->growth = HT_MAXLOAD(capacity) - ht->nkeys;
+    ht->ctrl = xmalloc(capacity + HT_GROUP);
+    memset(ht->ctrl, HT_EMPTY, capacity + HT_GROUP);
+    ht->entries = xmalloc(capacity * sizeof(*ht->entries));
+}
+
+/**
+ * Double the size of a hash table, rehashing with stored key hashes.
+ * @param ht            pointer to hash table
+ */
+static void htResize(hashTable ht)
+	/*@modifies ht @*/
+{
+    size_t ocapacity = ht->mask + 1;
+    unsigned char * octrl = ht->ctrl;
+    hashEntry oentries = ht->entries;
+    size_t i;
+
+    htAllocEntries(ht, 2 * ocapacity);
+    for (i = 0; i < ocapacity; i++) {
+	size_t j;
+	if (octrl[i] & HT_EMPTY)
+	    continue;
+	j = findFree(ht, oentries[i].hash);
+	htSetCtrl(ht, j, octrl[i]);
+	ht->entries[j] = oentries[i];
+    }
+    octrl = _free(octrl);
+    oentries = _free(oentries);
 }
 
 int hashEqualityString(const void * key1, const void * key2)
@@ -143,53 +432,53 @@ rpmuint32_t hashFunctionString(rpmuint32_t h, const void * data, size_t size)
 
 void htAddEntry(hashTable ht, const void * key, const void * data)
 {
-    rpmuint32_t hash = 0;
-    hashBucket b;
-
-    hash = ht->fn(hash, key, 0) % ht->numBuckets;
-    b = ht->buckets[hash];
-
-    while (b && b->key && ht->eq(b->key, key))
-	b = b->next;
-
-    if (b == NULL) {
-	b = xmalloc(sizeof(*b));
+    rpmuint32_t hash = ht->fn(0, key, 0);
+    size_t i = 0;
+    hashEntry b;
+
+    if ((b = findEntry(ht, key, hash, &i)) == NULL) {
+	if (ht->growth == 0) {
+	    htResize(ht);
+	    i = findFree(ht, hash);
+	}
+	b = ht->entries + i;
 	if (ht->keySize) {
-	    char *k = xmalloc(ht->keySize);
+	    char *k = htArenaAlloc(ht, ht->keySize);
 	    memcpy(k, key, ht->keySize);
 	    b->key = k;
 	} else {
 	    b->key = key;
 	}
-	b->dataCount = 0;
-	b->next = ht->buckets[hash];
 	b->data = NULL;
-	ht->buckets[hash] = b;
+	b->dataCount = 0;
+	b->hash = hash;
+	htSetCtrl(ht, i, HT_H2(htMix(hash)));
+	ht->nkeys++;
+	ht->growth--;
     }
 
-    b->data = xrealloc(b->data, sizeof(*b->data) * (b->dataCount + 1));
-    b->data[b->dataCount++] = data;
+    htAppendData(ht, b, data);
 }
 
 int htHasEntry(hashTable ht, const void * key)
 {
-    hashBucket b;
+    hashEntry b;
 
-    if (!(b = findEntry(ht, key))) return 0; else return 1;
+    if (!(b = findEntry(ht, key, ht->fn(0, key, 0), NULL))) return 0; else return 1;
 }
 
 int htGetEntry(hashTable ht, const void * key, const void * data,
 	       int * dataCount, const void * tableKey)
 {
-    hashBucket b;
+    hashEntry b;
 
-    if ((b = findEntry(ht, key)) == NULL)
+    if ((b = findEntry(ht, key, ht->fn(0, key, 0), NULL)) == NULL)
 	return 1;
 
     if (data)
 	*(const void ***)data = (const void **) b->data;
     if (dataCount)
-	*dataCount = b->dataCount;
+	*dataCount = (int) b->dataCount;
     if (tableKey)
 	*(const void **)tableKey = b->key;
 
@@ -198,22 +487,14 @@ int htGetEntry(hashTable ht, const void * key, const void * data,
 
 const void ** htGetKeys(hashTable ht)
 {
-    const void ** keys = xcalloc(ht->numBuckets+1, sizeof(const void*));
+    const void ** keys = xcalloc(ht->nkeys+1, sizeof(const void*));
     const void ** keypointer = keys;
-    hashBucket b, n;
-    int i;
+    size_t i;
 
-    for (i = 0; i < ht->numBuckets; i++) {
-	b = ht->buckets[i];
-	if (b == NULL)
+    for (i = 0; i <= ht->mask; i++) {
+	if (ht->ctrl[i] & HT_EMPTY)
 	    continue;
-	if (b->data)
-	    *(keys++) = b->key;
-	do {
-	    n = b->next;
-	    if(n != NULL)
-    		*(keys++) = n->key;
-	} while ((b = n) != NULL);
+	*(keys++) = ht->entries[i].key;
     }
 
     return keypointer;
@@ -224,28 +505,27 @@ static void htFini(void * _ht)
 	/*@modifies _ht @*/
 {
     hashTable ht = _ht;
-    hashBucket b, n;
-    int i;
-
-    for (i = 0; i < ht->numBuckets; i++) {
-	b = ht->buckets[i];
-	if (b == NULL)
+    hashArena a;
+    size_t i;
+
+    /* XXX only the first value of each key is owned by the table. */
+    if (ht->freeData)
+    for (i = 0; i <= ht->mask; i++) {
+	hashEntry b = ht->entries + i;
+	if (ht->ctrl[i] & HT_EMPTY)
 	    continue;
-	ht->buckets[i] = NULL;
-	if (ht->keySize > 0)
-	    b->key = _free(b->key);
-	do {
-	    n = b->next;
-	    if (b->data) {
-		if (ht->freeData)
-		    *b->data = _free(*b->data);
-		b->data = _free(b->data);
-	    }
-	    b = _free(b);
-	} while ((b = n) != NULL);
+	if (b->dataCount > 0)
+	    b->data[0] = _free(b->data[0]);
     }
 
-    ht->buckets = _free(ht->buckets);
+    while ((a = ht->arena) != NULL) {
+	ht->arena = a->next;
+	a = _free(a);
+    }
+    memset(ht->avail, 0, sizeof(ht->avail));
+    ht->ctrl = _free(ht->ctrl);
+    ht->entries = _free(ht->entries);
+    ht->nkeys = 0;
 }
 /*@=mustmod@*/
 
@@ -270,9 +550,16 @@ hashTable htCreate(int numBuckets, size_t keySize, int freeData,
 		hashFunctionType fn, hashEqualityType eq)
 {
     hashTable ht = htGetPool(_htPool);
+    size_t capacity = HT_GROUP;
+
+    /* Size the table so that numBuckets keys fit without resizing. */
+    while (numBuckets > 0 && HT_MAXLOAD(capacity) < (size_t)numBuckets)
+	capacity <<= 1;
 
-    ht->numBuckets = numBuckets;
-    ht->buckets = xcalloc(numBuckets, sizeof(*ht->buckets));
+    ht->nkeys = 0;
+    ht->arena = NULL;
+    memset(ht->avail, 0, sizeof(ht->avail));
+    htAllocEntries(ht, capacity);
     ht->keySize = keySize;
     ht->freeData = freeData;
     /*@-assignexpose@*/
@@ -67,6 +67,8 @@ void htAddEntry(hashTable ht, /*@owned@*/ const void * key,
 
 /**
  * Retrieve item from hash table.
+ * The returned data array remains valid until another item is added
+ * with the same key.
  * @param ht		pointer to hash table
  * @param key		pointer to key value
  * @retval *data	data value from bucket
@@ -135,7 +137,8 @@ hashTable htFree( /*@only@*/ hashTable ht)
  * Create hash table.
  * If keySize > 0, the key is duplicated within the table (which costs
  * memory, but may be useful anyway.
- * @param numBuckets    number of hash buckets
+ * The table grows automatically, numBuckets is only a sizing hint.
+ * @param numBuckets    expected number of keys
  * @param keySize       size of key (0 if unknown)
  * @param freeData      Should data be freed when table is destroyed?
  * @param fn            function to generate hash key (NULL for default)
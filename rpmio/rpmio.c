@@ -62,6 +62,11 @@ extern void freeaddrinfo (/*@only@*/ struct addrinfo *__ai)
 #include <lzma.h>
 #endif
 
+#if defined(HAVE_LINUX_FS_H)
+#include <sys/ioctl.h>
+#include <linux/fs.h>		/* XXX FICLONE */
+#endif
+
 #include <rpmiotypes.h>
 #include <rpmmacro.h>		/* XXX rpmioAccess needs rpmCleanPath() */
 
@@ -1545,11 +1550,128 @@ static void urlSetCallback(rpmCallbackFunction notify, void *notifyData, int not
 }
 #endif
 
+/**
+ * Bytes moved by each copy path.
+ * XXX not thread safe, copies are (so far) done serially.
+ */
+/*@unchecked@*/
+static struct rpmop_s fdcopy_ops[FDCOPY_MAX];
+
+rpmop fdCopyOp(fdCopyPath path)
+{
+    return ((int)path >= 0 && path < FDCOPY_MAX ? fdcopy_ops + path : NULL);
+}
+
+/**
+ * Return file type of an unstacked, undigested local fdio/ufdio fd.
+ * @param fd		file handle
+ * @return		file type (S_IFMT bits), 0 if not a plain fd
+ */
+static mode_t fdPlainType(FD_t fd)
+	/*@globals fileSystem @*/
+	/*@modifies fileSystem @*/
+{
+    struct stat sb;
+    FDIO_t iof = fdGetIo(fd);
+
+    if (fd->nfps != 0 || !(iof == fdio || iof == ufdio))
+	return 0;
+    if (fd->ndigests > 0 || fd->req != NULL || fd->xar != NULL)
+	return 0;
+    if (fdFileno(fd) < 0 || fstat(fdFileno(fd), &sb) < 0)
+	return 0;
+    return (sb.st_mode & S_IFMT);
+}
+
+size_t fdCopy(FD_t sfd, FD_t tfd, size_t nb)
+{
+    struct rpmop_s op;
+    fdCopyPath path = FDCOPY_MAX;
+    mode_t stype;
+    mode_t ttype;
+    int sfdno;
+    int tfdno;
+    size_t left = nb;
+
+    FDSANE(sfd);
+    FDSANE(tfd);
+    stype = fdPlainType(sfd);
+    ttype = fdPlainType(tfd);
+    sfdno = fdFileno(sfd);
+    tfdno = fdFileno(tfd);
+
+    memset(&op, 0, sizeof(op));
+    (void) rpmswEnter(&op, 0);
+    fdstat_enter(sfd, FDSTAT_READ);
+    fdstat_enter(tfd, FDSTAT_WRITE);
+
+    if (S_ISREG(stype) && S_ISREG(ttype)) {
+#if defined(FICLONE)
+	struct stat ssb, tsb;
+	/* Share the extents (btrfs/xfs reflink) when copying a whole file. */
+	if (fstat(sfdno, &ssb) == 0 && fstat(tfdno, &tsb) == 0
+	 && tsb.st_size == 0 && (nb == (size_t)-1 || nb == (size_t)ssb.st_size)
+	 && lseek(sfdno, 0, SEEK_CUR) == 0 && lseek(tfdno, 0, SEEK_CUR) == 0
+	 && ioctl(tfdno, FICLONE, sfdno) == 0)
+	{
+	    (void) lseek(sfdno, ssb.st_size, SEEK_SET);
+	    (void) lseek(tfdno, ssb.st_size, SEEK_SET);
+	    path = FDCOPY_CLONE;
+	    left -= (size_t) ssb.st_size;
+	    goto exit;
+	}
+#endif
+#if defined(HAVE_COPY_FILE_RANGE)
+	path = FDCOPY_RANGE;
+	while (left > 0) {
+	    size_t len = (left > 0x40000000 ? 0x40000000 : left);
+	    ssize_t rc = copy_file_range(sfdno, NULL, tfdno, NULL, len, 0);
+	    if (rc < 0 && errno == EINTR)
+		continue;
+	    /* XXX EXDEV, ENOSYS et al: the caller reads/writes the rest. */
+	    if (rc <= 0)
+		break;
+	    left -= rc;
+	}
+#endif
+    }
+#if defined(HAVE_SPLICE)
+    else if ((S_ISREG(stype) || S_ISFIFO(stype))
+	  && (S_ISREG(ttype) || S_ISFIFO(ttype)))
+    {
+	/* One end is a pipe (e.g. to an external compressor). */
+	path = FDCOPY_SPLICE;
+	while (left > 0) {
+	    size_t len = (left > 0x40000000 ? 0x40000000 : left);
+	    ssize_t rc = splice(sfdno, NULL, tfdno, NULL, len, SPLICE_F_MOVE);
+	    if (rc < 0 && errno == EINTR)
+		continue;
+	    if (rc <= 0)
+		break;
+	    left -= rc;
+	}
+    }
+#endif
+
+exit:
+    nb -= left;
+    fdstat_exit(sfd, FDSTAT_READ, (ssize_t) nb);
+    fdstat_exit(tfd, FDSTAT_WRITE, (ssize_t) nb);
+    (void) rpmswExit(&op, nb);
+    if (nb > 0 && path < FDCOPY_MAX)
+	(void) rpmswAdd(fdCopyOp(path), &op);
+
+DBGIO(sfd, (stderr, "==>\tfdCopy(%p,%p) path %d copied %lu bytes\n", sfd, tfd, (int)path, (unsigned long) nb));
+    return nb;
+}
+
 int ufdCopy(FD_t sfd, FD_t tfd)
 {
+    struct rpmop_s op;
     char buf[BUFSIZ];
     int itemsRead;
     int itemsCopied = 0;
+    int ncopied;
     int rc = 0;
 #ifdef	DYING
     int notifier = -1;
@@ -1562,6 +1684,11 @@ int ufdCopy(FD_t sfd, FD_t tfd)
     }
 #endif
 
+    /* Let the kernel copy between local files, read/write the rest. */
+    itemsCopied = ncopied = (int) fdCopy(sfd, tfd, (size_t)-1);
+
+    memset(&op, 0, sizeof(op));
+    (void) rpmswEnter(&op, 0);
     while (1) {
 	rc = (int) Fread(buf, sizeof(buf[0]), sizeof(buf), sfd);
 	if (rc < 0)	/* XXX never happens Fread returns size_t */
@@ -1594,6 +1721,10 @@ int ufdCopy(FD_t sfd, FD_t tfd)
 #endif
     }
 
+    (void) rpmswExit(&op, itemsCopied - ncopied);
+    if (itemsCopied > ncopied)
+	(void) rpmswAdd(fdCopyOp(FDCOPY_RW), &op);
+
     DBGIO(sfd, (stderr, "++ copied %d bytes: %s\n", itemsCopied,
 	ftpStrerror(rc)));
 
@@ -3221,6 +3352,7 @@ void rpmioClean(void)
 /*@-shadow@*/
     extern rpmioPool _mirePool;
     extern rpmioPool _rpmbfPool;
+    extern rpmioPool _rpmstrPoolPool;
     extern rpmioPool _rpmhkpPool;
     extern rpmioPool _htmlPool;
     extern rpmioPool _htPool;
@@ -3325,6 +3457,7 @@ void rpmioClean(void)
     _mirePool = rpmioFreePool(_mirePool);
     _rpmmgPool = rpmioFreePool(_rpmmgPool);
     _rpmbfPool = rpmioFreePool(_rpmbfPool);
+    _rpmstrPoolPool = rpmioFreePool(_rpmstrPoolPool);
     _htPool = rpmioFreePool(_htPool);
     _ctxPool = rpmioFreePool(_ctxPool);
     _rpmsyckPool = rpmioFreePool(_rpmsyckPool);
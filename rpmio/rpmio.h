@@ -707,6 +707,41 @@ const char * urlStrerror(const char * url)
 	/*@modifies internalState @*/;
 /*@=redecl@*/
 
+/**
+ * Paths used to copy bytes between file handles.
+ */
+typedef enum fdCopyPath_e {
+    FDCOPY_RW		= 0,	/*!< read/write through a buffer */
+    FDCOPY_CLONE	= 1,	/*!< FICLONE ioctl (btrfs/xfs reflink) */
+    FDCOPY_RANGE	= 2,	/*!< copy_file_range(2) */
+    FDCOPY_SPLICE	= 3,	/*!< splice(2) from/to a pipe */
+    FDCOPY_MAX		= 4
+} fdCopyPath;
+
+/**
+ * Return statistics of bytes moved by a copy path.
+ * @param path		copy path
+ * @return		copy path statistics
+ */
+/*@null@*/
+struct rpmop_s * fdCopyOp(fdCopyPath path)
+	/*@*/;
+
+/**
+ * Copy bytes between (unstacked fdio/ufdio) local files in the kernel.
+ * Files are reflinked, copy_file_range'd, or spliced to/from pipes at
+ * the current offsets, which are advanced. Whatever is not copied (e.g.
+ * across file systems, or with stacked/digested fd's) is left for the
+ * caller to read/write.
+ * @param sfd		source file handle
+ * @param tfd		target file handle
+ * @param nb		no. of bytes to copy ((size_t)-1 copies to EOF)
+ * @return		no. of bytes copied
+ */
+size_t fdCopy(FD_t sfd, FD_t tfd, size_t nb)
+	/*@globals errno, fileSystem, internalState @*/
+	/*@modifies sfd, tfd, errno, fileSystem, internalState @*/;
+
 /**
  */
 /*@-exportlocal@*/
@@ -14,6 +14,9 @@
 static int nrecs = 0;
 /*@unchecked@*/
 static /*@only@*/ /*@null@*/ rpmlogRec recs = NULL;
+/* Messages may be logged from (payload unpack) threads. */
+/*@unchecked@*/
+static pthread_mutex_t recs_mutex = PTHREAD_MUTEX_INITIALIZER;
 
 /**
  * Wrapper to free(3), hides const compilation noise, permit NULL, return NULL.
@@ -81,6 +84,7 @@ void rpmlogClose (void)
 {
     int i;
 
+    (void) pthread_mutex_lock(&recs_mutex);
     if (recs)
     for (i = 0; i < nrecs; i++) {
 	rpmlogRec rec = recs + i;
@@ -88,6 +92,7 @@ void rpmlogClose (void)
     }
     recs = _free(recs);
     nrecs = 0;
+    (void) pthread_mutex_unlock(&recs_mutex);
 }
 
 void rpmlogOpen (/*@unused@*/ const char *ident,
@@ -257,6 +262,7 @@ void vrpmlog (unsigned code, const char *fmt, va_list ap)
 
     /* Save copy of all messages at warning (or below == "more important"). */
     if (pri <= RPMLOG_WARNING) {
+	(void) pthread_mutex_lock(&recs_mutex);
 	if (recs == NULL)
 	    recs = xmalloc((nrecs+2) * sizeof(*recs));
 	else
@@ -268,6 +274,7 @@ void vrpmlog (unsigned code, const char *fmt, va_list ap)
 	recs[nrecs].code = 0;
 	recs[nrecs].pri = 0;
 	recs[nrecs].message = NULL;
+	(void) pthread_mutex_unlock(&recs_mutex);
     }
 
     if (_rpmlogCallback) {
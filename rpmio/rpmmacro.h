@@ -298,6 +298,7 @@ const char * rpmGenPath(/*@null@*/ const char * urlroot,
  * Return macro expansion as a numeric value.
  * Boolean values ('Y' or 'y' returns 1, 'N' or 'n' returns 0)
  * are permitted as well. An undefined macro returns 0.
+ * Concurrent calls (e.g. from payload unpack threads) are serialized.
  * @param arg		macro to expand
  * @return		numeric value
  */
@@ -0,0 +1,223 @@
+/** \ingroup rpmio
+ * \file rpmio/rpmstrpool.c
+ */
+
+#include "system.h"
+
+#include <rpmiotypes.h>
+#include <rpmio.h>	/* for *Pool methods */
+#include <rpmhash.h>	/* XXX hashFunctionString */
+
+#define	_RPMSTRPOOL_INTERNAL
+#include <rpmstrpool.h>
+
+#include "debug.h"
+
+/*@unchecked@*/
+int _rpmstrpool_debug = 0;
+
+/** Default no. of bytes in a string storage chunk. */
+#define	STRPOOL_CHUNK	(64 * 1024)
+
+/*@-mustmod@*/	/* XXX splint on crack */
+static void rpmstrPoolFini(void * _pool)
+	/*@modifies *_pool @*/
+{
+    rpmstrPool pool = _pool;
+    size_t i;
+
+if (_rpmstrpool_debug)
+rpmstrPoolPrintStats(pool, NULL);
+
+    for (i = 0; i < pool->nchunks; i++)
+	pool->chunks[i] = _free(pool->chunks[i]);
+    pool->chunks = _free(pool->chunks);
+    pool->nchunks = 0;
+    pool->strs = _free(pool->strs);
+    pool->hashes = _free(pool->hashes);
+    pool->slots = _free(pool->slots);
+    pool->nstrs = pool->astrs = pool->nslots = 0;
+    pool->lock = yarnFreeLock(pool->lock);
+}
+/*@=mustmod@*/
+
+/*@unchecked@*/ /*@only@*/ /*@null@*/
+rpmioPool _rpmstrPoolPool = NULL;
+
+static rpmstrPool rpmstrPoolGetPool(/*@null@*/ rpmioPool pool)
+	/*@globals _rpmstrPoolPool, fileSystem @*/
+	/*@modifies pool, _rpmstrPoolPool, fileSystem @*/
+{
+    rpmstrPool sp;
+
+    if (_rpmstrPoolPool == NULL) {
+	_rpmstrPoolPool = rpmioNewPool("strpool", sizeof(*sp), -1,
+			_rpmstrpool_debug, NULL, NULL, rpmstrPoolFini);
+	pool = _rpmstrPoolPool;
+    }
+    sp = (rpmstrPool) rpmioGetPool(pool, sizeof(*sp));
+    memset(((char *)sp)+sizeof(sp->_item), 0, sizeof(*sp)-sizeof(sp->_item));
+    return sp;
+}
+
+rpmstrPool rpmstrPoolNew(size_t nstrs)
+{
+    rpmstrPool pool = rpmstrPoolGetPool(_rpmstrPoolPool);
+
+    if (nstrs == 0)
+	nstrs = 1024;
+    pool->lock = yarnNewLock(0);
+    pool->astrs = nstrs + 1;
+    pool->strs = xcalloc(pool->astrs, sizeof(*pool->strs));
+    pool->hashes = xcalloc(pool->astrs, sizeof(*pool->hashes));
+    pool->nstrs = 1;		/* id 0 is reserved */
+    for (pool->nslots = 16; pool->nslots < 2 * nstrs; pool->nslots <<= 1)
+	{};
+    pool->slots = xcalloc(pool->nslots, sizeof(*pool->slots));
+
+    return rpmstrPoolLink(pool);
+}
+
+/**
+ * Return the slot that holds (or should hold) a string.
+ * @param pool		string pool
+ * @param s		string
+ * @param ns		no. of bytes in string
+ * @param hash		string hash
+ * @return		slot index
+ */
+static size_t strpoolSlot(rpmstrPool pool, const char * s, size_t ns,
+		rpmuint32_t hash)
+	/*@*/
+{
+    size_t mask = pool->nslots - 1;
+    size_t i = hash & mask;
+    rpmsid sid;
+
+    /* Linear probing, the table is at most half full. */
+    while ((sid = pool->slots[i]) != 0) {
+	if (pool->hashes[sid] == hash
+	 && !strncmp(pool->strs[sid], s, ns) && pool->strs[sid][ns] == '\0')
+	    break;
+	i = (i + 1) & mask;
+    }
+    return i;
+}
+
+/**
+ * Double the id table, rehashing with the saved hashes.
+ * @param pool		string pool
+ */
+static void strpoolGrow(rpmstrPool pool)
+	/*@modifies pool @*/
+{
+    size_t nslots = 2 * pool->nslots;
+    size_t mask = nslots - 1;
+    rpmsid * slots = xcalloc(nslots, sizeof(*slots));
+    rpmsid sid;
+
+    for (sid = 1; sid < (rpmsid) pool->nstrs; sid++) {
+	size_t i = pool->hashes[sid] & mask;
+	while (slots[i] != 0)
+	    i = (i + 1) & mask;
+	slots[i] = sid;
+    }
+    pool->slots = _free(pool->slots);
+    pool->slots = slots;
+    pool->nslots = nslots;
+}
+
+/**
+ * Copy a string into pool storage.
+ * @param pool		string pool
+ * @param s		string
+ * @param ns		no. of bytes in string
+ * @return		stored string
+ */
+static const char * strpoolStore(rpmstrPool pool, const char * s, size_t ns)
+	/*@modifies pool @*/
+{
+    char * t;
+
+    /* Strings never move: start a new chunk rather than realloc. */
+    if (pool->nchunks == 0 || pool->chunkused + ns + 1 > pool->chunksize) {
+	pool->chunksize = (ns + 1 > STRPOOL_CHUNK ? ns + 1 : STRPOOL_CHUNK);
+	pool->chunks = xrealloc(pool->chunks,
+			(pool->nchunks + 1) * sizeof(*pool->chunks));
+	pool->chunks[pool->nchunks++] = xmalloc(pool->chunksize);
+	pool->chunkused = 0;
+    }
+    t = pool->chunks[pool->nchunks - 1] + pool->chunkused;
+    memcpy(t, s, ns);
+    t[ns] = '\0';
+    pool->chunkused += ns + 1;
+    pool->nbytes += ns + 1;
+    return t;
+}
+
+rpmsid rpmstrPoolId(rpmstrPool pool, const char * s, int create)
+{
+    rpmsid sid = 0;
+    rpmuint32_t hash;
+    size_t ns;
+    size_t i;
+
+    if (pool == NULL || s == NULL)
+	return sid;
+
+    ns = strlen(s);
+    hash = hashFunctionString(0, s, ns);
+
+    yarnPossess(pool->lock);
+    pool->nlookups++;
+    i = strpoolSlot(pool, s, ns, hash);
+    sid = pool->slots[i];
+    if (sid == 0 && create) {
+	if (pool->nstrs == pool->astrs) {
+	    pool->astrs *= 2;
+	    pool->strs = xrealloc(pool->strs,
+			pool->astrs * sizeof(*pool->strs));
+	    pool->hashes = xrealloc(pool->hashes,
+			pool->astrs * sizeof(*pool->hashes));
+	}
+	sid = (rpmsid) pool->nstrs++;
+	pool->strs[sid] = strpoolStore(pool, s, ns);
+	pool->hashes[sid] = hash;
+	pool->slots[i] = sid;
+	if (2 * pool->nstrs > pool->nslots)
+	    strpoolGrow(pool);
+    }
+    yarnRelease(pool->lock);
+
+    return sid;
+}
+
+const char * rpmstrPoolStr(rpmstrPool pool, rpmsid sid)
+{
+    const char * s = NULL;
+
+    if (pool != NULL) {
+	yarnPossess(pool->lock);
+	if (sid > 0 && sid < (rpmsid) pool->nstrs)
+	    s = pool->strs[sid];
+	yarnRelease(pool->lock);
+    }
+    return s;
+}
+
+size_t rpmstrPoolNumStr(rpmstrPool pool)
+{
+    return (pool != NULL ? pool->nstrs - 1 : 0);
+}
+
+void rpmstrPoolPrintStats(rpmstrPool pool, FILE * fp)
+{
+    if (pool == NULL)
+	return;
+    if (fp == NULL)
+	fp = stderr;
+    fprintf(fp, "   strpool: %u strings %u bytes %u lookups %u slots %u chunks\n",
+	(unsigned) (pool->nstrs - 1), (unsigned) pool->nbytes,
+	(unsigned) pool->nlookups, (unsigned) pool->nslots,
+	(unsigned) pool->nchunks);
+}
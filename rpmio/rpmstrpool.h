@@ -0,0 +1,148 @@
+#ifndef	H_RPMSTRPOOL
+#define	H_RPMSTRPOOL
+
+/** \ingroup rpmio
+ * \file rpmio/rpmstrpool.h
+ * Interned strings: each distinct string is stored once, and identified
+ * by a small integer id, so string equality becomes an integer compare.
+ */
+
+/** \ingroup rpmio
+ */
+/*@unchecked@*/
+extern int _rpmstrpool_debug;
+
+/** \ingroup rpmio
+ * String id (0 is never a valid id).
+ */
+typedef rpmuint32_t rpmsid;
+
+/** \ingroup rpmio
+ */
+typedef /*@refcounted@*/ struct rpmstrPool_s * rpmstrPool;
+
+#if defined(_RPMSTRPOOL_INTERNAL)
+#include <yarn.h>
+
+/** \ingroup rpmio
+ */
+struct rpmstrPool_s {
+    struct rpmioItem_s _item;	/*!< usage mutex and pool identifier. */
+/*@only@*/
+    yarnLock lock;		/*!< Serializes lookups and additions. */
+/*@only@*/
+    const char ** strs;		/*!< Strings, indexed by id. */
+/*@only@*/
+    rpmuint32_t * hashes;	/*!< String hashes, indexed by id. */
+    size_t nstrs;		/*!< No. of ids in use (including 0). */
+    size_t astrs;		/*!< No. of ids allocated. */
+/*@only@*/
+    rpmsid * slots;		/*!< Open addressed id table. */
+    size_t nslots;		/*!< No. of slots (a power of 2). */
+/*@only@*/ /*@null@*/
+    char ** chunks;		/*!< String storage. */
+    size_t nchunks;		/*!< No. of storage chunks. */
+    size_t chunkused;		/*!< No. of bytes used in last chunk. */
+    size_t chunksize;		/*!< No. of bytes in last chunk. */
+    size_t nbytes;		/*!< No. of string bytes stored. */
+    size_t nlookups;		/*!< No. of rpmstrPoolId() lookups. */
+#if defined(__LCLINT__)
+/*@refs@*/
+    int nrefs;			/*!< (unused) keep splint happy */
+#endif
+};
+#endif	/* _RPMSTRPOOL_INTERNAL */
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Unreference a string pool instance.
+ * @param pool		string pool
+ * @return		NULL on last dereference
+ */
+/*@unused@*/ /*@null@*/
+rpmstrPool rpmstrPoolUnlink (/*@killref@*/ /*@only@*/ /*@null@*/ rpmstrPool pool)
+	/*@modifies pool @*/;
+#define	rpmstrPoolUnlink(_pool)	\
+    ((rpmstrPool)rpmioUnlinkPoolItem((rpmioItem)(_pool), __FUNCTION__, __FILE__, __LINE__))
+
+/**
+ * Reference a string pool instance.
+ * @param pool		string pool
+ * @return		new string pool reference
+ */
+/*@unused@*/ /*@newref@*/ /*@null@*/
+rpmstrPool rpmstrPoolLink (/*@null@*/ rpmstrPool pool)
+	/*@modifies pool @*/;
+#define	rpmstrPoolLink(_pool)	\
+    ((rpmstrPool)rpmioLinkPoolItem((rpmioItem)(_pool), __FUNCTION__, __FILE__, __LINE__))
+
+/**
+ * Destroy a string pool.
+ * Strings returned by rpmstrPoolStr() are not valid after the last
+ * dereference.
+ * @param pool		string pool
+ * @return		NULL on last dereference
+ */
+/*@null@*/
+rpmstrPool rpmstrPoolFree(/*@killref@*/ /*@null@*/ rpmstrPool pool)
+	/*@modifies pool @*/;
+#define	rpmstrPoolFree(_pool)	\
+    ((rpmstrPool)rpmioFreePoolItem((rpmioItem)(_pool), __FUNCTION__, __FILE__, __LINE__))
+
+/**
+ * Create a string pool.
+ * @param nstrs		estimated no. of strings (0 uses default)
+ * @return		new string pool
+ */
+/*@newref@*/
+rpmstrPool rpmstrPoolNew(size_t nstrs)
+	/*@*/;
+
+/**
+ * Return the id of a string, adding the string if requested.
+ * @param pool		string pool
+ * @param s		string
+ * @param create	add the string if not already present?
+ * @return		string id (0 if not present or on NULL arguments)
+ */
+rpmsid rpmstrPoolId(/*@null@*/ rpmstrPool pool, /*@null@*/ const char * s,
+		int create)
+	/*@modifies pool @*/;
+
+/**
+ * Return the string of an id.
+ * The string is stored once, and remains valid (and at the same address)
+ * for the life of the pool, so equal ids imply equal string pointers.
+ * @param pool		string pool
+ * @param sid		string id
+ * @return		string (NULL on invalid id)
+ */
+/*@observer@*/ /*@null@*/
+const char * rpmstrPoolStr(/*@null@*/ rpmstrPool pool, rpmsid sid)
+	/*@*/;
+
+/**
+ * Return the no. of strings in a pool.
+ * @param pool		string pool
+ * @return		no. of strings
+ */
+size_t rpmstrPoolNumStr(/*@null@*/ rpmstrPool pool)
+	/*@*/;
+
+/**
+ * Print string pool statistics.
+ * @param pool		string pool
+ * @param fp		output file (NULL uses stderr)
+ */
+void rpmstrPoolPrintStats(/*@null@*/ rpmstrPool pool, /*@null@*/ FILE * fp)
+	/*@globals fileSystem @*/
+	/*@modifies *fp, fileSystem @*/;
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif	/* H_RPMSTRPOOL */
@@ -38,15 +38,19 @@
 
 #include "system.h"
 
-#if defined(WITH_BZIP2)
+#if defined(WITH_BZIP2) || defined(WITH_ZLIB)
+
+#include <assert.h>
 
 #include <rpmiotypes.h>
 #include <rpmlog.h>
 
+#if defined(WITH_BZIP2)
 #define	_RPMBZ_INTERNAL
 #include "rpmbz.h"
 
 /*@access rpmbz @*/
+#endif	/* WITH_BZIP2 */
 
 #include "yarn.h"
 
@@ -294,6 +298,7 @@ struct poptOption rpmzqOptionsPoptTable[] = {
 
 /*==============================================================*/
 
+#if defined(WITH_BZIP2)
 /*@-mustmod@*/
 int rpmbzCompressBlock(void * _bz, rpmzJob job)
 {
@@ -324,6 +329,7 @@ static int rpmbzDecompressBlock(rpmbz bz, rpmzJob job)
     return rc;
 }
 /*@=mustmod@*/
+#endif	/* WITH_BZIP2 */
 
 /*==============================================================*/
 
@@ -865,6 +871,7 @@ void rpmzqAddWJob(rpmzQueue zq, rpmzJob job)
     yarnTwist(zq->_zw.q->first, TO, zq->_zw.q->head->seq);
 }
 
+#if defined(WITH_BZIP2)
 static rpmzJob rpmzqFillOut(rpmzQueue zq, /*@returned@*/rpmzJob job, rpmbz bz)
 	/*@globals fileSystem, internalState @*/
 	/*@modifies zq, job, fileSystem, internalState @*/
@@ -973,10 +980,12 @@ zqFprintf(stderr, "--> %s(%p) bz %p\n", __FUNCTION__, zq, bz);
 
     bz = rpmbzFini(bz);
 }
+#endif	/* WITH_BZIP2 */
 
 /* start another compress/decompress thread if needed */
 void rpmzqLaunch(rpmzQueue zq, long seq, unsigned int threads)
 {
+#if defined(WITH_BZIP2)
     if (zq->_zc.cthreads < seq && zq->_zc.cthreads < (int)threads) {
 	switch (zq->omode) {
 	default:	assert(0);	break;
@@ -985,6 +994,7 @@ void rpmzqLaunch(rpmzQueue zq, long seq, unsigned int threads)
 	}
 	zq->_zc.cthreads++;
     }
+#endif	/* WITH_BZIP2 */
 }
 
 /* verify no more jobs, prepare for next use */
@@ -994,4 +1004,4 @@ void rpmzqVerify(rpmzQueue zq)
     rpmzqVerifySEQ(zq->_zw.q);
 }
 
-#endif /* WITH_BZIP2 */
+#endif /* WITH_BZIP2 || WITH_ZLIB */
@@ -0,0 +1,206 @@
+#include "system.h"
+#include <rpmio.h>
+#include <rpmhash.h>
+#include <rpmsw.h>
+#include "debug.h"
+
+/*
+ * Microbenchmark: rpmhash.c open addressing vs. the previous chained table.
+ *	thash [nkeys [nvalues]]
+ */
+
+/* ===== Reference: the chained hash table rpmhash.c used to implement. */
+typedef	struct refBucket_s * refBucket;
+struct refBucket_s {
+    const void * key;
+    const void ** data;
+    int dataCount;
+    refBucket next;
+};
+
+typedef struct refTable_s * refTable;
+struct refTable_s {
+    int numBuckets;
+    refBucket * buckets;
+    hashFunctionType fn;
+    hashEqualityType eq;
+};
+
+static refTable refCreate(int numBuckets)
+{
+    refTable ht = xcalloc(1, sizeof(*ht));
+    ht->numBuckets = numBuckets;
+    ht->buckets = xcalloc(numBuckets, sizeof(*ht->buckets));
+    ht->fn = hashFunctionString;
+    ht->eq = hashEqualityString;
+    return ht;
+}
+
+static refBucket refFind(refTable ht, const void * key)
+{
+    rpmuint32_t hash = ht->fn(0, key, 0) % ht->numBuckets;
+    refBucket b = ht->buckets[hash];
+
+    while (b && b->key && ht->eq(b->key, key))
+	b = b->next;
+    return b;
+}
+
+static void refAdd(refTable ht, const void * key, const void * data)
+{
+    rpmuint32_t hash = ht->fn(0, key, 0) % ht->numBuckets;
+    refBucket b = refFind(ht, key);
+
+    if (b == NULL) {
+	b = xcalloc(1, sizeof(*b));
+	b->key = key;
+	b->next = ht->buckets[hash];
+	ht->buckets[hash] = b;
+    }
+    b->data = xrealloc(b->data, sizeof(*b->data) * (b->dataCount + 1));
+    b->data[b->dataCount++] = data;
+}
+
+static int refGet(refTable ht, const void * key, const void *** data,
+		int * dataCount)
+{
+    refBucket b = refFind(ht, key);
+    if (b == NULL)
+	return 1;
+    *data = b->data;
+    *dataCount = b->dataCount;
+    return 0;
+}
+
+static void refFree(refTable ht)
+{
+    int i;
+    for (i = 0; i < ht->numBuckets; i++) {
+	refBucket b, n;
+	for (b = ht->buckets[i]; b != NULL; b = n) {
+	    n = b->next;
+	    b->data = _free(b->data);
+	    b = _free(b);
+	}
+    }
+    ht->buckets = _free(ht->buckets);
+    ht = _free(ht);
+}
+
+/* ===== Benchmark. */
+static const char * dirs[] = {
+    "/usr/bin/", "/usr/lib/", "/usr/lib64/", "/usr/share/doc/",
+    "/usr/share/man/man1/", "/usr/include/", "/etc/", "/usr/libexec/",
+};
+
+static unsigned report(const char * name, struct rpmsw_s * begin, size_t n)
+{
+    struct rpmsw_s end;
+    rpmtime_t usecs = rpmswDiff(rpmswNow(&end), begin);
+
+    fprintf(stdout, "%-28s %10u usecs %8.1f nsecs/op\n", name,
+	(unsigned) usecs, (n ? (1000.0 * usecs) / n : 0.0));
+    return (unsigned) usecs;
+}
+
+int
+main(int argc, char *argv[])
+{
+    size_t nkeys = (argc > 1 ? (size_t) atol(argv[1]) : 1000000);
+    size_t nvals = (argc > 2 ? (size_t) atol(argv[2]) : 2 * nkeys);
+    int nbuckets = (int)(nkeys / 2 + 1);	/* XXX as rpmtsPrepare() */
+    struct rpmsw_s begin;
+    char ** keys;
+    char ** miss;
+    size_t nfound;
+    size_t i;
+    int ec = EXIT_SUCCESS;
+
+    (void) rpmswInit();
+
+    keys = xcalloc(nkeys, sizeof(*keys));
+    miss = xcalloc(nkeys, sizeof(*miss));
+    for (i = 0; i < nkeys; i++) {
+	char b[BUFSIZ];
+	const char * dn = dirs[i % (sizeof(dirs)/sizeof(dirs[0]))];
+	(void) snprintf(b, sizeof(b), "%sfile-%u.%u", dn,
+		(unsigned) i, (unsigned) (i * 2654435761U) % 977);
+	keys[i] = xstrdup(b);
+	(void) snprintf(b, sizeof(b), "%smissing-%u", dn, (unsigned) i);
+	miss[i] = xstrdup(b);
+    }
+
+    fprintf(stdout, "%u keys, %u values, %u initial buckets\n",
+	(unsigned) nkeys, (unsigned) nvals, (unsigned) nbuckets);
+
+    {	refTable ht = refCreate(nbuckets);
+	const void ** data;
+	int dataCount;
+
+	(void) rpmswNow(&begin);
+	for (i = 0; i < nvals; i++)
+	    refAdd(ht, keys[i % nkeys], keys[i % nkeys]);
+	(void) report("chained: add", &begin, nvals);
+
+	(void) rpmswNow(&begin);
+	for (i = 0, nfound = 0; i < nkeys; i++)
+	    if (!refGet(ht, keys[i], &data, &dataCount))
+		nfound += dataCount;
+	(void) report("chained: lookup (hit)", &begin, nkeys);
+	if (nfound != nvals)
+	    ec = EXIT_FAILURE;
+
+	(void) rpmswNow(&begin);
+	for (i = 0, nfound = 0; i < nkeys; i++)
+	    if (!refGet(ht, miss[i], &data, &dataCount))
+		nfound++;
+	(void) report("chained: lookup (miss)", &begin, nkeys);
+	if (nfound != 0)
+	    ec = EXIT_FAILURE;
+
+	(void) rpmswNow(&begin);
+	refFree(ht);
+	(void) report("chained: free", &begin, nkeys);
+    }
+
+    {	hashTable ht = htCreate(nbuckets, 0, 0, NULL, NULL);
+	const void ** data;
+	int dataCount;
+
+	(void) rpmswNow(&begin);
+	for (i = 0; i < nvals; i++)
+	    htAddEntry(ht, keys[i % nkeys], keys[i % nkeys]);
+	(void) report("rpmhash: add", &begin, nvals);
+
+	(void) rpmswNow(&begin);
+	for (i = 0, nfound = 0; i < nkeys; i++)
+	    if (!htGetEntry(ht, keys[i], &data, &dataCount, NULL))
+		nfound += dataCount;
+	(void) report("rpmhash: lookup (hit)", &begin, nkeys);
+	if (nfound != nvals)
+	    ec = EXIT_FAILURE;
+
+	(void) rpmswNow(&begin);
+	for (i = 0, nfound = 0; i < nkeys; i++)
+	    if (!htGetEntry(ht, miss[i], &data, &dataCount, NULL))
+		nfound++;
+	(void) report("rpmhash: lookup (miss)", &begin, nkeys);
+	if (nfound != 0)
+	    ec = EXIT_FAILURE;
+
+	(void) rpmswNow(&begin);
+	ht = htFree(ht);
+	(void) report("rpmhash: free", &begin, nkeys);
+    }
+
+    for (i = 0; i < nkeys; i++) {
+	keys[i] = _free(keys[i]);
+	miss[i] = _free(miss[i]);
+    }
+    keys = _free(keys);
+    miss = _free(miss);
+
+    if (ec != EXIT_SUCCESS)
+	fprintf(stderr, "*** lookup results differ from insertions\n");
+    return ec;
+}
@@ -0,0 +1,104 @@
+#include "system.h"
+#include <rpmio.h>
+#include <rpmsw.h>
+#include "debug.h"
+
+/*
+ * Round trip and throughput of xzdio, single and multithreaded.
+ *	txzdio [MB [level [threads]]]
+ * Compressible pseudo-random data is written and read back through each
+ * pair of "w<level>[T<threads>].xzdio" and "r[T<threads>].xzdio" modes.
+ */
+
+static const char * fn = "/tmp/txzdio.xz";
+static size_t nb = 16 * 1024 * 1024;
+static int level = 6;
+static int threads = 0;		/* XXX T0 is one thread per CPU */
+
+static int run(const unsigned char * b, unsigned char * ob,
+		const char * wmode, const char * rmode)
+{
+    struct rpmsw_s begin, end;
+    rpmtime_t wusecs, rusecs;
+    size_t chunk = 100 * 1000;	/* XXX not a multiple of any block size */
+    size_t got = 0;
+    size_t n;
+    FD_t fd;
+    int rc = 0;
+
+    (void) rpmswNow(&begin);
+    fd = Fopen(fn, wmode);
+    if (fd == NULL || Ferror(fd)) {
+	fprintf(stderr, "%s: Fopen(\"%s\"): %s\n", fn, wmode, Fstrerror(fd));
+	return -1;
+    }
+    for (n = 0; n < nb; n += chunk) {
+	size_t len = (nb - n < chunk ? nb - n : chunk);
+	if (Fwrite(b + n, 1, len, fd) != len || Ferror(fd))
+	    rc = -1;
+    }
+    if (Fclose(fd))
+	rc = -1;
+    wusecs = rpmswDiff(rpmswNow(&end), &begin);
+
+    (void) rpmswNow(&begin);
+    fd = Fopen(fn, rmode);
+    if (fd == NULL || Ferror(fd)) {
+	fprintf(stderr, "%s: Fopen(\"%s\"): %s\n", fn, rmode, Fstrerror(fd));
+	return -1;
+    }
+    while ((n = Fread(ob + got, 1, 64 * 1024, fd)) > 0 && got + n <= nb)
+	got += n;
+    if (Ferror(fd))
+	rc = -1;
+    (void) Fclose(fd);
+    rusecs = rpmswDiff(rpmswNow(&end), &begin);
+
+    if (got != nb || memcmp(b, ob, nb))
+	rc = -1;
+    fprintf(stdout, "%-10s %-6s write %6.1f MB/s read %6.1f MB/s %s\n",
+	wmode, rmode,
+	(wusecs ? (double) nb / wusecs : 0.0),
+	(rusecs ? (double) nb / rusecs : 0.0),
+	(rc ? "FAILED" : "ok"));
+    return rc;
+}
+
+int
+main(int argc, char *argv[])
+{
+    unsigned char * b;
+    unsigned char * ob;
+    unsigned x = 1;
+    char wmode[32], wmodeT[32], rmodeT[32];
+    size_t i;
+    int ec = EXIT_SUCCESS;
+
+    if (argc > 1) nb = (size_t) atol(argv[1]) * 1024 * 1024;
+    if (argc > 2) level = atoi(argv[2]);
+    if (argc > 3) threads = atoi(argv[3]);
+
+    (void) rpmswInit();
+    b = xmalloc(nb);
+    ob = xmalloc(nb + 64 * 1024);
+    /* Runs of a small alphabet that changes every 4K: roughly 3:1. */
+    for (i = 0; i < nb; i++) {
+	x = x * 1103515245 + 12345;
+	b[i] = "abcdefghij"[(x >> 16) % ((i >> 12) % 10 + 1)];
+    }
+
+    (void) snprintf(wmode, sizeof(wmode), "w%d.xzdio", level);
+    (void) snprintf(wmodeT, sizeof(wmodeT), "w%dT%d.xzdio", level, threads);
+    (void) snprintf(rmodeT, sizeof(rmodeT), "rT%d.xzdio", threads);
+
+    fprintf(stdout, "%u MB, level %d\n", (unsigned)(nb >> 20), level);
+    if (run(b, ob, wmode, "r.xzdio")) ec = EXIT_FAILURE;
+    if (run(b, ob, wmodeT, "r.xzdio")) ec = EXIT_FAILURE;
+    if (run(b, ob, wmodeT, rmodeT)) ec = EXIT_FAILURE;
+    if (run(b, ob, wmode, rmodeT)) ec = EXIT_FAILURE;
+
+    (void) Unlink(fn);
+    ob = _free(ob);
+    b = _free(b);
+    return ec;
+}
@@ -13,7 +13,14 @@
    is looked up via getpw() and getgr() functions.  If this performs
    too poorly I'll have to implement it properly :-( */
 
-int unameToUid(const char * thisUname, uid_t * uid)
+/* The name->id caches are shared by concurrent payload unpacks. */
+#if defined(WITH_PTHREADS)
+/*@unchecked@*/
+static pthread_mutex_t _ugid_mutex = PTHREAD_MUTEX_INITIALIZER;
+#endif
+
+static int _unameToUid(const char * thisUname, uid_t * uid)
+	/*@modifies *uid @*/
 {
 /*@only@*/ static char * lastUname = NULL;
     static size_t lastUnameLen = 0;
@@ -68,7 +75,22 @@ lp
     return 0;
 }
 
-int gnameToGid(const char * thisGname, gid_t * gid)
+int unameToUid(const char * thisUname, uid_t * uid)
+{
+    int rc;
+
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&_ugid_mutex);
+#endif
+    rc = _unameToUid(thisUname, uid);
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&_ugid_mutex);
+#endif
+    return rc;
+}
+
+static int _gnameToGid(const char * thisGname, gid_t * gid)
+	/*@modifies *gid @*/
 {
 /*@only@*/ static char * lastGname = NULL;
     static size_t lastGnameLen = 0;
@@ -132,6 +154,20 @@ lp
     return 0;
 }
 
+int gnameToGid(const char * thisGname, gid_t * gid)
+{
+    int rc;
+
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_lock(&_ugid_mutex);
+#endif
+    rc = _gnameToGid(thisGname, gid);
+#if defined(WITH_PTHREADS)
+    (void) pthread_mutex_unlock(&_ugid_mutex);
+#endif
+    return rc;
+}
+
 char * uidToUname(uid_t uid)
 {
     static uid_t lastUid = (uid_t) -1;
@@ -54,6 +54,7 @@ typedef struct xzfile {
     FILE * fp;
     int encoding;
     int eof;
+    int ineof;			/*!< compressed input exhausted? */
 } XZFILE;
 
 /*@-globstate@*/
@@ -63,6 +64,7 @@ static XZFILE *xzopen_internal(const char *path, const char *mode, int fdno, int
 	/*@modifies fileSystem @*/
 {
     int level = LZMA_PRESET_DEFAULT;
+    int threads = rpmExpandNumeric("%{?_xz_threads}");
     int encoding = 0;
     FILE *fp;
     XZFILE *xzfile;
@@ -74,9 +76,22 @@ static XZFILE *xzopen_internal(const char *path, const char *mode, int fdno, int
 	    encoding = 1;
 	else if (*mode == 'r')
 	    encoding = 0;
-	else if (*mode >= '0' && *mode <= '9')
+	else if (*mode == 'T') {	/* e.g. "w6T4.xzdio", T0 is per CPU */
+	    threads = 0;
+	    while (mode[1] >= '0' && mode[1] <= '9')
+		threads = 10 * threads + (int)(*++mode - '0');
+	    if (threads == 0)
+		threads = -1;
+	} else if (*mode >= '0' && *mode <= '9')
 	    level = (int)(*mode - '0');
     }
+    if (threads < 0) {
+#if defined(HAVE_LZMA_CPUTHREADS)
+	threads = (int) lzma_cputhreads();
+#else
+	threads = 1;
+#endif
+    }
     if (fdno != -1)
 	fp = fdopen(fdno, encoding ? "w" : "r");
     else
@@ -94,6 +109,17 @@ static XZFILE *xzopen_internal(const char *path, const char *mode, int fdno, int
     tmp = (lzma_stream)LZMA_STREAM_INIT;
     xzfile->strm = tmp;
     if (encoding) {
+#if defined(HAVE_LZMA_STREAM_ENCODER_MT)
+	if (xz && threads > 1) {
+	    /* Independent blocks (3 * dictionary size) compressed in parallel. */
+	    lzma_mt mt;
+	    memset(&mt, 0, sizeof(mt));
+	    mt.threads = threads;
+	    mt.preset = level;
+	    mt.check = LZMA_CHECK_CRC32;
+	    ret = lzma_stream_encoder_mt(&xzfile->strm, &mt);
+	} else
+#endif
 	if (xz) {
 	    ret = lzma_easy_encoder(&xzfile->strm, level, LZMA_CHECK_CRC32);
 	} else {
@@ -102,6 +128,21 @@ static XZFILE *xzopen_internal(const char *path, const char *mode, int fdno, int
 	    ret = lzma_alone_encoder(&xzfile->strm, &options);
 	}
     } else {
+#if defined(HAVE_LZMA_STREAM_DECODER_MT)
+	if (xz && threads > 1) {
+	    /* Blocks of multi-block streams are decoded in parallel, up to
+	     * a quarter of RAM, else (or for single block streams) serially.
+	     */
+	    lzma_mt mt;
+	    memset(&mt, 0, sizeof(mt));
+	    mt.threads = threads;
+	    mt.memlimit_threading = lzma_physmem() / 4;
+	    if (mt.memlimit_threading < (100<<20))
+		mt.memlimit_threading = (100<<20);
+	    mt.memlimit_stop = mt.memlimit_threading;
+	    ret = lzma_stream_decoder_mt(&xzfile->strm, &mt);
+	} else
+#endif
 	/* We set the memlimit for decompression to 100MiB which should be
 	 * more than enough to be sufficient for level 9 which requires 65 MiB.
 	 */
@@ -197,7 +238,7 @@ static ssize_t xzread(XZFILE *xzfile, void *buf, size_t len)
 	/*@modifies xzfile, *buf, fileSystem @*/
 {
     lzma_ret ret;
-    int eof = 0;
+    size_t avail_out;
 
     if (!xzfile || xzfile->encoding)
       return -1;
@@ -208,13 +249,16 @@ static ssize_t xzread(XZFILE *xzfile, void *buf, size_t len)
 /*@=temptrans@*/
     xzfile->strm.avail_out = len;
     for (;;) {
-	if (!xzfile->strm.avail_in) {
+	if (!xzfile->strm.avail_in && !xzfile->ineof) {
 	    xzfile->strm.next_in = (uint8_t *)xzfile->buf;
 	    xzfile->strm.avail_in = fread(xzfile->buf, 1, kBufferSize, xzfile->fp);
 	    if (!xzfile->strm.avail_in)
-		eof = 1;
+		xzfile->ineof = 1;
 	}
-	ret = lzma_code(&xzfile->strm, LZMA_RUN);
+	avail_out = xzfile->strm.avail_out;
+	/* XXX threaded decoders may need several calls to drain at EOF. */
+	ret = lzma_code(&xzfile->strm,
+		(xzfile->ineof ? LZMA_FINISH : LZMA_RUN));
 	if (ret == LZMA_STREAM_END) {
 	    xzfile->eof = 1;
 	    return len - xzfile->strm.avail_out;
@@ -223,7 +267,8 @@ static ssize_t xzread(XZFILE *xzfile, void *buf, size_t len)
 	    return -1;
 	if (!xzfile->strm.avail_out)
 	    return len;
-	if (eof)
+	/* Truncated stream: no input left and no progress. */
+	if (xzfile->ineof && xzfile->strm.avail_out == avail_out)
 	    return -1;
       }
     /*@notreached@*/